@@ -0,0 +1,168 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PACKML_ROS_INGEST_MONITOR_H
+#define PACKML_ROS_INGEST_MONITOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace packml_ros
+{
+/**
+ * @brief Classification of an incoming sequence number.
+ *
+ */
+enum class SequenceResult
+{
+  IN_ORDER,   /** next expected message, or the first one of its source */
+  GAP,        /** newer than expected, the messages in between were lost */
+  DUPLICATE,  /** already seen, should be ignored */
+  RESTART     /** new session, back at 1 or far behind the last one, the producer restarted its numbering */
+};
+
+/**
+ * @brief Tracks per source sequence numbers, lost messages and ingestion lag of a fire-and-forget topic.
+ *
+ * track() and recordLag() must be called from a single thread, the accessors may be called from any thread.
+ */
+class IngestMonitor
+{
+public:
+  /**
+   * @brief Constructor for IngestMonitor
+   *
+   * @param restart_window A sequence number more than this far behind the last one is treated as a producer restart
+   */
+  explicit IngestMonitor(uint64_t restart_window = 1000);
+
+  /**
+   * @brief Changes the restart window. Must not be called concurrently with track().
+   *
+   * @param restart_window A sequence number more than this far behind the last one is treated as a producer restart
+   */
+  void setRestartWindow(uint64_t restart_window)
+  {
+    restart_window_ = restart_window;
+  }
+
+  /**
+   * @brief Classifies a message and updates the counters.
+   * @details Sequence number 0 means the producer does not number its messages, these are always IN_ORDER. A
+   * restart is recognized by a change of session, by seq falling back to 1, or by seq falling more than the restart
+   * window behind, so a producer that restarts early is not mistaken for a duplicate.
+   *
+   * @param source Producer id, sequence numbers are tracked per source
+   * @param seq Sequence number of the message
+   * @param session Producer session, e.g. its start time, 0 if the producer does not report one
+   * @return Classification of the message
+   */
+  SequenceResult track(const std::string& source, uint64_t seq, uint64_t session = 0);
+
+  /**
+   * @brief Records the time between producing and ingesting a message.
+   *
+   * @param lag Ingestion lag in seconds
+   */
+  void recordLag(double lag);
+
+  /**
+   * @brief Records items of an accepted message that could not be applied.
+   *
+   * @param count Number of rejected items
+   */
+  void recordRejected(uint64_t count);
+
+  /**
+   * @brief Accessor for the number of messages passed on for processing.
+   *
+   * @return Message or item count
+   */
+  uint64_t getAcceptedCount() const
+  {
+    return accepted_count_;
+  }
+
+  /**
+   * @brief Accessor for the number of messages ignored as duplicates.
+   *
+   * @return Message or item count
+   */
+  uint64_t getDuplicateCount() const
+  {
+    return duplicate_count_;
+  }
+
+  /**
+   * @brief Accessor for the number of messages lost in sequence gaps.
+   *
+   * @return Message or item count
+   */
+  uint64_t getDroppedCount() const
+  {
+    return dropped_count_;
+  }
+
+  /**
+   * @brief Accessor for the number of items of accepted messages that could not be applied.
+   *
+   * @return Message or item count
+   */
+  uint64_t getRejectedCount() const
+  {
+    return rejected_count_;
+  }
+
+  /**
+   * @brief Accessor for the largest recorded lag.
+   *
+   * @return Lag in seconds
+   */
+  double getMaxLag() const
+  {
+    return max_lag_;
+  }
+
+  /**
+   * @brief Accessor for the average recorded lag.
+   *
+   * @return Lag in seconds, 0 if nothing was recorded
+   */
+  double getMeanLag() const;
+
+private:
+  uint64_t restart_window_;                              /** distance behind the last seq treated as a restart */
+  struct SourceState
+  {
+    uint64_t seq;      /** last accepted sequence number */
+    uint64_t session;  /** session of the last accepted message */
+  };
+
+  std::unordered_map<std::string, SourceState> sources_; /** per source sequence tracking */
+  std::atomic<uint64_t> accepted_count_;                 /** messages passed on */
+  std::atomic<uint64_t> duplicate_count_;                /** messages ignored as duplicates */
+  std::atomic<uint64_t> dropped_count_;                  /** messages missing from sequence gaps */
+  std::atomic<uint64_t> rejected_count_;                 /** items of accepted messages that were not applied */
+  std::atomic<uint64_t> lag_samples_;                    /** calls to recordLag */
+  std::atomic<double> total_lag_;                        /** sum of recorded lags */
+  std::atomic<double> max_lag_;                          /** largest recorded lag */
+};
+}  // namespace packml_ros
+
+#endif  // PACKML_ROS_INGEST_MONITOR_H
@@ -0,0 +1,104 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PACKML_ROS_LATENCY_BENCH_H
+#define PACKML_ROS_LATENCY_BENCH_H
+
+#include <ros/ros.h>
+#include <packml_msgs/Status.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace packml_ros
+{
+/**
+ * @brief Measures the delivery latency of Packml status messages while cycling a PackmlRos instance.
+ *
+ * The bench drives the state machine through its send_command and send_event services and records the time between
+ * the status stamp (taken on the state machine thread) and its arrival, so the node and nodelet deployments can be
+ * compared under the same load.
+ */
+class LatencyBench
+{
+public:
+  /**
+   * @brief Constructor for LatencyBench
+   *
+   * @param nh Node handle used for the status topic and the services
+   * @param pn Private node handle used for the parameters
+   */
+  LatencyBench(ros::NodeHandle nh, ros::NodeHandle pn);
+
+  /**
+   * @brief Destructor for LatencyBench. Stops the driver thread.
+   */
+  ~LatencyBench();
+
+  /**
+   * @brief Starts driving the state machine from a background thread
+   */
+  void start();
+
+  /**
+   * @brief Accessor for the completion of the benchmark.
+   *
+   * @return True once the requested number of samples was collected and reported
+   */
+  bool isDone() const
+  {
+    return done_;
+  }
+
+private:
+  ros::Subscriber status_sub_;            /** Packml status */
+  ros::Time subscribed_;                  /** statuses stamped before this are not measured */
+  ros::ServiceClient command_client_;     /** send_command of the PackmlRos under test */
+  ros::ServiceClient event_client_;       /** send_event of the PackmlRos under test */
+  size_t samples_;                        /** number of latencies to collect */
+  std::vector<double> latencies_;         /** collected latencies in seconds */
+  int last_state_;                        /** most recently received state */
+  bool state_changed_ = false;            /** a status arrived since the driver last looked */
+  std::atomic<bool> running_;             /** driver thread should keep going */
+  std::atomic<bool> done_;                /** results have been reported */
+  std::mutex mutex_;                      /** protects latencies_, last_state_ and state_changed_ */
+  std::condition_variable cv_;            /** wakes the driver thread on new status */
+  std::thread driver_;                    /** sends the commands and events */
+
+  /**
+   * @brief Records the latency of a status message
+   *
+   * @param msg Status message
+   */
+  void statusCb(const packml_msgs::StatusConstPtr& msg);
+
+  /**
+   * @brief Body of the driver thread, moves the state machine on after every status
+   */
+  void drive();
+
+  /**
+   * @brief Logs the latency distribution
+   */
+  void report();
+};
+}  // namespace packml_ros
+
+#endif  // PACKML_ROS_LATENCY_BENCH_H
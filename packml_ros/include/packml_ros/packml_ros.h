@@ -18,6 +18,7 @@
 #ifndef PACKML_ROS_H
 #define PACKML_ROS_H
 
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 
 #include <packml_msgs/GetStats.h>
@@ -29,9 +30,23 @@
 #include <packml_msgs/SendEvent.h>
 #include <packml_msgs/Status.h>
 #include <packml_msgs/Stats.h>
+#include <packml_ros/IncrementStats.h>
+#include <packml_ros/PackmlRosConfig.h>
+#include <packml_ros/SendCommands.h>
+#include <packml_ros/StatIncrementArray.h>
+#include <packml_ros/ingest_monitor.h>
+#include <packml_ros/StatsDelta.h>
+#include <packml_ros/stats_delta.h>
+#include <packml_ros/stats_publisher.h>
 #include <packml_sm/abstract_state_machine.h>
 #include <packml_sm/boost/packml_state_machine_continuous.h>
 #include <packml_sm/common.h>
+#include <packml_sm/shm_stats.h>
+
+#include <dynamic_reconfigure/server.h>
+
+#include <atomic>
+#include <mutex>
 
 namespace packml_ros
 {
@@ -54,22 +69,74 @@ public:
   ~PackmlRos();
 
   /**
-   * @brief Overloads ros::spin()
+   * @brief Starts the spinner threads serving the command, increment and stats queues. Does not block.
+   */
+  void start();
+
+  /**
+   * @brief Stops the spinner threads. Callbacks already running are finished first.
+   */
+  void stop();
+
+  /**
+   * @brief Overloads ros::spin(). Starts the spinner threads and serves the global queue until shutdown.
    */
   void spin();
 
   /**
-   * @brief Overloads ros::spinOnce()
+   * @brief Overloads ros::spinOnce(). Serves all queues from the calling thread if the spinners are not running.
    */
   void spinOnce();
 
+  /**
+   * @brief Converts stats snapshot to stats message
+   *
+   * @param stats_snapshot data structure with stats data
+   * @return stats message
+   */
+  static packml_msgs::Stats populateStatsMsg(const packml_sm::PackmlStatsSnapshot& stats_snapshot);
+
+  /**
+   * @brief Converts stats message to stats snapshot
+   *
+   * @param msg stats message
+   * @return stats snapshot
+   */
+  static packml_sm::PackmlStatsSnapshot populateStatsSnapshot(const packml_msgs::Stats& msg);
+
+  /**
+   * @brief Converts a stats delta frame to a stats delta message
+   *
+   * @param frame Encoded frame
+   * @return stats delta message
+   */
+  static StatsDelta populateStatsDeltaMsg(const StatsDeltaFrame& frame);
+
+  /**
+   * @brief Converts a stats delta message to a stats delta frame, e.g. to feed a StatsDeltaReassembler
+   *
+   * @param msg stats delta message
+   * @return stats delta frame
+   */
+  static StatsDeltaFrame populateStatsDeltaFrame(const StatsDelta& msg);
+
 protected:
   ros::NodeHandle nh_;                                  /** Node handle */
   ros::NodeHandle pn_;                                  /** Private node handle */
   std::shared_ptr<packml_sm::PackmlStateMachineContinuous> sm_; /** Packml state machine */
+  ros::CallbackQueue command_queue_;                    /** Commands and events, never wait behind stats requests */
+  ros::CallbackQueue sequence_queue_;                   /** Command lists, which may wait for their steps */
+  ros::CallbackQueue increment_queue_;                  /** Stat increments */
+  ros::CallbackQueue stats_queue_;                      /** Stats services, timers and parameter updates */
+  std::unique_ptr<ros::AsyncSpinner> command_spinner_;  /** Serves command_queue_ */
+  std::unique_ptr<ros::AsyncSpinner> sequence_spinner_; /** Serves sequence_queue_ */
+  std::unique_ptr<ros::AsyncSpinner> increment_spinner_; /** Serves increment_queue_ */
+  std::unique_ptr<ros::AsyncSpinner> stats_spinner_;    /** Serves stats_queue_ */
+  ros::NodeHandle stats_nh_;                            /** Node handle whose callbacks go to stats_queue_ */
   ros::Publisher status_pub_;                           /** Publisher for Packml status */
   ros::Publisher stats_pub_;                            /** Publisher for Packml stats */
   ros::Publisher incremental_stats_pub_;                /** Publisher for incremental Packml stats */
+  ros::Publisher stats_delta_pub_;                      /** Publisher for delta encoded Packml stats */
   ros::ServiceServer command_server_;                   /** Advertises service to send commands to Packml state machine */
   ros::ServiceServer reset_stats_server_;               /** Advertises service for resetting stats */
   ros::ServiceServer get_stats_server_;                 /** Advertises service for getting stats */
@@ -77,12 +144,23 @@ protected:
   ros::ServiceServer events_server_;                    /** Advertises service to send events to Packml state machine */
   ros::ServiceServer invoke_state_change_server_;       /** Advertises service to invoke a state change */
   ros::ServiceServer inc_stat_server_;                  /** Advertises service to increment a stat*/
+  ros::ServiceServer inc_stats_server_;                 /** Advertises service to increment a batch of stats */
+  ros::ServiceServer commands_server_;                  /** Advertises service to send a list of commands and events */
+  double max_commands_timeout_;                         /** Longest a command list waits for its steps */
+  ros::Subscriber stat_increments_sub_;                 /** Fire-and-forget stat increments */
+  IngestMonitor increment_monitor_;                     /** Duplicates, drops and lag of stat_increments */
   packml_msgs::Status status_msg_;                      /** Message containing Packml status */
-  double stats_publish_rate_;                           /** Rate at which rolling Packml stats are calculated and published */
-  double incremental_stats_publish_rate_;               /** Rate at which incremental Packml stats are calculated and published */
-  double ideal_cycle_time_;                             /** Ideal time for a cycle used to calculate performance and OEE*/
-  ros::Timer stats_timer_;                              /** Timer used to publish Packml stats */
+  std::mutex status_mutex_;                             /** Protects status_msg_ */
+  std::atomic<double> stats_publish_rate_;              /** Cached period of the rolling Packml stats */
+  std::atomic<double> incremental_stats_publish_rate_;  /** Cached period of the incremental Packml stats */
+  std::atomic<double> ideal_cycle_time_;                /** Cached ideal cycle time used for performance and OEE */
   ros::Timer incremental_stats_timer_;                  /** Timer used to publish incremental Packml stats */
+  std::unique_ptr<StatsPublisher> stats_publisher_;     /** Publishes rolling Packml stats in the background */
+  StatsPublisherOptions stats_publisher_options_;       /** Tuning last handed to the stats publisher */
+  bool stats_delta_mode_;                               /** Publish delta encoded stats instead of full stats */
+  StatsDeltaEncoder stats_delta_encoder_;               /** Tracks the itemized stats last sent on stats_delta */
+  std::unique_ptr<packml_sm::ShmStatsExporter> shm_exporter_;  /** Optional shared memory copy of state and stats */
+  std::unique_ptr<dynamic_reconfigure::Server<PackmlRosConfig>> reconfigure_server_;  /** Parameter updates */
 
   /**
    * @brief Processes external packml commands
@@ -115,6 +193,30 @@ protected:
    */
   bool incStatRequest(packml_msgs::IncrementStat::Request& req, packml_msgs::IncrementStat::Response& res);
 
+  /**
+   * @brief Processes request to increment a batch of statistics under a single lock
+   *
+   * @return True, per increment results are in the response
+   */
+  bool incStatsRequest(IncrementStats::Request& req, IncrementStats::Response& res);
+
+  /**
+   * @brief Applies increments received on the stat_increments topic
+   *
+   * @param msg Batch of increments
+   */
+  void statIncrementsCb(const StatIncrementArray::ConstPtr& msg);
+
+  /**
+   * @brief Processes an ordered list of commands and events
+   * @details All steps are queued at once, the response reports each step's outcome as far as it is known
+   * within the requested timeout, capped at the max_commands_timeout param. Served from its own spinner thread, so
+   * a waiting request holds up later command lists but not send_command or send_event
+   *
+   * @return True, a malformed request is reported through success and message
+   */
+  bool commandsRequest(SendCommands::Request& req, SendCommands::Response& res);
+
 private:
   /**
    * @brief Event callback triggered on state change
@@ -140,14 +242,6 @@ private:
    */
   void getIncrementalStats(packml_msgs::Stats &out_stats);
 
-  /**
-   * @brief Converts stats snapshot to stats message
-   *
-   * @param stats_snapshot data structure with stats data
-   * @return stats message
-   */
-  packml_msgs::Stats populateStatsMsg(const packml_sm::PackmlStatsSnapshot& stats_snapshot);
-
   /**
    * @brief Service callback for getting stats
    *
@@ -176,31 +270,40 @@ private:
   bool loadStats(packml_msgs::LoadStats::Request& req, packml_msgs::LoadStats::Response& response);
 
   /**
-   * @brief Converts stats message to stats snapshot
+   * @brief Timer callback for publishing incremental Packml stats
    *
-   * @param msg stats message
-   * @return stats snapshot
+   * @param timer_event ROS TimerEvent; not used
    */
-  packml_sm::PackmlStatsSnapshot populateStatsSnapshot(const packml_msgs::Stats& msg);
+  void publishIncrementalStatsCb(const ros::TimerEvent &timer_event);
 
   /**
-   * @brief Timer callback for publishing Packml stats
+   * @brief Dynamic reconfigure callback, applies parameter changes to the running node
    *
-   * @param timer_event ROS TimerEvent; not used
+   * @param config New parameter values
+   * @param level Bitwise OR of the levels of the changed parameters, see cfg/PackmlRos.cfg
    */
-  void publishStatsCb(const ros::TimerEvent& timer_event);
+  void reconfigureCb(PackmlRosConfig& config, uint32_t level);
 
   /**
-   * @brief Timer callback for publishing incremental Packml stats
+   * @brief Reads the stats publisher tuning from the parameter server
    *
-   * @param timer_event ROS TimerEvent; not used
+   * @return Publisher tuning
    */
-  void publishIncrementalStatsCb(const ros::TimerEvent &timer_event);
+  StatsPublisherOptions loadStatsPublisherOptions();
+
+  /**
+   * @brief Sends a keyframe when a subscriber connects to the stats delta topic
+   *
+   * @param pub Publisher of the new subscriber; not used
+   */
+  void statsDeltaConnectCb(const ros::SingleSubscriberPublisher& pub);
 
   /**
-   * @brief Publishes Packml stats
+   * @brief Publishes Packml stats, called from the stats publisher thread
+   *
+   * @param stats_snapshot Stats to publish
    */
-  void publishStats();
+  void publishStats(const packml_sm::PackmlStatsSnapshot& stats_snapshot);
 
   /**
    * @brief Evaluates validity and effect of command request
@@ -0,0 +1,155 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PACKML_ROS_STATS_DELTA_H
+#define PACKML_ROS_STATS_DELTA_H
+
+#include <packml_sm/packml_stats_itemized.h>
+#include <packml_sm/packml_stats_snapshot.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+
+namespace packml_ros
+{
+/**
+ * @brief A stats snapshot whose itemized maps only hold the items that changed since the previous frame.
+ *
+ * Scalar stats are always complete. A keyframe carries every item and replaces whatever the consumer held before.
+ */
+struct StatsDeltaFrame
+{
+  uint64_t seq = 0;                        /** increments by one per frame, starting at 1 */
+  bool keyframe = false;                   /** frame carries the complete itemized maps */
+  packml_sm::PackmlStatsSnapshot stats;    /** scalars plus changed (or, for keyframes, all) items */
+};
+
+/**
+ * @brief Publisher side of the delta encoding.
+ *
+ */
+class StatsDeltaEncoder
+{
+public:
+  /**
+   * @brief Constructor for StatsDeltaEncoder
+   *
+   * @param keyframe_interval A keyframe is sent every keyframe_interval frames. Zero sends only keyframes.
+   */
+  explicit StatsDeltaEncoder(uint32_t keyframe_interval = 60);
+
+  /**
+   * @brief Encodes the next frame. Not thread safe, call from a single publishing thread.
+   *
+   * @param snapshot Current complete stats
+   * @return StatsDeltaFrame The frame to publish
+   */
+  StatsDeltaFrame encode(const packml_sm::PackmlStatsSnapshot& snapshot);
+
+  /**
+   * @brief Makes the next frame a keyframe, e.g. when a new subscriber connects. Thread safe.
+   */
+  void requestKeyframe();
+
+  /**
+   * @brief Sets how often keyframes are sent. Thread safe.
+   *
+   * @param keyframe_interval A keyframe is sent every keyframe_interval frames. Zero sends only keyframes.
+   */
+  void setKeyframeInterval(uint32_t keyframe_interval);
+
+private:
+  std::atomic<uint32_t> keyframe_interval_;                            /** frames between keyframes */
+  std::atomic<bool> keyframe_requested_;                               /** next frame must be a keyframe */
+  uint32_t frames_since_keyframe_ = 0;                                 /** deltas sent since the last keyframe */
+  uint64_t next_seq_ = 1;                                              /** sequence number of the next frame */
+  std::map<int16_t, packml_sm::PackmlStatsItemized> last_error_map_;   /** error items as last sent */
+  std::map<int16_t, packml_sm::PackmlStatsItemized> last_quality_map_; /** quality items as last sent */
+};
+
+/**
+ * @brief Subscriber side of the delta encoding, rebuilds the complete stats from a stream of frames.
+ *
+ */
+class StatsDeltaReassembler
+{
+public:
+  /**
+   * @brief Applies a frame.
+   * @details A delta that does not directly follow the previous frame is dropped, and the reassembler stays out of
+   * sync until the next keyframe arrives.
+   *
+   * @param frame Received frame
+   * @return True if the reassembled stats are complete and current after this frame
+   */
+  bool apply(const StatsDeltaFrame& frame);
+
+  /**
+   * @brief Accessor for the synchronization state.
+   *
+   * @return True if a keyframe and every delta since have been applied
+   */
+  bool isSynchronized() const
+  {
+    return synchronized_;
+  }
+
+  /**
+   * @brief Accessor for the reassembled stats. Only meaningful while synchronized.
+   *
+   * @return The complete stats as of the last applied frame
+   */
+  const packml_sm::PackmlStatsSnapshot& getSnapshot() const
+  {
+    return snapshot_;
+  }
+
+  /**
+   * @brief Accessor for the sequence number of the last applied frame.
+   *
+   * @return Sequence number, 0 if no frame has been applied
+   */
+  uint64_t getLastSequence() const
+  {
+    return last_seq_;
+  }
+
+  /**
+   * @brief Accessor for the number of detected sequence gaps.
+   *
+   * @return Number of gaps
+   */
+  uint64_t getGapCount() const
+  {
+    return gap_count_;
+  }
+
+  /**
+   * @brief Drops the reassembled stats and waits for the next keyframe.
+   */
+  void reset();
+
+private:
+  packml_sm::PackmlStatsSnapshot snapshot_ = packml_sm::PackmlStatsSnapshot(); /** reassembled stats */
+  bool synchronized_ = false;                                                 /** snapshot_ is complete */
+  uint64_t last_seq_ = 0;                                                     /** last applied frame */
+  uint64_t gap_count_ = 0;                                                    /** detected sequence gaps */
+};
+}  // namespace packml_ros
+
+#endif  // PACKML_ROS_STATS_DELTA_H
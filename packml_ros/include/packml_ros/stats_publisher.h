@@ -0,0 +1,167 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PACKML_ROS_STATS_PUBLISHER_H
+#define PACKML_ROS_STATS_PUBLISHER_H
+
+#include <packml_sm/common.h>
+#include <packml_sm/packml_stats_snapshot.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace packml_ros
+{
+/**
+ * @brief Tuning for StatsPublisher.
+ *
+ */
+struct StatsPublisherOptions
+{
+  /** Minimum time between two publications triggered by state changes. */
+  std::chrono::milliseconds min_interval = std::chrono::milliseconds(100);
+
+  /** Time after which the stats are published regardless of changes. Zero or less disables the heartbeat. */
+  std::chrono::milliseconds max_interval = std::chrono::milliseconds(1000);
+
+  /** Smallest change in OEE that is worth publishing. */
+  double oee_deadband = 0.0;
+
+  /** Smallest change in throughput that is worth publishing. */
+  double throughput_deadband = 0.0;
+
+  /** States that bypass the minimum interval and the deadbands. */
+  std::set<packml_sm::StatesEnum> immediate_states;
+};
+
+/**
+ * @brief Publishes Packml stats from a dedicated thread.
+ *
+ * State changes only mark the mailbox as dirty, so the state machine thread never pays for the snapshot or the
+ * serialization. Any number of state changes between two publications collapse into a single one, which keeps the
+ * publication cost bounded by the minimum interval instead of the transition rate.
+ */
+class StatsPublisher
+{
+public:
+  typedef std::function<void(packml_sm::PackmlStatsSnapshot&)> SampleFunction;
+  typedef std::function<void(const packml_sm::PackmlStatsSnapshot&)> PublishFunction;
+
+  /**
+   * @brief Constructor for StatsPublisher
+   *
+   * @param sample Fills in the current stats snapshot, called from the publisher thread
+   * @param publish Publishes a snapshot, called from the publisher thread
+   * @param options Publication tuning
+   */
+  StatsPublisher(SampleFunction sample, PublishFunction publish,
+                 const StatsPublisherOptions& options = StatsPublisherOptions());
+
+  /**
+   * @brief Destructor for StatsPublisher. Stops the publisher thread.
+   */
+  ~StatsPublisher();
+
+  /**
+   * @brief Starts the publisher thread
+   */
+  void start();
+
+  /**
+   * @brief Stops the publisher thread. Pending publications are dropped.
+   */
+  void stop();
+
+  /**
+   * @brief Records a state change. Cheap enough to call from the state machine thread.
+   *
+   * @param state The new state
+   */
+  void notifyStateChanged(packml_sm::StatesEnum state);
+
+  /**
+   * @brief Requests a publication that bypasses the minimum interval and the deadbands, e.g. after a stats reset.
+   */
+  void requestPublish();
+
+  /**
+   * @brief Replaces the publication tuning. Takes effect on the next wake up of the publisher thread.
+   *
+   * @param options Publication tuning
+   */
+  void setOptions(const StatsPublisherOptions& options);
+
+  /**
+   * @brief Accessor for the number of published snapshots.
+   *
+   * @return uint64_t Number of published snapshots
+   */
+  uint64_t getPublishCount() const
+  {
+    return publish_count_;
+  }
+
+  /**
+   * @brief Accessor for the number of state changes that did not get a publication of their own.
+   *
+   * @return uint64_t Number of coalesced or suppressed state changes
+   */
+  uint64_t getCoalescedCount() const
+  {
+    return coalesced_count_;
+  }
+
+private:
+  SampleFunction sample_;                               /** reads the current snapshot */
+  PublishFunction publish_;                             /** sends a snapshot out */
+  StatsPublisherOptions options_;                       /** publication tuning */
+  bool dirty_ = false;                                  /** a state change is waiting to be published */
+  bool immediate_ = false;                              /** the next publication skips interval and deadbands */
+  bool running_ = false;                                /** publisher thread should keep going */
+  bool has_published_ = false;                          /** last_published_ holds a valid snapshot */
+  packml_sm::PackmlStatsSnapshot last_published_;       /** reference point for the deadbands */
+  std::chrono::steady_clock::time_point last_publish_;  /** time of the last publication, drives the heartbeat */
+  std::chrono::steady_clock::time_point last_sample_;   /** time of the last snapshot, drives the minimum interval */
+  std::atomic<uint64_t> publish_count_;                 /** published snapshots */
+  std::atomic<uint64_t> coalesced_count_;               /** state changes without a publication of their own */
+  std::mutex mutex_;                                    /** protects the mailbox and the options */
+  std::condition_variable cv_;                          /** wakes the publisher thread */
+  std::thread thread_;                                  /** the publisher thread */
+
+  /**
+   * @brief Body of the publisher thread.
+   */
+  void run();
+
+  /**
+   * @brief Checks the snapshot against the last published one.
+   *
+   * @param snapshot Freshly sampled stats
+   * @param options Publication tuning
+   * @return True if the snapshot differs enough to be worth publishing
+   */
+  bool exceedsDeadband(const packml_sm::PackmlStatsSnapshot& snapshot, const StatsPublisherOptions& options) const;
+};
+}  // namespace packml_ros
+
+#endif  // PACKML_ROS_STATS_PUBLISHER_H
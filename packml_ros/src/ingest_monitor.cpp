@@ -0,0 +1,97 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_ros/ingest_monitor.h"
+
+namespace packml_ros
+{
+IngestMonitor::IngestMonitor(uint64_t restart_window)
+  : restart_window_(restart_window)
+  , accepted_count_(0)
+  , duplicate_count_(0)
+  , dropped_count_(0)
+  , rejected_count_(0)
+  , lag_samples_(0)
+  , total_lag_(0.0)
+  , max_lag_(0.0)
+{
+}
+
+SequenceResult IngestMonitor::track(const std::string& source, uint64_t seq, uint64_t session)
+{
+  if (seq == 0)
+  {
+    accepted_count_++;
+    return SequenceResult::IN_ORDER;
+  }
+
+  auto state_it = sources_.find(source);
+  if (state_it == sources_.end())
+  {
+    sources_[source] = SourceState{ seq, session };
+    accepted_count_++;
+    return SequenceResult::IN_ORDER;
+  }
+
+  SourceState& state = state_it->second;
+  uint64_t last = state.seq;
+  if (session != state.session || (seq == 1 && last > 1) || (seq <= last && last - seq > restart_window_))
+  {
+    state = SourceState{ seq, session };
+    accepted_count_++;
+    return SequenceResult::RESTART;
+  }
+
+  if (seq <= last)
+  {
+    duplicate_count_++;
+    return SequenceResult::DUPLICATE;
+  }
+
+  state.seq = seq;
+  accepted_count_++;
+  if (seq == last + 1)
+  {
+    return SequenceResult::IN_ORDER;
+  }
+
+  dropped_count_ += seq - last - 1;
+  return SequenceResult::GAP;
+}
+
+void IngestMonitor::recordLag(double lag)
+{
+  // Single writer, so plain load/store is enough to keep the atomics consistent for readers.
+  lag_samples_++;
+  total_lag_ = total_lag_ + lag;
+  if (lag > max_lag_)
+  {
+    max_lag_ = lag;
+  }
+}
+
+void IngestMonitor::recordRejected(uint64_t count)
+{
+  rejected_count_ += count;
+}
+
+double IngestMonitor::getMeanLag() const
+{
+  uint64_t samples = lag_samples_;
+  return samples > 0 ? total_lag_ / samples : 0.0;
+}
+}  // namespace packml_ros
@@ -0,0 +1,164 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_ros/latency_bench.h"
+
+#include <packml_msgs/SendCommand.h>
+#include <packml_msgs/SendEvent.h>
+#include <packml_sm/common.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace packml_ros
+{
+LatencyBench::LatencyBench(ros::NodeHandle nh, ros::NodeHandle pn)
+  : last_state_(static_cast<int>(packml_sm::StatesEnum::UNDEFINED)), running_(false), done_(false)
+{
+  int samples;
+  pn.param<int>("samples", samples, 1000);
+  samples_ = static_cast<size_t>(std::max(samples, 1));
+  latencies_.reserve(samples_);
+
+  command_client_ = nh.serviceClient<packml_msgs::SendCommand>("send_command");
+  event_client_ = nh.serviceClient<packml_msgs::SendEvent>("send_event");
+  subscribed_ = ros::Time::now();
+  status_sub_ = nh.subscribe("status", 100, &LatencyBench::statusCb, this, ros::TransportHints().tcpNoDelay());
+}
+
+LatencyBench::~LatencyBench()
+{
+  running_ = false;
+  cv_.notify_all();
+  if (driver_.joinable())
+  {
+    driver_.join();
+  }
+}
+
+void LatencyBench::start()
+{
+  running_ = true;
+  driver_ = std::thread(&LatencyBench::drive, this);
+}
+
+void LatencyBench::statusCb(const packml_msgs::StatusConstPtr& msg)
+{
+  double latency = (ros::Time::now() - msg->header.stamp).toSec();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // status is latched, the first message may be a state change from long before the bench started.
+  if (latencies_.size() < samples_ && msg->header.stamp > subscribed_)
+  {
+    latencies_.push_back(latency);
+  }
+  last_state_ = msg->sub_state != packml_msgs::State::UNDEFINED ? msg->sub_state : msg->state.val;
+  state_changed_ = true;
+  cv_.notify_all();
+}
+
+void LatencyBench::drive()
+{
+  if (!command_client_.waitForExistence(ros::Duration(10.0)) || !event_client_.waitForExistence(ros::Duration(10.0)))
+  {
+    ROS_ERROR_STREAM("Latency bench could not find the send_command and send_event services");
+    done_ = true;
+    return;
+  }
+
+  while (running_ && ros::ok())
+  {
+    int state;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // A missed or latched status is recovered by re-sending the action for the last known state.
+      cv_.wait_for(lock, std::chrono::seconds(1), [this]() { return state_changed_ || !running_; });
+      if (latencies_.size() >= samples_)
+      {
+        break;
+      }
+      state = last_state_;
+      state_changed_ = false;
+    }
+
+    switch (static_cast<packml_sm::StatesEnum>(state))
+    {
+      case packml_sm::StatesEnum::ABORTED:
+      {
+        packml_msgs::SendCommand srv;
+        srv.request.command = static_cast<int>(packml_sm::CmdEnum::CLEAR);
+        command_client_.call(srv);
+        break;
+      }
+      case packml_sm::StatesEnum::STOPPED:
+      case packml_sm::StatesEnum::COMPLETE:
+      {
+        packml_msgs::SendCommand srv;
+        srv.request.command = static_cast<int>(packml_sm::CmdEnum::RESET);
+        command_client_.call(srv);
+        break;
+      }
+      case packml_sm::StatesEnum::IDLE:
+      {
+        packml_msgs::SendCommand srv;
+        srv.request.command = static_cast<int>(packml_sm::CmdEnum::START);
+        command_client_.call(srv);
+        break;
+      }
+      case packml_sm::StatesEnum::UNDEFINED:
+        break;
+      default:
+      {
+        // Acting states, and execute, move on when their state method reports completion.
+        packml_msgs::SendEvent srv;
+        srv.request.event_id = static_cast<int>(packml_sm::EventsEnum::STATE_COMPLETE);
+        event_client_.call(srv);
+        break;
+      }
+    }
+  }
+
+  if (running_ && ros::ok())
+  {
+    report();
+    done_ = true;
+  }
+}
+
+void LatencyBench::report()
+{
+  std::vector<double> sorted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sorted = latencies_;
+  }
+  if (sorted.empty())
+  {
+    return;
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  auto percentile = [&sorted](double p) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+  };
+  double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+
+  ROS_INFO_STREAM("Status latency over " << sorted.size() << " samples [us]: min " << sorted.front() * 1e6
+                                         << ", mean " << mean * 1e6 << ", p50 " << percentile(0.5) * 1e6 << ", p99 "
+                                         << percentile(0.99) * 1e6 << ", max " << sorted.back() * 1e6);
+}
+}  // namespace packml_ros
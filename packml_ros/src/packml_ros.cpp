@@ -21,6 +21,9 @@
 
 #include "packml_ros/packml_ros.h"
 
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <condition_variable>
 #include <packml_sm/boost/packml_events.h>
 #include <packml_sm/common.h>
 #include "packml_sm/packml_stats_snapshot.h"
@@ -28,87 +31,215 @@
 
 namespace packml_ros
 {
+namespace
+{
+std::chrono::milliseconds toMilliseconds(double seconds)
+{
+  return std::chrono::milliseconds(static_cast<int64_t>(std::max(seconds, 0.0) * 1000.0));
+}
+
+std::vector<packml_sm::StatIncrement> toStatIncrements(const std::vector<StatIncrement>& msgs)
+{
+  std::vector<packml_sm::StatIncrement> increments;
+  increments.reserve(msgs.size());
+  for (const auto& increment : msgs)
+  {
+    increments.push_back(packml_sm::StatIncrement{ increment.metric, static_cast<float>(increment.step),
+                                                   static_cast<float>(increment.duration) });
+  }
+  return increments;
+}
+}  // namespace
 
 PackmlRos::PackmlRos(ros::NodeHandle nh, ros::NodeHandle pn, std::shared_ptr<packml_sm::PackmlStateMachineContinuous> sm)
   : nh_(nh), pn_(pn), sm_(sm)
 {
-  ros::NodeHandle packml_node("~/packml");
+  // Derived from pn rather than "~" so that a nodelet resolves to its own name instead of the manager's.
+  ros::NodeHandle packml_node(pn_, "packml");
+  ros::NodeHandle command_node(pn_, "packml");
+  ros::NodeHandle sequence_node(pn_, "packml");
+  ros::NodeHandle increment_node(pn_, "packml");
+  ros::NodeHandle stats_node(pn_, "packml");
+  command_node.setCallbackQueue(&command_queue_);
+  sequence_node.setCallbackQueue(&sequence_queue_);
+  increment_node.setCallbackQueue(&increment_queue_);
+  stats_node.setCallbackQueue(&stats_queue_);
+  stats_nh_ = nh_;
+  stats_nh_.setCallbackQueue(&stats_queue_);
 
   status_pub_ = packml_node.advertise<packml_msgs::Status>("status", 10, true);
   stats_pub_ = packml_node.advertise<packml_msgs::Stats>("stats", 10, true);
   incremental_stats_pub_ = packml_node.advertise<packml_msgs::Stats>("incremental_stats", 10, true);
 
-  command_server_ = packml_node.advertiseService("send_command", &PackmlRos::commandRequest, this);
-  reset_stats_server_ = packml_node.advertiseService("reset_stats", &PackmlRos::resetStats, this);
-  get_stats_server_ = packml_node.advertiseService("get_stats", &PackmlRos::getStats, this);
-  load_stats_server_ = packml_node.advertiseService("load_stats", &PackmlRos::loadStats, this);
-  events_server_ = packml_node.advertiseService("send_event", &PackmlRos::eventRequest, this);
-  invoke_state_change_server_ = packml_node.advertiseService("invoke_state_change", &PackmlRos::triggerStateChange, this);
-  inc_stat_server_ = packml_node.advertiseService("inc_stat", &PackmlRos::incStatRequest, this);
+  pn_.param<bool>("stats_delta_mode", stats_delta_mode_, false);
+  if (stats_delta_mode_)
+  {
+    // Not latched, a late subscriber would only get a delta. Connecting triggers a keyframe instead.
+    stats_delta_pub_ = packml_node.advertise<StatsDelta>(
+        "stats_delta", 10, boost::bind(&PackmlRos::statsDeltaConnectCb, this, _1), ros::SubscriberStatusCallback());
+  }
+
+  command_server_ = command_node.advertiseService("send_command", &PackmlRos::commandRequest, this);
+  reset_stats_server_ = stats_node.advertiseService("reset_stats", &PackmlRos::resetStats, this);
+  get_stats_server_ = stats_node.advertiseService("get_stats", &PackmlRos::getStats, this);
+  load_stats_server_ = stats_node.advertiseService("load_stats", &PackmlRos::loadStats, this);
+  events_server_ = command_node.advertiseService("send_event", &PackmlRos::eventRequest, this);
+  invoke_state_change_server_ = command_node.advertiseService("invoke_state_change", &PackmlRos::triggerStateChange,
+                                                              this);
+  inc_stat_server_ = increment_node.advertiseService("inc_stat", &PackmlRos::incStatRequest, this);
+  inc_stats_server_ = increment_node.advertiseService("inc_stats", &PackmlRos::incStatsRequest, this);
+  // send_commands may wait for its steps, so it is served apart from the single commands and events.
+  commands_server_ = sequence_node.advertiseService("send_commands", &PackmlRos::commandsRequest, this);
+  pn_.param<double>("max_commands_timeout", max_commands_timeout_, 10.0);
+
+  int stat_increments_queue_size;
+  pn_.param<int>("stat_increments_queue_size", stat_increments_queue_size, 1000);
+  int stat_increments_restart_window;
+  pn_.param<int>("stat_increments_restart_window", stat_increments_restart_window, 1000);
+  increment_monitor_.setRestartWindow(static_cast<uint64_t>(std::max(stat_increments_restart_window, 0)));
+  stat_increments_sub_ = increment_node.subscribe("stat_increments", static_cast<uint32_t>(stat_increments_queue_size),
+                                                  &PackmlRos::statIncrementsCb, this,
+                                                  ros::TransportHints().tcpNoDelay());
 
   status_msg_ = initStatus(pn.getNamespace());
 
-  if (!pn_.getParam("stats_publish_rate", stats_publish_rate_))
+  double stats_publish_rate;
+  if (!pn_.getParam("stats_publish_rate", stats_publish_rate))
   {
     ROS_WARN_STREAM("Missing param: stats_publish_rate. Defaulting to 1 second");
-    stats_publish_rate_ = 1;
+    stats_publish_rate = 1;
   }
-  if(stats_publish_rate_ <= 0)
+  if(stats_publish_rate <= 0)
   {
     ROS_WARN_STREAM("stats_publish_rate <= 0. stats will not be published regularly");
   }
-  else
-  {
-    stats_timer_ = nh_.createTimer(ros::Duration(stats_publish_rate_), &PackmlRos::publishStatsCb, this);
-  }
+  stats_publish_rate_ = stats_publish_rate;
 
-  if (!pn_.getParam("incremental_stats_publish_rate", incremental_stats_publish_rate_))
+  double incremental_stats_publish_rate;
+  if (!pn_.getParam("incremental_stats_publish_rate", incremental_stats_publish_rate))
   {
     ROS_WARN_STREAM("Missing param: incremental_stats_publish_rate. Defaulting to 15 minutes");
-    incremental_stats_publish_rate_ = 900;
+    incremental_stats_publish_rate = 900;
   }
-  if(incremental_stats_publish_rate_ <= 0)
+  if(incremental_stats_publish_rate <= 0)
   {
     ROS_WARN_STREAM("incremental_stats_publish_rate <= 0. Incremental stats will not be published");
   }
   else
   {
-    incremental_stats_timer_ = nh_.createTimer(ros::Duration(incremental_stats_publish_rate_),
-                                               &PackmlRos::publishIncrementalStatsCb, this);
+    incremental_stats_timer_ = stats_nh_.createTimer(ros::Duration(incremental_stats_publish_rate),
+                                                     &PackmlRos::publishIncrementalStatsCb, this);
   }
+  incremental_stats_publish_rate_ = incremental_stats_publish_rate;
 
-  if (!pn_.getParam("ideal_cycle_time", ideal_cycle_time_))
+  double ideal_cycle_time;
+  if (!pn_.getParam("ideal_cycle_time", ideal_cycle_time))
   {
     ROS_WARN_STREAM("Missing param: ideal_cycle_time. Defaulting to 0.1 second");
-    ideal_cycle_time_ = 0.1;
+    ideal_cycle_time = 0.1;
+  }
+  ideal_cycle_time_ = ideal_cycle_time;
+
+  int stats_keyframe_interval;
+  pn_.param<int>("stats_keyframe_interval", stats_keyframe_interval, 60);
+  stats_delta_encoder_.setKeyframeInterval(static_cast<uint32_t>(std::max(stats_keyframe_interval, 0)));
+
+  std::string shm_export;
+  pn_.param<std::string>("shm_export", shm_export, "");
+  if (!shm_export.empty())
+  {
+    shm_exporter_.reset(new packml_sm::ShmStatsExporter());
+    if (!shm_exporter_->open(shm_export))
+    {
+      ROS_ERROR_STREAM("Failed to open shared memory segment " << shm_export << ", state and stats are not exported");
+      shm_exporter_.reset();
+    }
   }
 
+  stats_publisher_options_ = loadStatsPublisherOptions();
+  stats_publisher_.reset(new StatsPublisher(
+      [this](packml_sm::PackmlStatsSnapshot& snapshot) { sm_->getCurrentStatSnapshot(snapshot); },
+      [this](const packml_sm::PackmlStatsSnapshot& snapshot) { publishStats(snapshot); },
+      stats_publisher_options_));
+  stats_publisher_->start();
+
   sm_->stateChangedEvent.bind_member_func(this, &PackmlRos::handleStateChanged);
   sm_->activate();
   sm_->setIdealCycleTime(ideal_cycle_time_);
 
+  // Parameters are only read once here, later changes arrive through reconfigureCb.
+  ros::NodeHandle reconfigure_node(pn_);
+  reconfigure_node.setCallbackQueue(&stats_queue_);
+  reconfigure_server_.reset(new dynamic_reconfigure::Server<PackmlRosConfig>(reconfigure_node));
+  reconfigure_server_->setCallback(boost::bind(&PackmlRos::reconfigureCb, this, _1, _2));
 }
 
 PackmlRos::~PackmlRos()
 {
+  stop();
+  reconfigure_server_.reset();
+
   if (sm_ != nullptr)
   {
     sm_->stateChangedEvent.unbind_member_func(this, &PackmlRos::handleStateChanged);
   }
+
+  if (stats_publisher_ != nullptr)
+  {
+    stats_publisher_->stop();
+  }
 }
 
-void PackmlRos::spin()
+void PackmlRos::start()
+{
+  if (command_spinner_ != nullptr)
+  {
+    return;
+  }
+
+  command_spinner_.reset(new ros::AsyncSpinner(1, &command_queue_));
+  sequence_spinner_.reset(new ros::AsyncSpinner(1, &sequence_queue_));
+  increment_spinner_.reset(new ros::AsyncSpinner(1, &increment_queue_));
+  stats_spinner_.reset(new ros::AsyncSpinner(1, &stats_queue_));
+  command_spinner_->start();
+  sequence_spinner_->start();
+  increment_spinner_->start();
+  stats_spinner_->start();
+}
+
+void PackmlRos::stop()
 {
-  while (ros::ok())
+  if (command_spinner_ == nullptr)
   {
-    spinOnce();
-    ros::Duration(0.001).sleep();
+    return;
   }
-  return;
+
+  command_spinner_->stop();
+  sequence_spinner_->stop();
+  increment_spinner_->stop();
+  stats_spinner_->stop();
+  command_spinner_.reset();
+  sequence_spinner_.reset();
+  increment_spinner_.reset();
+  stats_spinner_.reset();
+}
+
+void PackmlRos::spin()
+{
+  start();
+  ros::spin();
+  stop();
 }
 
 void PackmlRos::spinOnce()
 {
+  if (command_spinner_ == nullptr)
+  {
+    command_queue_.callAvailable();
+    sequence_queue_.callAvailable();
+    increment_queue_.callAvailable();
+    stats_queue_.callAvailable();
+  }
   ros::spinOnce();
 }
 
@@ -171,11 +302,115 @@ bool PackmlRos::incStatRequest(packml_msgs::IncrementStat::Request& req, packml_
     return incStat(req.metric, req.step);
 }
 
+bool PackmlRos::incStatsRequest(IncrementStats::Request& req, IncrementStats::Response& res)
+{
+  std::vector<bool> results = sm_->incrementStats(toStatIncrements(req.increments));
+  res.success = true;
+  res.results.resize(results.size());
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    res.results[i] = results[i];
+    res.success = res.success && results[i];
+  }
+  return true;
+}
+
+void PackmlRos::statIncrementsCb(const StatIncrementArray::ConstPtr& msg)
+{
+  SequenceResult sequence = increment_monitor_.track(msg->source, msg->seq, msg->session);
+  if (sequence == SequenceResult::DUPLICATE)
+  {
+    ROS_DEBUG_STREAM("Ignoring duplicate stat increments " << msg->source << ":" << msg->seq);
+    return;
+  }
+  if (sequence == SequenceResult::GAP)
+  {
+    ROS_WARN_STREAM_THROTTLE(10, "Lost stat increments from " << msg->source << ", "
+                                 << increment_monitor_.getDroppedCount() << " messages dropped so far");
+  }
+
+  if (!msg->header.stamp.isZero())
+  {
+    increment_monitor_.recordLag((ros::Time::now() - msg->header.stamp).toSec());
+  }
+
+  uint64_t rejected = 0;
+  for (bool result : sm_->incrementStats(toStatIncrements(msg->increments)))
+  {
+    rejected += result ? 0 : 1;
+  }
+  increment_monitor_.recordRejected(rejected);
+}
+
+bool PackmlRos::commandsRequest(SendCommands::Request& req, SendCommands::Response& res)
+{
+  if (req.types.size() != req.ids.size())
+  {
+    res.success = false;
+    res.message = "types and ids must have the same length";
+    ROS_ERROR_STREAM("Invalid command list: " << res.message);
+    return true;
+  }
+
+  std::vector<packml_sm::SequenceStep> steps;
+  steps.reserve(req.ids.size());
+  for (size_t i = 0; i < req.ids.size(); ++i)
+  {
+    steps.push_back(packml_sm::SequenceStep{ req.types[i] == SendCommands::Request::EVENT, req.ids[i] });
+  }
+
+  // The callbacks may outlive this request if the timeout expires first.
+  struct Outcome
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<uint8_t> results;
+    std::vector<int32_t> states;
+    size_t pending;
+  };
+  auto outcome = std::make_shared<Outcome>();
+  outcome->results.assign(steps.size(), SendCommands::Response::PENDING);
+  outcome->states.assign(steps.size(), static_cast<int32_t>(packml_sm::StatesEnum::UNDEFINED));
+  outcome->pending = steps.size();
+
+  sm_->commandSequence(steps, [outcome](size_t index, const packml_sm::CommandResult& result) {
+    std::lock_guard<std::mutex> lock(outcome->mutex);
+    outcome->results[index] = static_cast<uint8_t>(result.result);
+    outcome->states[index] = static_cast<int32_t>(result.state);
+    outcome->pending--;
+    outcome->cv.notify_all();
+  });
+
+  // Waiting holds up the other send_commands requests, not single commands and events, but is still bounded.
+  std::unique_lock<std::mutex> lock(outcome->mutex);
+  double timeout = std::min(req.timeout, max_commands_timeout_);
+  if (timeout > 0)
+  {
+    outcome->cv.wait_for(lock, std::chrono::duration<double>(timeout),
+                         [&outcome]() { return outcome->pending == 0; });
+  }
+
+  res.results = outcome->results;
+  res.states = outcome->states;
+  res.success = true;
+  for (auto result : res.results)
+  {
+    res.success = res.success && result == SendCommands::Response::COMPLETED;
+  }
+  if (outcome->pending > 0)
+  {
+    res.message = std::to_string(outcome->pending) + " of " + std::to_string(steps.size()) + " steps still pending";
+  }
+  return true;
+}
+
 void PackmlRos::handleStateChanged(packml_sm::AbstractStateMachine& state_machine,
                                    const packml_sm::StateChangedEventArgs& args)
 {
   ROS_DEBUG_STREAM("Publishing state change: " << args.name << "(" << args.value << ")");
 
+  // invoke_state_change runs on the command thread while real transitions arrive from the state machine thread.
+  std::lock_guard<std::mutex> lock(status_mutex_);
   status_msg_.header.stamp = ros::Time().now();
   int cur_state = static_cast<int>(args.value);
   if (isStandardState(cur_state))
@@ -188,8 +423,13 @@ void PackmlRos::handleStateChanged(packml_sm::AbstractStateMachine& state_machin
     status_msg_.sub_state = cur_state;
   }
 
-  status_pub_.publish(status_msg_);
-  publishStats();
+  // Published by shared pointer so intra-process (nodelet) subscribers receive it without serialization.
+  status_pub_.publish(boost::make_shared<const packml_msgs::Status>(status_msg_));
+  stats_publisher_->notifyStateChanged(args.value);
+  if (shm_exporter_ != nullptr)
+  {
+    shm_exporter_->publishState(args.value);
+  }
 }
 
 void PackmlRos::getCurrentStats(packml_msgs::Stats& out_stats)
@@ -297,6 +537,25 @@ packml_sm::PackmlStatsSnapshot PackmlRos::populateStatsSnapshot(const packml_msg
   return snapshot;
 }
 
+StatsDelta PackmlRos::populateStatsDeltaMsg(const StatsDeltaFrame& frame)
+{
+  StatsDelta msg;
+  msg.stats = populateStatsMsg(frame.stats);
+  msg.header.stamp = msg.stats.header.stamp;
+  msg.seq = frame.seq;
+  msg.keyframe = frame.keyframe;
+  return msg;
+}
+
+StatsDeltaFrame PackmlRos::populateStatsDeltaFrame(const StatsDelta& msg)
+{
+  StatsDeltaFrame frame;
+  frame.seq = msg.seq;
+  frame.keyframe = msg.keyframe;
+  frame.stats = populateStatsSnapshot(msg.stats);
+  return frame;
+}
+
 bool PackmlRos::getStats(packml_msgs::GetStats::Request& req, packml_msgs::GetStats::Response& response)
 {
   packml_msgs::Stats stats;
@@ -313,54 +572,126 @@ bool PackmlRos::resetStats(packml_msgs::ResetStats::Request& req, packml_msgs::R
   response.last_stat = stats;
 
   sm_->resetStats();
+  stats_publisher_->requestPublish();
 
   return true;
 }
 
-void PackmlRos::publishStatsCb(const ros::TimerEvent&)
+StatsPublisherOptions PackmlRos::loadStatsPublisherOptions()
+{
+  StatsPublisherOptions options;
+
+  double min_interval;
+  pn_.param<double>("stats_min_interval", min_interval, 0.1);
+  options.min_interval = toMilliseconds(min_interval);
+  options.max_interval = toMilliseconds(stats_publish_rate_);
+
+  pn_.param<double>("stats_oee_deadband", options.oee_deadband, 0.0);
+  pn_.param<double>("stats_throughput_deadband", options.throughput_deadband, 0.0);
+
+  std::vector<int> immediate_states;
+  if (!pn_.getParam("stats_immediate_states", immediate_states))
+  {
+    immediate_states = { packml_msgs::State::ABORTED, packml_msgs::State::STOPPED, packml_msgs::State::HELD,
+                         packml_msgs::State::SUSPENDED, packml_msgs::State::COMPLETE };
+  }
+  for (const auto& state : immediate_states)
+  {
+    options.immediate_states.insert(static_cast<packml_sm::StatesEnum>(state));
+  }
+
+  return options;
+}
+
+void PackmlRos::statsDeltaConnectCb(const ros::SingleSubscriberPublisher&)
 {
-  publishStats();
+  stats_delta_encoder_.requestKeyframe();
+  stats_publisher_->requestPublish();
 }
 
-void PackmlRos::publishStats()
+void PackmlRos::publishStats(const packml_sm::PackmlStatsSnapshot& stats_snapshot)
 {
-  // Check if stats_publish_rate changed
-  double stats_publish_rate_new;
-  if (pn_.getParam("stats_publish_rate", stats_publish_rate_new))
+  if (stats_delta_mode_)
   {
-    if (stats_publish_rate_new != stats_publish_rate_ && stats_publish_rate_new > 0)
-    {
-      stats_timer_ = nh_.createTimer(ros::Duration(stats_publish_rate_new), &PackmlRos::publishStatsCb, this);
-    }
+    stats_delta_pub_.publish(
+        boost::make_shared<const StatsDelta>(populateStatsDeltaMsg(stats_delta_encoder_.encode(stats_snapshot))));
+  }
+  else
+  {
+    stats_pub_.publish(boost::make_shared<const packml_msgs::Stats>(populateStatsMsg(stats_snapshot)));
   }
 
-  packml_msgs::Stats stats;
-  getCurrentStats(stats);
-  stats_pub_.publish(stats);
+  if (shm_exporter_ != nullptr)
+  {
+    shm_exporter_->publishStats(sm_->getCurrentState(), stats_snapshot);
+  }
 }
 
 void PackmlRos::publishIncrementalStatsCb(const ros::TimerEvent &timer_event)
 {
-  // Check if incremental_stats_publish_rate changed
-  double incremental_stats_publish_rate_new;
-  if (pn_.getParam("incremental_stats_publish_rate", incremental_stats_publish_rate_new))
+  ROS_DEBUG_STREAM("stat_increments: " << increment_monitor_.getAcceptedCount() << " accepted, "
+                   << increment_monitor_.getDuplicateCount() << " duplicates, "
+                   << increment_monitor_.getDroppedCount() << " dropped, " << increment_monitor_.getRejectedCount()
+                   << " rejected items, lag mean " << increment_monitor_.getMeanLag() << "s max "
+                   << increment_monitor_.getMaxLag() << "s");
+
+  auto stats = boost::make_shared<packml_msgs::Stats>();
+  getIncrementalStats(*stats);
+  incremental_stats_pub_.publish(packml_msgs::StatsConstPtr(stats));
+}
+
+void PackmlRos::reconfigureCb(PackmlRosConfig& config, uint32_t level)
+{
+  if (config.stats_publish_rate != stats_publish_rate_ ||
+      toMilliseconds(config.stats_min_interval) != stats_publisher_options_.min_interval ||
+      config.stats_oee_deadband != stats_publisher_options_.oee_deadband ||
+      config.stats_throughput_deadband != stats_publisher_options_.throughput_deadband)
+  {
+    ROS_INFO_STREAM("Updating stats publication: rate " << config.stats_publish_rate << "s, min interval "
+                                                        << config.stats_min_interval << "s");
+    stats_publish_rate_ = config.stats_publish_rate;
+    stats_publisher_options_.max_interval = toMilliseconds(config.stats_publish_rate);
+    stats_publisher_options_.min_interval = toMilliseconds(config.stats_min_interval);
+    stats_publisher_options_.oee_deadband = config.stats_oee_deadband;
+    stats_publisher_options_.throughput_deadband = config.stats_throughput_deadband;
+    stats_publisher_->setOptions(stats_publisher_options_);
+  }
+
+  stats_delta_encoder_.setKeyframeInterval(static_cast<uint32_t>(config.stats_keyframe_interval));
+
+  if (config.incremental_stats_publish_rate != incremental_stats_publish_rate_)
   {
-    if (incremental_stats_publish_rate_new != incremental_stats_publish_rate_ && incremental_stats_publish_rate_new > 0)
+    ROS_INFO_STREAM("Updating incremental_stats_publish_rate to " << config.incremental_stats_publish_rate << "s");
+    incremental_stats_publish_rate_ = config.incremental_stats_publish_rate;
+    if (config.incremental_stats_publish_rate <= 0)
     {
-      incremental_stats_timer_ = nh_.createTimer(ros::Duration(incremental_stats_publish_rate_new),
-                                                 &PackmlRos::publishIncrementalStatsCb, this);
+      incremental_stats_timer_.stop();
+    }
+    else if (incremental_stats_timer_.isValid())
+    {
+      incremental_stats_timer_.setPeriod(ros::Duration(config.incremental_stats_publish_rate));
+      incremental_stats_timer_.start();
+    }
+    else
+    {
+      incremental_stats_timer_ = stats_nh_.createTimer(ros::Duration(config.incremental_stats_publish_rate),
+                                                       &PackmlRos::publishIncrementalStatsCb, this);
     }
   }
 
-  packml_msgs::Stats stats;
-  getIncrementalStats(stats);
-  incremental_stats_pub_.publish(stats);
+  if (config.ideal_cycle_time != ideal_cycle_time_)
+  {
+    ROS_INFO_STREAM("Updating ideal_cycle_time to " << config.ideal_cycle_time << "s");
+    ideal_cycle_time_ = config.ideal_cycle_time;
+    sm_->setIdealCycleTime(config.ideal_cycle_time);
+  }
 }
 
 bool PackmlRos::loadStats(packml_msgs::LoadStats::Request &req, packml_msgs::LoadStats::Response &response)
 {
   packml_sm::PackmlStatsSnapshot snapshot = populateStatsSnapshot(req.stats);
   sm_->loadStats(snapshot);
+  stats_publisher_->requestPublish();
 
   return true;
 }
@@ -408,28 +739,29 @@ bool PackmlRos::commandGuard(const int& command_int, bool& command_valid, bool&
 
 bool PackmlRos::eventGuard(const int& event_id)
 {
+  // Runs on the command spinner thread, so events are handed to the event loop thread rather than processed here.
   switch(event_id)
   {
     case static_cast<int>(packml_sm::EventsEnum::STATE_COMPLETE):
-      sm_->triggerEvent(packml_sm::state_complete_event());
+      sm_->enqueueEvent(packml_sm::state_complete_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::HOLD):
-      sm_->triggerEvent(packml_sm::hold_event());
+      sm_->enqueueEvent(packml_sm::hold_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::UNHOLD):
-      sm_->triggerEvent(packml_sm::unhold_event());
+      sm_->enqueueEvent(packml_sm::unhold_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::SUSPEND):
-      sm_->triggerEvent(packml_sm::suspend_event());
+      sm_->enqueueEvent(packml_sm::suspend_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::UNSUSPEND):
-      sm_->triggerEvent(packml_sm::unsuspend_event());
+      sm_->enqueueEvent(packml_sm::unsuspend_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::RESET):
-      sm_->triggerEvent(packml_sm::reset_event());
+      sm_->enqueueEvent(packml_sm::reset_event());
       break;
     case static_cast<int>(packml_sm::EventsEnum::CLEAR):
-      sm_->triggerEvent(packml_sm::clear_event());
+      sm_->enqueueEvent(packml_sm::clear_event());
       break;
     default:
       ROS_ERROR_STREAM_NAMED("packml", "Event request called with invalid event_id: " << event_id);
@@ -440,38 +772,11 @@ bool PackmlRos::eventGuard(const int& event_id)
 
 bool PackmlRos::incStat(const int& metric, const double& step)
 {
-  bool result = true;
-
-  switch(metric)
+  if (!sm_->incrementStat(packml_sm::StatIncrement{ metric, static_cast<float>(step), 0.0f }))
   {
-    case static_cast<int32_t>(packml_sm::MetricIDEnum::CYCLE_INC_ID):
-      //do nothing, we don't have a way to increment cycle yet.
-      break;
-    case static_cast<int32_t>(packml_sm::MetricIDEnum::SUCCESS_INC_ID):
-      sm_->incrementSuccessCount();
-      break;
-    case static_cast<int32_t>(packml_sm::MetricIDEnum::FAILURE_INC_ID):
-      sm_->incrementFailureCount();
-      break;
-    default:
-      if(metric >= static_cast<int32_t>(packml_sm::MetricIDEnum::MIN_QUALITY_ID)
-        && metric <= static_cast<int32_t>(packml_sm::MetricIDEnum::MAX_QUALITY_ID))
-      {
-        sm_->incrementQualityStatItem(metric, step);
-        break;
-      }
-      else if(metric >= static_cast<int32_t>(packml_sm::MetricIDEnum::MIN_ERROR_ID)
-        && metric <= static_cast<int32_t>(packml_sm::MetricIDEnum::MAX_ERROR_ID))
-      {
-        sm_->incrementErrorStatItem(metric, step);
-        break;
-      }
-      else
-      {
-        ROS_ERROR_STREAM_NAMED("packml", "Increment stat request called with invalid metric id: " << metric);
-        result = false;
-      }
-  }
-  return result;
+    ROS_ERROR_STREAM_NAMED("packml", "Increment stat request called with invalid metric id: " << metric);
+    return false;
+  }
+  return true;
 }
 }  // namespace kitsune_robot
@@ -0,0 +1,39 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ros/ros.h>
+#include <packml_ros/latency_bench.h>
+
+int main(int argc, char* argv[])
+{
+  ros::init(argc, argv, "packml_latency_bench");
+
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  packml_ros::LatencyBench bench(ros::NodeHandle(), ros::NodeHandle("~"));
+  bench.start();
+
+  ros::Rate rate(10);
+  while (ros::ok() && !bench.isDone())
+  {
+    rate.sleep();
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <packml_ros/latency_bench.h>
+#include <packml_ros/packml_ros.h>
+#include <packml_sm/boost/packml_state_machine_continuous.h>
+
+namespace packml_ros
+{
+/**
+ * @brief Runs PackmlRos inside a nodelet manager so co-located subscribers receive status and stats by pointer.
+ */
+class PackmlRosNodelet : public nodelet::Nodelet
+{
+private:
+  std::unique_ptr<PackmlRos> packml_ros_;  /** Packml ROS interface */
+
+  virtual void onInit() override
+  {
+    auto sm = packml_sm::PackmlStateMachineContinuous::spawn();
+    packml_ros_.reset(new PackmlRos(getNodeHandle(), getPrivateNodeHandle(), sm));
+
+    // The manager serves the nodelet's own queues, PackmlRos serves its command, increment and stats queues.
+    packml_ros_->start();
+  }
+};
+
+/**
+ * @brief Runs the status latency bench in the same manager as PackmlRosNodelet.
+ */
+class LatencyBenchNodelet : public nodelet::Nodelet
+{
+private:
+  std::unique_ptr<LatencyBench> bench_;  /** Latency bench */
+
+  virtual void onInit() override
+  {
+    bench_.reset(new LatencyBench(getNodeHandle(), getPrivateNodeHandle()));
+    bench_->start();
+  }
+};
+}  // namespace packml_ros
+
+PLUGINLIB_EXPORT_CLASS(packml_ros::PackmlRosNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(packml_ros::LatencyBenchNodelet, nodelet::Nodelet)
@@ -0,0 +1,162 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_ros/stats_delta.h"
+
+namespace packml_ros
+{
+namespace
+{
+bool sameItem(const packml_sm::PackmlStatsItemized& lhs, const packml_sm::PackmlStatsItemized& rhs)
+{
+  return lhs.count == rhs.count && lhs.duration == rhs.duration;
+}
+
+/**
+ * @brief Collects the items of current that are new or differ from last.
+ *
+ * @return False if an item of last is missing from current, which a delta cannot express
+ */
+bool diffItems(const std::map<int16_t, packml_sm::PackmlStatsItemized>& last,
+               const std::map<int16_t, packml_sm::PackmlStatsItemized>& current,
+               std::map<int16_t, packml_sm::PackmlStatsItemized>& changed)
+{
+  // Both maps are sorted by id, so a single merge pass finds additions, changes and removals.
+  auto last_it = last.begin();
+  for (const auto& item : current)
+  {
+    if (last_it != last.end() && last_it->first < item.first)
+    {
+      return false;
+    }
+
+    if (last_it != last.end() && last_it->first == item.first)
+    {
+      if (!sameItem(last_it->second, item.second))
+      {
+        changed.insert(changed.end(), item);
+      }
+      ++last_it;
+    }
+    else
+    {
+      changed.insert(changed.end(), item);
+    }
+  }
+
+  return last_it == last.end();
+}
+}  // namespace
+
+StatsDeltaEncoder::StatsDeltaEncoder(uint32_t keyframe_interval)
+  : keyframe_interval_(keyframe_interval), keyframe_requested_(true)
+{
+}
+
+StatsDeltaFrame StatsDeltaEncoder::encode(const packml_sm::PackmlStatsSnapshot& snapshot)
+{
+  StatsDeltaFrame frame;
+  frame.seq = next_seq_++;
+  frame.stats = snapshot;
+
+  bool keyframe = keyframe_requested_.exchange(false) || frames_since_keyframe_ >= keyframe_interval_;
+  if (!keyframe)
+  {
+    frame.stats.itemized_error_map.clear();
+    frame.stats.itemized_quality_map.clear();
+    keyframe = !diffItems(last_error_map_, snapshot.itemized_error_map, frame.stats.itemized_error_map) ||
+               !diffItems(last_quality_map_, snapshot.itemized_quality_map, frame.stats.itemized_quality_map);
+  }
+
+  if (keyframe)
+  {
+    frame.stats.itemized_error_map = snapshot.itemized_error_map;
+    frame.stats.itemized_quality_map = snapshot.itemized_quality_map;
+    frames_since_keyframe_ = 0;
+  }
+  else
+  {
+    frames_since_keyframe_++;
+  }
+
+  frame.keyframe = keyframe;
+  last_error_map_ = snapshot.itemized_error_map;
+  last_quality_map_ = snapshot.itemized_quality_map;
+  return frame;
+}
+
+void StatsDeltaEncoder::requestKeyframe()
+{
+  keyframe_requested_ = true;
+}
+
+void StatsDeltaEncoder::setKeyframeInterval(uint32_t keyframe_interval)
+{
+  keyframe_interval_ = keyframe_interval;
+}
+
+bool StatsDeltaReassembler::apply(const StatsDeltaFrame& frame)
+{
+  if (frame.keyframe)
+  {
+    if (synchronized_ && frame.seq != last_seq_ + 1)
+    {
+      gap_count_++;
+    }
+    snapshot_ = frame.stats;
+    synchronized_ = true;
+    last_seq_ = frame.seq;
+    return true;
+  }
+
+  if (!synchronized_)
+  {
+    return false;
+  }
+
+  if (frame.seq != last_seq_ + 1)
+  {
+    gap_count_++;
+    synchronized_ = false;
+    return false;
+  }
+
+  auto error_map = std::move(snapshot_.itemized_error_map);
+  auto quality_map = std::move(snapshot_.itemized_quality_map);
+  for (const auto& item : frame.stats.itemized_error_map)
+  {
+    error_map[item.first] = item.second;
+  }
+  for (const auto& item : frame.stats.itemized_quality_map)
+  {
+    quality_map[item.first] = item.second;
+  }
+
+  snapshot_ = frame.stats;
+  snapshot_.itemized_error_map = std::move(error_map);
+  snapshot_.itemized_quality_map = std::move(quality_map);
+  last_seq_ = frame.seq;
+  return true;
+}
+
+void StatsDeltaReassembler::reset()
+{
+  snapshot_ = packml_sm::PackmlStatsSnapshot();
+  synchronized_ = false;
+  last_seq_ = 0;
+}
+}  // namespace packml_ros
@@ -0,0 +1,192 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_ros/stats_publisher.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace packml_ros
+{
+StatsPublisher::StatsPublisher(SampleFunction sample, PublishFunction publish, const StatsPublisherOptions& options)
+  : sample_(sample), publish_(publish), options_(options), publish_count_(0), coalesced_count_(0)
+{
+}
+
+StatsPublisher::~StatsPublisher()
+{
+  stop();
+}
+
+void StatsPublisher::start()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_)
+  {
+    return;
+  }
+
+  running_ = true;
+  last_publish_ = std::chrono::steady_clock::now();
+  last_sample_ = last_publish_;
+  thread_ = std::thread(&StatsPublisher::run, this);
+}
+
+void StatsPublisher::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    dirty_ = false;
+    immediate_ = false;
+  }
+  cv_.notify_one();
+
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+void StatsPublisher::notifyStateChanged(packml_sm::StatesEnum state)
+{
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dirty_)
+    {
+      coalesced_count_++;
+    }
+    else
+    {
+      dirty_ = true;
+      wake = true;
+    }
+
+    if (!immediate_ && options_.immediate_states.count(state) > 0)
+    {
+      immediate_ = true;
+      wake = true;
+    }
+  }
+
+  // Only wake the publisher thread when its deadline actually moved.
+  if (wake)
+  {
+    cv_.notify_one();
+  }
+}
+
+void StatsPublisher::requestPublish()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    immediate_ = true;
+  }
+  cv_.notify_one();
+}
+
+void StatsPublisher::setOptions(const StatsPublisherOptions& options)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+  }
+  cv_.notify_one();
+}
+
+void StatsPublisher::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_)
+  {
+    auto now = std::chrono::steady_clock::now();
+    bool heartbeat_enabled = options_.max_interval.count() > 0;
+    bool heartbeat_due = heartbeat_enabled && now >= last_publish_ + options_.max_interval;
+    bool dirty_due = dirty_ && now >= last_sample_ + options_.min_interval;
+
+    if (!immediate_ && !heartbeat_due && !dirty_due)
+    {
+      auto wake_time = std::chrono::steady_clock::time_point::max();
+      if (dirty_)
+      {
+        wake_time = last_sample_ + options_.min_interval;
+      }
+      if (heartbeat_enabled)
+      {
+        wake_time = std::min(wake_time, last_publish_ + options_.max_interval);
+      }
+
+      if (wake_time == std::chrono::steady_clock::time_point::max())
+      {
+        cv_.wait(lock);
+      }
+      else
+      {
+        cv_.wait_until(lock, wake_time);
+      }
+      continue;
+    }
+
+    bool force = immediate_ || heartbeat_due || !has_published_;
+    StatsPublisherOptions options = options_;
+    dirty_ = false;
+    immediate_ = false;
+    last_sample_ = now;
+    lock.unlock();
+
+    packml_sm::PackmlStatsSnapshot snapshot;
+    sample_(snapshot);
+    bool publish = force || exceedsDeadband(snapshot, options);
+    if (publish)
+    {
+      publish_(snapshot);
+      last_published_ = snapshot;
+      has_published_ = true;
+      publish_count_++;
+    }
+    else
+    {
+      coalesced_count_++;
+    }
+
+    lock.lock();
+    if (publish)
+    {
+      last_publish_ = now;
+    }
+  }
+}
+
+bool StatsPublisher::exceedsDeadband(const packml_sm::PackmlStatsSnapshot& snapshot,
+                                     const StatsPublisherOptions& options) const
+{
+  if (snapshot.cycle_count != last_published_.cycle_count || snapshot.success_count != last_published_.success_count ||
+      snapshot.fail_count != last_published_.fail_count)
+  {
+    return true;
+  }
+
+  if (std::fabs(snapshot.overall_equipment_effectiveness - last_published_.overall_equipment_effectiveness) >
+      options.oee_deadband)
+  {
+    return true;
+  }
+
+  return std::fabs(snapshot.throughput - last_published_.throughput) > options.throughput_deadband;
+}
+}  // namespace packml_ros
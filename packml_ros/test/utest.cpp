@@ -22,6 +22,14 @@
 #include <packml_msgs/SendCommand.h>
 #include <packml_msgs/State.h>
 #include <packml_sm/common.h>
+#include <packml_ros/ingest_monitor.h>
+#include <packml_ros/stats_delta.h>
+#include <packml_ros/stats_publisher.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 
 int main(int argc, char **argv)
@@ -64,3 +72,281 @@ TEST(Packml_ROS, sync_packml_state)
   EXPECT_EQ(static_cast<int>(StatesEnum::IDLE), State::IDLE);
 
 }
+
+
+namespace
+{
+/** Stand-in for the state machine stats, shared between the test and the publisher thread. */
+struct FakeStats
+{
+  std::mutex mutex;
+  packml_sm::PackmlStatsSnapshot snapshot = packml_sm::PackmlStatsSnapshot();
+  std::atomic<int> sample_count{ 0 };
+  std::atomic<int> publish_count{ 0 };
+
+  void sample(packml_sm::PackmlStatsSnapshot& out)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    out = snapshot;
+    sample_count++;
+  }
+
+  void publish(const packml_sm::PackmlStatsSnapshot&)
+  {
+    publish_count++;
+  }
+};
+
+bool waitForCount(const std::atomic<int>& count, int expected)
+{
+  for (int i = 0; i < 200 && count < expected; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return count >= expected;
+}
+}
+
+
+TEST(Packml_ROS, stats_publisher_coalesces)
+{
+  using namespace packml_ros;
+  using namespace packml_sm;
+  FakeStats stats;
+  StatsPublisherOptions options;
+  options.min_interval = std::chrono::milliseconds(200);
+  options.max_interval = std::chrono::milliseconds(0);
+  StatsPublisher publisher([&](PackmlStatsSnapshot& out) { stats.sample(out); },
+                           [&](const PackmlStatsSnapshot& snapshot) { stats.publish(snapshot); }, options);
+  publisher.start();
+
+  // A burst of transitions collapses into at most a couple of publications.
+  for (int i = 0; i < 1000; ++i)
+  {
+    publisher.notifyStateChanged(StatesEnum::EXECUTE);
+    publisher.notifyStateChanged(StatesEnum::COMPLETING);
+  }
+  ASSERT_TRUE(waitForCount(stats.publish_count, 1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  publisher.stop();
+
+  EXPECT_LE(stats.sample_count, 2);
+  EXPECT_EQ(stats.publish_count, static_cast<int>(publisher.getPublishCount()));
+  EXPECT_GE(publisher.getCoalescedCount(), 1998u);
+}
+
+
+TEST(Packml_ROS, stats_publisher_deadband)
+{
+  using namespace packml_ros;
+  using namespace packml_sm;
+  FakeStats stats;
+  StatsPublisherOptions options;
+  options.min_interval = std::chrono::milliseconds(0);
+  options.max_interval = std::chrono::milliseconds(0);
+  options.oee_deadband = 0.05;
+  options.throughput_deadband = 1.0;
+  options.immediate_states.insert(StatesEnum::ABORTED);
+  StatsPublisher publisher([&](PackmlStatsSnapshot& out) { stats.sample(out); },
+                           [&](const PackmlStatsSnapshot& snapshot) { stats.publish(snapshot); }, options);
+  publisher.start();
+
+  // The first snapshot is always published.
+  publisher.notifyStateChanged(StatesEnum::EXECUTE);
+  ASSERT_TRUE(waitForCount(stats.publish_count, 1));
+
+  // Small OEE changes are suppressed once sampled.
+  {
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.snapshot.overall_equipment_effectiveness = 0.01f;
+  }
+  publisher.notifyStateChanged(StatesEnum::COMPLETING);
+  ASSERT_TRUE(waitForCount(stats.sample_count, 2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1, stats.publish_count);
+
+  // Immediate states bypass the deadband.
+  publisher.notifyStateChanged(StatesEnum::ABORTED);
+  ASSERT_TRUE(waitForCount(stats.publish_count, 2));
+
+  // Counter changes and large OEE changes go through.
+  {
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.snapshot.success_count = 1;
+  }
+  publisher.notifyStateChanged(StatesEnum::EXECUTE);
+  ASSERT_TRUE(waitForCount(stats.publish_count, 3));
+  {
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.snapshot.overall_equipment_effectiveness = 0.5f;
+  }
+  publisher.notifyStateChanged(StatesEnum::COMPLETING);
+  ASSERT_TRUE(waitForCount(stats.publish_count, 4));
+  publisher.stop();
+}
+
+
+TEST(Packml_ROS, stats_publisher_heartbeat)
+{
+  using namespace packml_ros;
+  using namespace packml_sm;
+  FakeStats stats;
+  StatsPublisherOptions options;
+  options.max_interval = std::chrono::milliseconds(20);
+  StatsPublisher publisher([&](PackmlStatsSnapshot& out) { stats.sample(out); },
+                           [&](const PackmlStatsSnapshot& snapshot) { stats.publish(snapshot); }, options);
+  publisher.start();
+
+  // Unchanged stats are still refreshed at the heartbeat interval.
+  ASSERT_TRUE(waitForCount(stats.publish_count, 3));
+  publisher.stop();
+
+  int published = stats.publish_count;
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_EQ(published, stats.publish_count);
+}
+
+
+TEST(Packml_ROS, stats_delta_roundtrip)
+{
+  using namespace packml_ros;
+  using namespace packml_sm;
+  StatsDeltaEncoder encoder(3);
+  StatsDeltaReassembler reassembler;
+
+  PackmlStatsSnapshot snapshot = PackmlStatsSnapshot();
+  for (int16_t id = 1; id <= 100; ++id)
+  {
+    snapshot.itemized_error_map[id] = { id, 1.0, 0.5 };
+  }
+
+  // The first frame is always a keyframe.
+  StatsDeltaFrame frame = encoder.encode(snapshot);
+  EXPECT_TRUE(frame.keyframe);
+  EXPECT_EQ(1u, frame.seq);
+  EXPECT_EQ(100u, frame.stats.itemized_error_map.size());
+  EXPECT_TRUE(reassembler.apply(frame));
+
+  // Only the changed and the new item are sent.
+  snapshot.itemized_error_map[7].count = 2.0;
+  snapshot.itemized_quality_map[3] = { 3, 1.0, 0.0 };
+  snapshot.success_count = 5;
+  frame = encoder.encode(snapshot);
+  EXPECT_FALSE(frame.keyframe);
+  EXPECT_EQ(2u, frame.seq);
+  EXPECT_EQ(1u, frame.stats.itemized_error_map.size());
+  EXPECT_EQ(1u, frame.stats.itemized_quality_map.size());
+  EXPECT_TRUE(reassembler.apply(frame));
+  EXPECT_EQ(5, reassembler.getSnapshot().success_count);
+  EXPECT_EQ(100u, reassembler.getSnapshot().itemized_error_map.size());
+  EXPECT_DOUBLE_EQ(2.0, reassembler.getSnapshot().itemized_error_map.at(7).count);
+  EXPECT_DOUBLE_EQ(1.0, reassembler.getSnapshot().itemized_quality_map.at(3).count);
+
+  // Unchanged stats produce empty deltas until the keyframe interval is reached.
+  EXPECT_TRUE(encoder.encode(snapshot).stats.itemized_error_map.empty());
+  EXPECT_TRUE(encoder.encode(snapshot).stats.itemized_error_map.empty());
+  frame = encoder.encode(snapshot);
+  EXPECT_TRUE(frame.keyframe);
+  EXPECT_EQ(5u, frame.seq);
+
+  // Removed items (e.g. after a stats reset) force a keyframe.
+  EXPECT_FALSE(encoder.encode(snapshot).keyframe);
+  snapshot.itemized_error_map.erase(50);
+  frame = encoder.encode(snapshot);
+  EXPECT_TRUE(frame.keyframe);
+  EXPECT_EQ(99u, frame.stats.itemized_error_map.size());
+}
+
+
+TEST(Packml_ROS, stats_delta_gap)
+{
+  using namespace packml_ros;
+  using namespace packml_sm;
+  StatsDeltaEncoder encoder(100);
+  StatsDeltaReassembler reassembler;
+
+  PackmlStatsSnapshot snapshot = PackmlStatsSnapshot();
+  snapshot.itemized_error_map[1] = { 1, 1.0, 0.0 };
+
+  // Deltas are ignored until a keyframe arrives.
+  StatsDeltaFrame keyframe = encoder.encode(snapshot);
+  snapshot.itemized_error_map[1].count = 2.0;
+  StatsDeltaFrame delta = encoder.encode(snapshot);
+  EXPECT_FALSE(reassembler.apply(delta));
+  EXPECT_FALSE(reassembler.isSynchronized());
+  EXPECT_TRUE(reassembler.apply(keyframe));
+  EXPECT_TRUE(reassembler.apply(delta));
+
+  // A lost delta drops the reassembler out of sync until the requested keyframe.
+  snapshot.itemized_error_map[1].count = 3.0;
+  encoder.encode(snapshot);
+  snapshot.itemized_error_map[1].count = 4.0;
+  EXPECT_FALSE(reassembler.apply(encoder.encode(snapshot)));
+  EXPECT_EQ(1u, reassembler.getGapCount());
+  EXPECT_FALSE(reassembler.isSynchronized());
+
+  encoder.requestKeyframe();
+  StatsDeltaFrame frame = encoder.encode(snapshot);
+  EXPECT_TRUE(frame.keyframe);
+  EXPECT_TRUE(reassembler.apply(frame));
+  EXPECT_DOUBLE_EQ(4.0, reassembler.getSnapshot().itemized_error_map.at(1).count);
+}
+
+
+TEST(Packml_ROS, ingest_monitor)
+{
+  using namespace packml_ros;
+  IngestMonitor monitor(100);
+
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("vision", 1));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("vision", 2));
+  EXPECT_EQ(SequenceResult::DUPLICATE, monitor.track("vision", 2));
+  EXPECT_EQ(SequenceResult::GAP, monitor.track("vision", 6));
+  EXPECT_EQ(SequenceResult::DUPLICATE, monitor.track("vision", 4));
+
+  // Sources are numbered independently, unnumbered messages are always accepted.
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("driver", 2));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("driver", 0));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("driver", 0));
+
+  // Falling far behind the last number is a producer restart.
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("robot", 500));
+  EXPECT_EQ(SequenceResult::RESTART, monitor.track("robot", 1));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("robot", 2));
+
+  EXPECT_EQ(9u, monitor.getAcceptedCount());
+  EXPECT_EQ(2u, monitor.getDuplicateCount());
+  EXPECT_EQ(3u, monitor.getDroppedCount());
+
+  EXPECT_DOUBLE_EQ(0.0, monitor.getMeanLag());
+  monitor.recordLag(0.1);
+  monitor.recordLag(0.3);
+  EXPECT_DOUBLE_EQ(0.2, monitor.getMeanLag());
+  EXPECT_DOUBLE_EQ(0.3, monitor.getMaxLag());
+  monitor.recordRejected(2);
+  EXPECT_EQ(2u, monitor.getRejectedCount());
+}
+
+TEST(Packml_ROS, ingest_monitor_early_restart)
+{
+  using namespace packml_ros;
+  IngestMonitor monitor;
+
+  // A producer that restarts well within the default window is not mistaken for a duplicate.
+  for (uint64_t seq = 1; seq <= 20; ++seq)
+  {
+    EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("vision", seq));
+  }
+  EXPECT_EQ(SequenceResult::DUPLICATE, monitor.track("vision", 20));
+  EXPECT_EQ(SequenceResult::RESTART, monitor.track("vision", 1));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("vision", 2));
+
+  // With a session the restart is recognized even if its first messages were lost.
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("robot", 10, 100));
+  EXPECT_EQ(SequenceResult::DUPLICATE, monitor.track("robot", 10, 100));
+  EXPECT_EQ(SequenceResult::RESTART, monitor.track("robot", 3, 200));
+  EXPECT_EQ(SequenceResult::IN_ORDER, monitor.track("robot", 4, 200));
+
+  EXPECT_EQ(2u, monitor.getDuplicateCount());
+  EXPECT_EQ(0u, monitor.getDroppedCount());
+}
@@ -19,15 +19,57 @@
 #include "packml_sm/state_changed_event_args.h"
 #include "packml_sm/packml_stats_snapshot.h"
 #include "packml_sm/packml_stats_itemized.h"
+#include "packml_sm/clock.h"
+#include "packml_sm/state_method_context.h"
 #include "common.h"
 
+#include <array>
 #include <map>
 #include <mutex>
 #include <chrono>
 #include <functional>
+#include <future>
+#include <memory>
+#include <vector>
 
 namespace packml_sm
 {
+/**
+ * @brief Outcome of a command sent with AbstractStateMachine::command.
+ *
+ */
+struct CommandResult
+{
+  CmdResultEnum result;  /** whether the command's transition was taken */
+  StatesEnum state;      /** state entered by the command, or the state that rejected it */
+};
+
+typedef std::function<void(const CommandResult&)> CommandCallback;
+
+/**
+ * @brief A single step of a command sequence, either a command or an event.
+ *
+ */
+struct SequenceStep
+{
+  bool is_event;  /** id is an EventsEnum value rather than a CmdEnum value */
+  int id;         /** the command or event to send */
+};
+
+/** Receives the index of a sequence step and its outcome. */
+typedef std::function<void(size_t, const CommandResult&)> SequenceCallback;
+
+/**
+ * @brief A single stat increment, see MetricIDEnum for the metric ranges.
+ *
+ */
+struct StatIncrement
+{
+  int32_t metric;  /** success, failure, quality or error metric id */
+  float step;      /** amount to add to the count */
+  float duration;  /** amount to add to the duration of itemized stats */
+};
+
 /**
  * @brief The StateMachineInterface class defines a implementation independent interface
  * to a PackML state machine.
@@ -153,6 +195,182 @@ public:
    */
   virtual bool setUnholding(std::function<int()> state_method) = 0;
 
+  /**
+   * @brief Override to handle setting a context aware starting state method.
+   *
+   * @param state_method The state method to execute when entering the start state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setStarting(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware execute state method.
+   *
+   * @param state_method The state method to execute when entering the exec state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setExecute(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware completing state method.
+   *
+   * @param state_method The state method to execute when entering the completing state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setCompleting(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware aborting state method.
+   *
+   * @param state_method The state method to execute when entering the aborting state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setAborting(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware clearing state method.
+   *
+   * @param state_method The state method to execute when entering the clearing state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setClearing(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware stopping state method.
+   *
+   * @param state_method The state method to execute when entering the stopping state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setStopping(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware resetting state method.
+   *
+   * @param state_method The state method to execute when entering the resetting state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setResetting(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware suspending state method.
+   *
+   * @param state_method The state method to execute when entering the suspending state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setSuspending(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware un-suspending state method.
+   *
+   * @param state_method The state method to execute when entering the unsuspending state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setUnsuspending(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware holding state method.
+   *
+   * @param state_method The state method to execute when entering the holding state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setHolding(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting a context aware unholding state method.
+   *
+   * @param state_method The state method to execute when entering the unholding state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setUnholding(ContextStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous starting state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the start state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setStarting(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous execute state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the exec state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setExecute(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous completing state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the completing state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setCompleting(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous aborting state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the aborting state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setAborting(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous clearing state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the clearing state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setClearing(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous stopping state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the stopping state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setStopping(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous resetting state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the resetting state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setResetting(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous suspending state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the suspending state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setSuspending(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous un-suspending state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the unsuspending state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setUnsuspending(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous holding state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the holding state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setHolding(AsyncStateMethod state_method) = 0;
+
+  /**
+   * @brief Override to handle setting an asynchronous unholding state method.
+   *
+   * @param state_method The asynchronous state method to launch when entering the unholding state.
+   * @return bool Returns true on success.
+   */
+  virtual bool setUnholding(AsyncStateMethod state_method) = 0;
+
   /**
    * @brief Override to provide an accessor to whether the state machine is currently active.
    *
@@ -160,6 +378,25 @@ public:
    */
   virtual bool isActive() = 0;
 
+  /**
+   * @brief Sets the clock used for stats and state timing, restarting the timing of the current state.
+   *
+   * Call before activate(). Each state machine has its own clock so that several simulations can run side by side.
+   *
+   * @param clock The clock to use, or nullptr for std::chrono::steady_clock.
+   */
+  virtual void setClock(std::shared_ptr<Clock> clock);
+
+  /**
+   * @brief Accessor for the clock set with setClock().
+   *
+   * @return std::shared_ptr<Clock> The clock, or nullptr if the steady clock is used.
+   */
+  std::shared_ptr<Clock> getClock() const
+  {
+    return clock_;
+  }
+
   /**
    * @brief Accessor for the current state.
    *
@@ -329,6 +566,23 @@ public:
    */
   void incrementQualityStatItem(int16_t id, float count, float duration = 0.0);
 
+  /**
+   * @brief Applies a stat increment to the metric it names.
+   *
+   * @param increment The increment to apply.
+   * @return bool Returns false if the metric id is not in any of the MetricIDEnum ranges.
+   */
+  bool incrementStat(const StatIncrement& increment);
+
+  /**
+   * @brief Applies a batch of stat increments under a single acquisition of the stats lock, so no snapshot sees a
+   * partially applied batch.
+   *
+   * @param increments The increments to apply, in order.
+   * @return std::vector<bool> Per increment, false if its metric id is invalid. Valid increments are always applied.
+   */
+  std::vector<bool> incrementStats(const std::vector<StatIncrement>& increments);
+
   /**
    * @brief Call to increment the successful operation count.
    *
@@ -411,12 +665,47 @@ public:
    */
   virtual bool abort();
 
+  /**
+   * @brief Sends a command and reports when its transition has been taken.
+   *
+   * The callback runs on the thread that processes the command once the target state has been entered. It reports
+   * REJECTED if the command is not valid in the current state (immediately, on the calling thread) or if the state
+   * changed before the command was processed, and CANCELLED if the state machine is deactivated first.
+   *
+   * @param command The command to send.
+   * @param on_complete Called exactly once with the outcome, may be nullptr.
+   * @return bool Returns true if the command was queued.
+   */
+  bool command(CmdEnum command, CommandCallback on_complete = nullptr);
+
+  /**
+   * @brief Sends a command and returns a future for its outcome, see command().
+   *
+   * @param command The command to send.
+   * @return std::future<CommandResult> Becomes ready once the command completed, was rejected or was cancelled.
+   */
+  std::future<CommandResult> commandAsync(CmdEnum command);
+
+  /**
+   * @brief Queues an ordered list of commands and events in a single step.
+   *
+   * Unlike command(), the steps are not checked against the current state up front, since earlier steps change the
+   * state the later ones are processed in. Each step is processed in order by the event loop and reports COMPLETED if
+   * it caused a transition and REJECTED otherwise. Unknown ids are reported as REJECTED immediately.
+   *
+   * @param steps The commands and events to send, in order.
+   * @param on_complete Called exactly once per step with its index and outcome, may be nullptr.
+   * @return size_t The number of steps queued.
+   */
+  size_t commandSequence(const std::vector<SequenceStep>& steps, SequenceCallback on_complete = nullptr);
+
   /**
    * @brief Fills the reference variable with the current stats snapshot.
    *
    * @param snapshot_out Reference to the variable to fill the snapshot data with.
+   * @param include_itemized Set to false to skip copying the itemized maps, e.g. for high rate sampling.
    */
-  void getCurrentStatSnapshot(PackmlStatsSnapshot& snapshot_out);
+  void getCurrentStatSnapshot(PackmlStatsSnapshot& snapshot_out, bool include_itemized = true);
 
   /**
    * @brief Fills the reference variable with the current incremental stats
@@ -434,6 +723,16 @@ public:
   void invokeStateChangedEvent(const std::string& name, StatesEnum value);
 
 protected:
+  /**
+   * @brief Reads the state machine clock.
+   *
+   * @return Clock::TimePoint The current time.
+   */
+  Clock::TimePoint currentTime() const
+  {
+    return clock_ != nullptr ? clock_->now() : std::chrono::steady_clock::now();
+  }
+
   /**
    * @brief Override to call implementations version of start command.
    *
@@ -488,7 +787,54 @@ protected:
    */
   virtual void _abort() = 0;
 
+  /**
+   * @brief Override to send a command that reports its outcome to on_complete.
+   *
+   */
+  virtual void _command(CmdEnum command, CommandCallback on_complete) = 0;
+
+  /**
+   * @brief Override to queue a sequence of commands and events, see commandSequence().
+   *
+   */
+  virtual size_t _commandSequence(const std::vector<SequenceStep>& steps, SequenceCallback on_complete) = 0;
+
+  /**
+   * @brief Checks whether the command is valid in the given state.
+   *
+   * @param state The state the command would be processed in.
+   * @param command The command to check.
+   * @return bool Returns true if the command is valid in state.
+   */
+  static bool acceptsCommand(StatesEnum state, CmdEnum command);
+
 private:
+  /** Number of state duration slots, indexed by StatesEnum value. */
+  static const size_t STATE_DURATION_SLOTS = static_cast<size_t>(StatesEnum::COMPLETE) + 1;
+
+  /**
+   * @brief Durations of the states that have been left, with running sums so snapshots do not iterate the states.
+   *
+   */
+  struct StateDurations
+  {
+    std::array<double, STATE_DURATION_SLOTS> closed;  /** time spent in each state before its current entry */
+    double total = 0.0;                               /** sum of closed */
+    double downtime = 0.0;                            /** sum of closed for the stopped, suspended and aborted states */
+
+    StateDurations()
+    {
+      clear();
+    }
+
+    void clear()
+    {
+      closed.fill(0.0);
+      total = 0.0;
+      downtime = 0.0;
+    }
+  };
+
   std::map<int16_t, PackmlStatsItemized> itemized_error_map_;              /** count and duration of error items */
   std::map<int16_t, PackmlStatsItemized> incremental_itemized_error_map_;  /** count and duration of error items for incremental stats */
   std::map<int16_t, PackmlStatsItemized> itemized_quality_map_;            /** count and duration of quality items */
@@ -500,10 +846,11 @@ private:
   float ideal_cycle_time_ = 0.0;                                           /** ideal cycle time in operations per second */
   std::recursive_mutex stat_mutex_;                                        /** stat mutex for protecting stat operations */
   StatesEnum current_state_ = StatesEnum::UNDEFINED;                       /** cache of the current state */
-  std::map<StatesEnum, float> duration_map_;                               /** container for all of the durations referenced by their state id */
-  std::map<StatesEnum, float> incremental_duration_map_;                   /** container for all of the durations referenced by their state id for incremental stats */
+  StateDurations durations_;                                               /** durations of the states that have been left */
+  StateDurations incremental_durations_;                                   /** durations of the states that have been left for incremental stats */
   std::chrono::steady_clock::time_point start_time_;                       /** start time for the latest state entry */
   std::chrono::steady_clock::time_point incremental_start_time_;           /** start time for the latest state entry for incremental stats */
+  std::shared_ptr<Clock> clock_;                                           /** clock for all timing, steady clock if null */
 
   /**
    * @brief adds or updates the specific itemized map
@@ -513,6 +860,11 @@ private:
    * @param step the amount to increment by.
    * @param duration the duration to add.
    */
+  /**
+   * @brief Applies a single stat increment. Caller must hold the stats lock.
+   */
+  bool applyStatIncrement(const StatIncrement& increment);
+
   void incrementMapStatItem(std::map<int16_t, PackmlStatsItemized>& itemized_map, int16_t id, float step,
                             float duration);
 
@@ -547,5 +899,29 @@ private:
    * @return double Returns the total time spent in the state machine.
    */
   double calculateTotalTime(bool is_incremental=false);
+
+  /**
+   * @brief Adds time to the given state's closed duration and the running sums.
+   *
+   * @param durations The durations to update.
+   * @param state The state the time was spent in.
+   * @param duration The time in seconds.
+   */
+  static void addStateDuration(StateDurations& durations, StatesEnum state, double duration);
+
+  /**
+   * @brief Fills a snapshot from durations, counts and a single reading of the clock.
+   *
+   */
+  void fillSnapshot(const StateDurations& durations, Clock::TimePoint start_time, int success_count,
+                    int failure_count, PackmlStatsSnapshot& snapshot_out);
+
+  /**
+   * @brief Checks whether the command is valid in the current state, logging a warning if it is not.
+   *
+   * @param command The command to check.
+   * @return bool Returns true if the command is valid in the current state.
+   */
+  bool acceptsCommand(CmdEnum command);
 };
 }
@@ -23,9 +23,14 @@
 #include "packml_sm/boost/packml_transitions_continuous.h"
 #include "packml_sm/boost/packml_transitions_single_cycle.h"
 #include "packml_sm/boost/state_machine_event_loop.h"
+#include "packml_sm/boost/state_method_supervisor.h"
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <map>
 #include <functional>
+#include <mutex>
 #include <boost/msm/back/state_machine.hpp>
 #include <boost/msm/front/state_machine_def.hpp>
 #include <boost/msm/front/states.hpp>
@@ -52,7 +57,30 @@ public:
   virtual bool setUnsuspending(std::function<int()> state_method) override;
   virtual bool setHolding(std::function<int()> state_method) override;
   virtual bool setUnholding(std::function<int()> state_method) override;
+  virtual bool setStarting(ContextStateMethod state_method) override;
+  virtual bool setExecute(ContextStateMethod state_method) override;
+  virtual bool setCompleting(ContextStateMethod state_method) override;
+  virtual bool setAborting(ContextStateMethod state_method) override;
+  virtual bool setClearing(ContextStateMethod state_method) override;
+  virtual bool setStopping(ContextStateMethod state_method) override;
+  virtual bool setResetting(ContextStateMethod state_method) override;
+  virtual bool setSuspending(ContextStateMethod state_method) override;
+  virtual bool setUnsuspending(ContextStateMethod state_method) override;
+  virtual bool setHolding(ContextStateMethod state_method) override;
+  virtual bool setUnholding(ContextStateMethod state_method) override;
+  virtual bool setStarting(AsyncStateMethod state_method) override;
+  virtual bool setExecute(AsyncStateMethod state_method) override;
+  virtual bool setCompleting(AsyncStateMethod state_method) override;
+  virtual bool setAborting(AsyncStateMethod state_method) override;
+  virtual bool setClearing(AsyncStateMethod state_method) override;
+  virtual bool setStopping(AsyncStateMethod state_method) override;
+  virtual bool setResetting(AsyncStateMethod state_method) override;
+  virtual bool setSuspending(AsyncStateMethod state_method) override;
+  virtual bool setUnsuspending(AsyncStateMethod state_method) override;
+  virtual bool setHolding(AsyncStateMethod state_method) override;
+  virtual bool setUnholding(AsyncStateMethod state_method) override;
   virtual bool isActive() override;
+  virtual void setClock(std::shared_ptr<Clock> clock) override;
 
   template <typename EventType>
   void triggerEvent(EventType evt)
@@ -60,6 +88,103 @@ public:
     boost_fsm_.process_event(evt);
   }
 
+  /**
+   * @brief Switches between the event loop thread (the default) and manual driving through step(). In manual mode
+   * state methods run inline in step() instead of on their own threads, so they must queue events with
+   * enqueueEvent() rather than trigger them. Asynchronous state methods are launched as usual.
+   *
+   * @param manual True for manual driving.
+   * @return bool Returns false if the state machine is active.
+   */
+  bool setManualDrive(bool manual);
+
+  /**
+   * @brief Accessor for the drive mode.
+   *
+   * @return bool Returns true in manual mode.
+   */
+  bool isManualDrive();
+
+  /**
+   * @brief Performs one event loop update on the calling thread: advances the deadline timers, processes the queued
+   * events and then runs the current state's method if it has not run yet. Manual mode only.
+   *
+   * @return bool Returns true if an event was processed or a state method ran.
+   */
+  bool step();
+
+  /**
+   * @brief Calls step() until there is nothing left to do.
+   *
+   * @param max_steps Upper bound on the steps, for state methods that keep queueing events.
+   * @return size_t The number of steps that did work.
+   */
+  size_t runUntilIdle(size_t max_steps = 10000);
+
+  /**
+   * @brief Queues an event for the event loop thread. Safe to call from any thread.
+   *
+   * @param evt The event to process on the next update.
+   */
+  template <typename EventType>
+  void enqueueEvent(EventType evt)
+  {
+    enqueueEvent(evt, nullptr);
+  }
+
+  /**
+   * @brief Accessor for the number of events waiting for the event loop thread.
+   *
+   * @return size_t The number of queued events.
+   */
+  size_t getEventQueueDepth();
+
+  /**
+   * @brief Accessor for the number of events that had no transition in the state they were processed in.
+   *
+   * @return uint64_t The number of dropped events since construction.
+   */
+  uint64_t getDroppedEventCount();
+
+  /**
+   * @brief Sets a function that receives the time each queued event waited before it was dispatched. Called on the
+   * event loop thread.
+   *
+   * @param observer The function to call, or nullptr to stop observing.
+   */
+  void setEventDispatchObserver(std::function<void(std::chrono::steady_clock::duration)> observer);
+
+  /**
+   * @brief Sets the deadline and exit behavior of the given state's method.
+   *
+   * @param state The state to configure.
+   * @param policy The deadline and exit timeout for the state method.
+   * @return bool Returns true on success.
+   */
+  bool setStateMethodPolicy(StatesEnum state, const StateMethodPolicy& policy);
+
+  /**
+   * @brief Sets the deadline and exit behavior of every state method.
+   *
+   * @param policy The deadline and exit timeout for the state methods.
+   */
+  void setStateMethodPolicy(const StateMethodPolicy& policy);
+
+  /**
+   * @brief Sets the maximum number of state methods allowed to finish in the background after their state exits.
+   * Exiting a state over the quota still does not wait for its method, but raises error_event.
+   *
+   * @param quota The maximum number of background state methods.
+   */
+  void setBackgroundQuota(size_t quota);
+
+  /**
+   * @brief Accessor for the number of state methods still running after their state exited.
+   *
+   * @return size_t The number of background state methods.
+   */
+  size_t getBackgroundStateMethodCount();
+
 protected:
   PackmlStateMachine();
 
@@ -72,17 +197,58 @@ protected:
   virtual void _unsuspend() override;
   virtual void _stop() override;
   virtual void _abort() override;
+  virtual void _command(CmdEnum command, CommandCallback on_complete) override;
+  virtual size_t _commandSequence(const std::vector<SequenceStep>& steps, SequenceCallback on_complete) override;
 
 private:
+  struct QueuedEvent
+  {
+    std::chrono::steady_clock::time_point enqueue_time;
+    std::function<bool()> dispatch;  /** processes the event, returns true if it caused a transition */
+    CommandCallback on_complete;     /** outcome of a command, may be nullptr */
+  };
+
   bool is_active_ = false;
 
   boost::msm::back::state_machine<T> boost_fsm_;
+  StateMethodSupervisor supervisor_;
   StateMachineEventLoop event_loop_;
+  Clock::TimePoint last_update_time_;
+  std::deque<QueuedEvent> event_queue_;
+  std::mutex event_queue_mutex_;
+  std::function<void(std::chrono::steady_clock::duration)> dispatch_observer_;
+  std::atomic<uint64_t> dropped_event_count_;
 
   bool setStateMethod(StatesEnum state, std::function<int()> state_method);
-  void sendCommand(CmdEnum command);
+  bool setStateMethod(StatesEnum state, ContextStateMethod state_method);
+  bool setStateMethod(StatesEnum state, AsyncStateMethod state_method);
+  void sendCommand(CmdEnum command, CommandCallback on_complete = nullptr);
+  void cancelQueuedEvents();
+
+  bool makeQueuedStep(const SequenceStep& step, CommandCallback on_complete, QueuedEvent& queued_out);
+
+  template <typename EventType>
+  QueuedEvent makeQueuedEvent(EventType evt, CommandCallback on_complete)
+  {
+    QueuedEvent queued;
+    queued.enqueue_time = std::chrono::steady_clock::now();
+    queued.dispatch = [this, evt]() { return boost_fsm_.process_event(evt) == boost::msm::back::HANDLED_TRUE; };
+    queued.on_complete = on_complete;
+    return queued;
+  }
+
+  template <typename EventType>
+  void enqueueEvent(EventType evt, CommandCallback on_complete)
+  {
+    QueuedEvent queued = makeQueuedEvent(evt, on_complete);
+    std::lock_guard<std::mutex> lock(event_queue_mutex_);
+    event_queue_.push_back(std::move(queued));
+  }
   void handleStateChanged(StateChangeNotifier& state_machine, const StateChangedEventArgs& args);
+  void handleNoTransition(StateChangeNotifier& state_machine, const StateChangedEventArgs& args);
+  void handleStateMethodOverrun(StatesEnum state);
   void update(StateMachineEventLoop& event_loop, const EventArgs& args);
+  bool processUpdate();
   PackmlState* getPackmlState(StatesEnum state);
 };
 
@@ -17,14 +17,20 @@
  */
 #pragma once
 
+#include "packml_sm/clock.h"
 #include "packml_sm/common.h"
 #include "packml_sm/dlog.h"
 #include "packml_sm/state_change_notifier.h"
+#include "packml_sm/state_method_context.h"
 #include "packml_sm/boost/packml_events.h"
+#include "packml_sm/boost/state_method_supervisor.h"
 
 #include <boost/msm/front/state_machine_def.hpp>
 #include <boost/msm/back/state_machine.hpp>
+#include <atomic>
 #include <future>
+#include <memory>
+#include <mutex>
 
 namespace packml_sm
 {
@@ -35,23 +41,105 @@ public:
   virtual StatesEnum stateId() = 0;
 
   void setStateMethod(std::function<int()> state_method)
+  {
+    if (state_method != nullptr)
+    {
+      setStateMethod(std::function<int(StateMethodContext&)>(
+          [state_method](StateMethodContext&) { return state_method(); }));
+    }
+    else
+    {
+      setStateMethod(std::function<int(StateMethodContext&)>());
+    }
+  }
+
+  void setStateMethod(std::function<int(StateMethodContext&)> state_method)
   {
     state_method_ = state_method;
+    async_method_ = nullptr;
+  }
+
+  void setStateMethod(AsyncStateMethod::Launcher state_method)
+  {
+    state_method_ = nullptr;
+    async_method_ = state_method;
+  }
+
+  static std::future<void> launchAsyncMethod(AsyncStateMethod::Launcher state_method,
+                                             std::shared_ptr<StateMethodContext> context,
+                                             std::shared_ptr<std::atomic<bool>> method_done)
+  {
+    // Completion is reported through a future so on_exit treats asynchronous methods like threaded ones.
+    auto finished = std::make_shared<std::promise<void>>();
+    auto future = finished->get_future();
+    state_method(context, [method_done, finished](int) {
+      *method_done = true;
+      finished->set_value();
+    });
+
+    return future;
+  }
+
+  void setStateMethodPolicy(const StateMethodPolicy& policy)
+  {
+    policy_ = policy;
+  }
+
+  void setSupervisor(StateMethodSupervisor* supervisor)
+  {
+    supervisor_ = supervisor;
+  }
+
+  void setClock(std::shared_ptr<Clock> clock)
+  {
+    clock_ = clock;
+  }
+
+  void setInlineStateMethods(bool inline_methods)
+  {
+    inline_methods_ = inline_methods;
+  }
+
+  /**
+   * @brief Runs the state method on the calling thread if it is inline and has not run yet.
+   *
+   * @return bool Returns true if the state method ran.
+   */
+  bool runInlineStateMethod()
+  {
+    if (!isDeferred())
+    {
+      return false;
+    }
+
+    state_method_future_.wait();
+    return true;
   }
 
-  template <class FSM>
-  void runStateMethod(FSM* state_machine_ptr)
+  void requestStop(CmdEnum command)
   {
-    if (state_method_ != nullptr)
+    std::lock_guard<std::mutex> lock(context_mutex_);
+    if (context_ != nullptr)
     {
-      auto result = state_method_();
+      context_->requestStop(command);
     }
   }
 
+  static void runStateMethod(std::function<int(StateMethodContext&)> state_method,
+                             std::shared_ptr<StateMethodContext> context, std::shared_ptr<std::atomic<bool>> method_done)
+  {
+    if (state_method != nullptr)
+    {
+      auto result = state_method(*context);
+    }
+
+    *method_done = true;
+  }
+
   template <class Event, class FSM>
   void on_entry(Event const& event, FSM& state_machine)
   {
-    start_time_ = std::chrono::steady_clock::now();
+    start_time_ = clock_ != nullptr ? clock_->now() : std::chrono::steady_clock::now();
 
     is_exiting_ = false;
     is_running_ = true;
@@ -63,17 +151,64 @@ public:
 
     DLog::LogInfo("Entering: %s", stateName().c_str());
 
-    state_method_future_ = std::async(
-        std::launch::async, std::bind(&PackmlState::runStateMethod<FSM>, this, std::placeholders::_1), &state_machine);
+    if (hasStateMethod())
+    {
+      auto context = std::make_shared<StateMethodContext>(stateId(), clock_);
+      {
+        std::lock_guard<std::mutex> lock(context_mutex_);
+        context_ = context;
+      }
+
+      // The method is copied into the task so it can safely outlive this state if it is moved to the background.
+      auto method_done = std::make_shared<std::atomic<bool>>(false);
+      if (async_method_ != nullptr)
+      {
+        state_method_future_ = launchAsyncMethod(async_method_, context, method_done);
+      }
+      else
+      {
+        state_method_future_ =
+            std::async(inline_methods_ ? std::launch::deferred : std::launch::async, &PackmlState::runStateMethod,
+                       state_method_, context, method_done);
+      }
+      scheduleDeadline(method_done);
+    }
   }
 
   template <class Event, class FSM>
   void on_exit(Event const& event, FSM& state_machine)
   {
     is_exiting_ = true;
+    requestStop(CmdEnum::NO_COMMAND);
+    if (supervisor_ != nullptr && deadline_timer_ != TimerWheel::INVALID_TIMER)
+    {
+      supervisor_->timers().cancel(deadline_timer_);
+      deadline_timer_ = TimerWheel::INVALID_TIMER;
+    }
+
     if (state_method_future_.valid())
     {
-      state_method_future_.get();
+      // An inline method that has not run yet runs here, with the stop already requested.
+      bool finished = true;
+      if (policy_.exit_timeout.count() >= 0 && !isDeferred())
+      {
+        finished = state_method_future_.wait_for(policy_.exit_timeout) == std::future_status::ready;
+      }
+
+      if (finished || supervisor_ == nullptr)
+      {
+        state_method_future_.get();
+      }
+      else if (!supervisor_->detach(stateName(), state_method_future_))
+      {
+        // Exiting stays bounded, but too many methods have outlived their states, so treat it as a fault.
+        supervisor_->notifyOverrun(stateId());
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(context_mutex_);
+      context_.reset();
     }
 
     is_running_ = false;
@@ -84,10 +219,49 @@ private:
   std::atomic<bool> is_running_;
   std::atomic<bool> is_exiting_;
   std::string state_name_;
-  std::function<int()> state_method_;
+  std::function<int(StateMethodContext&)> state_method_;
+  AsyncStateMethod::Launcher async_method_;
+  std::shared_ptr<StateMethodContext> context_;
+  std::mutex context_mutex_;
   std::future<void> state_method_future_;
   std::chrono::steady_clock::time_point start_time_;
   double cummulative_time_ = 0.0f;
+  StateMethodPolicy policy_;
+  StateMethodSupervisor* supervisor_ = nullptr;
+  std::shared_ptr<Clock> clock_;
+  TimerWheel::TimerId deadline_timer_ = TimerWheel::INVALID_TIMER;
+  bool inline_methods_ = false;
+
+  bool hasStateMethod() const
+  {
+    return state_method_ != nullptr || async_method_ != nullptr;
+  }
+
+  bool isDeferred() const
+  {
+    return state_method_future_.valid() &&
+           state_method_future_.wait_for(std::chrono::seconds(0)) == std::future_status::deferred;
+  }
+
+  void scheduleDeadline(std::shared_ptr<std::atomic<bool>> method_done)
+  {
+    if (supervisor_ == nullptr || !hasStateMethod() || policy_.deadline.count() <= 0)
+    {
+      return;
+    }
+
+    StateMethodSupervisor* supervisor = supervisor_;
+    StatesEnum state_id = stateId();
+    std::string state_name = stateName();
+    deadline_timer_ =
+        supervisor_->timers().schedule(policy_.deadline, [supervisor, state_id, state_name, method_done]() {
+          if (!*method_done)
+          {
+            DLog::LogError("%s state method exceeded its deadline", state_name.c_str());
+            supervisor->notifyOverrun(state_id);
+          }
+        });
+  }
 };
 
 struct Aborted_impl : public PackmlState
@@ -34,8 +34,11 @@ public:
   typedef Aborted_impl initial_state;
 
   template <class FSM, class Event>
-  void no_transition(Event const&, FSM&, int)
+  void no_transition(Event const&, FSM& state_machine, int state)
   {
+    // Every state derives from PackmlState, the cast is needed because the msm base state is not polymorphic.
+    auto packml_state = static_cast<PackmlState*>(state_machine.get_state_by_id(state));
+    handleNoTransitionNotify(packml_state->stateName(), packml_state->stateId());
   }
 
   struct transition_table
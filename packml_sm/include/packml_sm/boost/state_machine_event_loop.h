@@ -35,9 +35,20 @@ public:
   void start();
   void stop();
 
+  /**
+   * @brief In manual mode start() does not spawn the update thread and the owner drives the updates itself. Only
+   * takes effect on the next start().
+   *
+   * @param manual True to disable the update thread.
+   */
+  void setManual(bool manual);
+
+  bool isManual() const;
+
 private:
   std::unique_ptr<std::thread> thread_;
   std::atomic<bool> stop_thread_;
+  std::atomic<bool> manual_;
   int interval_;
 
   void updateLoop();
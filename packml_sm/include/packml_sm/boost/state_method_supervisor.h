@@ -0,0 +1,137 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/common.h"
+#include "packml_sm/timer_wheel.h"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace packml_sm
+{
+/**
+ * @brief Per state limits on how long a state method may run.
+ *
+ */
+struct StateMethodPolicy
+{
+  /** Maximum run time of the state method. Overrunning it raises error_event. Zero disables the deadline. */
+  std::chrono::milliseconds deadline = std::chrono::milliseconds(0);
+
+  /**
+   * Maximum time on_exit waits for the state method before handing it to the background pool. Negative waits
+   * forever (the original behavior), zero lets the state exit immediately.
+   */
+  std::chrono::milliseconds exit_timeout = std::chrono::milliseconds(-1);
+};
+
+/**
+ * @brief Owns the deadline timers and the background state methods of a single state machine.
+ *
+ */
+class StateMethodSupervisor
+{
+public:
+  /**
+   * @brief Constructor for StateMethodSupervisor.
+   *
+   * @param background_quota Maximum number of state methods allowed to finish in the background.
+   */
+  StateMethodSupervisor(size_t background_quota = 4);
+
+  /**
+   * @brief Destructor for StateMethodSupervisor. Waits a bounded time for the background state methods and
+   * abandons the ones still running.
+   *
+   */
+  ~StateMethodSupervisor();
+
+  /**
+   * @brief Accessor for the timer wheel used for state method deadlines.
+   *
+   * @return TimerWheel& The deadline timer wheel.
+   */
+  TimerWheel& timers()
+  {
+    return timers_;
+  }
+
+  /**
+   * @brief Sets the function invoked when a state method overruns its deadline.
+   *
+   * @param handler Called with the state whose method overran.
+   */
+  void setOverrunHandler(std::function<void(StatesEnum)> handler);
+
+  /**
+   * @brief Reports a deadline overrun to the overrun handler.
+   *
+   * @param state The state whose method overran.
+   */
+  void notifyOverrun(StatesEnum state);
+
+  /**
+   * @brief Moves a still running state method to the background pool. The method is always taken, so leaving a
+   * state never waits on it.
+   *
+   * @param state_name Name of the state the method belongs to, used for logging.
+   * @param future The future of the running state method.
+   * @return bool Returns false if the method exceeded the background quota.
+   */
+  bool detach(const std::string& state_name, std::future<void>& future);
+
+  /**
+   * @brief Releases background state methods that have finished.
+   *
+   * @return size_t The number of state methods still running in the background.
+   */
+  size_t reap();
+
+  /**
+   * @brief Accessor for the number of state methods running in the background.
+   *
+   * @return size_t The number of state methods still running in the background.
+   */
+  size_t backgroundCount();
+
+  /**
+   * @brief Sets the maximum number of state methods allowed to finish in the background.
+   *
+   * @param quota The new quota.
+   */
+  void setBackgroundQuota(size_t quota);
+
+private:
+  struct BackgroundMethod
+  {
+    std::string state_name;
+    std::future<void> future;
+  };
+
+  TimerWheel timers_;                                /** deadline timers for the active state methods */
+  std::function<void(StatesEnum)> overrun_handler_;  /** raises the error event on the owning state machine */
+  std::list<BackgroundMethod> background_;           /** state methods that outlived their state */
+  size_t background_quota_;                          /** size of background_ above which detaching is an error */
+  std::mutex mutex_;                                 /** protects the handler, background_ and the quota */
+};
+}  // namespace packml_sm
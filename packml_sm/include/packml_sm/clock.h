@@ -0,0 +1,96 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+namespace packml_sm
+{
+/**
+ * @brief Source of time for the state machine stats and state timing.
+ *
+ * Time points share the steady clock's representation so that durations can be mixed freely. State machines without
+ * a clock read std::chrono::steady_clock directly.
+ */
+class Clock
+{
+public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  typedef std::chrono::steady_clock::duration Duration;
+
+  virtual ~Clock()
+  {
+  }
+
+  /**
+   * @brief Override to provide the current time.
+   *
+   * @return TimePoint The current time.
+   */
+  virtual TimePoint now() const = 0;
+};
+
+/**
+ * @brief Clock backed by std::chrono::steady_clock.
+ *
+ */
+class SteadyClock : public Clock
+{
+public:
+  virtual TimePoint now() const override
+  {
+    return std::chrono::steady_clock::now();
+  }
+};
+
+/**
+ * @brief Virtual clock that only moves when told to, for simulations, replays and tests.
+ *
+ */
+class ManualClock : public Clock
+{
+public:
+  /**
+   * @brief Constructor for ManualClock.
+   *
+   * @param start The initial time.
+   */
+  explicit ManualClock(TimePoint start = TimePoint());
+
+  virtual TimePoint now() const override;
+
+  /**
+   * @brief Moves the clock forward.
+   *
+   * @param duration The amount of time to add. Negative durations are ignored so the clock never runs backwards.
+   */
+  void advance(Duration duration);
+
+  /**
+   * @brief Moves the clock to the given time.
+   *
+   * @param time The new time. Times before the current time are ignored.
+   */
+  void set(TimePoint time);
+
+private:
+  TimePoint now_;             /** current virtual time */
+  mutable std::mutex mutex_;  /** protects now_ */
+};
+}  // namespace packml_sm
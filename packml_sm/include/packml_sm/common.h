@@ -86,6 +86,13 @@ enum class CmdEnum : int
   CLEAR=9
 };
 
+enum class CmdResultEnum : int
+{
+  COMPLETED=0,
+  REJECTED=1,
+  CANCELLED=2
+};
+
 enum class EventsEnum : int
 {
   UNDEFINED=0,
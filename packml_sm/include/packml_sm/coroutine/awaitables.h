@@ -0,0 +1,186 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/coroutine/state_task.h"
+#include "packml_sm/state_method_context.h"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace packml_sm
+{
+namespace detail
+{
+/**
+ * @brief Resumes a suspended state method exactly once, whichever of its wake up sources fires first.
+ *
+ */
+class Waiter
+{
+public:
+  explicit Waiter(StateTask::Handle handle);
+
+  /**
+   * @brief Posts the coroutine back to its executor unless it has already been woken.
+   *
+   * @param result The value returned from the co_await expression.
+   * @return bool Returns true if this call resumed the coroutine.
+   */
+  bool wake(bool result);
+
+  bool woken() const
+  {
+    return woken_;
+  }
+
+  bool result() const
+  {
+    return result_;
+  }
+
+private:
+  std::atomic<bool> woken_;
+  bool result_ = false;
+  StateTask::Handle handle_;
+};
+}  // namespace detail
+
+/**
+ * @brief Awaitable returned by sleepFor().
+ *
+ */
+class SleepAwaiter
+{
+public:
+  SleepAwaiter(StateMethodContext& context, std::chrono::nanoseconds duration);
+
+  bool await_ready() const
+  {
+    return context_.stopRequested();
+  }
+
+  void await_suspend(StateTask::Handle handle);
+  bool await_resume();
+
+private:
+  StateMethodContext& context_;
+  std::chrono::nanoseconds duration_;
+  std::shared_ptr<detail::Waiter> waiter_;
+};
+
+/**
+ * @brief Suspends a coroutine state method for the given time.
+ *
+ * @param context The context of the state method.
+ * @param duration Time to sleep. Zero lets other coroutines on the executor run first.
+ * @return SleepAwaiter Awaitable yielding true after the full duration, or false as soon as a stop is requested.
+ */
+SleepAwaiter sleepFor(StateMethodContext& context, std::chrono::nanoseconds duration);
+
+/**
+ * @brief Awaitable returned by waitForStop().
+ *
+ */
+class StopAwaiter
+{
+public:
+  explicit StopAwaiter(StateMethodContext& context);
+
+  bool await_ready() const
+  {
+    return context_.stopRequested();
+  }
+
+  void await_suspend(StateTask::Handle handle);
+  void await_resume();
+
+private:
+  StateMethodContext& context_;
+  std::shared_ptr<detail::Waiter> waiter_;
+};
+
+/**
+ * @brief Suspends a coroutine state method until its state is about to be left.
+ *
+ * @param context The context of the state method.
+ * @return StopAwaiter Awaitable that completes once a stop is requested.
+ */
+StopAwaiter waitForStop(StateMethodContext& context);
+
+/**
+ * @brief Manual reset event that coroutine state methods can await, e.g. "gripper closed".
+ *
+ * set() may be called from any thread. Waiting coroutines are resumed on their executor.
+ */
+class AsyncEvent
+{
+public:
+  class Awaiter
+  {
+  public:
+    Awaiter(AsyncEvent& event, StateMethodContext& context);
+
+    bool await_ready();
+    bool await_suspend(StateTask::Handle handle);
+    bool await_resume();
+
+  private:
+    AsyncEvent& event_;
+    StateMethodContext& context_;
+    bool ready_result_ = false;
+    std::shared_ptr<detail::Waiter> waiter_;
+  };
+
+  /**
+   * @brief Sets the event and resumes every waiting coroutine.
+   *
+   */
+  void set();
+
+  /**
+   * @brief Clears the event so that later waits suspend again.
+   *
+   */
+  void reset();
+
+  /**
+   * @brief Accessor for whether the event is set.
+   *
+   * @return bool Returns true if the event is set.
+   */
+  bool isSet() const;
+
+  /**
+   * @brief Waits for the event to be set.
+   *
+   * @param context The context of the waiting state method.
+   * @return Awaiter Awaitable yielding true once the event is set, or false as soon as a stop is requested.
+   */
+  Awaiter wait(StateMethodContext& context);
+
+private:
+  mutable std::mutex mutex_;                               /** protects is_set_ and waiters_ */
+  bool is_set_ = false;                                    /** current state of the event */
+  std::vector<std::shared_ptr<detail::Waiter>> waiters_;   /** coroutines suspended on the event */
+};
+}  // namespace packml_sm
@@ -0,0 +1,133 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace packml_sm
+{
+/**
+ * @brief Single threaded executor that resumes coroutine state methods.
+ *
+ * All work posted to an executor runs on its one worker thread, in posting order for immediate work and in expiry
+ * order for timed work. Coroutine state methods of any number of state machines can share one executor, so a
+ * suspended method costs its coroutine frame instead of a thread.
+ */
+class CoroutineExecutor
+{
+public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  /**
+   * @brief Constructor for CoroutineExecutor. Starts the worker thread.
+   *
+   */
+  CoroutineExecutor();
+
+  /**
+   * @brief Destructor for CoroutineExecutor. Stops and joins the worker thread, dropping pending work and destroying
+   * the frames of the coroutines that have not finished.
+   *
+   */
+  ~CoroutineExecutor();
+
+  CoroutineExecutor(const CoroutineExecutor&) = delete;
+  CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+
+  /**
+   * @brief Accessor for the process wide executor used by the state machines.
+   *
+   * @return CoroutineExecutor& The shared executor.
+   */
+  static CoroutineExecutor& defaultExecutor();
+
+  /**
+   * @brief Queues work to run on the worker thread as soon as possible.
+   *
+   * @param work The function to run.
+   */
+  void post(std::function<void()> work);
+
+  /**
+   * @brief Queues work to run on the worker thread once the given time has passed.
+   *
+   * @param when The earliest time to run the work.
+   * @param work The function to run.
+   */
+  void postAt(TimePoint when, std::function<void()> work);
+
+  /**
+   * @brief Takes ownership of a coroutine frame until release(), so it is destroyed with the executor if it never
+   * finishes.
+   *
+   * @param handle The coroutine to track.
+   */
+  void adopt(std::coroutine_handle<> handle);
+
+  /**
+   * @brief Gives up ownership of a coroutine frame, called once the coroutine has finished.
+   *
+   * @param handle The coroutine to stop tracking.
+   */
+  void release(std::coroutine_handle<> handle);
+
+  /**
+   * @brief Accessor for whether the caller runs on the worker thread.
+   *
+   * @return bool Returns true when called from the worker thread.
+   */
+  bool isExecutorThread() const;
+
+private:
+  struct Timer
+  {
+    TimePoint when;
+    uint64_t sequence;
+    std::function<void()> work;
+  };
+
+  struct TimerCompare
+  {
+    bool operator()(const Timer& lhs, const Timer& rhs) const
+    {
+      return lhs.when > rhs.when || (lhs.when == rhs.when && lhs.sequence > rhs.sequence);
+    }
+  };
+
+  std::mutex mutex_;                                                      /** protects the queues, frames_, stopping_ */
+  std::condition_variable condition_;                                     /** wakes the worker for new work */
+  std::deque<std::function<void()>> ready_;                               /** work that can run immediately */
+  std::priority_queue<Timer, std::vector<Timer>, TimerCompare> timers_;   /** work waiting for its time */
+  uint64_t next_sequence_ = 0;                                            /** keeps equal expiries in post order */
+  std::set<void*> frames_;                                                /** addresses of the unfinished coroutines */
+  bool stopping_ = false;                                                 /** set when the worker should exit */
+  std::thread thread_;                                                    /** the worker thread */
+
+  void run();
+};
+}  // namespace packml_sm
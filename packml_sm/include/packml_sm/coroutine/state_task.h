@@ -0,0 +1,182 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/coroutine/coroutine_executor.h"
+#include "packml_sm/dlog.h"
+#include "packml_sm/state_method_context.h"
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <utility>
+
+namespace packml_sm
+{
+/**
+ * @brief Return type of coroutine state methods.
+ *
+ * A StateTask is created suspended. start() hands the coroutine to an executor, which from then on owns the frame
+ * and destroys it when the coroutine finishes, or when the executor is destroyed first. Tasks that are never started
+ * are destroyed with the StateTask.
+ */
+class StateTask
+{
+public:
+  struct promise_type
+  {
+    int result = 0;                                /** value passed to co_return */
+    CoroutineExecutor* executor = nullptr;         /** executor the coroutine is resumed on */
+    std::function<void(int)> on_complete;          /** called with the result once the frame is gone */
+
+    struct FinalAwaiter
+    {
+      bool await_ready() const noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+      {
+        auto on_complete = std::move(handle.promise().on_complete);
+        int result = handle.promise().result;
+        handle.promise().executor->release(handle);
+        handle.destroy();
+        if (on_complete != nullptr)
+        {
+          on_complete(result);
+        }
+      }
+
+      void await_resume() const noexcept
+      {
+      }
+    };
+
+    StateTask get_return_object()
+    {
+      return StateTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() const noexcept
+    {
+      return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept
+    {
+      return {};
+    }
+
+    void return_value(int value)
+    {
+      result = value;
+    }
+
+    void unhandled_exception()
+    {
+      // There is no future to carry the exception, so it is reported here and the state method fails.
+      result = -1;
+      try
+      {
+        throw;
+      }
+      catch (const std::exception& ex)
+      {
+        DLog::LogError("Coroutine state method threw: %s", ex.what());
+      }
+      catch (...)
+      {
+        DLog::LogError("Coroutine state method threw an unknown exception");
+      }
+    }
+  };
+
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  StateTask(StateTask&& other) noexcept : handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+
+  StateTask& operator=(StateTask&& other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  StateTask(const StateTask&) = delete;
+  StateTask& operator=(const StateTask&) = delete;
+
+  ~StateTask()
+  {
+    reset();
+  }
+
+  /**
+   * @brief Schedules the coroutine on the executor and gives up ownership of it.
+   *
+   * @param executor The executor to run the coroutine on.
+   * @param on_complete Called on the executor thread with the co_return value once the coroutine has finished.
+   * @return bool Returns false if the task holds no coroutine.
+   */
+  bool start(CoroutineExecutor& executor, std::function<void(int)> on_complete)
+  {
+    if (!handle_)
+    {
+      return false;
+    }
+
+    Handle handle = std::exchange(handle_, nullptr);
+    handle.promise().executor = &executor;
+    handle.promise().on_complete = on_complete;
+    executor.adopt(handle);
+    executor.post([handle]() { handle.resume(); });
+    return true;
+  }
+
+private:
+  Handle handle_;
+
+  explicit StateTask(Handle handle) : handle_(handle)
+  {
+  }
+
+  void reset()
+  {
+    if (handle_)
+    {
+      handle_.destroy();
+      handle_ = nullptr;
+    }
+  }
+};
+
+/**
+ * @brief Adapts a coroutine to the asynchronous state method setters.
+ *
+ * @param state_method The coroutine to run each time the state is entered.
+ * @param executor The executor that runs the coroutine, shared by all state machines by default.
+ * @return AsyncStateMethod The wrapped state method, e.g. for PackmlStateMachine::setExecute().
+ */
+AsyncStateMethod coroutineStateMethod(std::function<StateTask(StateMethodContext&)> state_method,
+                                      CoroutineExecutor& executor = CoroutineExecutor::defaultExecutor());
+}  // namespace packml_sm
@@ -0,0 +1,256 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/common.h"
+#include "packml_sm/packml_stats_snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+namespace packml_sm
+{
+/**
+ * @brief A single itemized stat as stored in shared memory.
+ *
+ */
+struct ShmStatsItem
+{
+  int16_t id;         /** item id */
+  int16_t padding;    /** unused, keeps the layout explicit */
+  uint32_t padding2;  /** unused, keeps the layout explicit */
+  double count;       /** item count */
+  double duration;    /** item duration */
+};
+
+/**
+ * @brief State and stats as stored in shared memory. Copied in and out as a whole under the seqlock.
+ *
+ */
+struct ShmStatsPayload
+{
+  static const uint32_t MAX_ITEMS = 64;
+
+  int64_t stamp_ns;                          /** system clock time of the update in nanoseconds since the epoch */
+  int32_t state;                             /** current StatesEnum */
+  int32_t cycle_count;                       /** total cycle count */
+  int32_t success_count;                     /** total success count */
+  int32_t fail_count;                        /** total fail count */
+  double duration;                           /** duration over which the stats were captured */
+  double idle_duration;                      /** time spent in the idle state */
+  double exe_duration;                       /** time spent in the execute state */
+  double held_duration;                      /** time spent in the held state */
+  double susp_duration;                      /** time spent in the suspended state */
+  double cmplt_duration;                     /** time spent in the complete state */
+  double stop_duration;                      /** time spent in the stopped state */
+  double abort_duration;                     /** time spent in the aborted state */
+  float throughput;                          /** the computed throughput */
+  float availability;                        /** the computed availability */
+  float performance;                         /** the computed performance */
+  float quality;                             /** the computed quality */
+  float overall_equipment_effectiveness;     /** the computed overall equipment effectiveness */
+  uint32_t error_item_count;                 /** valid entries in error_items */
+  uint32_t quality_item_count;               /** valid entries in quality_items */
+  uint32_t dropped_item_count;               /** itemized stats that did not fit */
+  ShmStatsItem error_items[MAX_ITEMS];       /** itemized error stats, ordered by id */
+  ShmStatsItem quality_items[MAX_ITEMS];     /** itemized quality stats, ordered by id */
+};
+
+/**
+ * @brief Fixed size, versioned layout of the shared memory segment.
+ *
+ * The sequence is a seqlock: it is odd while the exporter is writing and even otherwise, and readers retry when it
+ * changed during their copy. It doubles as the futex word readers sleep on.
+ */
+struct ShmStatsBlock
+{
+  static const uint32_t MAGIC = 0x4c4d4b50;  // "PKML"
+  static const uint32_t VERSION = 1;
+
+  uint32_t magic;                        /** MAGIC once the segment is initialized */
+  uint32_t version;                      /** VERSION of the layout */
+  uint32_t size;                         /** sizeof(ShmStatsBlock) of the writer */
+  std::atomic<uint32_t> sequence;        /** seqlock sequence and futex word */
+  std::atomic<uint32_t> waiters;         /** readers blocked in waitForChange, the writer skips the wake without */
+  uint32_t padding;                      /** unused, aligns the payload */
+  ShmStatsPayload payload;               /** last exported state and stats */
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The shared memory seqlock requires lock free 32 bit atomics");
+static_assert(std::is_standard_layout<ShmStatsBlock>::value, "ShmStatsBlock must have a fixed layout");
+
+/**
+ * @brief A consistent copy of the exported state and stats.
+ *
+ */
+struct ShmStatsSample
+{
+  uint32_t sequence = 0;                                      /** sequence the copy was taken at */
+  std::chrono::system_clock::time_point stamp;                /** time of the update */
+  StatesEnum state = StatesEnum::UNDEFINED;                   /** exported state */
+  PackmlStatsSnapshot stats;                                  /** exported stats */
+  uint32_t dropped_item_count = 0;                            /** itemized stats that did not fit the segment */
+};
+
+/**
+ * @brief Publishes the state and stats of a state machine into a POSIX shared memory segment.
+ *
+ * Local readers (an HMI, a PLC bridge) map the same segment with ShmStatsReader and read it without a ROS round
+ * trip. A single exporter owns a segment. It is created on open() and unlinked on close().
+ */
+class ShmStatsExporter
+{
+public:
+  ShmStatsExporter();
+
+  /**
+   * @brief Destructor for ShmStatsExporter. Closes the segment.
+   *
+   */
+  ~ShmStatsExporter();
+
+  ShmStatsExporter(const ShmStatsExporter&) = delete;
+  ShmStatsExporter& operator=(const ShmStatsExporter&) = delete;
+
+  /**
+   * @brief Creates (or takes over) and maps the segment.
+   *
+   * @param name Segment name, a leading '/' is added when missing.
+   * @return bool Returns false if the segment could not be created or mapped.
+   */
+  bool open(const std::string& name);
+
+  /**
+   * @brief Unmaps and unlinks the segment.
+   *
+   */
+  void close();
+
+  /**
+   * @brief Accessor for the state of the segment.
+   *
+   * @return bool Returns true if a segment is mapped.
+   */
+  bool isOpen() const
+  {
+    return block_ != nullptr;
+  }
+
+  /**
+   * @brief Exports a new state, keeping the previously exported stats.
+   *
+   * @param state The current state.
+   */
+  void publishState(StatesEnum state);
+
+  /**
+   * @brief Exports a new state and stats snapshot.
+   *
+   * @param state The current state.
+   * @param snapshot The current stats.
+   */
+  void publishStats(StatesEnum state, const PackmlStatsSnapshot& snapshot);
+
+private:
+  std::string name_;                  /** name of the mapped segment */
+  ShmStatsBlock* block_ = nullptr;    /** mapped segment */
+  ShmStatsPayload payload_;           /** writer side copy of the exported payload */
+  std::mutex mutex_;                  /** serializes writers */
+
+  /**
+   * @brief Copies payload_ into the segment under the seqlock and wakes blocked readers.
+   */
+  void write();
+};
+
+/**
+ * @brief Maps a segment created by ShmStatsExporter and takes consistent copies of it.
+ *
+ */
+class ShmStatsReader
+{
+public:
+  ShmStatsReader();
+
+  /**
+   * @brief Destructor for ShmStatsReader. Unmaps the segment.
+   *
+   */
+  ~ShmStatsReader();
+
+  ShmStatsReader(const ShmStatsReader&) = delete;
+  ShmStatsReader& operator=(const ShmStatsReader&) = delete;
+
+  /**
+   * @brief Maps an existing segment.
+   *
+   * @param name Segment name, a leading '/' is added when missing.
+   * @return bool Returns false if the segment does not exist or its layout is not compatible.
+   */
+  bool open(const std::string& name);
+
+  /**
+   * @brief Unmaps the segment.
+   *
+   */
+  void close();
+
+  /**
+   * @brief Accessor for the state of the segment.
+   *
+   * @return bool Returns true if a segment is mapped.
+   */
+  bool isOpen() const
+  {
+    return block_ != nullptr;
+  }
+
+  /**
+   * @brief Accessor for the current sequence, cheap enough to poll.
+   *
+   * @return uint32_t The current sequence, 0 if nothing was exported yet.
+   */
+  uint32_t getSequence() const;
+
+  /**
+   * @brief Takes a consistent copy of the segment.
+   *
+   * @param sample_out The copy.
+   * @param max_retries Number of times a copy torn by a concurrent write is retried.
+   * @return bool Returns false if nothing was exported yet or every attempt was torn.
+   */
+  bool read(ShmStatsSample& sample_out, int max_retries = 100) const;
+
+  /**
+   * @brief Blocks until the sequence differs from the given one.
+   *
+   * @param sequence Sequence of the last sample seen.
+   * @param timeout Maximum time to wait.
+   * @return bool Returns true if the sequence changed.
+   */
+  bool waitForChange(uint32_t sequence, std::chrono::milliseconds timeout);
+
+private:
+  ShmStatsBlock* block_ = nullptr;  /** mapped segment */
+};
+}  // namespace packml_sm
@@ -25,10 +25,16 @@ struct StateChangeNotifier
 {
 public:
   EventHandler<StateChangeNotifier, StateChangedEventArgs> stateChangedEvent;
+  EventHandler<StateChangeNotifier, StateChangedEventArgs> noTransitionEvent;
 
   void handleStateChangeNotify(const std::string& state_name, StatesEnum state_id)
   {
     stateChangedEvent.invoke(*this, StateChangedEventArgs(state_name, state_id));
   }
+
+  void handleNoTransitionNotify(const std::string& state_name, StatesEnum state_id)
+  {
+    noTransitionEvent.invoke(*this, StateChangedEventArgs(state_name, state_id));
+  }
 };
 }
@@ -0,0 +1,202 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/clock.h"
+#include "packml_sm/common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace packml_sm
+{
+/**
+ * @brief Read only view of a stop request shared between a state machine and a running state method.
+ *
+ */
+class StopToken
+{
+public:
+  /**
+   * @brief Accessor for whether the state method has been asked to stop.
+   *
+   * @return bool Returns true once a stop has been requested.
+   */
+  bool stopRequested() const;
+
+  /**
+   * @brief Blocks until a stop is requested or the timeout elapses.
+   *
+   * @param timeout Maximum time to wait.
+   * @return bool Returns true if a stop has been requested.
+   */
+  bool waitFor(std::chrono::nanoseconds timeout) const;
+
+private:
+  friend class StateMethodContext;
+
+  struct SharedState
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop_requested = false;
+    CmdEnum command = CmdEnum::NO_COMMAND;
+    std::function<void()> stop_callback;
+  };
+
+  explicit StopToken(std::shared_ptr<SharedState> state);
+
+  std::shared_ptr<SharedState> state_; /** stop request shared with the owning context */
+};
+
+/**
+ * @brief Passed to context aware state methods so they can react to pending transitions.
+ *
+ * A state machine creates one context each time a state is entered. Long running methods should poll
+ * stopRequested() or call yield() between units of work and return as soon as either reports a stop.
+ */
+class StateMethodContext
+{
+public:
+  /**
+   * @brief Constructor for StateMethodContext.
+   *
+   * @param state The state the method runs in.
+   * @param clock The state machine clock, or nullptr for the steady clock. Only timeInState() uses it, yield() always
+   * waits in real time.
+   */
+  explicit StateMethodContext(StatesEnum state, std::shared_ptr<Clock> clock = nullptr);
+
+  /**
+   * @brief Accessor for the state the method runs in.
+   *
+   * @return StatesEnum The state the method runs in.
+   */
+  StatesEnum state() const
+  {
+    return state_;
+  }
+
+  /**
+   * @brief Accessor for the stop token of this state entry.
+   *
+   * @return StopToken A token that can be handed to helper threads.
+   */
+  StopToken stopToken() const
+  {
+    return stop_token_;
+  }
+
+  /**
+   * @brief Accessor for whether the state is about to be left.
+   *
+   * @return bool Returns true once a stop has been requested.
+   */
+  bool stopRequested() const
+  {
+    return stop_token_.stopRequested();
+  }
+
+  /**
+   * @brief Accessor for the command that caused the stop request.
+   *
+   * @return CmdEnum The pending command, or NO_COMMAND if none is pending or the state is left for another reason.
+   */
+  CmdEnum pendingCommand() const;
+
+  /**
+   * @brief Accessor for the time since the state was entered.
+   *
+   * @return Clock::Duration The time spent in the state according to the state machine clock.
+   */
+  Clock::Duration timeInState() const;
+
+  /**
+   * @brief Sleeps until the next period boundary, waking early if a stop is requested.
+   *
+   * Boundaries are measured from the previous call, so a loop calling yield() runs at a fixed rate as long as its
+   * body is shorter than the period.
+   *
+   * @param period The loop period.
+   * @return bool Returns true if the method should keep running, false if a stop has been requested.
+   */
+  bool yield(std::chrono::nanoseconds period);
+
+  /**
+   * @brief Called by the state machine to ask the state method to stop. Only the first request is recorded.
+   *
+   * @param command The command that caused the request.
+   */
+  void requestStop(CmdEnum command = CmdEnum::NO_COMMAND);
+
+  /**
+   * @brief Registers a function to call when a stop is requested, replacing any previous one.
+   *
+   * Used by awaitables that have to wake up a suspended state method. The callback runs on the thread requesting the
+   * stop, or immediately on the calling thread if a stop has already been requested.
+   *
+   * @param callback The function to call, or nullptr to clear the registration.
+   */
+  void setStopCallback(std::function<void()> callback);
+
+private:
+  StatesEnum state_;                                          /** state the method runs in */
+  std::shared_ptr<StopToken::SharedState> shared_state_;      /** stop request shared with the tokens */
+  StopToken stop_token_;                                      /** token handed out to the state method */
+  std::shared_ptr<Clock> clock_;                              /** state machine clock, steady clock if null */
+  Clock::TimePoint entry_time_;                               /** time the state was entered */
+  std::chrono::steady_clock::time_point next_yield_;          /** next boundary used by yield() */
+};
+
+/**
+ * @brief Wraps a state method that takes a StateMethodContext.
+ *
+ * The explicit wrapper keeps the context aware setters from competing with the std::function<int()> overloads for
+ * callables such as std::bind expressions, which accept any number of arguments.
+ */
+struct ContextStateMethod
+{
+  explicit ContextStateMethod(std::function<int(StateMethodContext&)> method) : method(method)
+  {
+  }
+
+  std::function<int(StateMethodContext&)> method;
+};
+
+/**
+ * @brief Wraps a state method that runs asynchronously instead of on a dedicated thread.
+ *
+ * The launcher is called on the state machine thread when the state is entered. It must return promptly and call
+ * on_complete exactly once, from any thread, when the method has finished. The context stays valid for as long as
+ * the launcher keeps the shared pointer.
+ */
+struct AsyncStateMethod
+{
+  typedef std::function<void(std::shared_ptr<StateMethodContext> context, std::function<void(int)> on_complete)>
+      Launcher;
+
+  explicit AsyncStateMethod(Launcher method) : method(method)
+  {
+  }
+
+  Launcher method;
+};
+}  // namespace packml_sm
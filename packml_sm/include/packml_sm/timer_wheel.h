@@ -0,0 +1,129 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace packml_sm
+{
+/**
+ * @brief Hashed timer wheel for scheduling many coarse-grained timeouts.
+ *
+ * The wheel does not read a clock itself. The owner calls advance() with the time that has elapsed since the
+ * previous call, which lets the same wheel run on the steady clock or on a simulated clock. Callbacks are invoked
+ * from within advance() on the calling thread, after the internal lock has been released, so they may schedule or
+ * cancel other timers.
+ */
+class TimerWheel
+{
+public:
+  typedef uint64_t TimerId;
+  typedef std::function<void()> Callback;
+
+  static const TimerId INVALID_TIMER = 0;
+
+  /**
+   * @brief Constructor for TimerWheel.
+   *
+   * @param resolution Duration of a single wheel tick. Timeouts are rounded up to a whole number of ticks.
+   * @param slot_count Number of slots in the wheel.
+   */
+  TimerWheel(std::chrono::nanoseconds resolution = std::chrono::milliseconds(10), size_t slot_count = 512);
+
+  /**
+   * @brief Schedules a callback to fire after the given delay.
+   *
+   * @param delay Time from now until the callback fires.
+   * @param callback The function to invoke.
+   * @return TimerId Handle that can be passed to cancel().
+   */
+  TimerId schedule(std::chrono::nanoseconds delay, Callback callback);
+
+  /**
+   * @brief Cancels a pending timer.
+   *
+   * @param id The handle returned by schedule().
+   * @return bool Returns true if the timer was pending and has been removed.
+   */
+  bool cancel(TimerId id);
+
+  /**
+   * @brief Moves the wheel forward and fires all timers that have expired.
+   *
+   * @param elapsed Time elapsed since the previous call.
+   * @return size_t The number of callbacks invoked.
+   */
+  size_t advance(std::chrono::nanoseconds elapsed);
+
+  /**
+   * @brief Accessor for the number of pending timers.
+   *
+   * @return size_t The number of pending timers.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Computes how much time has to elapse before the earliest pending timer fires.
+   *
+   * Lets an owner sleep until the next expiry instead of advancing the wheel every tick.
+   *
+   * @param delay_out Time until the earliest timer fires, zero if it is already due.
+   * @return bool Returns false if no timer is pending.
+   */
+  bool nextExpiry(std::chrono::nanoseconds& delay_out) const;
+
+  /**
+   * @brief Accessor for the tick duration.
+   *
+   * @return std::chrono::nanoseconds The tick duration.
+   */
+  std::chrono::nanoseconds resolution() const
+  {
+    return resolution_;
+  }
+
+private:
+  struct Timer
+  {
+    TimerId id;
+    uint64_t expiry_tick;
+    Callback callback;
+  };
+
+  typedef std::list<Timer> Slot;
+
+  std::chrono::nanoseconds resolution_;                                     /** duration of a single tick */
+  std::vector<Slot> slots_;                                                 /** timers hashed by expiry tick */
+  std::unordered_map<TimerId, std::pair<size_t, Slot::iterator>> index_;    /** lookup used for cancellation */
+  uint64_t current_tick_ = 0;                                               /** number of ticks processed so far */
+  std::chrono::nanoseconds carry_ = std::chrono::nanoseconds(0);            /** elapsed time not yet worth a tick */
+  TimerId next_id_ = INVALID_TIMER + 1;                                     /** next handle to hand out */
+  mutable std::mutex mutex_;                                                /** protects all of the above */
+
+  /**
+   * @brief Moves all timers in the given slot that expire at or before tick into expired.
+   */
+  void collectExpired(size_t slot_index, uint64_t tick, std::vector<Timer>& expired);
+};
+}  // namespace packml_sm
@@ -0,0 +1,151 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "packml_sm/common.h"
+#include "packml_sm/packml_stats_snapshot.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace packml_sm
+{
+/**
+ * @brief Kinds of entries in a recorded trace.
+ *
+ */
+enum class TraceRecordType
+{
+  COMMAND,           /** operator command, value holds a CmdEnum */
+  STATE_COMPLETE,    /** state method finished */
+  STATE_ERROR,       /** state method raised an error */
+  SUCCESS,           /** successful operations, count holds the number */
+  FAILURE,           /** failed operations, count holds the number */
+  ERROR_ITEM,        /** itemized error stat, value holds the id */
+  QUALITY_ITEM,      /** itemized quality stat, value holds the id */
+  IDEAL_CYCLE_TIME   /** ideal cycle time change, count holds the new value */
+};
+
+/**
+ * @brief A single timestamped entry of a recorded trace.
+ *
+ */
+struct TraceRecord
+{
+  double time = 0.0;                                /** seconds since the state machine was activated */
+  TraceRecordType type = TraceRecordType::COMMAND;  /** kind of entry */
+  int value = 0;                                    /** command or item id, depending on type */
+  float count = 1.0f;                               /** increment amount or new ideal cycle time */
+  float duration = 0.0f;                            /** itemized duration */
+};
+
+/**
+ * @brief An extra stop inserted into a replay.
+ *
+ */
+struct InjectedStop
+{
+  double time = 0.0;      /** seconds since activation at which the machine is stopped */
+  double duration = 0.0;  /** seconds until the machine is reset and restarted */
+};
+
+/**
+ * @brief What-if settings applied while replaying a trace.
+ *
+ */
+struct ReplayOptions
+{
+  double ideal_cycle_time = -1.0;            /** overrides the trace's ideal cycle time when not negative */
+  double sample_period = 60.0;               /** seconds of virtual time between snapshots, <= 0 samples the end */
+  std::vector<InjectedStop> injected_stops;  /** extra stops to insert */
+};
+
+/**
+ * @brief Cumulative stats at a point in virtual time.
+ *
+ */
+struct ReplaySample
+{
+  double time;                   /** seconds since activation */
+  StatesEnum state;              /** state at the sample time */
+  PackmlStatsSnapshot snapshot;  /** cumulative stats at the sample time */
+};
+
+/**
+ * @brief Replays a recorded trace through a continuous cycle state machine on a virtual clock.
+ *
+ * Commands and events are processed synchronously, so a replay runs as fast as the state machine can transition.
+ * Each replay owns its state machine and clock, so any number of replays can run in parallel.
+ *
+ * Trace files are CSV with the columns time,type,value,count,duration. Blank lines and lines starting with '#' are
+ * skipped, as is a header line starting with "time". Types are command (value is the command name, e.g. start),
+ * state_complete, error, success, failure, error_item, quality_item (value is the id) and ideal_cycle_time (count is
+ * the new value).
+ */
+class TraceReplay
+{
+public:
+  /**
+   * @brief Constructor for TraceReplay.
+   *
+   * @param options The what-if settings for the replay.
+   */
+  explicit TraceReplay(const ReplayOptions& options = ReplayOptions());
+
+  /**
+   * @brief Parses one line of a trace file.
+   *
+   * @param line The line to parse.
+   * @param record_out Filled with the parsed entry.
+   * @param error_out Describes the problem if parsing fails.
+   * @return bool Returns true on success.
+   */
+  static bool parseRecord(const std::string& line, TraceRecord& record_out, std::string& error_out);
+
+  /**
+   * @brief Reads a whole trace.
+   *
+   * @param input The stream to read.
+   * @param records_out Filled with the entries in file order.
+   * @param error_out Describes the first problem, including its line number, if loading fails.
+   * @return bool Returns true on success.
+   */
+  static bool loadTrace(std::istream& input, std::vector<TraceRecord>& records_out, std::string& error_out);
+
+  /**
+   * @brief Replays a trace.
+   *
+   * @param records The trace entries. They are processed in time order, ties in the given order.
+   * @param samples_out Filled with a sample every sample period plus a final sample at the last entry.
+   * @return bool Returns true on success.
+   */
+  bool run(const std::vector<TraceRecord>& records, std::vector<ReplaySample>& samples_out);
+
+  /**
+   * @brief Writes samples as CSV, one row per sample with a header row.
+   *
+   * @param output The stream to write to.
+   * @param samples The samples to write.
+   */
+  static void writeSamples(std::ostream& output, const std::vector<ReplaySample>& samples);
+
+private:
+  ReplayOptions options_;  /** what-if settings for the replay */
+};
+}  // namespace packml_sm
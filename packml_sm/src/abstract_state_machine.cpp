@@ -24,272 +24,357 @@
 
 namespace packml_sm
 {
+namespace
+{
+/** States that count against availability. */
+bool isDowntime(StatesEnum state)
+{
+  return state == StatesEnum::STOPPED || state == StatesEnum::SUSPENDED || state == StatesEnum::ABORTED;
+}
+}  // namespace
+
+const size_t AbstractStateMachine::STATE_DURATION_SLOTS;
+
 AbstractStateMachine::AbstractStateMachine() : start_time_(std::chrono::steady_clock::now()),
 incremental_start_time_(std::chrono::steady_clock::now())
 {
 }
 
+void AbstractStateMachine::setClock(std::shared_ptr<Clock> clock)
+{
+  std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
+  clock_ = clock;
+  start_time_ = currentTime();
+  incremental_start_time_ = start_time_;
+}
+
 bool AbstractStateMachine::start()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::START))
   {
-    case StatesEnum::IDLE:
-      _start();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring START command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _start();
+  return true;
 }
 
 bool AbstractStateMachine::clear()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::CLEAR))
   {
-    case StatesEnum::ABORTED:
-      _clear();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring CLEAR command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _clear();
+  return true;
 }
 
 bool AbstractStateMachine::reset()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::RESET))
   {
-    case StatesEnum::COMPLETE:
-    case StatesEnum::STOPPED:
-      _reset();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring RESET command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _reset();
+  return true;
 }
 
 bool AbstractStateMachine::hold()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::HOLD))
   {
-    case StatesEnum::EXECUTE:
-      _hold();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring HOLD command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _hold();
+  return true;
 }
 
 bool AbstractStateMachine::unhold()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::UNHOLD))
   {
-    case StatesEnum::HELD:
-      _unhold();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring HELD command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _unhold();
+  return true;
 }
 
 bool AbstractStateMachine::suspend()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::SUSPEND))
   {
-    case StatesEnum::EXECUTE:
-      _suspend();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring SUSPEND command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _suspend();
+  return true;
 }
 
 bool AbstractStateMachine::unsuspend()
 {
-  switch (StatesEnum(getCurrentState()))
+  if (!acceptsCommand(CmdEnum::UNSUSPEND))
   {
-    case StatesEnum::SUSPENDED:
-      _unsuspend();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring UNSUSPEND command in current state: %d", getCurrentState());
-      return false;
+    return false;
   }
+
+  _unsuspend();
+  return true;
 }
 
 bool AbstractStateMachine::stop()
 {
-  switch (StatesEnum(getCurrentState()))
-  {
-    case StatesEnum::STOPPABLE:
-    case StatesEnum::STARTING:
-    case StatesEnum::IDLE:
-    case StatesEnum::SUSPENDED:
-    case StatesEnum::EXECUTE:
-    case StatesEnum::HOLDING:
-    case StatesEnum::HELD:
-    case StatesEnum::SUSPENDING:
-    case StatesEnum::UNSUSPENDING:
-    case StatesEnum::UNHOLDING:
-    case StatesEnum::COMPLETING:
-    case StatesEnum::COMPLETE:
-      _stop();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring STOP command in current state: %d", getCurrentState());
-      return false;
+  if (!acceptsCommand(CmdEnum::STOP))
+  {
+    return false;
   }
+
+  _stop();
+  return true;
 }
 
 bool AbstractStateMachine::abort()
 {
-  switch (StatesEnum(getCurrentState()))
-  {
-    case StatesEnum::ABORTABLE:
-    case StatesEnum::STOPPED:
-    case StatesEnum::STARTING:
-    case StatesEnum::IDLE:
-    case StatesEnum::SUSPENDED:
-    case StatesEnum::EXECUTE:
-    case StatesEnum::HOLDING:
-    case StatesEnum::HELD:
-    case StatesEnum::SUSPENDING:
-    case StatesEnum::UNSUSPENDING:
-    case StatesEnum::UNHOLDING:
-    case StatesEnum::COMPLETING:
-    case StatesEnum::COMPLETE:
-    case StatesEnum::CLEARING:
-    case StatesEnum::STOPPING:
-      _abort();
-      return true;
-    default:
-      DLog::LogWarning("Ignoring ABORT command in current state: %d", getCurrentState());
-      return false;
+  if (!acceptsCommand(CmdEnum::ABORT))
+  {
+    return false;
   }
+
+  _abort();
+  return true;
 }
 
-void AbstractStateMachine::getCurrentStatSnapshot(PackmlStatsSnapshot& snapshot_out)
+bool AbstractStateMachine::command(CmdEnum command, CommandCallback on_complete)
 {
-  std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  auto scheduled_time = calculateTotalTime();
-  float throughput = 0.0f;
-  if (scheduled_time > std::numeric_limits<double>::epsilon())
+  if (!acceptsCommand(command))
   {
-    throughput = success_count_ / scheduled_time;
+    if (on_complete != nullptr)
+    {
+      on_complete(CommandResult{ CmdResultEnum::REJECTED, getCurrentState() });
+    }
+    return false;
   }
 
-  auto held_time = getHeldTime();
-  auto stopped_time = getStoppedTime();
-  auto suspend_time = getSuspendedTime();
-  auto aborted_time = getAbortedTime();
+  _command(command, on_complete);
+  return true;
+}
 
-  auto operating_time = scheduled_time;
-  operating_time -= stopped_time;
-  operating_time -= suspend_time;
-  operating_time -= aborted_time;
+std::future<CommandResult> AbstractStateMachine::commandAsync(CmdEnum command)
+{
+  auto promise = std::make_shared<std::promise<CommandResult>>();
+  auto future = promise->get_future();
+  this->command(command, [promise](const CommandResult& result) { promise->set_value(result); });
+  return future;
+}
 
-  float availability = 0.0f;
-  if (scheduled_time > std::numeric_limits<double>::epsilon())
+size_t AbstractStateMachine::commandSequence(const std::vector<SequenceStep>& steps, SequenceCallback on_complete)
+{
+  return _commandSequence(steps, on_complete);
+}
+
+bool AbstractStateMachine::acceptsCommand(StatesEnum state, CmdEnum command)
+{
+  bool accepted = false;
+  switch (command)
   {
-    availability = operating_time / scheduled_time;
+    case CmdEnum::START:
+      accepted = state == StatesEnum::IDLE;
+      break;
+    case CmdEnum::CLEAR:
+      accepted = state == StatesEnum::ABORTED;
+      break;
+    case CmdEnum::RESET:
+      accepted = state == StatesEnum::COMPLETE || state == StatesEnum::STOPPED;
+      break;
+    case CmdEnum::HOLD:
+      accepted = state == StatesEnum::EXECUTE;
+      break;
+    case CmdEnum::UNHOLD:
+      accepted = state == StatesEnum::HELD;
+      break;
+    case CmdEnum::SUSPEND:
+      accepted = state == StatesEnum::EXECUTE;
+      break;
+    case CmdEnum::UNSUSPEND:
+      accepted = state == StatesEnum::SUSPENDED;
+      break;
+    case CmdEnum::STOP:
+      switch (state)
+      {
+        case StatesEnum::STOPPABLE:
+        case StatesEnum::STARTING:
+        case StatesEnum::IDLE:
+        case StatesEnum::SUSPENDED:
+        case StatesEnum::EXECUTE:
+        case StatesEnum::HOLDING:
+        case StatesEnum::HELD:
+        case StatesEnum::SUSPENDING:
+        case StatesEnum::UNSUSPENDING:
+        case StatesEnum::UNHOLDING:
+        case StatesEnum::COMPLETING:
+        case StatesEnum::COMPLETE:
+          accepted = true;
+          break;
+        default:
+          break;
+      }
+      break;
+    case CmdEnum::ABORT:
+      switch (state)
+      {
+        case StatesEnum::ABORTABLE:
+        case StatesEnum::STOPPED:
+        case StatesEnum::STARTING:
+        case StatesEnum::IDLE:
+        case StatesEnum::SUSPENDED:
+        case StatesEnum::EXECUTE:
+        case StatesEnum::HOLDING:
+        case StatesEnum::HELD:
+        case StatesEnum::SUSPENDING:
+        case StatesEnum::UNSUSPENDING:
+        case StatesEnum::UNHOLDING:
+        case StatesEnum::COMPLETING:
+        case StatesEnum::COMPLETE:
+        case StatesEnum::CLEARING:
+        case StatesEnum::STOPPING:
+          accepted = true;
+          break;
+        default:
+          break;
+      }
+      break;
+    default:
+      break;
   }
 
-  float performance = 0.0f;
-  if (operating_time > std::numeric_limits<double>::epsilon())
+  return accepted;
+}
+
+bool AbstractStateMachine::acceptsCommand(CmdEnum command)
+{
+  if (acceptsCommand(StatesEnum(getCurrentState()), command))
   {
-    performance = static_cast<float>(success_count_) * ideal_cycle_time_ / operating_time;
+    return true;
   }
 
-  float quality = 0.0f;
-  auto total_count = success_count_ + failure_count_;
-  if (total_count > 0)
+  const char* name = "UNKNOWN";
+  switch (command)
   {
-    quality = static_cast<float>(success_count_) / static_cast<float>(total_count);
+    case CmdEnum::START:
+      name = "START";
+      break;
+    case CmdEnum::CLEAR:
+      name = "CLEAR";
+      break;
+    case CmdEnum::RESET:
+      name = "RESET";
+      break;
+    case CmdEnum::HOLD:
+      name = "HOLD";
+      break;
+    case CmdEnum::UNHOLD:
+      name = "UNHOLD";
+      break;
+    case CmdEnum::SUSPEND:
+      name = "SUSPEND";
+      break;
+    case CmdEnum::UNSUSPEND:
+      name = "UNSUSPEND";
+      break;
+    case CmdEnum::STOP:
+      name = "STOP";
+      break;
+    case CmdEnum::ABORT:
+      name = "ABORT";
+      break;
+    default:
+      break;
   }
 
-  snapshot_out.cycle_count = total_count;
-  snapshot_out.duration = scheduled_time;
-  snapshot_out.idle_duration = getIdleTime();
-  snapshot_out.exe_duration = getExecuteTime();
-  snapshot_out.held_duration = held_time;
-  snapshot_out.susp_duration = suspend_time;
-  snapshot_out.cmplt_duration = getCompleteTime();
-  snapshot_out.stop_duration = stopped_time;
-  snapshot_out.abort_duration = aborted_time;
-  snapshot_out.success_count = success_count_;
-  snapshot_out.fail_count = failure_count_;
-  snapshot_out.throughput = throughput;
-  snapshot_out.availability = availability;
-  snapshot_out.performance = performance;
-  snapshot_out.quality = quality;
-  snapshot_out.overall_equipment_effectiveness = quality * performance * availability;
-  snapshot_out.itemized_error_map = itemized_error_map_;
-  snapshot_out.itemized_quality_map = itemized_quality_map_;
+  DLog::LogWarning("Ignoring %s command in current state: %d", name, getCurrentState());
+  return false;
 }
 
-void AbstractStateMachine::getCurrentIncrementalStatSnapshot(PackmlStatsSnapshot &snapshot_out)
+void AbstractStateMachine::getCurrentStatSnapshot(PackmlStatsSnapshot& snapshot_out, bool include_itemized)
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  auto scheduled_time = calculateTotalTime(true);
-  float throughput = 0.0f;
-  if (scheduled_time > std::numeric_limits<double>::epsilon())
+  fillSnapshot(durations_, start_time_, success_count_, failure_count_, snapshot_out);
+  if (include_itemized)
+  {
+    snapshot_out.itemized_error_map = itemized_error_map_;
+    snapshot_out.itemized_quality_map = itemized_quality_map_;
+  }
+  else
   {
-    throughput = incremental_success_count_ / scheduled_time;
+    snapshot_out.itemized_error_map.clear();
+    snapshot_out.itemized_quality_map.clear();
   }
+}
+
+void AbstractStateMachine::getCurrentIncrementalStatSnapshot(PackmlStatsSnapshot &snapshot_out)
+{
+  std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
+  fillSnapshot(incremental_durations_, incremental_start_time_, incremental_success_count_,
+               incremental_failure_count_, snapshot_out);
+  snapshot_out.itemized_error_map = incremental_itemized_error_map_;
+  snapshot_out.itemized_quality_map = inremental_itemized_quality_map_;
+
+  resetIncrementalStats();
+}
 
-  auto held_time = getHeldTime(true);
-  auto stopped_time = getStoppedTime(true);
-  auto suspend_time = getSuspendedTime(true);
-  auto aborted_time = getAbortedTime(true);
+void AbstractStateMachine::fillSnapshot(const StateDurations& durations, Clock::TimePoint start_time,
+                                        int success_count, int failure_count, PackmlStatsSnapshot& snapshot_out)
+{
+  // Only the current state is still accumulating time, everything else comes from the running sums.
+  std::chrono::duration<double> open_duration = currentTime() - start_time;
+  double open_time = open_duration.count();
+  auto state_time = [&durations, open_time, this](StatesEnum state) {
+    return durations.closed[static_cast<size_t>(state)] + (state == current_state_ ? open_time : 0.0);
+  };
 
-  auto operating_time = scheduled_time;
-  operating_time -= stopped_time;
-  operating_time -= suspend_time;
-  operating_time -= aborted_time;
+  double scheduled_time = durations.total + open_time;
+  double operating_time = scheduled_time - durations.downtime - (isDowntime(current_state_) ? open_time : 0.0);
 
+  float throughput = 0.0f;
   float availability = 0.0f;
   if (scheduled_time > std::numeric_limits<double>::epsilon())
   {
+    throughput = success_count / scheduled_time;
     availability = operating_time / scheduled_time;
   }
 
   float performance = 0.0f;
   if (operating_time > std::numeric_limits<double>::epsilon())
   {
-    performance = static_cast<float>(incremental_success_count_) * ideal_cycle_time_ / operating_time;
+    performance = static_cast<float>(success_count) * ideal_cycle_time_ / operating_time;
   }
 
   float quality = 0.0f;
-  auto total_count = incremental_success_count_ + incremental_failure_count_;
+  auto total_count = success_count + failure_count;
   if (total_count > 0)
   {
-    quality = static_cast<float>(incremental_success_count_) / static_cast<float>(total_count);
+    quality = static_cast<float>(success_count) / static_cast<float>(total_count);
   }
 
   snapshot_out.cycle_count = total_count;
   snapshot_out.duration = scheduled_time;
-  snapshot_out.idle_duration = getIdleTime(true);
-  snapshot_out.exe_duration = getExecuteTime(true);
-  snapshot_out.held_duration = held_time;
-  snapshot_out.susp_duration = suspend_time;
-  snapshot_out.cmplt_duration = getCompleteTime(true);
-  snapshot_out.stop_duration = stopped_time;
-  snapshot_out.abort_duration = aborted_time;
-  snapshot_out.success_count = incremental_success_count_;
-  snapshot_out.fail_count = incremental_failure_count_;
+  snapshot_out.idle_duration = state_time(StatesEnum::IDLE);
+  snapshot_out.exe_duration = state_time(StatesEnum::EXECUTE);
+  snapshot_out.held_duration = state_time(StatesEnum::HELD);
+  snapshot_out.susp_duration = state_time(StatesEnum::SUSPENDED);
+  snapshot_out.cmplt_duration = state_time(StatesEnum::COMPLETE);
+  snapshot_out.stop_duration = state_time(StatesEnum::STOPPED);
+  snapshot_out.abort_duration = state_time(StatesEnum::ABORTED);
+  snapshot_out.success_count = success_count;
+  snapshot_out.fail_count = failure_count;
   snapshot_out.throughput = throughput;
   snapshot_out.availability = availability;
   snapshot_out.performance = performance;
   snapshot_out.quality = quality;
   snapshot_out.overall_equipment_effectiveness = quality * performance * availability;
-  snapshot_out.itemized_error_map = incremental_itemized_error_map_;
-  snapshot_out.itemized_quality_map = inremental_itemized_quality_map_;
-
-  resetIncrementalStats();
 }
 
 double AbstractStateMachine::getIdleTime(bool is_incremental)
@@ -375,21 +460,15 @@ double AbstractStateMachine::getAbortingTime(bool is_incremental)
 double AbstractStateMachine::calculateTotalTime(bool is_incremental)
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  std::chrono::duration<double> duration = std::chrono::steady_clock::now() - (is_incremental ? incremental_start_time_ : start_time_);
-  auto elapsed_time = duration.count();
-  for (auto & iter : (is_incremental ? incremental_duration_map_ : duration_map_) )
-  {
-    elapsed_time += iter.second;
-  }
-
-  return elapsed_time;
+  std::chrono::duration<double> duration = currentTime() - (is_incremental ? incremental_start_time_ : start_time_);
+  return duration.count() + (is_incremental ? incremental_durations_ : durations_).total;
 }
 
 void AbstractStateMachine::resetStats()
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  start_time_ = std::chrono::steady_clock::now();
-  duration_map_.clear();
+  start_time_ = currentTime();
+  durations_.clear();
   failure_count_ = 0;
   success_count_ = 0;
 
@@ -409,8 +488,8 @@ void AbstractStateMachine::resetStats()
 void AbstractStateMachine::resetIncrementalStats()
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  incremental_start_time_ = std::chrono::steady_clock::now();
-  incremental_duration_map_.clear();
+  incremental_start_time_ = currentTime();
+  incremental_durations_.clear();
   incremental_success_count_ = 0;
   incremental_failure_count_ = 0;
 
@@ -478,6 +557,64 @@ void AbstractStateMachine::incrementQualityStatItem(int16_t id, float step, floa
   incrementMapStatItem(inremental_itemized_quality_map_, id, step, duration);
 }
 
+bool AbstractStateMachine::incrementStat(const StatIncrement& increment)
+{
+  std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
+  return applyStatIncrement(increment);
+}
+
+std::vector<bool> AbstractStateMachine::incrementStats(const std::vector<StatIncrement>& increments)
+{
+  std::vector<bool> results;
+  results.reserve(increments.size());
+
+  std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
+  for (const auto& increment : increments)
+  {
+    results.push_back(applyStatIncrement(increment));
+  }
+  return results;
+}
+
+bool AbstractStateMachine::applyStatIncrement(const StatIncrement& increment)
+{
+  int32_t metric = increment.metric;
+  if (metric == static_cast<int32_t>(MetricIDEnum::CYCLE_INC_ID))
+  {
+    // Cycles are counted by the state machine itself.
+    return true;
+  }
+  if (metric == static_cast<int32_t>(MetricIDEnum::SUCCESS_INC_ID))
+  {
+    success_count_++;
+    incremental_success_count_++;
+    return true;
+  }
+  if (metric == static_cast<int32_t>(MetricIDEnum::FAILURE_INC_ID))
+  {
+    failure_count_++;
+    incremental_failure_count_++;
+    return true;
+  }
+  if (metric >= static_cast<int32_t>(MetricIDEnum::MIN_QUALITY_ID) &&
+      metric <= static_cast<int32_t>(MetricIDEnum::MAX_QUALITY_ID))
+  {
+    incrementMapStatItem(itemized_quality_map_, metric, increment.step, increment.duration);
+    incrementMapStatItem(inremental_itemized_quality_map_, metric, increment.step, increment.duration);
+    return true;
+  }
+  if (metric >= static_cast<int32_t>(MetricIDEnum::MIN_ERROR_ID) &&
+      metric <= static_cast<int32_t>(MetricIDEnum::MAX_ERROR_ID))
+  {
+    incrementMapStatItem(itemized_error_map_, metric, increment.step, increment.duration);
+    incrementMapStatItem(incremental_itemized_error_map_, metric, increment.step, increment.duration);
+    return true;
+  }
+
+  DLog::LogError("Invalid stat metric id: %d", metric);
+  return false;
+}
+
 void AbstractStateMachine::incrementSuccessCount()
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
@@ -507,41 +644,49 @@ void AbstractStateMachine::invokeStateChangedEvent(const std::string& name, Stat
 void AbstractStateMachine::updateClock(StatesEnum new_state)
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start_time_;
-  auto elapsed_time = duration.count();
-  if (duration_map_.find(current_state_) != duration_map_.end())
+  auto now = currentTime();
+  std::chrono::duration<double> duration = now - start_time_;
+  addStateDuration(durations_, current_state_, duration.count());
+
+  std::chrono::duration<double> incremental_duration = now - incremental_start_time_;
+  addStateDuration(incremental_durations_, current_state_, incremental_duration.count());
+
+  current_state_ = new_state;
+  start_time_ = now;
+  incremental_start_time_ = now;
+}
+
+void AbstractStateMachine::addStateDuration(StateDurations& durations, StatesEnum state, double duration)
+{
+  auto slot = static_cast<size_t>(state);
+  if (slot >= STATE_DURATION_SLOTS)
   {
-    elapsed_time += duration_map_[current_state_];
+    return;
   }
-  duration_map_[current_state_] = elapsed_time;
 
-  std::chrono::duration<double> incremental_duration = std::chrono::steady_clock::now() - incremental_start_time_;
-  auto incremental_elapsed_time = incremental_duration.count();
-  if (incremental_duration_map_.find(current_state_) != incremental_duration_map_.end())
+  durations.closed[slot] += duration;
+  durations.total += duration;
+  if (isDowntime(state))
   {
-    incremental_elapsed_time += incremental_duration_map_[current_state_];
+    durations.downtime += duration;
   }
-  incremental_duration_map_[current_state_] = incremental_elapsed_time;
-
-  current_state_ = new_state;
-  start_time_ = std::chrono::steady_clock::now();
-  incremental_start_time_ = std::chrono::steady_clock::now();
 }
 
 double AbstractStateMachine::getStateDuration(StatesEnum state, bool is_incremental)
 {
   std::lock_guard<std::recursive_mutex> lock(stat_mutex_);
-  double elapsed_time = 0;
-  if (state == current_state_)
+  auto slot = static_cast<size_t>(state);
+  if (slot >= STATE_DURATION_SLOTS)
   {
-    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - (is_incremental ? incremental_start_time_ : start_time_);
-    elapsed_time += duration.count();
+    return 0.0;
   }
 
-  auto map = is_incremental ? incremental_duration_map_ : duration_map_;
-  if (map.find(state) != map.end())
+  const StateDurations& durations = is_incremental ? incremental_durations_ : durations_;
+  double elapsed_time = durations.closed[slot];
+  if (state == current_state_)
   {
-    elapsed_time += map[state];
+    std::chrono::duration<double> duration = currentTime() - (is_incremental ? incremental_start_time_ : start_time_);
+    elapsed_time += duration.count();
   }
 
   return elapsed_time;
@@ -549,6 +694,12 @@ double AbstractStateMachine::getStateDuration(StatesEnum state, bool is_incremen
 
 void AbstractStateMachine::setStateDuration(StatesEnum state, double duration)
 {
-  duration_map_[state] = duration;
+  auto slot = static_cast<size_t>(state);
+  if (slot >= STATE_DURATION_SLOTS)
+  {
+    return;
+  }
+
+  addStateDuration(durations_, state, duration - durations_.closed[slot]);
 }
 }  // namespace packml_sm
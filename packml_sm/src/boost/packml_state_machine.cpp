@@ -20,13 +20,45 @@
 
 namespace packml_sm
 {
+namespace
+{
+/** Every concrete state, used when a setting applies to all of them */
+const StatesEnum PACKML_STATES[] = {
+  StatesEnum::STOPPED,
+  StatesEnum::STARTING,
+  StatesEnum::IDLE,
+  StatesEnum::SUSPENDED,
+  StatesEnum::EXECUTE,
+  StatesEnum::STOPPING,
+  StatesEnum::ABORTING,
+  StatesEnum::ABORTED,
+  StatesEnum::HOLDING,
+  StatesEnum::HELD,
+  StatesEnum::RESETTING,
+  StatesEnum::SUSPENDING,
+  StatesEnum::UNSUSPENDING,
+  StatesEnum::CLEARING,
+  StatesEnum::UNHOLDING,
+  StatesEnum::COMPLETING,
+  StatesEnum::COMPLETE
+};
+}  // namespace
+
 template <typename T>
-PackmlStateMachine<T>::PackmlStateMachine()
+PackmlStateMachine<T>::PackmlStateMachine() : dropped_event_count_(0)
 {
+  for (auto state : PACKML_STATES)
+  {
+    getPackmlState(state)->setSupervisor(&supervisor_);
+  }
+  supervisor_.setOverrunHandler(
+      std::bind(&PackmlStateMachine<T>::handleStateMethodOverrun, this, std::placeholders::_1));
+
   auto state_change_notifier = dynamic_cast<StateChangeNotifier*>(&boost_fsm_);
   if (state_change_notifier != nullptr)
   {
     state_change_notifier->stateChangedEvent.bind_member_func(this, &PackmlStateMachine<T>::handleStateChanged);
+    state_change_notifier->noTransitionEvent.bind_member_func(this, &PackmlStateMachine<T>::handleNoTransition);
   }
 
   event_loop_.updateTickEvent.bind_member_func(this, &PackmlStateMachine<T>::update);
@@ -39,15 +71,19 @@ PackmlStateMachine<T>::~PackmlStateMachine()
   if (state_change_notifier != nullptr)
   {
     state_change_notifier->stateChangedEvent.unbind_member_func(this, &PackmlStateMachine<T>::handleStateChanged);
+    state_change_notifier->noTransitionEvent.unbind_member_func(this, &PackmlStateMachine<T>::handleNoTransition);
   }
 
   event_loop_.updateTickEvent.unbind_member_func(this, &PackmlStateMachine<T>::update);
+  event_loop_.stop();
+  cancelQueuedEvents();
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::activate()
 {
   is_active_ = true;
+  last_update_time_ = currentTime();
   event_loop_.start();
   boost_fsm_.start();
   return true;
@@ -58,6 +94,7 @@ bool PackmlStateMachine<T>::deactivate()
 {
   is_active_ = false;
   event_loop_.stop();
+  cancelQueuedEvents();
   boost_fsm_.stop();
   return true;
 }
@@ -65,67 +102,265 @@ bool PackmlStateMachine<T>::deactivate()
 template <typename T>
 bool PackmlStateMachine<T>::setStarting(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::STARTING, state_method);
+  return this->setStateMethod(StatesEnum::STARTING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setExecute(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::EXECUTE, state_method);
+  return this->setStateMethod(StatesEnum::EXECUTE, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setCompleting(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::COMPLETING, state_method);
+  return this->setStateMethod(StatesEnum::COMPLETING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setAborting(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::ABORTING, state_method);
+  return this->setStateMethod(StatesEnum::ABORTING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setClearing(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::CLEARING, state_method);
+  return this->setStateMethod(StatesEnum::CLEARING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setStopping(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::STOPPING, state_method);
+  return this->setStateMethod(StatesEnum::STOPPING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setResetting(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::RESETTING, state_method);
+  return this->setStateMethod(StatesEnum::RESETTING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setSuspending(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::SUSPENDING, state_method);
+  return this->setStateMethod(StatesEnum::SUSPENDING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setUnsuspending(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::UNSUSPENDING, state_method);
+  return this->setStateMethod(StatesEnum::UNSUSPENDING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setHolding(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::HOLDING, state_method);
+  return this->setStateMethod(StatesEnum::HOLDING, state_method);
 }
 
 template <typename T>
 bool PackmlStateMachine<T>::setUnholding(std::function<int()> state_method)
 {
-  this->setStateMethod(StatesEnum::UNHOLDING, state_method);
+  return this->setStateMethod(StatesEnum::UNHOLDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStarting(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::STARTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setExecute(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::EXECUTE, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setCompleting(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::COMPLETING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setAborting(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::ABORTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setClearing(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::CLEARING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStopping(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::STOPPING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setResetting(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::RESETTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setSuspending(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::SUSPENDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setUnsuspending(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::UNSUSPENDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setHolding(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::HOLDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setUnholding(ContextStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::UNHOLDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStarting(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::STARTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setExecute(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::EXECUTE, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setCompleting(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::COMPLETING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setAborting(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::ABORTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setClearing(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::CLEARING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStopping(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::STOPPING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setResetting(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::RESETTING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setSuspending(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::SUSPENDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setUnsuspending(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::UNSUSPENDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setHolding(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::HOLDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setUnholding(AsyncStateMethod state_method)
+{
+  return this->setStateMethod(StatesEnum::UNHOLDING, state_method);
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStateMethodPolicy(StatesEnum state, const StateMethodPolicy& policy)
+{
+  PackmlState* state_machine_state = getPackmlState(state);
+
+  if (state_machine_state != nullptr)
+  {
+    state_machine_state->setStateMethodPolicy(policy);
+    return true;
+  }
+
+  return false;
+}
+
+template <typename T>
+void PackmlStateMachine<T>::setStateMethodPolicy(const StateMethodPolicy& policy)
+{
+  for (auto state : PACKML_STATES)
+  {
+    setStateMethodPolicy(state, policy);
+  }
+}
+
+template <typename T>
+void PackmlStateMachine<T>::setBackgroundQuota(size_t quota)
+{
+  supervisor_.setBackgroundQuota(quota);
+}
+
+template <typename T>
+size_t PackmlStateMachine<T>::getBackgroundStateMethodCount()
+{
+  return supervisor_.backgroundCount();
+}
+
+template <typename T>
+size_t PackmlStateMachine<T>::getEventQueueDepth()
+{
+  std::lock_guard<std::mutex> lock(event_queue_mutex_);
+  return event_queue_.size();
+}
+
+template <typename T>
+uint64_t PackmlStateMachine<T>::getDroppedEventCount()
+{
+  return dropped_event_count_;
+}
+
+template <typename T>
+void PackmlStateMachine<T>::setEventDispatchObserver(std::function<void(std::chrono::steady_clock::duration)> observer)
+{
+  std::lock_guard<std::mutex> lock(event_queue_mutex_);
+  dispatch_observer_ = observer;
+}
+
+template <typename T>
+void PackmlStateMachine<T>::setClock(std::shared_ptr<Clock> clock)
+{
+  AbstractStateMachine::setClock(clock);
+  for (auto state : PACKML_STATES)
+  {
+    getPackmlState(state)->setClock(clock);
+  }
+  last_update_time_ = currentTime();
 }
 
 template <typename T>
@@ -189,39 +424,170 @@ void PackmlStateMachine<T>::_abort()
 }
 
 template <typename T>
-void PackmlStateMachine<T>::sendCommand(CmdEnum command)
+void PackmlStateMachine<T>::_command(CmdEnum command, CommandCallback on_complete)
+{
+  sendCommand(command, on_complete);
+}
+
+template <typename T>
+size_t PackmlStateMachine<T>::_commandSequence(const std::vector<SequenceStep>& steps, SequenceCallback on_complete)
+{
+  std::vector<QueuedEvent> queued;
+  queued.reserve(steps.size());
+  bool first_step = true;
+
+  for (size_t index = 0; index < steps.size(); ++index)
+  {
+    CommandCallback step_complete = nullptr;
+    if (on_complete != nullptr)
+    {
+      step_complete = [on_complete, index](const CommandResult& result) { on_complete(index, result); };
+    }
+
+    QueuedEvent event;
+    if (!makeQueuedStep(steps[index], step_complete, event))
+    {
+      DLog::LogError("Unsupported %s %d in command sequence.", steps[index].is_event ? "event" : "command",
+                     steps[index].id);
+      if (step_complete != nullptr)
+      {
+        step_complete(CommandResult{ CmdResultEnum::REJECTED, getCurrentState() });
+      }
+      continue;
+    }
+
+    // Only the leading step is processed in the current state, so only a command there that the state accepts
+    // may ask the state method to stop; a stop request cannot be withdrawn once the step is rejected.
+    if (first_step)
+    {
+      first_step = false;
+      StatesEnum state = getCurrentState();
+      CmdEnum command = static_cast<CmdEnum>(steps[index].id);
+      PackmlState* current_state = getPackmlState(state);
+      if (!steps[index].is_event && current_state != nullptr && acceptsCommand(state, command))
+      {
+        current_state->requestStop(command);
+      }
+    }
+    queued.push_back(std::move(event));
+  }
+
+  std::lock_guard<std::mutex> lock(event_queue_mutex_);
+  for (auto& event : queued)
+  {
+    event_queue_.push_back(std::move(event));
+  }
+  return queued.size();
+}
+
+template <typename T>
+void PackmlStateMachine<T>::sendCommand(CmdEnum command, CommandCallback on_complete)
+{
+  // Let a busy state method wind down while the command waits in the queue.
+  PackmlState* current_state = getPackmlState(getCurrentState());
+  if (current_state != nullptr)
+  {
+    current_state->requestStop(command);
+  }
+
+  QueuedEvent queued;
+  if (!makeQueuedStep(SequenceStep{ false, static_cast<int>(command) }, on_complete, queued))
+  {
+    DLog::LogError("Unsupported command requested.");
+    if (on_complete != nullptr)
+    {
+      on_complete(CommandResult{ CmdResultEnum::REJECTED, getCurrentState() });
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(event_queue_mutex_);
+  event_queue_.push_back(std::move(queued));
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::makeQueuedStep(const SequenceStep& step, CommandCallback on_complete,
+                                           QueuedEvent& queued_out)
 {
-  switch (command)
+  if (step.is_event)
+  {
+    switch (static_cast<EventsEnum>(step.id))
+    {
+      case EventsEnum::STATE_COMPLETE:
+        queued_out = makeQueuedEvent(state_complete_event(), on_complete);
+        return true;
+      case EventsEnum::HOLD:
+        queued_out = makeQueuedEvent(hold_event(), on_complete);
+        return true;
+      case EventsEnum::UNHOLD:
+        queued_out = makeQueuedEvent(unhold_event(), on_complete);
+        return true;
+      case EventsEnum::SUSPEND:
+        queued_out = makeQueuedEvent(suspend_event(), on_complete);
+        return true;
+      case EventsEnum::UNSUSPEND:
+        queued_out = makeQueuedEvent(unsuspend_event(), on_complete);
+        return true;
+      case EventsEnum::RESET:
+        queued_out = makeQueuedEvent(reset_event(), on_complete);
+        return true;
+      case EventsEnum::CLEAR:
+        queued_out = makeQueuedEvent(clear_event(), on_complete);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  switch (static_cast<CmdEnum>(step.id))
   {
     case CmdEnum::CLEAR:
-      boost_fsm_.enqueue_event(clear_event());
-      break;
+      queued_out = makeQueuedEvent(clear_event(), on_complete);
+      return true;
     case CmdEnum::START:
-      boost_fsm_.enqueue_event(start_event());
-      break;
+      queued_out = makeQueuedEvent(start_event(), on_complete);
+      return true;
     case CmdEnum::STOP:
-      boost_fsm_.enqueue_event(stop_event());
-      break;
+      queued_out = makeQueuedEvent(stop_event(), on_complete);
+      return true;
     case CmdEnum::HOLD:
-      boost_fsm_.enqueue_event(hold_event());
-      break;
+      queued_out = makeQueuedEvent(hold_event(), on_complete);
+      return true;
     case CmdEnum::ABORT:
-      boost_fsm_.enqueue_event(abort_event());
-      break;
+      queued_out = makeQueuedEvent(abort_event(), on_complete);
+      return true;
     case CmdEnum::RESET:
-      boost_fsm_.enqueue_event(reset_event());
-      break;
+      queued_out = makeQueuedEvent(reset_event(), on_complete);
+      return true;
     case CmdEnum::SUSPEND:
-      boost_fsm_.enqueue_event(suspend_event());
-      break;
+      queued_out = makeQueuedEvent(suspend_event(), on_complete);
+      return true;
     case CmdEnum::UNSUSPEND:
-      boost_fsm_.enqueue_event(unsuspend_event());
-      break;
+      queued_out = makeQueuedEvent(unsuspend_event(), on_complete);
+      return true;
     case CmdEnum::UNHOLD:
-      boost_fsm_.enqueue_event(unhold_event());
-      break;
+      queued_out = makeQueuedEvent(unhold_event(), on_complete);
+      return true;
     default:
-      DLog::LogError("Unsupported command requested.");
+      return false;
+  }
+}
+
+template <typename T>
+void PackmlStateMachine<T>::cancelQueuedEvents()
+{
+  std::deque<QueuedEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(event_queue_mutex_);
+    events.swap(event_queue_);
+  }
+
+  for (auto& event : events)
+  {
+    if (event.on_complete != nullptr)
+    {
+      event.on_complete(CommandResult{ CmdResultEnum::CANCELLED, getCurrentState() });
+    }
   }
 }
 
@@ -304,18 +670,148 @@ bool PackmlStateMachine<T>::setStateMethod(StatesEnum state, std::function<int()
   return false;
 }
 
+template <typename T>
+bool PackmlStateMachine<T>::setStateMethod(StatesEnum state, ContextStateMethod state_method)
+{
+  PackmlState* state_machine_state = getPackmlState(state);
+
+  if (state_machine_state != nullptr)
+  {
+    state_machine_state->setStateMethod(state_method.method);
+    return true;
+  }
+
+  return false;
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setStateMethod(StatesEnum state, AsyncStateMethod state_method)
+{
+  PackmlState* state_machine_state = getPackmlState(state);
+
+  if (state_machine_state != nullptr)
+  {
+    state_machine_state->setStateMethod(state_method.method);
+    return true;
+  }
+
+  return false;
+}
+
 template <typename T>
 void PackmlStateMachine<T>::handleStateChanged(StateChangeNotifier& state_machine, const StateChangedEventArgs& args)
 {
   invokeStateChangedEvent(args.name, args.value);
 }
 
+template <typename T>
+void PackmlStateMachine<T>::handleStateMethodOverrun(StatesEnum state)
+{
+  // Deadline overruns arrive from update() before the queue is drained and are processed in the same tick. Exits
+  // over the background quota arrive while the state is left and are processed in the state that follows.
+  if (getCurrentState() == state)
+  {
+    enqueueEvent(error_event());
+  }
+}
+
+template <typename T>
+void PackmlStateMachine<T>::handleNoTransition(StateChangeNotifier& state_machine, const StateChangedEventArgs& args)
+{
+  dropped_event_count_++;
+  DLog::LogDebug("Dropped event without a transition in state: %s", args.name.c_str());
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::setManualDrive(bool manual)
+{
+  if (is_active_)
+  {
+    DLog::LogError("Cannot change the drive mode of an active state machine");
+    return false;
+  }
+
+  event_loop_.setManual(manual);
+  for (auto state : PACKML_STATES)
+  {
+    getPackmlState(state)->setInlineStateMethods(manual);
+  }
+  return true;
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::isManualDrive()
+{
+  return event_loop_.isManual();
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::step()
+{
+  if (!event_loop_.isManual())
+  {
+    DLog::LogError("step() is only available in manual drive mode");
+    return false;
+  }
+
+  bool processed = processUpdate();
+  PackmlState* current_state = getPackmlState(getCurrentState());
+  if (current_state != nullptr && current_state->runInlineStateMethod())
+  {
+    processed = true;
+  }
+  return processed;
+}
+
+template <typename T>
+size_t PackmlStateMachine<T>::runUntilIdle(size_t max_steps)
+{
+  size_t steps = 0;
+  while (steps < max_steps && step())
+  {
+    steps++;
+  }
+  return steps;
+}
+
 template <typename T>
 void PackmlStateMachine<T>::update(StateMachineEventLoop& event_loop, const EventArgs& args)
 {
-  if (boost_fsm_.get_message_queue_size() > 0)
+  processUpdate();
+}
+
+template <typename T>
+bool PackmlStateMachine<T>::processUpdate()
+{
+  auto now = currentTime();
+  supervisor_.timers().advance(now - last_update_time_);
+  last_update_time_ = now;
+  supervisor_.reap();
+
+  // Take the whole queue so producers never wait on an event being processed.
+  std::deque<QueuedEvent> events;
+  std::function<void(std::chrono::steady_clock::duration)> observer;
   {
-    boost_fsm_.execute_queued_events();
+    std::lock_guard<std::mutex> lock(event_queue_mutex_);
+    events.swap(event_queue_);
+    observer = dispatch_observer_;
   }
+
+  for (auto& event : events)
+  {
+    if (observer != nullptr)
+    {
+      observer(std::chrono::steady_clock::now() - event.enqueue_time);
+    }
+
+    bool handled = event.dispatch();
+    if (event.on_complete != nullptr)
+    {
+      event.on_complete(
+          CommandResult{ handled ? CmdResultEnum::COMPLETED : CmdResultEnum::REJECTED, getCurrentState() });
+    }
+  }
+
+  return !events.empty();
 }
 }
@@ -22,7 +22,7 @@
 
 namespace packml_sm
 {
-StateMachineEventLoop::StateMachineEventLoop(int interval) : interval_(interval)
+StateMachineEventLoop::StateMachineEventLoop(int interval) : stop_thread_(false), manual_(false), interval_(interval)
 {
 }
 
@@ -37,8 +37,9 @@ StateMachineEventLoop::~StateMachineEventLoop()
 
 void StateMachineEventLoop::start()
 {
-  if (thread_ == nullptr)
+  if (thread_ == nullptr && !manual_)
   {
+    stop_thread_ = false;
     thread_ = std::make_unique<std::thread>(&StateMachineEventLoop::updateLoop, this);
   }
 }
@@ -53,6 +54,16 @@ void StateMachineEventLoop::stop()
   }
 }
 
+void StateMachineEventLoop::setManual(bool manual)
+{
+  manual_ = manual;
+}
+
+bool StateMachineEventLoop::isManual() const
+{
+  return manual_;
+}
+
 void StateMachineEventLoop::updateLoop()
 {
   while (!stop_thread_)
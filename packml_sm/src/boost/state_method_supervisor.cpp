@@ -0,0 +1,125 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/boost/state_method_supervisor.h"
+#include "packml_sm/dlog.h"
+
+namespace packml_sm
+{
+namespace
+{
+// How long destruction waits for the background state methods before abandoning them.
+const std::chrono::milliseconds SHUTDOWN_TIMEOUT(1000);
+}  // namespace
+
+StateMethodSupervisor::StateMethodSupervisor(size_t background_quota) : background_quota_(background_quota)
+{
+}
+
+StateMethodSupervisor::~StateMethodSupervisor()
+{
+  std::list<BackgroundMethod> background;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    background.swap(background_);
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + SHUTDOWN_TIMEOUT;
+  for (auto& method : background)
+  {
+    if (method.future.valid() && method.future.wait_until(deadline) != std::future_status::ready)
+    {
+      // The future of a std::async task blocks in its destructor, so a hung method is leaked rather than joined.
+      DLog::LogError("Abandoning %s state method still running at shutdown", method.state_name.c_str());
+      new std::future<void>(std::move(method.future));
+    }
+  }
+}
+
+void StateMethodSupervisor::setOverrunHandler(std::function<void(StatesEnum)> handler)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  overrun_handler_ = handler;
+}
+
+void StateMethodSupervisor::notifyOverrun(StatesEnum state)
+{
+  std::function<void(StatesEnum)> handler;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handler = overrun_handler_;
+  }
+
+  if (handler != nullptr)
+  {
+    handler(state);
+  }
+}
+
+bool StateMethodSupervisor::detach(const std::string& state_name, std::future<void>& future)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool within_quota = background_.size() < background_quota_;
+
+  BackgroundMethod method;
+  method.state_name = state_name;
+  method.future = std::move(future);
+  background_.push_back(std::move(method));
+  if (!within_quota)
+  {
+    DLog::LogError("Background quota (%zu) exhausted, %s state method finishing in background anyway (%zu)",
+                   background_quota_, state_name.c_str(), background_.size());
+    return false;
+  }
+
+  DLog::LogWarning("%s state method still running, finishing in background (%zu/%zu)", state_name.c_str(),
+                   background_.size(), background_quota_);
+  return true;
+}
+
+size_t StateMethodSupervisor::reap()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto iter = background_.begin(); iter != background_.end();)
+  {
+    if (!iter->future.valid() ||
+        iter->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+      DLog::LogInfo("Background %s state method finished", iter->state_name.c_str());
+      iter = background_.erase(iter);
+    }
+    else
+    {
+      ++iter;
+    }
+  }
+
+  return background_.size();
+}
+
+size_t StateMethodSupervisor::backgroundCount()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return background_.size();
+}
+
+void StateMethodSupervisor::setBackgroundQuota(size_t quota)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  background_quota_ = quota;
+}
+}  // namespace packml_sm
@@ -0,0 +1,49 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/clock.h"
+
+namespace packml_sm
+{
+ManualClock::ManualClock(TimePoint start) : now_(start)
+{
+}
+
+Clock::TimePoint ManualClock::now() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return now_;
+}
+
+void ManualClock::advance(Duration duration)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (duration > Duration::zero())
+  {
+    now_ += duration;
+  }
+}
+
+void ManualClock::set(TimePoint time)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (time > now_)
+  {
+    now_ = time;
+  }
+}
+}  // namespace packml_sm
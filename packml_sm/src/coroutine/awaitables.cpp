@@ -0,0 +1,178 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/coroutine/awaitables.h"
+
+#include <algorithm>
+
+namespace packml_sm
+{
+namespace detail
+{
+Waiter::Waiter(StateTask::Handle handle) : woken_(false), handle_(handle)
+{
+}
+
+bool Waiter::wake(bool result)
+{
+  if (woken_.exchange(true))
+  {
+    return false;
+  }
+
+  // result_ is published to the resuming thread through the executor queue.
+  result_ = result;
+  StateTask::Handle handle = handle_;
+  handle.promise().executor->post([handle]() { handle.resume(); });
+  return true;
+}
+}  // namespace detail
+
+SleepAwaiter::SleepAwaiter(StateMethodContext& context, std::chrono::nanoseconds duration)
+  : context_(context), duration_(duration)
+{
+}
+
+void SleepAwaiter::await_suspend(StateTask::Handle handle)
+{
+  auto waiter = std::make_shared<detail::Waiter>(handle);
+  waiter_ = waiter;
+
+  auto when = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                     std::max(duration_, std::chrono::nanoseconds(0)));
+  handle.promise().executor->postAt(when, [waiter]() { waiter->wake(true); });
+  context_.setStopCallback([waiter]() { waiter->wake(false); });
+}
+
+bool SleepAwaiter::await_resume()
+{
+  if (waiter_ == nullptr)
+  {
+    return false;
+  }
+
+  context_.setStopCallback(nullptr);
+  return waiter_->result();
+}
+
+SleepAwaiter sleepFor(StateMethodContext& context, std::chrono::nanoseconds duration)
+{
+  return SleepAwaiter(context, duration);
+}
+
+StopAwaiter::StopAwaiter(StateMethodContext& context) : context_(context)
+{
+}
+
+void StopAwaiter::await_suspend(StateTask::Handle handle)
+{
+  auto waiter = std::make_shared<detail::Waiter>(handle);
+  waiter_ = waiter;
+  context_.setStopCallback([waiter]() { waiter->wake(true); });
+}
+
+void StopAwaiter::await_resume()
+{
+}
+
+StopAwaiter waitForStop(StateMethodContext& context)
+{
+  return StopAwaiter(context);
+}
+
+AsyncEvent::Awaiter::Awaiter(AsyncEvent& event, StateMethodContext& context) : event_(event), context_(context)
+{
+}
+
+bool AsyncEvent::Awaiter::await_ready()
+{
+  if (context_.stopRequested())
+  {
+    ready_result_ = false;
+    return true;
+  }
+
+  ready_result_ = event_.isSet();
+  return ready_result_;
+}
+
+bool AsyncEvent::Awaiter::await_suspend(StateTask::Handle handle)
+{
+  auto waiter = std::make_shared<detail::Waiter>(handle);
+  {
+    std::lock_guard<std::mutex> lock(event_.mutex_);
+    if (event_.is_set_)
+    {
+      ready_result_ = true;
+      return false;
+    }
+
+    // Drop waiters that were cancelled since the last set().
+    event_.waiters_.erase(std::remove_if(event_.waiters_.begin(), event_.waiters_.end(),
+                                         [](const std::shared_ptr<detail::Waiter>& w) { return w->woken(); }),
+                          event_.waiters_.end());
+    event_.waiters_.push_back(waiter);
+  }
+
+  waiter_ = waiter;
+  context_.setStopCallback([waiter]() { waiter->wake(false); });
+  return true;
+}
+
+bool AsyncEvent::Awaiter::await_resume()
+{
+  if (waiter_ == nullptr)
+  {
+    return ready_result_;
+  }
+
+  context_.setStopCallback(nullptr);
+  return waiter_->result();
+}
+
+void AsyncEvent::set()
+{
+  std::vector<std::shared_ptr<detail::Waiter>> waiters;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_set_ = true;
+    waiters.swap(waiters_);
+  }
+
+  for (auto& waiter : waiters)
+  {
+    waiter->wake(true);
+  }
+}
+
+void AsyncEvent::reset()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  is_set_ = false;
+}
+
+bool AsyncEvent::isSet() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return is_set_;
+}
+
+AsyncEvent::Awaiter AsyncEvent::wait(StateMethodContext& context)
+{
+  return Awaiter(*this, context);
+}
+}  // namespace packml_sm
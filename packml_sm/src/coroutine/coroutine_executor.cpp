@@ -0,0 +1,137 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/coroutine/coroutine_executor.h"
+#include "packml_sm/dlog.h"
+
+#include <exception>
+
+namespace packml_sm
+{
+CoroutineExecutor::CoroutineExecutor() : thread_(&CoroutineExecutor::run, this)
+{
+}
+
+CoroutineExecutor::~CoroutineExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+
+  condition_.notify_all();
+  thread_.join();
+
+  // Pending resumes only hold handles, so the suspended frames are destroyed here rather than leaked.
+  ready_.clear();
+  timers_ = decltype(timers_)();
+  if (!frames_.empty())
+  {
+    DLog::LogWarning("Destroying %zu unfinished coroutine state methods", frames_.size());
+  }
+  for (void* frame : frames_)
+  {
+    std::coroutine_handle<>::from_address(frame).destroy();
+  }
+  frames_.clear();
+}
+
+CoroutineExecutor& CoroutineExecutor::defaultExecutor()
+{
+  static CoroutineExecutor executor;
+  return executor;
+}
+
+void CoroutineExecutor::post(std::function<void()> work)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.push_back(std::move(work));
+  }
+
+  condition_.notify_one();
+}
+
+void CoroutineExecutor::postAt(TimePoint when, std::function<void()> work)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timers_.push(Timer{ when, next_sequence_++, std::move(work) });
+  }
+
+  condition_.notify_one();
+}
+
+void CoroutineExecutor::adopt(std::coroutine_handle<> handle)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  frames_.insert(handle.address());
+}
+
+void CoroutineExecutor::release(std::coroutine_handle<> handle)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  frames_.erase(handle.address());
+}
+
+bool CoroutineExecutor::isExecutorThread() const
+{
+  return std::this_thread::get_id() == thread_.get_id();
+}
+
+void CoroutineExecutor::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_)
+  {
+    auto now = std::chrono::steady_clock::now();
+    while (!timers_.empty() && timers_.top().when <= now)
+    {
+      ready_.push_back(std::move(const_cast<Timer&>(timers_.top()).work));
+      timers_.pop();
+    }
+
+    if (ready_.empty())
+    {
+      if (timers_.empty())
+      {
+        condition_.wait(lock);
+      }
+      else
+      {
+        condition_.wait_until(lock, timers_.top().when);
+      }
+      continue;
+    }
+
+    auto work = std::move(ready_.front());
+    ready_.pop_front();
+    lock.unlock();
+
+    try
+    {
+      work();
+    }
+    catch (const std::exception& ex)
+    {
+      DLog::LogError("Coroutine executor work threw: %s", ex.what());
+    }
+
+    lock.lock();
+  }
+}
+}  // namespace packml_sm
@@ -0,0 +1,37 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/coroutine/state_task.h"
+
+namespace packml_sm
+{
+AsyncStateMethod coroutineStateMethod(std::function<StateTask(StateMethodContext&)> state_method,
+                                      CoroutineExecutor& executor)
+{
+  CoroutineExecutor* executor_ptr = &executor;
+  return AsyncStateMethod([state_method, executor_ptr](std::shared_ptr<StateMethodContext> context,
+                                                       std::function<void(int)> on_complete) {
+    // The completion handler holds the context, which the coroutine only references.
+    auto finish = [context, on_complete](int result) { on_complete(result); };
+    StateTask task = state_method(*context);
+    if (!task.start(*executor_ptr, finish))
+    {
+      finish(0);
+    }
+  });
+}
+}  // namespace packml_sm
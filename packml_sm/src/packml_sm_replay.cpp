@@ -0,0 +1,203 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/trace_replay.h"
+#include "ros/console.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [options] trace.csv [trace.csv ...]" << std::endl
+            << "  --ideal-cycle-time SECONDS  override the ideal cycle time recorded in the traces" << std::endl
+            << "  --inject-stop TIME:DURATION stop the machine at TIME for DURATION seconds (repeatable)" << std::endl
+            << "  --sample-period SECONDS     interval between snapshots, 0 for the final snapshot only"
+            << std::endl
+            << "  --jobs N                    number of traces replayed in parallel" << std::endl
+            << "  -o DIRECTORY                write <trace>_stats.csv files instead of printing to stdout"
+            << std::endl;
+}
+
+bool parseDouble(const std::string& text, double& value_out)
+{
+  char* end = nullptr;
+  value_out = std::strtod(text.c_str(), &end);
+  return !text.empty() && end != nullptr && *end == '\0';
+}
+
+std::string outputPath(const std::string& directory, const std::string& trace_path)
+{
+  std::string name = trace_path.substr(trace_path.find_last_of('/') + 1);
+  auto extension = name.find_last_of('.');
+  if (extension != std::string::npos && extension > 0)
+  {
+    name = name.substr(0, extension);
+  }
+  return directory + "/" + name + "_stats.csv";
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  packml_sm::ReplayOptions options;
+  std::vector<std::string> traces;
+  std::string output_directory;
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "-h" || arg == "--help")
+    {
+      printUsage(argv[0]);
+      return 0;
+    }
+    else if (arg == "--ideal-cycle-time" && has_value)
+    {
+      if (!parseDouble(argv[++i], options.ideal_cycle_time) || options.ideal_cycle_time < 0.0)
+      {
+        std::cerr << "Invalid ideal cycle time: " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--inject-stop" && has_value)
+    {
+      std::string value = argv[++i];
+      auto separator = value.find(':');
+      packml_sm::InjectedStop stop;
+      if (separator == std::string::npos || !parseDouble(value.substr(0, separator), stop.time) ||
+          !parseDouble(value.substr(separator + 1), stop.duration) || stop.time < 0.0 || stop.duration < 0.0)
+      {
+        std::cerr << "Invalid stop, expected TIME:DURATION: " << value << std::endl;
+        return 1;
+      }
+      options.injected_stops.push_back(stop);
+    }
+    else if (arg == "--sample-period" && has_value)
+    {
+      if (!parseDouble(argv[++i], options.sample_period) || options.sample_period < 0.0)
+      {
+        std::cerr << "Invalid sample period: " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--jobs" && has_value)
+    {
+      jobs = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+    }
+    else if (arg == "-o" && has_value)
+    {
+      output_directory = argv[++i];
+    }
+    else if (!arg.empty() && arg[0] == '-')
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      traces.push_back(arg);
+    }
+  }
+
+  if (traces.empty())
+  {
+    std::cerr << "No trace given." << std::endl;
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  if (traces.size() > 1 && output_directory.empty())
+  {
+    std::cerr << "Multiple traces need an output directory (-o)." << std::endl;
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // Every transition is logged at info level, which would dominate the replay time.
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn))
+  {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  // Each worker replays whole traces on its own state machine and virtual clock, so nothing is shared but the index.
+  std::atomic<size_t> next_trace(0);
+  std::atomic<int> failures(0);
+  std::mutex output_mutex;
+  auto worker = [&]() {
+    for (size_t index = next_trace++; index < traces.size(); index = next_trace++)
+    {
+      const std::string& trace_path = traces[index];
+      std::vector<packml_sm::TraceRecord> records;
+      std::vector<packml_sm::ReplaySample> samples;
+      std::string error;
+
+      std::ifstream input(trace_path);
+      bool ok = input.good() && packml_sm::TraceReplay::loadTrace(input, records, error);
+      if (ok)
+      {
+        packml_sm::TraceReplay replay(options);
+        ok = replay.run(records, samples);
+      }
+
+      if (ok && !output_directory.empty())
+      {
+        std::ofstream output(outputPath(output_directory, trace_path));
+        packml_sm::TraceReplay::writeSamples(output, samples);
+        ok = output.good();
+        if (!ok)
+        {
+          error = "failed to write " + outputPath(output_directory, trace_path);
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(output_mutex);
+      if (!ok)
+      {
+        std::cerr << trace_path << ": " << (error.empty() ? "failed to read trace" : error) << std::endl;
+        failures++;
+      }
+      else if (output_directory.empty())
+      {
+        packml_sm::TraceReplay::writeSamples(std::cout, samples);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < std::min<size_t>(jobs, traces.size()); i++)
+  {
+    workers.emplace_back(worker);
+  }
+  for (auto& thread : workers)
+  {
+    thread.join();
+  }
+
+  return failures > 0 ? 1 : 0;
+}
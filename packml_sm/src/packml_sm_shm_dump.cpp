@@ -0,0 +1,187 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/shm_stats.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace
+{
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [options] SEGMENT" << std::endl
+            << "  --follow         print every update until interrupted" << std::endl
+            << "  --timeout MS     give up following after MS milliseconds without an update (default 0, never)"
+            << std::endl;
+}
+
+const char* stateName(packml_sm::StatesEnum state)
+{
+  switch (state)
+  {
+    case packml_sm::StatesEnum::CLEARING: return "CLEARING";
+    case packml_sm::StatesEnum::STOPPED: return "STOPPED";
+    case packml_sm::StatesEnum::STARTING: return "STARTING";
+    case packml_sm::StatesEnum::IDLE: return "IDLE";
+    case packml_sm::StatesEnum::SUSPENDED: return "SUSPENDED";
+    case packml_sm::StatesEnum::EXECUTE: return "EXECUTE";
+    case packml_sm::StatesEnum::STOPPING: return "STOPPING";
+    case packml_sm::StatesEnum::ABORTING: return "ABORTING";
+    case packml_sm::StatesEnum::ABORTED: return "ABORTED";
+    case packml_sm::StatesEnum::HOLDING: return "HOLDING";
+    case packml_sm::StatesEnum::HELD: return "HELD";
+    case packml_sm::StatesEnum::UNHOLDING: return "UNHOLDING";
+    case packml_sm::StatesEnum::SUSPENDING: return "SUSPENDING";
+    case packml_sm::StatesEnum::UNSUSPENDING: return "UNSUSPENDING";
+    case packml_sm::StatesEnum::RESETTING: return "RESETTING";
+    case packml_sm::StatesEnum::COMPLETING: return "COMPLETING";
+    case packml_sm::StatesEnum::COMPLETE: return "COMPLETE";
+    default: return "UNDEFINED";
+  }
+}
+
+void printSample(const packml_sm::ShmStatsSample& sample)
+{
+  std::time_t stamp = std::chrono::system_clock::to_time_t(sample.stamp);
+  char stamp_text[32];
+  std::strftime(stamp_text, sizeof(stamp_text), "%Y-%m-%d %H:%M:%S", std::localtime(&stamp));
+
+  const packml_sm::PackmlStatsSnapshot& stats = sample.stats;
+  std::cout << "sequence: " << sample.sequence << std::endl
+            << "stamp: " << stamp_text << std::endl
+            << "state: " << stateName(sample.state) << " (" << static_cast<int>(sample.state) << ")" << std::endl
+            << std::fixed << std::setprecision(3) << "duration: " << stats.duration << std::endl
+            << "idle_duration: " << stats.idle_duration << std::endl
+            << "exe_duration: " << stats.exe_duration << std::endl
+            << "held_duration: " << stats.held_duration << std::endl
+            << "susp_duration: " << stats.susp_duration << std::endl
+            << "cmplt_duration: " << stats.cmplt_duration << std::endl
+            << "stop_duration: " << stats.stop_duration << std::endl
+            << "abort_duration: " << stats.abort_duration << std::endl
+            << "cycle_count: " << stats.cycle_count << std::endl
+            << "success_count: " << stats.success_count << std::endl
+            << "fail_count: " << stats.fail_count << std::endl
+            << "throughput: " << stats.throughput << std::endl
+            << "availability: " << stats.availability << std::endl
+            << "performance: " << stats.performance << std::endl
+            << "quality: " << stats.quality << std::endl
+            << "overall_equipment_effectiveness: " << stats.overall_equipment_effectiveness << std::endl;
+
+  for (const auto& item : stats.itemized_error_map)
+  {
+    std::cout << "error_item " << item.first << ": count " << item.second.count << ", duration "
+              << item.second.duration << std::endl;
+  }
+  for (const auto& item : stats.itemized_quality_map)
+  {
+    std::cout << "quality_item " << item.first << ": count " << item.second.count << ", duration "
+              << item.second.duration << std::endl;
+  }
+  if (sample.dropped_item_count > 0)
+  {
+    std::cout << "dropped_items: " << sample.dropped_item_count << std::endl;
+  }
+  std::cout << "---" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  std::string segment;
+  bool follow = false;
+  long timeout_ms = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help")
+    {
+      printUsage(argv[0]);
+      return 0;
+    }
+    else if (arg == "--follow")
+    {
+      follow = true;
+    }
+    else if (arg == "--timeout" && i + 1 < argc)
+    {
+      timeout_ms = std::atol(argv[++i]);
+    }
+    else if (!arg.empty() && arg[0] == '-')
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      segment = arg;
+    }
+  }
+
+  if (segment.empty())
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  packml_sm::ShmStatsReader reader;
+  if (!reader.open(segment))
+  {
+    std::cerr << "Could not open shared memory segment " << segment << std::endl;
+    return 1;
+  }
+
+  packml_sm::ShmStatsSample sample;
+  uint32_t sequence = 0;
+  if (reader.read(sample))
+  {
+    printSample(sample);
+    sequence = sample.sequence;
+  }
+  else if (!follow)
+  {
+    std::cerr << "Nothing exported to " << segment << " yet" << std::endl;
+    return 1;
+  }
+
+  // Without a timeout, wake up once a second anyway so a segment unlinked by the exporter is not waited on forever.
+  auto wait = std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 1000);
+  while (follow)
+  {
+    if (!reader.waitForChange(sequence, wait))
+    {
+      if (timeout_ms > 0)
+      {
+        std::cerr << "No update within " << timeout_ms << " ms" << std::endl;
+        return 1;
+      }
+      continue;
+    }
+
+    if (reader.read(sample))
+    {
+      printSample(sample);
+      sequence = sample.sequence;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,433 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/boost/packml_state_machine_continuous.h"
+#include "packml_sm/boost/packml_state_machine_single_cycle.h"
+#include "ros/console.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct SoakOptions
+{
+  double duration = 60.0;         /** seconds to run for */
+  double report_period = 10.0;    /** seconds between report lines */
+  int command_threads = 4;        /** threads sending commands */
+  double command_rate = 20.0;     /** commands per second per thread */
+  int event_threads = 2;          /** threads sending state complete and error events */
+  double event_rate = 20.0;       /** events per second per thread */
+  int stat_threads = 4;           /** threads incrementing stats */
+  double stat_rate = 200.0;       /** increments per second per thread */
+  double error_ratio = 0.02;      /** share of events that are error events */
+  bool continuous = true;         /** soak the continuous cycle state machine */
+  bool single_cycle = true;       /** soak the single cycle state machine */
+};
+
+/**
+ * @brief Lock free latency histogram with four buckets per power of two microseconds.
+ */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram()
+  {
+    for (auto& bucket : buckets_)
+    {
+      bucket = 0;
+    }
+  }
+
+  void record(std::chrono::steady_clock::duration latency)
+  {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    buckets_[bucketIndex(micros > 0 ? static_cast<uint64_t>(micros) : 0)]++;
+  }
+
+  /** Upper bound of the bucket holding the given quantile, in microseconds. */
+  uint64_t quantile(double quantile) const
+  {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_)
+    {
+      total += bucket;
+    }
+    if (total == 0)
+    {
+      return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+      seen += buckets_[i];
+      if (seen >= target)
+      {
+        return bucketUpperBound(i);
+      }
+    }
+    return bucketUpperBound(BUCKET_COUNT - 1);
+  }
+
+private:
+  static const size_t SUB_BUCKETS = 4;
+  static const size_t BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_;
+
+  static size_t bucketIndex(uint64_t micros)
+  {
+    if (micros < SUB_BUCKETS)
+    {
+      return static_cast<size_t>(micros);
+    }
+
+    size_t exponent = 63 - __builtin_clzll(micros);
+    size_t sub_bucket = static_cast<size_t>((micros >> (exponent - 2)) & (SUB_BUCKETS - 1));
+    return std::min(BUCKET_COUNT - 1, (exponent - 1) * SUB_BUCKETS + sub_bucket);
+  }
+
+  static uint64_t bucketUpperBound(size_t index)
+  {
+    if (index < SUB_BUCKETS)
+    {
+      return index;
+    }
+
+    size_t exponent = index / SUB_BUCKETS + 1;
+    uint64_t sub_bucket = index % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub_bucket + 1) << (exponent - 2)) - 1;
+  }
+};
+
+long readRssKb()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmRSS:") == 0)
+    {
+      return std::atol(line.c_str() + 6);
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Calls step at the given rate until stop is set.
+ */
+template <typename Step>
+void runAtRate(double rate, const std::atomic<bool>& stop, Step step)
+{
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(rate > 0.0 ? 1.0 / rate : 1.0));
+  auto next = std::chrono::steady_clock::now();
+  while (!stop)
+  {
+    step();
+    next += period;
+    std::this_thread::sleep_until(next);
+  }
+}
+
+template <typename StateMachine>
+class Soak
+{
+public:
+  Soak(const std::string& name, const SoakOptions& options)
+    : name_(name), options_(options), state_machine_(StateMachine::spawn())
+  {
+  }
+
+  void start()
+  {
+    state_machine_->setEventDispatchObserver(
+        [this](std::chrono::steady_clock::duration latency) { latency_.record(latency); });
+    state_machine_->activate();
+    start_rss_kb_ = readRssKb();
+
+    for (int i = 0; i < options_.command_threads; i++)
+    {
+      workers_.emplace_back(&Soak::commandLoop, this, i);
+    }
+    for (int i = 0; i < options_.event_threads; i++)
+    {
+      workers_.emplace_back(&Soak::eventLoop, this, i);
+    }
+    for (int i = 0; i < options_.stat_threads; i++)
+    {
+      workers_.emplace_back(&Soak::statLoop, this, i);
+    }
+  }
+
+  void stop()
+  {
+    stop_ = true;
+    for (auto& worker : workers_)
+    {
+      worker.join();
+    }
+    workers_.clear();
+    state_machine_->deactivate();
+  }
+
+  void report(double elapsed)
+  {
+    long rss_kb = readRssKb();
+    std::printf("%-12s t=%8.0fs state=%-2d accepted=%-10llu rejected=%-10llu dropped=%-10llu queue=%-5zu "
+                "p50=%lluus p99=%lluus p999=%lluus rss=%ldkB (+%ldkB)\n",
+                name_.c_str(), elapsed, static_cast<int>(state_machine_->getCurrentState()),
+                static_cast<unsigned long long>(accepted_.load()), static_cast<unsigned long long>(rejected_.load()),
+                static_cast<unsigned long long>(state_machine_->getDroppedEventCount()),
+                state_machine_->getEventQueueDepth(), static_cast<unsigned long long>(latency_.quantile(0.5)),
+                static_cast<unsigned long long>(latency_.quantile(0.99)),
+                static_cast<unsigned long long>(latency_.quantile(0.999)), rss_kb, rss_kb - start_rss_kb_);
+    std::fflush(stdout);
+  }
+
+private:
+  std::string name_;
+  SoakOptions options_;
+  std::shared_ptr<StateMachine> state_machine_;
+  std::vector<std::thread> workers_;
+  std::atomic<bool> stop_{ false };
+  std::atomic<uint64_t> accepted_{ 0 };
+  std::atomic<uint64_t> rejected_{ 0 };
+  LatencyHistogram latency_;
+  long start_rss_kb_ = 0;
+
+  void commandLoop(int seed)
+  {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> command(0, 8);
+    runAtRate(options_.command_rate, stop_, [&]() {
+      bool accepted = false;
+      switch (command(random))
+      {
+        case 0:
+          accepted = state_machine_->clear();
+          break;
+        case 1:
+          accepted = state_machine_->reset();
+          break;
+        case 2:
+          accepted = state_machine_->start();
+          break;
+        case 3:
+          accepted = state_machine_->stop();
+          break;
+        case 4:
+          accepted = state_machine_->hold();
+          break;
+        case 5:
+          accepted = state_machine_->unhold();
+          break;
+        case 6:
+          accepted = state_machine_->suspend();
+          break;
+        case 7:
+          accepted = state_machine_->unsuspend();
+          break;
+        default:
+          // Aborting is rare in production, keep it from dominating the run.
+          accepted = command(random) == 0 ? state_machine_->abort() : state_machine_->clear();
+      }
+      (accepted ? accepted_ : rejected_)++;
+    });
+  }
+
+  void eventLoop(int seed)
+  {
+    std::mt19937 random(1000 + seed);
+    std::bernoulli_distribution error(options_.error_ratio);
+    runAtRate(options_.event_rate, stop_, [&]() {
+      if (error(random))
+      {
+        state_machine_->enqueueEvent(packml_sm::error_event());
+      }
+      else
+      {
+        state_machine_->enqueueEvent(packml_sm::state_complete_event());
+      }
+    });
+  }
+
+  void statLoop(int seed)
+  {
+    std::mt19937 random(2000 + seed);
+    std::uniform_int_distribution<int> kind(0, 3);
+    std::uniform_int_distribution<int> item(0, 31);
+    runAtRate(options_.stat_rate, stop_, [&]() {
+      switch (kind(random))
+      {
+        case 0:
+          state_machine_->incrementSuccessCount();
+          break;
+        case 1:
+          state_machine_->incrementFailureCount();
+          break;
+        case 2:
+          state_machine_->incrementErrorStatItem(static_cast<int16_t>(item(random)), 1.0f, 0.1f);
+          break;
+        default:
+          state_machine_->incrementQualityStatItem(static_cast<int16_t>(item(random)), 1.0f, 0.1f);
+      }
+    });
+  }
+};
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [options]" << std::endl
+            << "  --duration SECONDS        total run time (default 60)" << std::endl
+            << "  --report-period SECONDS   time between report lines (default 10)" << std::endl
+            << "  --machine TYPE            continuous, single_cycle or both (default both)" << std::endl
+            << "  --command-threads N       --command-rate HZ (per thread)" << std::endl
+            << "  --event-threads N         --event-rate HZ (per thread)" << std::endl
+            << "  --stat-threads N          --stat-rate HZ (per thread)" << std::endl
+            << "  --error-ratio RATIO       share of events that are error events (default 0.02)" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  SoakOptions options;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc || arg == "-h" || arg == "--help")
+    {
+      printUsage(argv[0]);
+      return arg == "-h" || arg == "--help" ? 0 : 1;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--duration")
+    {
+      options.duration = std::atof(value.c_str());
+    }
+    else if (arg == "--report-period")
+    {
+      options.report_period = std::atof(value.c_str());
+    }
+    else if (arg == "--machine")
+    {
+      options.continuous = value == "continuous" || value == "both";
+      options.single_cycle = value == "single_cycle" || value == "both";
+    }
+    else if (arg == "--command-threads")
+    {
+      options.command_threads = std::atoi(value.c_str());
+    }
+    else if (arg == "--command-rate")
+    {
+      options.command_rate = std::atof(value.c_str());
+    }
+    else if (arg == "--event-threads")
+    {
+      options.event_threads = std::atoi(value.c_str());
+    }
+    else if (arg == "--event-rate")
+    {
+      options.event_rate = std::atof(value.c_str());
+    }
+    else if (arg == "--stat-threads")
+    {
+      options.stat_threads = std::atoi(value.c_str());
+    }
+    else if (arg == "--stat-rate")
+    {
+      options.stat_rate = std::atof(value.c_str());
+    }
+    else if (arg == "--error-ratio")
+    {
+      options.error_ratio = std::atof(value.c_str());
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if ((!options.continuous && !options.single_cycle) || options.duration <= 0.0 || options.report_period <= 0.0)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // Rejected commands are logged as warnings, which would swamp the report at soak rates.
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Error))
+  {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  Soak<packml_sm::PackmlStateMachineContinuous> continuous("continuous", options);
+  Soak<packml_sm::PackmlStateMachineSingleCycle> single_cycle("single_cycle", options);
+  if (options.continuous)
+  {
+    continuous.start();
+  }
+  if (options.single_cycle)
+  {
+    single_cycle.start();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto next_report = start;
+  double elapsed = 0.0;
+  while (elapsed < options.duration)
+  {
+    next_report += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.report_period));
+    std::this_thread::sleep_until(next_report);
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (options.continuous)
+    {
+      continuous.report(elapsed);
+    }
+    if (options.single_cycle)
+    {
+      single_cycle.report(elapsed);
+    }
+  }
+
+  if (options.continuous)
+  {
+    continuous.stop();
+  }
+  if (options.single_cycle)
+  {
+    single_cycle.stop();
+  }
+  return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/shm_stats.h"
+#include "packml_sm/dlog.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace packml_sm
+{
+const uint32_t ShmStatsPayload::MAX_ITEMS;
+const uint32_t ShmStatsBlock::MAGIC;
+const uint32_t ShmStatsBlock::VERSION;
+
+namespace
+{
+std::string segmentName(const std::string& name)
+{
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+int futex(std::atomic<uint32_t>* word, int op, uint32_t value, const struct timespec* timeout)
+{
+  // Not FUTEX_PRIVATE_FLAG, the waiters live in other processes.
+  return static_cast<int>(syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0));
+}
+
+uint32_t fillItems(const std::map<int16_t, PackmlStatsItemized>& items, ShmStatsItem* out, uint32_t& dropped)
+{
+  uint32_t count = 0;
+  for (const auto& item : items)
+  {
+    if (count >= ShmStatsPayload::MAX_ITEMS)
+    {
+      dropped++;
+      continue;
+    }
+    std::memset(&out[count], 0, sizeof(ShmStatsItem));
+    out[count].id = item.second.id;
+    out[count].count = item.second.count;
+    out[count].duration = item.second.duration;
+    count++;
+  }
+  return count;
+}
+
+void fillMap(const ShmStatsItem* items, uint32_t count, std::map<int16_t, PackmlStatsItemized>& out)
+{
+  out.clear();
+  for (uint32_t i = 0; i < count && i < ShmStatsPayload::MAX_ITEMS; i++)
+  {
+    PackmlStatsItemized item;
+    item.id = items[i].id;
+    item.count = items[i].count;
+    item.duration = items[i].duration;
+    out.insert(std::make_pair(item.id, item));
+  }
+}
+
+int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+ShmStatsExporter::ShmStatsExporter()
+{
+  std::memset(&payload_, 0, sizeof(payload_));
+}
+
+ShmStatsExporter::~ShmStatsExporter()
+{
+  close();
+}
+
+bool ShmStatsExporter::open(const std::string& name)
+{
+  close();
+
+  std::string segment = segmentName(name);
+  int fd = shm_open(segment.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+  {
+    DLog::LogError("Failed to create shared memory segment %s: %s", segment.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  void* address = MAP_FAILED;
+  if (ftruncate(fd, sizeof(ShmStatsBlock)) == 0)
+  {
+    address = mmap(nullptr, sizeof(ShmStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int error = errno;
+  ::close(fd);
+
+  if (address == MAP_FAILED)
+  {
+    DLog::LogError("Failed to map shared memory segment %s: %s", segment.c_str(), std::strerror(error));
+    shm_unlink(segment.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  name_ = segment;
+  block_ = static_cast<ShmStatsBlock*>(address);
+
+  // A segment left behind by a crashed writer may be mid update, move it to the next even sequence.
+  uint32_t sequence = block_->sequence.load(std::memory_order_relaxed);
+  block_->sequence.store((sequence + 1) & ~1u, std::memory_order_relaxed);
+  block_->version = ShmStatsBlock::VERSION;
+  block_->size = sizeof(ShmStatsBlock);
+  std::atomic_thread_fence(std::memory_order_release);
+  block_->magic = ShmStatsBlock::MAGIC;
+
+  DLog::LogInfo("Exporting state and stats to shared memory segment %s", segment.c_str());
+  return true;
+}
+
+void ShmStatsExporter::close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (block_ == nullptr)
+  {
+    return;
+  }
+
+  munmap(block_, sizeof(ShmStatsBlock));
+  shm_unlink(name_.c_str());
+  block_ = nullptr;
+  name_.clear();
+}
+
+void ShmStatsExporter::publishState(StatesEnum state)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  payload_.stamp_ns = nowNs();
+  payload_.state = static_cast<int32_t>(state);
+  write();
+}
+
+void ShmStatsExporter::publishStats(StatesEnum state, const PackmlStatsSnapshot& snapshot)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  payload_.stamp_ns = nowNs();
+  payload_.state = static_cast<int32_t>(state);
+  payload_.cycle_count = snapshot.cycle_count;
+  payload_.success_count = snapshot.success_count;
+  payload_.fail_count = snapshot.fail_count;
+  payload_.duration = snapshot.duration;
+  payload_.idle_duration = snapshot.idle_duration;
+  payload_.exe_duration = snapshot.exe_duration;
+  payload_.held_duration = snapshot.held_duration;
+  payload_.susp_duration = snapshot.susp_duration;
+  payload_.cmplt_duration = snapshot.cmplt_duration;
+  payload_.stop_duration = snapshot.stop_duration;
+  payload_.abort_duration = snapshot.abort_duration;
+  payload_.throughput = snapshot.throughput;
+  payload_.availability = snapshot.availability;
+  payload_.performance = snapshot.performance;
+  payload_.quality = snapshot.quality;
+  payload_.overall_equipment_effectiveness = snapshot.overall_equipment_effectiveness;
+  payload_.dropped_item_count = 0;
+  payload_.error_item_count = fillItems(snapshot.itemized_error_map, payload_.error_items, payload_.dropped_item_count);
+  payload_.quality_item_count =
+      fillItems(snapshot.itemized_quality_map, payload_.quality_items, payload_.dropped_item_count);
+  write();
+}
+
+void ShmStatsExporter::write()
+{
+  if (block_ == nullptr)
+  {
+    return;
+  }
+
+  uint32_t sequence = block_->sequence.load(std::memory_order_relaxed);
+  block_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&block_->payload, &payload_, sizeof(ShmStatsPayload));
+  // Skip 0 on wrap around, readers treat it as "never exported".
+  uint32_t next = sequence + 2 == 0 ? 2 : sequence + 2;
+  block_->sequence.store(next, std::memory_order_seq_cst);
+
+  if (block_->waiters.load(std::memory_order_seq_cst) > 0)
+  {
+    futex(&block_->sequence, FUTEX_WAKE, INT_MAX, nullptr);
+  }
+}
+
+ShmStatsReader::ShmStatsReader()
+{
+}
+
+ShmStatsReader::~ShmStatsReader()
+{
+  close();
+}
+
+bool ShmStatsReader::open(const std::string& name)
+{
+  close();
+
+  std::string segment = segmentName(name);
+  int fd = shm_open(segment.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    DLog::LogError("Failed to open shared memory segment %s: %s", segment.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  void* address = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(ShmStatsBlock)))
+  {
+    // Read/write so blocked readers can register in waiters.
+    address = mmap(nullptr, sizeof(ShmStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+
+  if (address == MAP_FAILED)
+  {
+    DLog::LogError("Shared memory segment %s is too small or could not be mapped", segment.c_str());
+    return false;
+  }
+
+  auto block = static_cast<ShmStatsBlock*>(address);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (block->magic != ShmStatsBlock::MAGIC || block->version != ShmStatsBlock::VERSION ||
+      block->size != sizeof(ShmStatsBlock))
+  {
+    DLog::LogError("Shared memory segment %s has an incompatible layout (version %u, size %u)", segment.c_str(),
+                   block->version, block->size);
+    munmap(address, sizeof(ShmStatsBlock));
+    return false;
+  }
+
+  block_ = block;
+  return true;
+}
+
+void ShmStatsReader::close()
+{
+  if (block_ != nullptr)
+  {
+    munmap(block_, sizeof(ShmStatsBlock));
+    block_ = nullptr;
+  }
+}
+
+uint32_t ShmStatsReader::getSequence() const
+{
+  return block_ == nullptr ? 0 : block_->sequence.load(std::memory_order_acquire);
+}
+
+bool ShmStatsReader::read(ShmStatsSample& sample_out, int max_retries) const
+{
+  if (block_ == nullptr)
+  {
+    return false;
+  }
+
+  ShmStatsPayload payload;
+  uint32_t sequence = 0;
+  bool consistent = false;
+  for (int attempt = 0; attempt <= max_retries && !consistent; attempt++)
+  {
+    sequence = block_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1u)
+    {
+      sched_yield();
+      continue;
+    }
+    std::memcpy(&payload, &block_->payload, sizeof(ShmStatsPayload));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    consistent = block_->sequence.load(std::memory_order_relaxed) == sequence;
+  }
+
+  if (!consistent || sequence == 0)
+  {
+    return false;
+  }
+
+  sample_out.sequence = sequence;
+  sample_out.stamp = std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(payload.stamp_ns)));
+  sample_out.state = static_cast<StatesEnum>(payload.state);
+  sample_out.dropped_item_count = payload.dropped_item_count;
+
+  PackmlStatsSnapshot& stats = sample_out.stats;
+  stats.cycle_count = payload.cycle_count;
+  stats.success_count = payload.success_count;
+  stats.fail_count = payload.fail_count;
+  stats.duration = payload.duration;
+  stats.idle_duration = payload.idle_duration;
+  stats.exe_duration = payload.exe_duration;
+  stats.held_duration = payload.held_duration;
+  stats.susp_duration = payload.susp_duration;
+  stats.cmplt_duration = payload.cmplt_duration;
+  stats.stop_duration = payload.stop_duration;
+  stats.abort_duration = payload.abort_duration;
+  stats.throughput = payload.throughput;
+  stats.availability = payload.availability;
+  stats.performance = payload.performance;
+  stats.quality = payload.quality;
+  stats.overall_equipment_effectiveness = payload.overall_equipment_effectiveness;
+  fillMap(payload.error_items, payload.error_item_count, stats.itemized_error_map);
+  fillMap(payload.quality_items, payload.quality_item_count, stats.itemized_quality_map);
+  return true;
+}
+
+bool ShmStatsReader::waitForChange(uint32_t sequence, std::chrono::milliseconds timeout)
+{
+  if (block_ == nullptr)
+  {
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  block_->waiters.fetch_add(1, std::memory_order_seq_cst);
+  uint32_t current = block_->sequence.load(std::memory_order_seq_cst);
+  // An odd sequence is a write in progress, wait for it to finish as well.
+  while (current == sequence || (current & 1u))
+  {
+    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0)
+    {
+      break;
+    }
+    struct timespec relative;
+    relative.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+    relative.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+    futex(&block_->sequence, FUTEX_WAIT, current, &relative);
+    current = block_->sequence.load(std::memory_order_seq_cst);
+  }
+  block_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+
+  return current != sequence && !(current & 1u);
+}
+}  // namespace packml_sm
@@ -0,0 +1,112 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/state_method_context.h"
+
+namespace packml_sm
+{
+StopToken::StopToken(std::shared_ptr<SharedState> state) : state_(state)
+{
+}
+
+bool StopToken::stopRequested() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stop_requested;
+}
+
+bool StopToken::waitFor(std::chrono::nanoseconds timeout) const
+{
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  return state_->condition.wait_for(lock, timeout, [this]() { return state_->stop_requested; });
+}
+
+StateMethodContext::StateMethodContext(StatesEnum state, std::shared_ptr<Clock> clock)
+  : state_(state)
+  , shared_state_(std::make_shared<StopToken::SharedState>())
+  , stop_token_(shared_state_)
+  , clock_(clock)
+  , entry_time_(clock != nullptr ? clock->now() : std::chrono::steady_clock::now())
+  , next_yield_(std::chrono::steady_clock::now())
+{
+}
+
+CmdEnum StateMethodContext::pendingCommand() const
+{
+  std::lock_guard<std::mutex> lock(shared_state_->mutex);
+  return shared_state_->command;
+}
+
+Clock::Duration StateMethodContext::timeInState() const
+{
+  return (clock_ != nullptr ? clock_->now() : std::chrono::steady_clock::now()) - entry_time_;
+}
+
+bool StateMethodContext::yield(std::chrono::nanoseconds period)
+{
+  auto now = std::chrono::steady_clock::now();
+  next_yield_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+
+  // Don't try to catch up after an overrun, start a fresh period instead.
+  if (next_yield_ < now)
+  {
+    next_yield_ = now;
+  }
+
+  std::unique_lock<std::mutex> lock(shared_state_->mutex);
+  return !shared_state_->condition.wait_until(lock, next_yield_, [this]() { return shared_state_->stop_requested; });
+}
+
+void StateMethodContext::requestStop(CmdEnum command)
+{
+  std::function<void()> callback;
+  {
+    std::lock_guard<std::mutex> lock(shared_state_->mutex);
+    if (shared_state_->stop_requested)
+    {
+      return;
+    }
+
+    shared_state_->stop_requested = true;
+    shared_state_->command = command;
+    callback.swap(shared_state_->stop_callback);
+  }
+
+  shared_state_->condition.notify_all();
+  if (callback != nullptr)
+  {
+    callback();
+  }
+}
+
+void StateMethodContext::setStopCallback(std::function<void()> callback)
+{
+  {
+    std::lock_guard<std::mutex> lock(shared_state_->mutex);
+    if (!shared_state_->stop_requested)
+    {
+      shared_state_->stop_callback = callback;
+      return;
+    }
+  }
+
+  if (callback != nullptr)
+  {
+    callback();
+  }
+}
+}  // namespace packml_sm
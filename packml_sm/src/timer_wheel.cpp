@@ -0,0 +1,165 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/timer_wheel.h"
+
+#include <algorithm>
+
+namespace packml_sm
+{
+const TimerWheel::TimerId TimerWheel::INVALID_TIMER;
+
+TimerWheel::TimerWheel(std::chrono::nanoseconds resolution, size_t slot_count)
+  : resolution_(resolution.count() > 0 ? resolution : std::chrono::nanoseconds(1))
+  , slots_(slot_count > 0 ? slot_count : 1)
+{
+}
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::nanoseconds delay, Callback callback)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Round up so a timer never fires early, and always wait at least one tick.
+  uint64_t ticks = 1;
+  if (delay.count() > 0)
+  {
+    ticks = static_cast<uint64_t>((delay.count() + resolution_.count() - 1) / resolution_.count());
+  }
+
+  Timer timer;
+  timer.id = next_id_++;
+  timer.expiry_tick = current_tick_ + ticks;
+  timer.callback = callback;
+
+  size_t slot_index = timer.expiry_tick % slots_.size();
+  Slot& slot = slots_[slot_index];
+  auto iter = slot.insert(slot.end(), timer);
+  index_[timer.id] = std::make_pair(slot_index, iter);
+
+  return timer.id;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto index_it = index_.find(id);
+  if (index_it == index_.end())
+  {
+    return false;
+  }
+
+  slots_[index_it->second.first].erase(index_it->second.second);
+  index_.erase(index_it);
+  return true;
+}
+
+size_t TimerWheel::advance(std::chrono::nanoseconds elapsed)
+{
+  std::vector<Timer> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (elapsed.count() > 0)
+    {
+      carry_ += elapsed;
+    }
+
+    uint64_t ticks = static_cast<uint64_t>(carry_.count() / resolution_.count());
+    carry_ -= resolution_ * static_cast<int64_t>(ticks);
+    uint64_t target_tick = current_tick_ + ticks;
+
+    if (ticks >= slots_.size())
+    {
+      // Large jumps (e.g. a simulated clock) visit every slot once instead of walking tick by tick.
+      for (size_t slot_index = 0; slot_index < slots_.size() && !index_.empty(); ++slot_index)
+      {
+        collectExpired(slot_index, target_tick, expired);
+      }
+    }
+    else
+    {
+      for (uint64_t tick = current_tick_ + 1; tick <= target_tick && !index_.empty(); ++tick)
+      {
+        collectExpired(tick % slots_.size(), tick, expired);
+      }
+    }
+
+    current_tick_ = target_tick;
+  }
+
+  // Fire in expiry order (and schedule order for equal expiries) so results do not depend on the wheel layout.
+  std::stable_sort(expired.begin(), expired.end(), [](const Timer& lhs, const Timer& rhs) {
+    return lhs.expiry_tick < rhs.expiry_tick || (lhs.expiry_tick == rhs.expiry_tick && lhs.id < rhs.id);
+  });
+
+  for (auto& timer : expired)
+  {
+    if (timer.callback != nullptr)
+    {
+      timer.callback();
+    }
+  }
+
+  return expired.size();
+}
+
+size_t TimerWheel::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+bool TimerWheel::nextExpiry(std::chrono::nanoseconds& delay_out) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (index_.empty())
+  {
+    return false;
+  }
+
+  uint64_t earliest_tick = UINT64_MAX;
+  for (const auto& entry : index_)
+  {
+    earliest_tick = std::min(earliest_tick, entry.second.second->expiry_tick);
+  }
+
+  // Time already carried towards the next tick counts against the delay.
+  delay_out = resolution_ * static_cast<int64_t>(earliest_tick - current_tick_) - carry_;
+  if (delay_out.count() < 0)
+  {
+    delay_out = std::chrono::nanoseconds(0);
+  }
+  return true;
+}
+
+void TimerWheel::collectExpired(size_t slot_index, uint64_t tick, std::vector<Timer>& expired)
+{
+  Slot& slot = slots_[slot_index];
+  for (auto iter = slot.begin(); iter != slot.end();)
+  {
+    if (iter->expiry_tick <= tick)
+    {
+      index_.erase(iter->id);
+      expired.push_back(*iter);
+      iter = slot.erase(iter);
+    }
+    else
+    {
+      ++iter;
+    }
+  }
+}
+}  // namespace packml_sm
@@ -0,0 +1,428 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "packml_sm/trace_replay.h"
+#include "packml_sm/clock.h"
+#include "packml_sm/dlog.h"
+#include "packml_sm/boost/packml_state_machine_continuous.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+
+namespace packml_sm
+{
+namespace
+{
+const std::map<std::string, CmdEnum> COMMAND_NAMES = {
+  { "reset", CmdEnum::RESET },   { "start", CmdEnum::START },         { "stop", CmdEnum::STOP },
+  { "hold", CmdEnum::HOLD },     { "unhold", CmdEnum::UNHOLD },       { "suspend", CmdEnum::SUSPEND },
+  { "unsuspend", CmdEnum::UNSUSPEND }, { "abort", CmdEnum::ABORT }, { "clear", CmdEnum::CLEAR }
+};
+
+const std::map<std::string, TraceRecordType> TYPE_NAMES = {
+  { "command", TraceRecordType::COMMAND },
+  { "state_complete", TraceRecordType::STATE_COMPLETE },
+  { "error", TraceRecordType::STATE_ERROR },
+  { "success", TraceRecordType::SUCCESS },
+  { "failure", TraceRecordType::FAILURE },
+  { "error_item", TraceRecordType::ERROR_ITEM },
+  { "quality_item", TraceRecordType::QUALITY_ITEM },
+  { "ideal_cycle_time", TraceRecordType::IDEAL_CYCLE_TIME }
+};
+
+std::string trim(const std::string& text)
+{
+  auto begin = text.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos)
+  {
+    return "";
+  }
+  auto end = text.find_last_not_of(" \t\r\n");
+  return text.substr(begin, end - begin + 1);
+}
+
+std::string toLower(std::string text)
+{
+  std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+bool parseNumber(const std::string& text, double& value_out)
+{
+  if (text.empty())
+  {
+    return false;
+  }
+
+  char* end = nullptr;
+  value_out = std::strtod(text.c_str(), &end);
+  return end != nullptr && *end == '\0';
+}
+
+Clock::Duration toDuration(double seconds)
+{
+  return std::chrono::duration_cast<Clock::Duration>(std::chrono::duration<double>(seconds));
+}
+
+/**
+ * @brief Replay steps in processing order: trace entries and the start and end of injected stops.
+ */
+struct ReplayStep
+{
+  /** Ordered so that at equal times a stop ends before, and begins after, the recorded entries. */
+  enum Kind
+  {
+    STOP_END,
+    RECORD,
+    STOP_BEGIN
+  };
+
+  double time;
+  Kind kind;
+  const TraceRecord* record;
+};
+
+void sendCommand(PackmlStateMachineContinuous& state_machine, CmdEnum command)
+{
+  // Trigger the events directly instead of queueing them so every command is applied at its own virtual time.
+  // Commands that are invalid in the current state are ignored by the transition table.
+  switch (command)
+  {
+    case CmdEnum::CLEAR:
+      state_machine.triggerEvent(clear_event());
+      break;
+    case CmdEnum::START:
+      state_machine.triggerEvent(start_event());
+      break;
+    case CmdEnum::STOP:
+      state_machine.triggerEvent(stop_event());
+      break;
+    case CmdEnum::HOLD:
+      state_machine.triggerEvent(hold_event());
+      break;
+    case CmdEnum::ABORT:
+      state_machine.triggerEvent(abort_event());
+      break;
+    case CmdEnum::RESET:
+      state_machine.triggerEvent(reset_event());
+      break;
+    case CmdEnum::SUSPEND:
+      state_machine.triggerEvent(suspend_event());
+      break;
+    case CmdEnum::UNSUSPEND:
+      state_machine.triggerEvent(unsuspend_event());
+      break;
+    case CmdEnum::UNHOLD:
+      state_machine.triggerEvent(unhold_event());
+      break;
+    default:
+      DLog::LogError("Unsupported command in trace.");
+  }
+}
+}  // namespace
+
+TraceReplay::TraceReplay(const ReplayOptions& options) : options_(options)
+{
+}
+
+bool TraceReplay::parseRecord(const std::string& line, TraceRecord& record_out, std::string& error_out)
+{
+  std::vector<std::string> fields;
+  std::stringstream stream(line);
+  std::string field;
+  while (std::getline(stream, field, ','))
+  {
+    fields.push_back(trim(field));
+  }
+
+  if (fields.size() < 2)
+  {
+    error_out = "expected at least time and type";
+    return false;
+  }
+
+  TraceRecord record;
+  if (!parseNumber(fields[0], record.time) || record.time < 0.0)
+  {
+    error_out = "invalid time '" + fields[0] + "'";
+    return false;
+  }
+
+  auto type_it = TYPE_NAMES.find(toLower(fields[1]));
+  if (type_it == TYPE_NAMES.end())
+  {
+    error_out = "unknown type '" + fields[1] + "'";
+    return false;
+  }
+  record.type = type_it->second;
+
+  std::string value = fields.size() > 2 ? fields[2] : "";
+  double number = 0.0;
+  switch (record.type)
+  {
+    case TraceRecordType::COMMAND:
+    {
+      auto command_it = COMMAND_NAMES.find(toLower(value));
+      if (command_it != COMMAND_NAMES.end())
+      {
+        record.value = static_cast<int>(command_it->second);
+      }
+      else if (parseNumber(value, number))
+      {
+        record.value = static_cast<int>(number);
+      }
+      else
+      {
+        error_out = "unknown command '" + value + "'";
+        return false;
+      }
+      break;
+    }
+    case TraceRecordType::ERROR_ITEM:
+    case TraceRecordType::QUALITY_ITEM:
+      if (!parseNumber(value, number))
+      {
+        error_out = "invalid item id '" + value + "'";
+        return false;
+      }
+      record.value = static_cast<int>(number);
+      break;
+    default:
+      break;
+  }
+
+  if (fields.size() > 3 && !fields[3].empty())
+  {
+    if (!parseNumber(fields[3], number))
+    {
+      error_out = "invalid count '" + fields[3] + "'";
+      return false;
+    }
+    record.count = static_cast<float>(number);
+  }
+
+  if (fields.size() > 4 && !fields[4].empty())
+  {
+    if (!parseNumber(fields[4], number))
+    {
+      error_out = "invalid duration '" + fields[4] + "'";
+      return false;
+    }
+    record.duration = static_cast<float>(number);
+  }
+
+  record_out = record;
+  return true;
+}
+
+bool TraceReplay::loadTrace(std::istream& input, std::vector<TraceRecord>& records_out, std::string& error_out)
+{
+  records_out.clear();
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(input, line))
+  {
+    line_number++;
+    std::string trimmed = trim(line);
+    if (trimmed.empty() || trimmed[0] == '#' || toLower(trimmed.substr(0, 4)) == "time")
+    {
+      continue;
+    }
+
+    TraceRecord record;
+    std::string error;
+    if (!parseRecord(trimmed, record, error))
+    {
+      error_out = "line " + std::to_string(line_number) + ": " + error;
+      return false;
+    }
+    records_out.push_back(record);
+  }
+
+  return true;
+}
+
+bool TraceReplay::run(const std::vector<TraceRecord>& records, std::vector<ReplaySample>& samples_out)
+{
+  samples_out.clear();
+
+  std::vector<ReplayStep> steps;
+  steps.reserve(records.size() + 2 * options_.injected_stops.size());
+  for (const auto& record : records)
+  {
+    steps.push_back({ record.time, ReplayStep::RECORD, &record });
+  }
+  for (const auto& stop : options_.injected_stops)
+  {
+    steps.push_back({ stop.time, ReplayStep::STOP_BEGIN, nullptr });
+    steps.push_back({ stop.time + std::max(stop.duration, 0.0), ReplayStep::STOP_END, nullptr });
+  }
+  std::stable_sort(steps.begin(), steps.end(), [](const ReplayStep& lhs, const ReplayStep& rhs) {
+    return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.kind < rhs.kind);
+  });
+
+  auto clock = std::make_shared<ManualClock>();
+  const auto start = clock->now();
+  // Manual drive keeps the replay on this thread, without an event loop thread per replay.
+  auto state_machine = PackmlStateMachineContinuous::spawn();
+  state_machine->setManualDrive(true);
+  state_machine->setClock(clock);
+  if (options_.ideal_cycle_time >= 0.0)
+  {
+    state_machine->setIdealCycleTime(options_.ideal_cycle_time);
+  }
+  state_machine->activate();
+
+  auto sample = [&](double time) {
+    ReplaySample sample;
+    sample.time = time;
+    sample.state = state_machine->getCurrentState();
+    state_machine->getCurrentStatSnapshot(sample.snapshot);
+    samples_out.push_back(sample);
+  };
+
+  double next_sample = options_.sample_period;
+  auto advance_to = [&](double time) {
+    while (options_.sample_period > 0.0 && next_sample <= time)
+    {
+      clock->set(start + toDuration(next_sample));
+      sample(next_sample);
+      next_sample += options_.sample_period;
+    }
+    clock->set(start + toDuration(time));
+  };
+
+  int active_stops = 0;
+  bool stopped_by_injection = false;
+  double end_time = 0.0;
+  for (const auto& step : steps)
+  {
+    advance_to(step.time);
+    end_time = step.time;
+
+    if (step.kind == ReplayStep::STOP_BEGIN)
+    {
+      // Overlapping stops extend the outage until the last one ends.
+      if (active_stops++ == 0 && state_machine->getCurrentState() == StatesEnum::EXECUTE)
+      {
+        state_machine->triggerEvent(stop_event());
+        state_machine->triggerEvent(state_complete_event());
+        stopped_by_injection = true;
+      }
+      continue;
+    }
+
+    if (step.kind == ReplayStep::STOP_END)
+    {
+      if (--active_stops == 0 && stopped_by_injection)
+      {
+        state_machine->triggerEvent(reset_event());
+        state_machine->triggerEvent(state_complete_event());
+        state_machine->triggerEvent(start_event());
+        state_machine->triggerEvent(state_complete_event());
+        stopped_by_injection = false;
+      }
+      continue;
+    }
+
+    const TraceRecord& record = *step.record;
+    if (record.type == TraceRecordType::IDEAL_CYCLE_TIME)
+    {
+      if (options_.ideal_cycle_time < 0.0)
+      {
+        state_machine->setIdealCycleTime(record.count);
+      }
+      continue;
+    }
+
+    // Nothing recorded during an injected stop happens: the machine is not running.
+    if (stopped_by_injection)
+    {
+      continue;
+    }
+
+    switch (record.type)
+    {
+      case TraceRecordType::COMMAND:
+        sendCommand(*state_machine, static_cast<CmdEnum>(record.value));
+        break;
+      case TraceRecordType::STATE_COMPLETE:
+        state_machine->triggerEvent(state_complete_event());
+        break;
+      case TraceRecordType::STATE_ERROR:
+        state_machine->triggerEvent(error_event());
+        break;
+      case TraceRecordType::SUCCESS:
+        for (int i = 0; i < static_cast<int>(record.count); i++)
+        {
+          state_machine->incrementSuccessCount();
+        }
+        break;
+      case TraceRecordType::FAILURE:
+        for (int i = 0; i < static_cast<int>(record.count); i++)
+        {
+          state_machine->incrementFailureCount();
+        }
+        break;
+      case TraceRecordType::ERROR_ITEM:
+        state_machine->incrementErrorStatItem(record.value, record.count, record.duration);
+        break;
+      case TraceRecordType::QUALITY_ITEM:
+        state_machine->incrementQualityStatItem(record.value, record.count, record.duration);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (samples_out.empty() || samples_out.back().time < end_time)
+  {
+    sample(end_time);
+  }
+
+  state_machine->deactivate();
+  return true;
+}
+
+void TraceReplay::writeSamples(std::ostream& output, const std::vector<ReplaySample>& samples)
+{
+  output << "time,state,duration,idle_duration,exe_duration,held_duration,susp_duration,cmplt_duration,"
+            "stop_duration,abort_duration,cycle_count,success_count,fail_count,throughput,availability,"
+            "performance,quality,overall_equipment_effectiveness\n";
+
+  std::ios::fmtflags flags(output.flags());
+  output << std::fixed << std::setprecision(6);
+  for (const auto& sample : samples)
+  {
+    const PackmlStatsSnapshot& snapshot = sample.snapshot;
+    output << sample.time << "," << static_cast<int>(sample.state) << "," << snapshot.duration << ","
+           << snapshot.idle_duration << "," << snapshot.exe_duration << "," << snapshot.held_duration << ","
+           << snapshot.susp_duration << "," << snapshot.cmplt_duration << "," << snapshot.stop_duration << ","
+           << snapshot.abort_duration << "," << snapshot.cycle_count << "," << snapshot.success_count << ","
+           << snapshot.fail_count << "," << snapshot.throughput << "," << snapshot.availability << ","
+           << snapshot.performance << "," << snapshot.quality << "," << snapshot.overall_equipment_effectiveness
+           << "\n";
+  }
+  output.flags(flags);
+}
+}  // namespace packml_sm
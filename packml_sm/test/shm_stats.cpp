@@ -0,0 +1,120 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include "packml_sm/shm_stats.h"
+
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace packml_sm_test
+{
+using namespace packml_sm;
+
+std::string testSegmentName()
+{
+  return "packml_sm_test_" + std::to_string(getpid());
+}
+
+TEST(ShmStats, round_trip)
+{
+  ShmStatsExporter exporter;
+  ASSERT_TRUE(exporter.open(testSegmentName()));
+
+  ShmStatsReader reader;
+  ASSERT_TRUE(reader.open(testSegmentName()));
+  ShmStatsSample sample;
+  ASSERT_FALSE(reader.read(sample));
+
+  PackmlStatsSnapshot snapshot = PackmlStatsSnapshot();
+  snapshot.cycle_count = 10;
+  snapshot.success_count = 8;
+  snapshot.fail_count = 2;
+  snapshot.exe_duration = 42.0;
+  snapshot.overall_equipment_effectiveness = 0.75f;
+  snapshot.itemized_error_map[3] = PackmlStatsItemized{ 3, 1.0, 2.5 };
+  snapshot.itemized_quality_map[7] = PackmlStatsItemized{ 7, 4.0, 0.0 };
+  exporter.publishStats(StatesEnum::EXECUTE, snapshot);
+
+  ASSERT_TRUE(reader.read(sample));
+  uint32_t first_sequence = sample.sequence;
+  ASSERT_EQ(sample.state, StatesEnum::EXECUTE);
+  ASSERT_EQ(sample.stats.cycle_count, 10);
+  ASSERT_EQ(sample.stats.success_count, 8);
+  ASSERT_EQ(sample.stats.fail_count, 2);
+  ASSERT_DOUBLE_EQ(sample.stats.exe_duration, 42.0);
+  ASSERT_FLOAT_EQ(sample.stats.overall_equipment_effectiveness, 0.75f);
+  ASSERT_EQ(sample.stats.itemized_error_map.size(), 1);
+  ASSERT_DOUBLE_EQ(sample.stats.itemized_error_map[3].duration, 2.5);
+  ASSERT_DOUBLE_EQ(sample.stats.itemized_quality_map[7].count, 4.0);
+
+  // A state change keeps the last stats.
+  exporter.publishState(StatesEnum::HELD);
+  ASSERT_TRUE(reader.read(sample));
+  ASSERT_GT(sample.sequence, first_sequence);
+  ASSERT_EQ(sample.state, StatesEnum::HELD);
+  ASSERT_EQ(sample.stats.cycle_count, 10);
+
+  exporter.close();
+  ShmStatsReader late_reader;
+  ASSERT_FALSE(late_reader.open(testSegmentName()));
+}
+
+TEST(ShmStats, drops_items_beyond_capacity)
+{
+  ShmStatsExporter exporter;
+  ASSERT_TRUE(exporter.open(testSegmentName()));
+  ShmStatsReader reader;
+  ASSERT_TRUE(reader.open(testSegmentName()));
+
+  PackmlStatsSnapshot snapshot = PackmlStatsSnapshot();
+  for (int16_t id = 0; id < static_cast<int16_t>(ShmStatsPayload::MAX_ITEMS + 5); id++)
+  {
+    snapshot.itemized_error_map[id] = PackmlStatsItemized{ id, 1.0, 0.0 };
+  }
+  exporter.publishStats(StatesEnum::IDLE, snapshot);
+
+  ShmStatsSample sample;
+  ASSERT_TRUE(reader.read(sample));
+  ASSERT_EQ(sample.stats.itemized_error_map.size(), ShmStatsPayload::MAX_ITEMS);
+  ASSERT_EQ(sample.dropped_item_count, 5);
+}
+
+TEST(ShmStats, wait_for_change)
+{
+  ShmStatsExporter exporter;
+  ASSERT_TRUE(exporter.open(testSegmentName()));
+  ShmStatsReader reader;
+  ASSERT_TRUE(reader.open(testSegmentName()));
+
+  uint32_t sequence = reader.getSequence();
+  ASSERT_FALSE(reader.waitForChange(sequence, std::chrono::milliseconds(10)));
+
+  std::thread writer([&exporter]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    exporter.publishState(StatesEnum::STOPPED);
+  });
+  ASSERT_TRUE(reader.waitForChange(sequence, std::chrono::seconds(5)));
+  writer.join();
+
+  ShmStatsSample sample;
+  ASSERT_TRUE(reader.read(sample));
+  ASSERT_EQ(sample.state, StatesEnum::STOPPED);
+  ASSERT_NE(sample.sequence, sequence);
+}
+}  // namespace packml_sm_test
@@ -0,0 +1,217 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "packml_sm/coroutine/awaitables.h"
+#include "packml_sm/coroutine/state_task.h"
+
+#include <atomic>
+#include <future>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace packml_sm_test
+{
+using namespace packml_sm;
+
+/**
+ * @brief Starts a task on the default executor and returns a future for its result.
+ */
+std::future<int> startTask(StateTask task)
+{
+  auto result = std::make_shared<std::promise<int>>();
+  auto future = result->get_future();
+  task.start(CoroutineExecutor::defaultExecutor(), [result](int value) { result->set_value(value); });
+  return future;
+}
+
+StateTask sleepTask(StateMethodContext& context, std::chrono::milliseconds duration, bool& slept)
+{
+  slept = co_await sleepFor(context, duration);
+  co_return 1;
+}
+
+StateTask eventTask(StateMethodContext& context, AsyncEvent& event, bool& signalled)
+{
+  signalled = co_await event.wait(context);
+  co_return 2;
+}
+
+StateTask throwingTask(StateMethodContext& context)
+{
+  co_await sleepFor(context, std::chrono::milliseconds(1));
+  throw std::runtime_error("state method failed");
+}
+
+/**
+ * @brief Sets a flag when destroyed, to see whether a coroutine frame was destroyed.
+ */
+struct FrameGuard
+{
+  std::atomic<bool>& destroyed;
+  ~FrameGuard()
+  {
+    destroyed = true;
+  }
+};
+
+TEST(Coroutine, sleep)
+{
+  StateMethodContext context(StatesEnum::EXECUTE);
+  bool slept = false;
+  auto start = std::chrono::steady_clock::now();
+  auto result = startTask(sleepTask(context, std::chrono::milliseconds(100), slept));
+
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+  ASSERT_EQ(result.get(), 1);
+  ASSERT_TRUE(slept);
+  ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+}
+
+TEST(Coroutine, sleep_cancelled)
+{
+  StateMethodContext context(StatesEnum::EXECUTE);
+  bool slept = true;
+  auto result = startTask(sleepTask(context, std::chrono::seconds(60), slept));
+
+  ASSERT_EQ(result.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+  context.requestStop(CmdEnum::STOP);
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_FALSE(slept);
+}
+
+TEST(Coroutine, async_event)
+{
+  StateMethodContext context(StatesEnum::EXECUTE);
+  AsyncEvent event;
+  bool signalled = false;
+  auto result = startTask(eventTask(context, event, signalled));
+
+  ASSERT_EQ(result.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+  event.set();
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_TRUE(signalled);
+
+  // A set event completes later waits without suspending.
+  StateMethodContext second_context(StatesEnum::EXECUTE);
+  signalled = false;
+  result = startTask(eventTask(second_context, event, signalled));
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_TRUE(signalled);
+
+  // Cancellation wins over an event that never comes.
+  event.reset();
+  StateMethodContext third_context(StatesEnum::EXECUTE);
+  signalled = true;
+  result = startTask(eventTask(third_context, event, signalled));
+  third_context.requestStop();
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_FALSE(signalled);
+}
+
+TEST(Coroutine, single_executor_thread)
+{
+  const int task_count = 200;
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  std::vector<std::unique_ptr<StateMethodContext>> contexts;
+  std::vector<std::future<int>> results;
+
+  auto task = [&mutex, &threads](StateMethodContext& context) -> StateTask {
+    for (int i = 0; i < 5; i++)
+    {
+      co_await sleepFor(context, std::chrono::milliseconds(10));
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.insert(std::this_thread::get_id());
+    }
+    co_return 0;
+  };
+
+  for (int i = 0; i < task_count; i++)
+  {
+    contexts.emplace_back(new StateMethodContext(StatesEnum::EXECUTE));
+    results.push_back(startTask(task(*contexts.back())));
+  }
+
+  for (auto& result : results)
+  {
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  }
+  ASSERT_EQ(threads.size(), 1);
+  ASSERT_EQ(threads.count(std::this_thread::get_id()), 0);
+}
+
+TEST(Coroutine, exception)
+{
+  StateMethodContext context(StatesEnum::EXECUTE);
+  auto result = startTask(throwingTask(context));
+
+  // The exception is reported and the state method completes as failed instead of hanging.
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_EQ(result.get(), -1);
+}
+
+TEST(Coroutine, executor_destroys_suspended)
+{
+  std::atomic<bool> destroyed(false);
+  std::atomic<bool> completed(false);
+  StateMethodContext context(StatesEnum::EXECUTE);
+  {
+    CoroutineExecutor executor;
+    auto task = [&destroyed](StateMethodContext& context) -> StateTask {
+      FrameGuard guard{ destroyed };
+      co_await waitForStop(context);
+      co_return 0;
+    };
+    ASSERT_TRUE(task(context).start(executor, [&completed](int) { completed = true; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_FALSE(destroyed);
+  }
+
+  // The frame still waiting for a stop is destroyed with the executor, without completing.
+  ASSERT_TRUE(destroyed);
+  ASSERT_FALSE(completed);
+}
+
+TEST(Coroutine, state_method_adapter)
+{
+  std::atomic<int> cycles(0);
+  AsyncStateMethod state_method = coroutineStateMethod([&cycles](StateMethodContext& context) -> StateTask {
+    while (co_await sleepFor(context, std::chrono::milliseconds(10)))
+    {
+      cycles++;
+    }
+    co_return context.pendingCommand() == CmdEnum::STOP ? 0 : -1;
+  });
+
+  auto context = std::make_shared<StateMethodContext>(StatesEnum::EXECUTE);
+  auto result = std::make_shared<std::promise<int>>();
+  auto future = result->get_future();
+  state_method.method(context, [result](int value) { result->set_value(value); });
+
+  ASSERT_EQ(future.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+  ASSERT_GT(cycles, 0);
+
+  // The running coroutine keeps its context alive, so it still sees the pending command.
+  context->requestStop(CmdEnum::STOP);
+  context.reset();
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  ASSERT_EQ(future.get(), 0);
+}
+}  // namespace packml_sm_test
@@ -28,6 +28,10 @@
 #include "packml_sm/packml_stats_snapshot.h"
 #include "packml_sm/packml_stats_itemized.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 namespace packml_sm_test
 {
 using namespace packml_sm;
@@ -82,19 +86,23 @@ TEST(Packml_SM, set_execute)
 {
   std::shared_ptr<PackmlStateMachineSingleCycle> sm = PackmlStateMachineSingleCycle::spawn();
   StateMachineVisitedStatesQueue queue(sm);
-  sm->setExecute(std::bind(success));
+  ASSERT_TRUE(sm->setManualDrive(true));
+  int executions = 0;
+  sm->setExecute([&executions]() { return ++executions; });
   sm->activate();
-  ros::Duration(1.0).sleep();  // give time to start
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
   ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
   ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
@@ -103,9 +111,11 @@ TEST(Packml_SM, set_execute)
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::COMPLETE, queue));
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+  ASSERT_EQ(executions, 1);
 }
 
 TEST(Packml_SC, state_diagram)
@@ -113,27 +123,31 @@ TEST(Packml_SC, state_diagram)
   ROS_INFO_STREAM("SINGLE CYCLE::State diagram");
   std::shared_ptr<PackmlStateMachineSingleCycle> sm = PackmlStateMachineSingleCycle::spawn();
   StateMachineVisitedStatesQueue queue(sm);
+  ASSERT_TRUE(sm->setManualDrive(true));
 
   EXPECT_FALSE(sm->isActive());
-  sm->setExecute(std::bind(success));
+  int executions = 0;
+  sm->setExecute([&executions]() { return ++executions; });
   sm->activate();
-  ros::Duration(1.0).sleep();  // give time to start
   EXPECT_TRUE(sm->isActive());
 
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
   ASSERT_TRUE(sm->isActive());
 
   ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
 
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
 
   ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
@@ -143,44 +157,51 @@ TEST(Packml_SC, state_diagram)
   ASSERT_TRUE(waitForState(StatesEnum::COMPLETE, queue));
 
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
 
   ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
   ASSERT_TRUE(sm->hold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::HELD, queue));
   ASSERT_TRUE(sm->unhold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNHOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->suspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDED, queue));
   ASSERT_TRUE(sm->unsuspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNSUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->stop());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STOPPING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
 
   ASSERT_TRUE(sm->abort());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
 
   sm->deactivate();
-  ros::Duration(1).sleep();
   EXPECT_FALSE(sm->isActive());
   ROS_INFO_STREAM("State diagram test complete");
 }
@@ -190,26 +211,30 @@ TEST(Packml_CC, state_diagram)
   ROS_INFO_STREAM("CONTINUOUS CYCLE::State diagram");
   std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
   StateMachineVisitedStatesQueue queue(sm);
+  ASSERT_TRUE(sm->setManualDrive(true));
   EXPECT_FALSE(sm->isActive());
-  sm->setExecute(std::bind(success));
+  int executions = 0;
+  sm->setExecute([&executions]() { return ++executions; });
   sm->activate();
-  ros::Duration(1.0).sleep();  // give time to start
   EXPECT_TRUE(sm->isActive());
 
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
   ASSERT_TRUE(sm->isActive());
 
   ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
 
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
 
   ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
@@ -219,37 +244,42 @@ TEST(Packml_CC, state_diagram)
   ASSERT_FALSE(waitForState(StatesEnum::COMPLETE, queue));
 
   ASSERT_TRUE(sm->hold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::HELD, queue));
 
   ASSERT_TRUE(sm->unhold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNHOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->suspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDED, queue));
 
   ASSERT_TRUE(sm->unsuspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNSUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->stop());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STOPPING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
 
   ASSERT_TRUE(sm->abort());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
 
   sm->deactivate();
-  ros::Duration(1).sleep();
   EXPECT_FALSE(sm->isActive());
   ROS_INFO_STREAM("State diagram test complete");
 }
@@ -362,26 +392,33 @@ TEST(Packml_CC, getCurrentStatTransaction_durations)
   StateMachineVisitedStatesQueue queue(sm);
   packml_sm::PackmlStatsSnapshot snapshot_out;
 
-  sm->setExecute(std::bind(success));
+  // Time only moves when the test advances it, so the durations are exact.
+  auto clock = std::make_shared<ManualClock>();
+  sm->setClock(clock);
+  ASSERT_TRUE(sm->setManualDrive(true));
+  sm->setExecute([]() { return 0; });
   sm->activate();
   while (!sm->isActive()) { }
 
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
@@ -389,66 +426,73 @@ TEST(Packml_CC, getCurrentStatTransaction_durations)
   ASSERT_FALSE(waitForState(StatesEnum::COMPLETING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_FALSE(waitForState(StatesEnum::COMPLETE, queue));
+  clock->advance(std::chrono::seconds(4));
 
   ASSERT_TRUE(sm->hold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::HELD, queue));
 
   ASSERT_TRUE(sm->unhold());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNHOLDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->suspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::SUSPENDED, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   ASSERT_TRUE(sm->unsuspend());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::UNSUSPENDING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
 
   ASSERT_TRUE(sm->stop());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::STOPPING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   ASSERT_TRUE(sm->abort());
+  sm->runUntilIdle();
   ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
   sm->triggerEvent(state_complete_event());
   ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
 
   sm->getCurrentIncrementalStatSnapshot(snapshot_out);
-  ASSERT_NEAR(snapshot_out.duration, 16, 1);
-  ASSERT_NEAR(snapshot_out.abort_duration, 4, 1);
-  ASSERT_NEAR(snapshot_out.stop_duration, 4, 1);
-  ASSERT_NEAR(snapshot_out.idle_duration, 2, 1);
-  ASSERT_NEAR(snapshot_out.exe_duration, 4, 1);
-  ASSERT_NEAR(snapshot_out.cmplt_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.susp_duration, 2, 1);
-  ASSERT_NEAR(snapshot_out.held_duration, 0, 1);
+  ASSERT_NEAR(snapshot_out.duration, 16, 1e-3);
+  ASSERT_NEAR(snapshot_out.abort_duration, 4, 1e-3);
+  ASSERT_NEAR(snapshot_out.stop_duration, 4, 1e-3);
+  ASSERT_NEAR(snapshot_out.idle_duration, 2, 1e-3);
+  ASSERT_NEAR(snapshot_out.exe_duration, 4, 1e-3);
+  ASSERT_NEAR(snapshot_out.cmplt_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.susp_duration, 2, 1e-3);
+  ASSERT_NEAR(snapshot_out.held_duration, 0, 1e-3);
 
   // Ensure durations reset after transaction
   sm->getCurrentIncrementalStatSnapshot(snapshot_out);
-  ASSERT_NEAR(snapshot_out.duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.abort_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.stop_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.idle_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.exe_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.cmplt_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.susp_duration, 0, 1);
-  ASSERT_NEAR(snapshot_out.held_duration, 0, 1);
+  ASSERT_NEAR(snapshot_out.duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.abort_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.stop_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.idle_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.exe_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.cmplt_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.susp_duration, 0, 1e-3);
+  ASSERT_NEAR(snapshot_out.held_duration, 0, 1e-3);
 
   // Next transaction
-  ros::Duration(2.0).sleep();
+  clock->advance(std::chrono::seconds(2));
   sm->getCurrentIncrementalStatSnapshot(snapshot_out);
-  ASSERT_NEAR(snapshot_out.duration, 2, 1);
-  ASSERT_NEAR(snapshot_out.abort_duration, 2, 1);
+  ASSERT_NEAR(snapshot_out.duration, 2, 1e-3);
+  ASSERT_NEAR(snapshot_out.abort_duration, 2, 1e-3);
 
   ROS_INFO_STREAM("stats transaction durations complete");
 }
@@ -533,4 +577,595 @@ TEST(Packml_CC, getCurrentStatTransaction_items)
   ROS_INFO_STREAM("stats transaction durations items");
 }
 
+TEST(Packml_CC, state_method_deadline)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::state method deadline");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  StateMethodPolicy policy;
+  policy.deadline = std::chrono::milliseconds(200);
+  policy.exit_timeout = std::chrono::milliseconds(0);
+  ASSERT_TRUE(sm->setStateMethodPolicy(StatesEnum::EXECUTE, policy));
+
+  sm->setExecute(std::bind(success));
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  ASSERT_TRUE(sm->clear());
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  ASSERT_TRUE(sm->reset());
+  ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+  ASSERT_TRUE(sm->start());
+  ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+
+  // The execute method takes a second, well past its deadline.
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
+  ASSERT_EQ(sm->getBackgroundStateMethodCount(), 1);
+
+  ros::Duration(1.5).sleep();
+  ASSERT_EQ(sm->getBackgroundStateMethodCount(), 0);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("state method deadline complete");
+}
+
+TEST(Packml_CC, state_method_exit_timeout)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::state method exit timeout");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  StateMethodPolicy policy;
+  policy.exit_timeout = std::chrono::milliseconds(0);
+  sm->setStateMethodPolicy(policy);
+  sm->setBackgroundQuota(1);
+
+  sm->setExecute(std::bind(success));
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  ASSERT_TRUE(sm->clear());
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  ASSERT_TRUE(sm->reset());
+  ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+  ASSERT_TRUE(sm->start());
+  ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+
+  // Holding is entered without waiting for the running execute method.
+  auto hold_time = std::chrono::steady_clock::now();
+  ASSERT_TRUE(sm->hold());
+  ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
+  ASSERT_LT(std::chrono::steady_clock::now() - hold_time, std::chrono::milliseconds(500));
+  ASSERT_EQ(sm->getBackgroundStateMethodCount(), 1);
+
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::HELD, queue));
+  ASSERT_TRUE(sm->unhold());
+  ASSERT_TRUE(waitForState(StatesEnum::UNHOLDING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+
+  // With the quota used up aborting still does not wait for the method, it is detached over the quota.
+  auto abort_time = std::chrono::steady_clock::now();
+  ASSERT_TRUE(sm->abort());
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
+  ASSERT_LT(std::chrono::steady_clock::now() - abort_time, std::chrono::milliseconds(500));
+  ASSERT_EQ(sm->getBackgroundStateMethodCount(), 2);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("state method exit timeout complete");
+}
+
+TEST(Packml_CC, state_method_detached_at_destruction)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::state method detached at destruction");
+  std::chrono::steady_clock::time_point destroy_time;
+  {
+    std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+    StateMachineVisitedStatesQueue queue(sm);
+
+    StateMethodPolicy policy;
+    policy.exit_timeout = std::chrono::milliseconds(0);
+    sm->setStateMethodPolicy(policy);
+
+    // Ignores the stop request and blocks well past the shutdown wait.
+    sm->setExecute([]() {
+      ros::WallDuration(10.0).sleep();
+      return 0;
+    });
+    sm->activate();
+    ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+    ASSERT_TRUE(sm->clear());
+    ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+    sm->triggerEvent(state_complete_event());
+    ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+    ASSERT_TRUE(sm->reset());
+    ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+    sm->triggerEvent(state_complete_event());
+    ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+    ASSERT_TRUE(sm->start());
+    ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+    sm->triggerEvent(state_complete_event());
+    ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+
+    ASSERT_TRUE(sm->hold());
+    ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
+    ASSERT_EQ(sm->getBackgroundStateMethodCount(), 1);
+
+    sm->deactivate();
+    destroy_time = std::chrono::steady_clock::now();
+  }
+
+  // Destroying the machine gives up on the blocked method instead of waiting for it.
+  ASSERT_LT(std::chrono::steady_clock::now() - destroy_time, std::chrono::seconds(3));
+  ROS_INFO_STREAM("state method detached at destruction complete");
+}
+
+TEST(Packml_CC, state_method_context)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::state method context");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  std::atomic<int> cycles(0);
+  std::atomic<CmdEnum> stop_command(CmdEnum::NO_COMMAND);
+  sm->setExecute(ContextStateMethod([&cycles, &stop_command](StateMethodContext& context) {
+    // Would run for ten seconds if it ignored the stop request.
+    while (context.yield(std::chrono::milliseconds(10)) && context.timeInState() < std::chrono::seconds(10))
+    {
+      cycles++;
+    }
+    stop_command = context.pendingCommand();
+    return 0;
+  }));
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  ASSERT_TRUE(sm->clear());
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  ASSERT_TRUE(sm->reset());
+  ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+  ASSERT_TRUE(sm->start());
+  ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+  ros::Duration(0.2).sleep();
+
+  auto hold_time = std::chrono::steady_clock::now();
+  ASSERT_TRUE(sm->hold());
+  ASSERT_TRUE(waitForState(StatesEnum::HOLDING, queue));
+  ASSERT_LT(std::chrono::steady_clock::now() - hold_time, std::chrono::milliseconds(500));
+  ASSERT_GT(cycles, 0);
+  ASSERT_EQ(stop_command, CmdEnum::HOLD);
+
+  // Leaving the state through an event rather than a command also stops the method.
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::HELD, queue));
+  ASSERT_TRUE(sm->unhold());
+  ASSERT_TRUE(waitForState(StatesEnum::UNHOLDING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+  auto error_time = std::chrono::steady_clock::now();
+  sm->triggerEvent(error_event());
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
+  ASSERT_LT(std::chrono::steady_clock::now() - error_time, std::chrono::milliseconds(500));
+  ASSERT_EQ(stop_command, CmdEnum::NO_COMMAND);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("state method context complete");
+}
+
+TEST(Packml_CC, async_state_method)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::async state method");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  // Completes from a helper thread once the state machine asks it to stop.
+  std::atomic<bool> completed(false);
+  sm->setExecute(AsyncStateMethod([&completed](std::shared_ptr<StateMethodContext> context,
+                                               std::function<void(int)> on_complete) {
+    std::thread([context, on_complete, &completed]() {
+      context->stopToken().waitFor(std::chrono::seconds(10));
+      completed = true;
+      on_complete(0);
+    }).detach();
+  }));
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  ASSERT_TRUE(sm->clear());
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  ASSERT_TRUE(sm->reset());
+  ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+  ASSERT_TRUE(sm->start());
+  ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+  ASSERT_FALSE(completed);
+
+  auto stop_time = std::chrono::steady_clock::now();
+  ASSERT_TRUE(sm->stop());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPING, queue));
+  ASSERT_LT(std::chrono::steady_clock::now() - stop_time, std::chrono::milliseconds(500));
+  ASSERT_TRUE(completed);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("async state method complete");
+}
+
+TEST(Packml_CC, event_queue)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::event queue");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  std::atomic<int> dispatched(0);
+  sm->setEventDispatchObserver([&dispatched](std::chrono::steady_clock::duration latency) { dispatched++; });
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  // Only the first clear has a transition, the rest arrive in CLEARING and are dropped.
+  std::vector<std::thread> producers;
+  for (int i = 0; i < 4; i++)
+  {
+    producers.emplace_back([sm]() {
+      for (int j = 0; j < 50; j++)
+      {
+        sm->enqueueEvent(clear_event());
+      }
+    });
+  }
+  for (auto& producer : producers)
+  {
+    producer.join();
+  }
+
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  ros::Duration(0.2).sleep();
+  ASSERT_EQ(sm->getEventQueueDepth(), 0);
+  ASSERT_EQ(dispatched, 200);
+  ASSERT_EQ(sm->getDroppedEventCount(), 199);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("event queue complete");
+}
+
+TEST(Packml_CC, command_completion)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::command completion");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  auto cleared = sm->commandAsync(CmdEnum::CLEAR);
+  ASSERT_EQ(cleared.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  CommandResult result = cleared.get();
+  ASSERT_EQ(result.result, CmdResultEnum::COMPLETED);
+  ASSERT_EQ(result.state, StatesEnum::CLEARING);
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+
+  // Invalid commands are rejected before they are queued.
+  bool called = false;
+  ASSERT_FALSE(sm->command(CmdEnum::START, [&called, &result](const CommandResult& command_result) {
+    called = true;
+    result = command_result;
+  }));
+  ASSERT_TRUE(called);
+  ASSERT_EQ(result.result, CmdResultEnum::REJECTED);
+  ASSERT_EQ(result.state, StatesEnum::CLEARING);
+
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  // A command that was valid when sent is rejected if an earlier event moved the state machine on.
+  sm->enqueueEvent(abort_event());
+  auto reset = sm->commandAsync(CmdEnum::RESET);
+  ASSERT_EQ(reset.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+  result = reset.get();
+  ASSERT_EQ(result.result, CmdResultEnum::REJECTED);
+  ASSERT_EQ(result.state, StatesEnum::ABORTING);
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTING, queue));
+
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  sm->deactivate();
+
+  // Commands still queued when the state machine goes away are cancelled.
+  std::shared_ptr<PackmlStateMachineContinuous> stopped_sm = PackmlStateMachineContinuous::spawn();
+  stopped_sm->activate();
+  stopped_sm->deactivate();
+  auto pending = stopped_sm->commandAsync(CmdEnum::CLEAR);
+  stopped_sm.reset();
+  ASSERT_EQ(pending.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  ASSERT_EQ(pending.get().result, CmdResultEnum::CANCELLED);
+  ROS_INFO_STREAM("command completion complete");
+}
+
+TEST(Packml_CC, manual_drive)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::manual drive");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  auto clock = std::make_shared<ManualClock>();
+  sm->setClock(clock);
+  ASSERT_TRUE(sm->setManualDrive(true));
+
+  // Every execute pass takes one virtual second, the thousandth one stops the machine.
+  PackmlStateMachineContinuous* machine = sm.get();
+  sm->setStarting([machine]() {
+    machine->enqueueEvent(state_complete_event());
+    return 0;
+  });
+  sm->setExecute([machine, clock]() {
+    clock->advance(std::chrono::seconds(1));
+    machine->incrementSuccessCount();
+    PackmlStatsSnapshot snapshot;
+    machine->getCurrentStatSnapshot(snapshot);
+    if (snapshot.success_count < 1000)
+    {
+      machine->enqueueEvent(state_complete_event());
+    }
+    else
+    {
+      machine->stop();
+    }
+    return 0;
+  });
+
+  sm->activate();
+  ASSERT_FALSE(sm->setManualDrive(false));
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::ABORTED);
+  ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
+  sm->triggerEvent(state_complete_event());
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::IDLE);
+
+  auto start_time = std::chrono::steady_clock::now();
+  ASSERT_TRUE(sm->start());
+  // Two steps per cycle, plus one to process the stop.
+  ASSERT_EQ(sm->runUntilIdle(), 2001);
+  ASSERT_LT(std::chrono::steady_clock::now() - start_time, std::chrono::seconds(5));
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::STOPPING);
+
+  PackmlStatsSnapshot snapshot;
+  sm->getCurrentStatSnapshot(snapshot);
+  ASSERT_EQ(snapshot.success_count, 1000);
+  ASSERT_DOUBLE_EQ(snapshot.exe_duration, 1000.0);
+  ASSERT_FALSE(sm->step());
+
+  sm->deactivate();
+  ROS_INFO_STREAM("manual drive complete");
+}
+
+TEST(Packml_CC, snapshot_aggregates)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::snapshot aggregates");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  auto clock = std::make_shared<ManualClock>();
+  sm->setClock(clock);
+  ASSERT_TRUE(sm->setManualDrive(true));
+  sm->setIdealCycleTime(2.0);
+  sm->activate();
+
+  clock->advance(std::chrono::seconds(10));
+  ASSERT_TRUE(sm->clear());
+  sm->runUntilIdle();
+  clock->advance(std::chrono::seconds(1));
+  sm->triggerEvent(state_complete_event());
+  clock->advance(std::chrono::seconds(5));
+  ASSERT_TRUE(sm->reset());
+  sm->runUntilIdle();
+  sm->triggerEvent(state_complete_event());
+  clock->advance(std::chrono::seconds(4));
+  ASSERT_TRUE(sm->start());
+  sm->runUntilIdle();
+  sm->triggerEvent(state_complete_event());
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::EXECUTE);
+  clock->advance(std::chrono::seconds(20));
+
+  for (int i = 0; i < 8; i++)
+  {
+    sm->incrementSuccessCount();
+  }
+  sm->incrementFailureCount();
+  sm->incrementFailureCount();
+  sm->incrementErrorStatItem(1, 1.0);
+
+  // Aborted and stopped time count against availability, the open execute entry counts toward it.
+  PackmlStatsSnapshot snapshot;
+  sm->getCurrentStatSnapshot(snapshot, false);
+  ASSERT_DOUBLE_EQ(snapshot.duration, 40.0);
+  ASSERT_DOUBLE_EQ(snapshot.abort_duration, 10.0);
+  ASSERT_DOUBLE_EQ(snapshot.stop_duration, 5.0);
+  ASSERT_DOUBLE_EQ(snapshot.idle_duration, 4.0);
+  ASSERT_DOUBLE_EQ(snapshot.exe_duration, 20.0);
+  ASSERT_FLOAT_EQ(snapshot.availability, 25.0 / 40.0);
+  ASSERT_FLOAT_EQ(snapshot.performance, 8 * 2.0 / 25.0);
+  ASSERT_FLOAT_EQ(snapshot.quality, 0.8);
+  ASSERT_FLOAT_EQ(snapshot.throughput, 8 / 40.0);
+  ASSERT_EQ(snapshot.itemized_error_map.size(), 0);
+  ASSERT_DOUBLE_EQ(sm->getExecuteTime(), 20.0);
+
+  sm->getCurrentStatSnapshot(snapshot);
+  ASSERT_EQ(snapshot.itemized_error_map.size(), 1);
+
+  sm->deactivate();
+  ROS_INFO_STREAM("snapshot aggregates complete");
+}
+
+TEST(Packml_CC, command_sequence)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::command sequence");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  ASSERT_TRUE(sm->setManualDrive(true));
+  sm->activate();
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::ABORTED);
+
+  std::vector<SequenceStep> steps = {
+    { false, static_cast<int>(CmdEnum::CLEAR) },   { true, static_cast<int>(EventsEnum::STATE_COMPLETE) },
+    { false, static_cast<int>(CmdEnum::RESET) },   { true, static_cast<int>(EventsEnum::STATE_COMPLETE) },
+    { false, static_cast<int>(CmdEnum::START) },   { false, 99 },
+    { false, static_cast<int>(CmdEnum::UNHOLD) },
+  };
+  std::vector<CommandResult> results(steps.size(), CommandResult{ CmdResultEnum::CANCELLED, StatesEnum::UNDEFINED });
+  std::vector<int> calls(steps.size(), 0);
+  auto on_complete = [&](size_t index, const CommandResult& result) {
+    results[index] = result;
+    calls[index]++;
+  };
+
+  // Unknown ids are rejected right away, the rest waits for the event loop.
+  ASSERT_EQ(6u, sm->commandSequence(steps, on_complete));
+  EXPECT_EQ(CmdResultEnum::REJECTED, results[5].result);
+  EXPECT_EQ(0, calls[0]);
+  sm->runUntilIdle();
+
+  EXPECT_EQ(sm->getCurrentState(), StatesEnum::STARTING);
+  EXPECT_EQ(CmdResultEnum::COMPLETED, results[0].result);
+  EXPECT_EQ(StatesEnum::CLEARING, results[0].state);
+  EXPECT_EQ(CmdResultEnum::COMPLETED, results[3].result);
+  EXPECT_EQ(StatesEnum::IDLE, results[3].state);
+  EXPECT_EQ(CmdResultEnum::COMPLETED, results[4].result);
+  EXPECT_EQ(StatesEnum::STARTING, results[4].state);
+  EXPECT_EQ(CmdResultEnum::REJECTED, results[6].result);
+  for (int count : calls)
+  {
+    EXPECT_EQ(1, count);
+  }
+  sm->deactivate();
+}
+
+TEST(Packml_CC, command_sequence_rejected)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::command sequence rejected");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+  StateMachineVisitedStatesQueue queue(sm);
+
+  std::atomic<int> cycles(0);
+  std::atomic<bool> exited(false);
+  sm->setExecute(ContextStateMethod([&cycles, &exited](StateMethodContext& context) {
+    while (context.yield(std::chrono::milliseconds(10)) && context.timeInState() < std::chrono::seconds(10))
+    {
+      cycles++;
+    }
+    exited = true;
+    return 0;
+  }));
+  sm->activate();
+  ASSERT_TRUE(waitForState(StatesEnum::ABORTED, queue));
+
+  ASSERT_TRUE(sm->clear());
+  ASSERT_TRUE(waitForState(StatesEnum::CLEARING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPED, queue));
+
+  ASSERT_TRUE(sm->reset());
+  ASSERT_TRUE(waitForState(StatesEnum::RESETTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::IDLE, queue));
+
+  ASSERT_TRUE(sm->start());
+  ASSERT_TRUE(waitForState(StatesEnum::STARTING, queue));
+  sm->triggerEvent(state_complete_event());
+  ASSERT_TRUE(waitForState(StatesEnum::EXECUTE, queue));
+
+  // Neither command is valid in EXECUTE, so the running method must not be asked to stop.
+  std::vector<SequenceStep> steps = {
+    { false, static_cast<int>(CmdEnum::START) },
+    { false, static_cast<int>(CmdEnum::RESET) },
+  };
+  std::atomic<int> rejected(0);
+  ASSERT_EQ(2u, sm->commandSequence(steps, [&rejected](size_t index, const CommandResult& result) {
+    if (result.result == CmdResultEnum::REJECTED)
+    {
+      rejected++;
+    }
+  }));
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (rejected < 2 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(rejected, 2);
+
+  int cycles_before = cycles;
+  ros::Duration(0.2).sleep();
+  ASSERT_EQ(sm->getCurrentState(), StatesEnum::EXECUTE);
+  ASSERT_FALSE(exited);
+  ASSERT_GT(cycles, cycles_before);
+
+  ASSERT_TRUE(sm->stop());
+  ASSERT_TRUE(waitForState(StatesEnum::STOPPING, queue));
+  sm->deactivate();
+  ROS_INFO_STREAM("command sequence rejected complete");
+}
+
+TEST(Packml_CC, stat_increment_batch)
+{
+  ROS_INFO_STREAM("CONTINUOUS CYCLE::stat increment batch");
+  std::shared_ptr<PackmlStateMachineContinuous> sm = PackmlStateMachineContinuous::spawn();
+
+  std::vector<StatIncrement> increments = {
+    { static_cast<int32_t>(MetricIDEnum::SUCCESS_INC_ID), 1.0f, 0.0f },
+    { static_cast<int32_t>(MetricIDEnum::FAILURE_INC_ID), 1.0f, 0.0f },
+    { 1005, 2.0f, 0.0f },
+    { 2010, 1.0f, 0.5f },
+    { 2010, 1.0f, 0.25f },
+    { 500, 1.0f, 0.0f },
+  };
+  std::vector<bool> results = sm->incrementStats(increments);
+  ASSERT_EQ(increments.size(), results.size());
+  EXPECT_TRUE(results[0] && results[1] && results[2] && results[3] && results[4]);
+  EXPECT_FALSE(results[5]);
+  EXPECT_TRUE(sm->incrementStat(StatIncrement{ static_cast<int32_t>(MetricIDEnum::SUCCESS_INC_ID), 1.0f, 0.0f }));
+
+  PackmlStatsSnapshot snapshot;
+  sm->getCurrentStatSnapshot(snapshot);
+  EXPECT_EQ(2, snapshot.success_count);
+  EXPECT_EQ(1, snapshot.fail_count);
+  EXPECT_DOUBLE_EQ(2.0, snapshot.itemized_quality_map.at(1005).count);
+  EXPECT_DOUBLE_EQ(2.0, snapshot.itemized_error_map.at(2010).count);
+  EXPECT_DOUBLE_EQ(0.75, snapshot.itemized_error_map.at(2010).duration);
+
+  sm->getCurrentIncrementalStatSnapshot(snapshot);
+  EXPECT_EQ(2, snapshot.success_count);
+  EXPECT_DOUBLE_EQ(2.0, snapshot.itemized_error_map.at(2010).count);
+}
 }
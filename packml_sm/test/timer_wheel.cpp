@@ -0,0 +1,113 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "packml_sm/timer_wheel.h"
+
+#include <vector>
+
+namespace packml_sm_test
+{
+using namespace packml_sm;
+
+TEST(TimerWheel, fires_after_delay)
+{
+  TimerWheel wheel(std::chrono::milliseconds(10), 8);
+  int fired = 0;
+  wheel.schedule(std::chrono::milliseconds(25), [&fired]() { fired++; });
+  ASSERT_EQ(wheel.size(), 1);
+
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(20)), 0);
+  ASSERT_EQ(fired, 0);
+
+  // 25ms rounds up to three ticks, so the timer never fires early.
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(5)), 0);
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(5)), 1);
+  ASSERT_EQ(fired, 1);
+  ASSERT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheel, cancel)
+{
+  TimerWheel wheel(std::chrono::milliseconds(10), 8);
+  int fired = 0;
+  auto id = wheel.schedule(std::chrono::milliseconds(10), [&fired]() { fired++; });
+
+  ASSERT_TRUE(wheel.cancel(id));
+  ASSERT_FALSE(wheel.cancel(id));
+  ASSERT_FALSE(wheel.cancel(TimerWheel::INVALID_TIMER));
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(100)), 0);
+  ASSERT_EQ(fired, 0);
+}
+
+TEST(TimerWheel, wraps_and_orders)
+{
+  TimerWheel wheel(std::chrono::milliseconds(10), 4);
+  std::vector<int> order;
+
+  // Delays longer than one revolution share slots with shorter ones.
+  wheel.schedule(std::chrono::milliseconds(90), [&order]() { order.push_back(3); });
+  wheel.schedule(std::chrono::milliseconds(10), [&order]() { order.push_back(1); });
+  wheel.schedule(std::chrono::milliseconds(50), [&order]() { order.push_back(2); });
+
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(10)), 1);
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(30)), 0);
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(10)), 1);
+  ASSERT_EQ(wheel.size(), 1);
+
+  // A jump larger than the wheel still fires the remaining timer exactly once.
+  ASSERT_EQ(wheel.advance(std::chrono::seconds(10)), 1);
+  ASSERT_EQ(order, std::vector<int>({ 1, 2, 3 }));
+}
+
+TEST(TimerWheel, schedule_from_callback)
+{
+  TimerWheel wheel(std::chrono::milliseconds(10), 8);
+  int fired = 0;
+  wheel.schedule(std::chrono::milliseconds(10), [&wheel, &fired]() {
+    fired++;
+    wheel.schedule(std::chrono::milliseconds(10), [&fired]() { fired++; });
+  });
+
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(10)), 1);
+  ASSERT_EQ(wheel.size(), 1);
+  ASSERT_EQ(wheel.advance(std::chrono::milliseconds(10)), 1);
+  ASSERT_EQ(fired, 2);
+}
+
+TEST(TimerWheel, next_expiry)
+{
+  TimerWheel wheel(std::chrono::milliseconds(10), 8);
+  std::chrono::nanoseconds delay;
+  ASSERT_FALSE(wheel.nextExpiry(delay));
+
+  wheel.schedule(std::chrono::milliseconds(200), []() {});
+  auto id = wheel.schedule(std::chrono::milliseconds(25), []() {});
+  ASSERT_TRUE(wheel.nextExpiry(delay));
+  ASSERT_EQ(delay, std::chrono::milliseconds(30));
+
+  // Elapsed time below a tick is carried and shortens the delay.
+  wheel.advance(std::chrono::milliseconds(14));
+  ASSERT_TRUE(wheel.nextExpiry(delay));
+  ASSERT_EQ(delay, std::chrono::milliseconds(16));
+
+  ASSERT_TRUE(wheel.cancel(id));
+  ASSERT_TRUE(wheel.nextExpiry(delay));
+  ASSERT_EQ(delay, std::chrono::milliseconds(186));
+}
+}  // namespace packml_sm_test
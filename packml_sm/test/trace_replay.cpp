@@ -0,0 +1,145 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2018 Plus One Robotics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include "packml_sm/trace_replay.h"
+
+#include <sstream>
+
+namespace packml_sm_test
+{
+using namespace packml_sm;
+
+const char* TEST_TRACE = "time,type,value,count,duration\n"
+                         "# bring the machine up\n"
+                         "0,command,clear\n"
+                         "0,state_complete\n"
+                         "0,command,reset\n"
+                         "0,state_complete\n"
+                         "10,command,start\n"
+                         "10,state_complete\n"
+                         "\n"
+                         "20,success,,8\n"
+                         "40,failure,,2\n"
+                         "50,error_item,3,1,2.5\n"
+                         "70,command,stop\n"
+                         "70,state_complete\n";
+
+const ReplaySample* sampleAt(const std::vector<ReplaySample>& samples, double time)
+{
+  for (const auto& sample : samples)
+  {
+    if (sample.time == time)
+    {
+      return &sample;
+    }
+  }
+  return nullptr;
+}
+
+TEST(TraceReplay, parse)
+{
+  TraceRecord record;
+  std::string error;
+
+  ASSERT_TRUE(TraceReplay::parseRecord("12.5, command, Start", record, error));
+  EXPECT_EQ(record.time, 12.5);
+  EXPECT_EQ(record.type, TraceRecordType::COMMAND);
+  EXPECT_EQ(record.value, static_cast<int>(CmdEnum::START));
+
+  ASSERT_TRUE(TraceReplay::parseRecord("3,quality_item,7,2,0.5", record, error));
+  EXPECT_EQ(record.type, TraceRecordType::QUALITY_ITEM);
+  EXPECT_EQ(record.value, 7);
+  EXPECT_FLOAT_EQ(record.count, 2.0f);
+  EXPECT_FLOAT_EQ(record.duration, 0.5f);
+
+  EXPECT_FALSE(TraceReplay::parseRecord("1,command,jump", record, error));
+  EXPECT_FALSE(TraceReplay::parseRecord("-1,success", record, error));
+  EXPECT_FALSE(TraceReplay::parseRecord("1,teleport", record, error));
+
+  std::vector<TraceRecord> records;
+  std::istringstream bad_trace("0,command,clear\n1,success,,many\n");
+  EXPECT_FALSE(TraceReplay::loadTrace(bad_trace, records, error));
+  EXPECT_EQ(error.find("line 2"), 0);
+}
+
+TEST(TraceReplay, replay)
+{
+  std::vector<TraceRecord> records;
+  std::string error;
+  std::istringstream trace(TEST_TRACE);
+  ASSERT_TRUE(TraceReplay::loadTrace(trace, records, error)) << error;
+  ASSERT_EQ(records.size(), 11);
+
+  ReplayOptions options;
+  options.ideal_cycle_time = 2.0;
+  options.sample_period = 30.0;
+  TraceReplay replay(options);
+  std::vector<ReplaySample> samples;
+  ASSERT_TRUE(replay.run(records, samples));
+
+  // Samples every 30 seconds of virtual time plus the end of the trace.
+  ASSERT_EQ(samples.size(), 3);
+  auto sample = sampleAt(samples, 30.0);
+  ASSERT_NE(sample, nullptr);
+  EXPECT_EQ(sample->state, StatesEnum::EXECUTE);
+  EXPECT_NEAR(sample->snapshot.idle_duration, 10.0, 1e-3);
+  EXPECT_NEAR(sample->snapshot.exe_duration, 20.0, 1e-3);
+  EXPECT_EQ(sample->snapshot.success_count, 8);
+
+  sample = sampleAt(samples, 70.0);
+  ASSERT_NE(sample, nullptr);
+  EXPECT_EQ(sample->state, StatesEnum::STOPPED);
+  EXPECT_NEAR(sample->snapshot.duration, 70.0, 1e-3);
+  EXPECT_NEAR(sample->snapshot.exe_duration, 60.0, 1e-3);
+  EXPECT_EQ(sample->snapshot.fail_count, 2);
+  EXPECT_NEAR(sample->snapshot.performance, 8 * 2.0 / 70.0, 1e-3);
+  ASSERT_EQ(sample->snapshot.itemized_error_map.count(3), 1);
+  EXPECT_DOUBLE_EQ(sample->snapshot.itemized_error_map.at(3).duration, 2.5);
+}
+
+TEST(TraceReplay, injected_stop)
+{
+  std::vector<TraceRecord> records;
+  std::string error;
+  std::istringstream trace(TEST_TRACE);
+  ASSERT_TRUE(TraceReplay::loadTrace(trace, records, error)) << error;
+
+  // The failures at 40 seconds fall inside the stop and never happen.
+  ReplayOptions options;
+  options.sample_period = 0.0;
+  InjectedStop stop;
+  stop.time = 35.0;
+  stop.duration = 10.0;
+  options.injected_stops.push_back(stop);
+  TraceReplay replay(options);
+  std::vector<ReplaySample> samples;
+  ASSERT_TRUE(replay.run(records, samples));
+
+  ASSERT_EQ(samples.size(), 1);
+  const PackmlStatsSnapshot& snapshot = samples.back().snapshot;
+  EXPECT_NEAR(snapshot.exe_duration, 50.0, 1e-3);
+  EXPECT_NEAR(snapshot.stop_duration, 10.0, 1e-3);
+  EXPECT_EQ(snapshot.success_count, 8);
+  EXPECT_EQ(snapshot.fail_count, 0);
+  EXPECT_LT(snapshot.availability, 1.0);
+
+  std::ostringstream output;
+  TraceReplay::writeSamples(output, samples);
+  EXPECT_EQ(output.str().find("time,state,"), 0);
+}
+}  // namespace packml_sm_test
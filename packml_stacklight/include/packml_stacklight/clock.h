@@ -0,0 +1,87 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKML_STACKLIGHT_CLOCK_H
+#define PACKML_STACKLIGHT_CLOCK_H
+
+#include <memory>
+#include <ros/ros.h>
+
+namespace packml_stacklight
+{
+/**
+ * @brief Time source for the stacklight timing.
+ *
+ * Everything that used to read ros::Time::now() directly reads it through a Clock, so tests can step time forward
+ * instead of sleeping through flash periods and status timeouts.
+ */
+class Clock
+{
+public:
+  typedef std::shared_ptr<Clock> Ptr;
+
+  virtual ~Clock()
+  {
+  }
+
+  virtual ros::Time now() const = 0;
+};
+
+/**
+ * @brief The ROS clock, which already follows /clock when use_sim_time is set.
+ */
+class RosClock : public Clock
+{
+public:
+  ros::Time now() const override
+  {
+    return ros::Time::now();
+  }
+};
+
+/**
+ * @brief Clock that only moves when told to.
+ */
+class SimulatedClock : public Clock
+{
+public:
+  explicit SimulatedClock(ros::Time start = ros::Time(1.0)) : now_(start)
+  {
+  }
+
+  ros::Time now() const override
+  {
+    return now_;
+  }
+
+  void set(ros::Time now)
+  {
+    now_ = now;
+  }
+
+  void advance(ros::Duration dur)
+  {
+    now_ = now_ + dur;
+  }
+
+private:
+  ros::Time now_;
+};
+}  // namespace packml_stacklight
+
+#endif  // PACKML_STACKLIGHT_CLOCK_H
@@ -0,0 +1,121 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKML_STACKLIGHT_OUTPUT_TABLE_H
+#define PACKML_STACKLIGHT_OUTPUT_TABLE_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <packml_msgs/State.h>
+#include <packml_stacklight/action.h>
+#include <packml_stacklight/flash.h>
+
+namespace packml_stacklight
+{
+/**
+ * @brief Output values for every (state, light flash phase, buzzer flash phase), compiled once from the actions.
+ *
+ * Looking up the outputs of a state is an array index, no Action copies or string maps are involved.
+ */
+class OutputTable
+{
+public:
+  enum Ids
+  {
+    RED = 0,
+    AMBER = 1,
+    GREEN = 2,
+    BLUE = 3,
+    START = 4,
+    RESET = 5,
+    BUZZER = 6,
+    COUNT = 7,
+  } typedef Id;
+
+  static const int8_t STATE_COUNT = packml_msgs::State::COMPLETE + 1;
+  static const uint8_t ALL_MASK = (1u << COUNT) - 1;  /** pack() of all outputs on */
+
+  typedef std::array<uint8_t, COUNT> Outputs;
+
+  OutputTable();
+
+  /**
+   * @brief Rebuilds the table from one action per state.
+   *
+   * @param actions Actions indexed by state, missing states produce all outputs off.
+   */
+  void compile(const std::vector<Action>& actions);
+
+  /**
+   * @brief Looks up the outputs of a state. States outside the table use the UNDEFINED row.
+   */
+  const Outputs& get(int8_t state, Flash::Value light_flash, Flash::Value buzzer_flash) const
+  {
+    return outputs_[stateIndex(state)][light_flash][buzzer_flash];
+  }
+
+  /**
+   * @brief Whether any light or button light of the state depends on the light flash phase.
+   */
+  bool lightFlashes(int8_t state) const
+  {
+    return light_flashes_[stateIndex(state)];
+  }
+
+  /**
+   * @brief Whether the buzzer of the state depends on the buzzer flash phase.
+   */
+  bool buzzerFlashes(int8_t state) const
+  {
+    return buzzer_flashes_[stateIndex(state)];
+  }
+
+  /**
+   * @brief Topic name of an output id, nullptr for ids outside the table.
+   */
+  static const char* getName(size_t id);
+
+  /**
+   * @brief Packs outputs into a bitmask, bit i is output i.
+   */
+  static uint8_t pack(const Outputs& outputs);
+
+  /**
+   * @brief Unpacks a bitmask produced by pack().
+   */
+  static Outputs unpack(uint8_t packed);
+
+  /**
+   * @brief Evaluates a single action for the given flash phases.
+   */
+  static Outputs evaluate(const Action& action, Flash::Value light_flash, Flash::Value buzzer_flash);
+
+private:
+  std::array<std::array<std::array<Outputs, 2>, 2>, STATE_COUNT> outputs_;
+  std::array<bool, STATE_COUNT> light_flashes_;
+  std::array<bool, STATE_COUNT> buzzer_flashes_;
+
+  static size_t stateIndex(int8_t state)
+  {
+    return (state < 0 || state >= STATE_COUNT) ? packml_msgs::State::UNDEFINED : static_cast<size_t>(state);
+  }
+};
+}  // namespace packml_stacklight
+
+#endif  // PACKML_STACKLIGHT_OUTPUT_TABLE_H
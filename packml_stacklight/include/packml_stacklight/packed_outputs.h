@@ -0,0 +1,74 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKML_STACKLIGHT_PACKED_OUTPUTS_H
+#define PACKML_STACKLIGHT_PACKED_OUTPUTS_H
+
+#include <cstdint>
+#include <packml_stacklight/output_table.h>
+
+namespace packml_stacklight
+{
+/**
+ * @brief Unpacks StacklightOutputs messages for a hardware bridge.
+ *
+ * Tracks the sequence so stale (reordered or duplicated) messages are dropped and computes which outputs changed
+ * against what the bridge last wrote, so a gateway can issue a single write per change even after a lost message.
+ */
+class PackedOutputsDecoder
+{
+public:
+  /**
+   * @brief Decodes a packed update.
+   *
+   * @param seq Sequence of the message.
+   * @param packed Output bitmask of the message.
+   * @param outputs_out Unpacked outputs.
+   * @param changed_out Bitmask of outputs that differ from the previous accepted message, all of them for the first.
+   * @return bool Returns false, leaving the outputs untouched, if the message is older than one already accepted.
+   */
+  bool decode(uint64_t seq, uint8_t packed, OutputTable::Outputs& outputs_out, uint8_t& changed_out);
+
+  /**
+   * @brief Forgets the last message, the next one is accepted and reported as all changed.
+   */
+  void reset()
+  {
+    has_last_ = false;
+  }
+
+  uint64_t getGapCount() const
+  {
+    return gap_count_;
+  }
+
+  uint64_t getStaleCount() const
+  {
+    return stale_count_;
+  }
+
+private:
+  bool has_last_ = false;
+  uint64_t last_seq_ = 0;
+  uint8_t last_packed_ = 0;
+  uint64_t gap_count_ = 0;
+  uint64_t stale_count_ = 0;
+};
+}  // namespace packml_stacklight
+
+#endif  // PACKML_STACKLIGHT_PACKED_OUTPUTS_H
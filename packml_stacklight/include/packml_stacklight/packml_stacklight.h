@@ -20,25 +20,29 @@
 #define PACKML_STACKLIGHT_H
 
 #include <ros/ros.h>
-#include <packml_msgs/Status.h>
-#include <packml_msgs/State.h>
-#include <std_msgs/UInt8.h>
+#include <memory>
+#include "packml_stacklight/stacklight_channel.h"
+#include "packml_stacklight/stacklight_scheduler.h"
 #include "packml_stacklight/utils.h"
 
 namespace packml_stacklight
 {
+/**
+ * @brief Drives the stacklight outputs from the packml status.
+ *
+ * Outputs are looked up in the precomputed OutputTable. The node only wakes up for status messages, flash phase
+ * edges of states that flash, the periodic re-publish and the status timeout.
+ */
 class PackmlStacklight
 {
 protected:
   ros::NodeHandle nh_;
   ros::NodeHandle pn_;
-  ros::Subscriber status_sub_;
-  std::map<std::string, ros::Publisher> pub_map_;
 
 private:
-  packml_msgs::State current_state_;
   packml_stacklight::Utils utils_;
-  ros::Time current_state_time_;
+  std::unique_ptr<StacklightScheduler> scheduler_;
+  std::unique_ptr<StacklightChannel> channel_;
 
 public:
   PackmlStacklight(ros::NodeHandle nh, ros::NodeHandle pn);
@@ -46,13 +50,37 @@ public:
 
   void spin();
   void spinOnce();
+  void start();
+};
+
+/**
+ * @brief Drives one stacklight per station from a single process.
+ *
+ * The stations param lists namespaces. Each station gets its own status subscription, outputs and state, while the
+ * settings and the timer wheel are shared.
+ */
+class MultiStacklight
+{
+protected:
+  ros::NodeHandle nh_;
+  ros::NodeHandle pn_;
 
 private:
-  void callBackStatus(const packml_msgs::StatusConstPtr& msg);
-  void processCurState();
-  void setDoubleParam(std::string param_name, double& default_val);
-  void setBoolParam(std::string param_name, bool& default_val);
+  packml_stacklight::Utils utils_;
+  std::unique_ptr<StacklightScheduler> scheduler_;
+  std::vector<std::unique_ptr<StacklightChannel>> channels_;
+
+public:
+  MultiStacklight(ros::NodeHandle nh, ros::NodeHandle pn);
+  ~MultiStacklight();
+
+  void spin();
+  void start();
+  size_t size() const
+  {
+    return channels_.size();
+  }
 };
 }  // namespace packml_stacklight
 
-#endif  // PACKML_STACKLIGHT_H
\ No newline at end of file
+#endif  // PACKML_STACKLIGHT_H
@@ -0,0 +1,110 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKML_STACKLIGHT_CHANNEL_H
+#define PACKML_STACKLIGHT_CHANNEL_H
+
+#include <functional>
+#include <memory>
+#include <ros/ros.h>
+#include <packml_msgs/Status.h>
+#include <packml_msgs/State.h>
+#include <std_msgs/UInt8.h>
+#include <packml_stacklight/StacklightOutputs.h>
+#include "packml_stacklight/stacklight_scheduler.h"
+#include "packml_stacklight/utils.h"
+
+namespace packml_stacklight
+{
+/**
+ * @brief State, flash phases and outputs of a single stacklight.
+ *
+ * Advertises the output topics under the given node handle and subscribes to status once started. Timing comes from
+ * the shared scheduler and the outputs from the shared Utils, so many channels can live in one process.
+ */
+class StacklightChannel
+{
+public:
+  /** Called with the outputs and the mask of outputs that are (re)published, instead of publishing them. */
+  typedef std::function<void(const OutputTable::Outputs& outputs, uint8_t changed)> OutputCallback;
+
+  StacklightChannel(ros::NodeHandle nh, const Utils& utils, StacklightScheduler& scheduler);
+
+  /**
+   * @brief Constructs a channel without any ROS communication, fed through handleStatus().
+   */
+  StacklightChannel(const std::string& name, const Utils& utils, StacklightScheduler& scheduler,
+                    OutputCallback callback);
+  ~StacklightChannel();
+
+  StacklightChannel(const StacklightChannel&) = delete;
+  StacklightChannel& operator=(const StacklightChannel&) = delete;
+
+  /**
+   * @brief Publishes the initial outputs, starts the periodic re-publish and subscribes to status.
+   */
+  void start();
+
+  int8_t getState() const
+  {
+    return current_state_;
+  }
+
+  const OutputTable::Outputs& getOutputs() const
+  {
+    return last_outputs_;
+  }
+
+  /**
+   * @brief Applies a status, as received on the status topic.
+   */
+  void handleStatus(int8_t state);
+
+private:
+  typedef StacklightScheduler::TimerId TimerId;
+
+  std::string name_;
+  const Utils& utils_;
+  StacklightScheduler& scheduler_;
+  std::unique_ptr<ros::NodeHandle> nh_;  /** null without ROS communication */
+  ros::Subscriber status_sub_;
+  std::vector<ros::Publisher> publishers_;  /** indexed by OutputTable::Id, empty in packed mode */
+  ros::Publisher packed_pub_;               /** StacklightOutputs, unused in topics mode */
+  OutputCallback output_callback_;
+  uint64_t packed_seq_ = 0;
+  int8_t current_state_ = packml_msgs::State::UNDEFINED;
+  Flash::Value light_flash_ = Flash::Value::ON;
+  Flash::Value buzzer_flash_ = Flash::Value::ON;
+  OutputTable::Outputs last_outputs_;
+  bool started_ = false;
+  TimerId light_flash_timer_ = packml_sm::TimerWheel::INVALID_TIMER;
+  TimerId buzzer_flash_timer_ = packml_sm::TimerWheel::INVALID_TIMER;
+  TimerId publish_timer_ = packml_sm::TimerWheel::INVALID_TIMER;
+  TimerId status_timeout_timer_ = packml_sm::TimerWheel::INVALID_TIMER;
+
+  void callBackStatus(const packml_msgs::StatusConstPtr& msg);
+  void setState(int8_t state);
+  void publishOutputs(bool publish_all);
+  void schedulePublish();
+  void scheduleLightFlash();
+  void scheduleBuzzerFlash();
+  void onStatusTimeout();
+};
+}  // namespace packml_stacklight
+
+#endif  // PACKML_STACKLIGHT_CHANNEL_H
@@ -0,0 +1,101 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKML_STACKLIGHT_SCHEDULER_H
+#define PACKML_STACKLIGHT_SCHEDULER_H
+
+#include <ros/ros.h>
+#include <packml_sm/timer_wheel.h>
+#include "packml_stacklight/clock.h"
+
+namespace packml_stacklight
+{
+/**
+ * @brief Runs the flash, re-publish and status timeout timers of any number of stacklights on one timer wheel.
+ *
+ * A single one-shot ros::Timer is armed for the earliest pending expiry, so an idle line of stacklights costs one
+ * wake-up per flash edge instead of one timer (or one polling loop) per stacklight. Timers fire on the callback
+ * queue of the node handle passed in, on the same thread as the status callbacks.
+ *
+ * Without a node handle nothing wakes the scheduler up; the owner moves the clock and calls poll(), which is how
+ * the simulated-time tests run hours of flashing in milliseconds.
+ */
+class StacklightScheduler
+{
+public:
+  typedef packml_sm::TimerWheel::TimerId TimerId;
+  typedef packml_sm::TimerWheel::Callback Callback;
+
+  StacklightScheduler(ros::NodeHandle nh, double resolution_secs = 0.01);
+  explicit StacklightScheduler(Clock::Ptr clock, double resolution_secs = 0.01);
+
+  ros::Time now() const
+  {
+    return clock_->now();
+  }
+
+  /**
+   * @brief Fires every timer that is due at the current clock time.
+   */
+  void poll();
+
+  /**
+   * @brief Computes the time until the earliest pending timer fires.
+   *
+   * @return bool Returns false if no timer is pending.
+   */
+  bool nextExpiry(ros::Duration& delay_out) const;
+
+  /**
+   * @brief Schedules a callback.
+   *
+   * @param secs Delay in seconds from now.
+   * @param callback Function to invoke.
+   * @return TimerId Handle for cancel().
+   */
+  TimerId schedule(double secs, Callback callback);
+
+  /**
+   * @brief Cancels a pending timer and resets the handle to INVALID_TIMER.
+   *
+   * @return bool Returns true if the timer was pending.
+   */
+  bool cancel(TimerId& id);
+
+  /**
+   * @brief Accessor for the number of pending timers.
+   */
+  size_t size() const
+  {
+    return wheel_.size();
+  }
+
+private:
+  Clock::Ptr clock_;
+  packml_sm::TimerWheel wheel_;
+  ros::Timer wake_timer_;
+  ros::Time last_advance_;
+  bool advancing_ = false;
+
+  void advanceToNow();
+  void rearm();
+  void wakeCb(const ros::TimerEvent& timer_event);
+};
+}  // namespace packml_stacklight
+
+#endif  // PACKML_STACKLIGHT_SCHEDULER_H
@@ -26,13 +26,27 @@
 #include <packml_stacklight/light.h>
 #include <packml_stacklight/button.h>
 #include <packml_stacklight/buzzer.h>
+#include <packml_stacklight/clock.h>
+#include <packml_stacklight/output_table.h>
 
 namespace packml_stacklight
 {
+enum class OutputMode
+{
+  TOPICS,  // one latched UInt8 per output
+  PACKED,  // one StacklightOutputs per update
+  BOTH,
+};
+
 class Utils
 {
+public:
+  typedef std::map<std::string, std::string> OutputConfig;  // output name => off, on or flash
+  typedef std::map<std::string, OutputConfig> ActionConfig;  // state name => outputs
+
 protected:
   std::vector<Action> action_vec_ = initDefaultStatusActions();
+  OutputTable output_table_;
 
 public:
   double flash_sec_light_on_ = 2.0;
@@ -41,11 +55,26 @@ public:
   double flash_sec_buzzer_off_ = 2.0;
   double publish_frequency_ = 0.5;
   double status_timeout_ = 30.0;
+  OutputMode output_mode_ = OutputMode::TOPICS;
 
 private:
+  Clock::Ptr clock_;
+
+  // Per instance, so several stacklights in one process keep independent timing.
+  ros::Time light_flash_time_ = ros::Time(0);
+  int8_t light_flash_state_ = -1;
+  Flash::Value light_flash_ = Flash::Value::ON;
+  ros::Time buzzer_flash_time_ = ros::Time(0);
+  int8_t buzzer_flash_state_ = -1;
+  Flash::Value buzzer_flash_ = Flash::Value::ON;
+  ros::Time publish_time_ = ros::Time(0);
+  int8_t publish_state_ = -1;
+
   std::vector<Action> initDefaultStatusActions();
   void getFlash(packml_msgs::State current_state, int8_t& last_state, packml_stacklight::Flash::Value& last_flash,
                 ros::Time& last_time, double on_secs, double off_secs);
+  static void setDoubleParam(ros::NodeHandle& pn, std::string param_name, double& default_val);
+  static void setBoolParam(ros::NodeHandle& pn, std::string param_name, bool& default_val);
 
 protected:
   Flash::Value getLightFlash(packml_msgs::State current_state);
@@ -60,7 +89,13 @@ public:
   bool setSuspendStarving(bool starving = true);
   bool getShouldPublish(packml_msgs::State current_state);
   std::map<std::string, uint8_t> getPubMap(packml_msgs::State current_state);
+  const OutputTable& getOutputTable() const;
+  const Clock::Ptr& getClock() const;
+  void setClock(Clock::Ptr clock);
   void maybeResetState(packml_msgs::State& current_state, ros::Time& last_time);
+  void loadParams(ros::NodeHandle pn);
+  bool loadActions(const ActionConfig& config, std::string& error);
+  static int8_t getStateFromName(const std::string& name);
 };
 
 }  // namespace packml_stacklight
@@ -0,0 +1,116 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packml_stacklight/output_table.h"
+
+namespace packml_stacklight
+{
+const int8_t OutputTable::STATE_COUNT;
+const uint8_t OutputTable::ALL_MASK;
+
+OutputTable::OutputTable()
+{
+  compile(std::vector<Action>());
+}
+
+void OutputTable::compile(const std::vector<Action>& actions)
+{
+  const Action empty_action;
+  for (size_t state = 0; state < STATE_COUNT; state++)
+  {
+    const Action& action = state < actions.size() ? actions[state] : empty_action;
+
+    for (int light_flash = Flash::Value::ON; light_flash <= Flash::Value::OFF; light_flash++)
+    {
+      for (int buzzer_flash = Flash::Value::ON; buzzer_flash <= Flash::Value::OFF; buzzer_flash++)
+      {
+        outputs_[state][light_flash][buzzer_flash] =
+            evaluate(action, (Flash::Value)light_flash, (Flash::Value)buzzer_flash);
+      }
+    }
+
+    // Only the phases that actually change an output need a timer.
+    light_flashes_[state] =
+        outputs_[state][Flash::Value::ON][Flash::Value::ON] != outputs_[state][Flash::Value::OFF][Flash::Value::ON];
+    buzzer_flashes_[state] =
+        outputs_[state][Flash::Value::ON][Flash::Value::ON] != outputs_[state][Flash::Value::ON][Flash::Value::OFF];
+  }
+}
+
+const char* OutputTable::getName(size_t id)
+{
+  static const char* names[COUNT] = { "red", "amber", "green", "blue", "start", "reset", "buzzer" };
+  return id < COUNT ? names[id] : nullptr;
+}
+
+uint8_t OutputTable::pack(const Outputs& outputs)
+{
+  uint8_t packed = 0;
+  for (size_t id = 0; id < outputs.size(); id++)
+  {
+    if (outputs[id] != 0)
+    {
+      packed |= static_cast<uint8_t>(1u << id);
+    }
+  }
+  return packed;
+}
+
+OutputTable::Outputs OutputTable::unpack(uint8_t packed)
+{
+  Outputs outputs;
+  for (size_t id = 0; id < outputs.size(); id++)
+  {
+    outputs[id] = (packed >> id) & 1u;
+  }
+  return outputs;
+}
+
+OutputTable::Outputs OutputTable::evaluate(const Action& action, Flash::Value light_flash, Flash::Value buzzer_flash)
+{
+  Outputs outputs;
+  outputs.fill(0);
+
+  for (const Light& light : action.light_vec_)
+  {
+    if (light.current_ == Light::Value::UNDEFINED || light.current_ > Light::Value::BLUE)
+    {
+      continue;
+    }
+
+    bool on = light.active_ && !(light.flashing_ && light_flash == Flash::Value::OFF);
+    outputs[RED + light.current_ - Light::Value::RED] = on ? 1 : 0;
+  }
+
+  for (const Button& button : action.button_vec_)
+  {
+    if (button.current_ == Button::Value::UNDEFINED || button.current_ > Button::Value::RESET)
+    {
+      continue;
+    }
+
+    bool on = button.light_.active_ && !(button.light_.flashing_ && light_flash == Flash::Value::OFF);
+    outputs[START + button.current_ - Button::Value::START] = on ? 1 : 0;
+  }
+
+  bool buzzer_on = action.buzzer_.active_ && !(action.buzzer_.flashing_ && buzzer_flash == Flash::Value::OFF);
+  outputs[BUZZER] = buzzer_on ? 1 : 0;
+
+  return outputs;
+}
+}  // namespace packml_stacklight
@@ -0,0 +1,46 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packml_stacklight/packed_outputs.h"
+
+namespace packml_stacklight
+{
+bool PackedOutputsDecoder::decode(uint64_t seq, uint8_t packed, OutputTable::Outputs& outputs_out,
+                                  uint8_t& changed_out)
+{
+  // seq restarts at 1 when the publisher restarts, which is accepted as a fresh stream.
+  if (has_last_ && seq <= last_seq_ && seq != 1)
+  {
+    stale_count_++;
+    return false;
+  }
+
+  if (has_last_ && seq > last_seq_ + 1)
+  {
+    gap_count_++;
+  }
+
+  changed_out = has_last_ ? static_cast<uint8_t>(packed ^ last_packed_) : OutputTable::ALL_MASK;
+  outputs_out = OutputTable::unpack(packed);
+
+  has_last_ = true;
+  last_seq_ = seq;
+  last_packed_ = packed;
+  return true;
+}
+}  // namespace packml_stacklight
@@ -0,0 +1,61 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include "packml_stacklight/packml_stacklight.h"
+
+namespace packml_stacklight
+{
+class PackmlStacklightNodelet : public nodelet::Nodelet
+{
+private:
+  std::unique_ptr<PackmlStacklight> stacklight_;
+  std::unique_ptr<MultiStacklight> multi_stacklight_;
+  ros::Timer start_timer_;
+
+  virtual void onInit() override
+  {
+    // A stations list drives one stacklight per station, otherwise a single stacklight is driven from status.
+    if (getPrivateNodeHandle().hasParam("stations"))
+    {
+      multi_stacklight_.reset(new MultiStacklight(getNodeHandle(), getPrivateNodeHandle()));
+    }
+    else
+    {
+      stacklight_.reset(new PackmlStacklight(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    // Started from the callback queue rather than here, so the scheduler is only ever used from its thread.
+    start_timer_ = getNodeHandle().createTimer(ros::Duration(0), &PackmlStacklightNodelet::startCb, this, true);
+  }
+
+  void startCb(const ros::TimerEvent&)
+  {
+    if (multi_stacklight_)
+    {
+      multi_stacklight_->start();
+    }
+    else
+    {
+      stacklight_->start();
+    }
+  }
+};
+}  // namespace packml_stacklight
+
+PLUGINLIB_EXPORT_CLASS(packml_stacklight::PackmlStacklightNodelet, nodelet::Nodelet)
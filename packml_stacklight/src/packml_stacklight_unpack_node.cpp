@@ -0,0 +1,79 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ros/ros.h>
+#include <std_msgs/UInt8.h>
+#include <packml_stacklight/StacklightOutputs.h>
+#include "packml_stacklight/packed_outputs.h"
+
+namespace
+{
+/**
+ * @brief Republishes packed stacklight outputs as one latched UInt8 per output, for IO drivers that expect them.
+ */
+class UnpackBridge
+{
+public:
+  UnpackBridge(ros::NodeHandle nh)
+  {
+    for (size_t id = 0; id < packml_stacklight::OutputTable::COUNT; id++)
+    {
+      publishers_.push_back(nh.advertise<std_msgs::UInt8>(packml_stacklight::OutputTable::getName(id), 2, true));
+    }
+    outputs_sub_ = nh.subscribe("outputs", 10, &UnpackBridge::outputsCb, this);
+  }
+
+private:
+  ros::Subscriber outputs_sub_;
+  std::vector<ros::Publisher> publishers_;
+  packml_stacklight::PackedOutputsDecoder decoder_;
+
+  void outputsCb(const packml_stacklight::StacklightOutputsConstPtr& msg)
+  {
+    packml_stacklight::OutputTable::Outputs outputs;
+    uint8_t changed = 0;
+    if (!decoder_.decode(msg->seq, msg->outputs, outputs, changed))
+    {
+      ROS_WARN("%s dropping stale outputs seq %lu", __FUNCTION__, static_cast<unsigned long>(msg->seq));
+      return;
+    }
+
+    // A refresh from the publisher re-sends everything, like the topics mode does.
+    changed |= msg->changed;
+    for (size_t id = 0; id < publishers_.size(); id++)
+    {
+      if (changed & (1u << id))
+      {
+        std_msgs::UInt8 out;
+        out.data = outputs[id];
+        publishers_[id].publish(out);
+      }
+    }
+  }
+};
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  ros::init(argc, argv, "packml_stacklight_unpack_node");
+
+  UnpackBridge bridge((ros::NodeHandle()));
+  ros::spin();
+
+  return 0;
+}
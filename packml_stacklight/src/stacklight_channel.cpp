@@ -0,0 +1,213 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packml_stacklight/stacklight_channel.h"
+
+#include <algorithm>
+#include <boost/make_shared.hpp>
+
+namespace packml_stacklight
+{
+namespace
+{
+// Never faster than the former 1 ms processing loop.
+const double MIN_FLASH_SECS = 0.001;
+}  // namespace
+
+StacklightChannel::StacklightChannel(ros::NodeHandle nh, const Utils& utils, StacklightScheduler& scheduler)
+  : name_(nh.getNamespace()), utils_(utils), scheduler_(scheduler), nh_(new ros::NodeHandle(nh))
+{
+  last_outputs_.fill(0);
+  if (utils_.output_mode_ != OutputMode::PACKED)
+  {
+    for (size_t id = 0; id < OutputTable::COUNT; id++)
+    {
+      publishers_.push_back(nh.advertise<std_msgs::UInt8>(OutputTable::getName(id), 2, true));
+    }
+  }
+  if (utils_.output_mode_ != OutputMode::TOPICS)
+  {
+    // Queued rather than dropped so a bridge sees every edge, latched so it gets the outputs when it connects.
+    packed_pub_ = nh.advertise<StacklightOutputs>("outputs", 10, true);
+  }
+}
+
+StacklightChannel::StacklightChannel(const std::string& name, const Utils& utils, StacklightScheduler& scheduler,
+                                     OutputCallback callback)
+  : name_(name), utils_(utils), scheduler_(scheduler), output_callback_(callback)
+{
+  last_outputs_.fill(0);
+}
+
+StacklightChannel::~StacklightChannel()
+{
+  status_sub_.shutdown();
+  scheduler_.cancel(light_flash_timer_);
+  scheduler_.cancel(buzzer_flash_timer_);
+  scheduler_.cancel(publish_timer_);
+  scheduler_.cancel(status_timeout_timer_);
+}
+
+void StacklightChannel::start()
+{
+  if (started_)
+  {
+    return;
+  }
+
+  started_ = true;
+  publishOutputs(true);
+  schedulePublish();
+
+  // Subscribed last, so status callbacks never touch the scheduler or outputs while start() runs on another thread.
+  if (nh_)
+  {
+    status_sub_ = nh_->subscribe<packml_msgs::Status>("status", 1, &StacklightChannel::callBackStatus, this);
+  }
+}
+
+void StacklightChannel::callBackStatus(const packml_msgs::StatusConstPtr& msg)
+{
+  handleStatus(msg->state.val);
+}
+
+void StacklightChannel::handleStatus(int8_t state)
+{
+  if (utils_.status_timeout_ > 0)
+  {
+    scheduler_.cancel(status_timeout_timer_);
+    status_timeout_timer_ = scheduler_.schedule(utils_.status_timeout_, [this]() {
+      status_timeout_timer_ = packml_sm::TimerWheel::INVALID_TIMER;
+      onStatusTimeout();
+    });
+  }
+
+  if (state != current_state_)
+  {
+    setState(state);
+  }
+}
+
+void StacklightChannel::setState(int8_t state)
+{
+  current_state_ = state;
+  light_flash_ = Flash::Value::ON;
+  buzzer_flash_ = Flash::Value::ON;
+
+  const OutputTable& table = utils_.getOutputTable();
+  scheduler_.cancel(light_flash_timer_);
+  scheduler_.cancel(buzzer_flash_timer_);
+  if (table.lightFlashes(state))
+  {
+    scheduleLightFlash();
+  }
+  if (table.buzzerFlashes(state))
+  {
+    scheduleBuzzerFlash();
+  }
+
+  // A state change publishes everything, so the periodic re-publish starts counting again.
+  if (started_)
+  {
+    schedulePublish();
+  }
+  publishOutputs(true);
+}
+
+void StacklightChannel::scheduleLightFlash()
+{
+  double secs = light_flash_ == Flash::Value::ON ? utils_.flash_sec_light_on_ : utils_.flash_sec_light_off_;
+  light_flash_timer_ = scheduler_.schedule(std::max(secs, MIN_FLASH_SECS), [this]() {
+    light_flash_ = light_flash_ == Flash::Value::ON ? Flash::Value::OFF : Flash::Value::ON;
+    scheduleLightFlash();
+    publishOutputs(false);
+  });
+}
+
+void StacklightChannel::scheduleBuzzerFlash()
+{
+  double secs = buzzer_flash_ == Flash::Value::ON ? utils_.flash_sec_buzzer_on_ : utils_.flash_sec_buzzer_off_;
+  buzzer_flash_timer_ = scheduler_.schedule(std::max(secs, MIN_FLASH_SECS), [this]() {
+    buzzer_flash_ = buzzer_flash_ == Flash::Value::ON ? Flash::Value::OFF : Flash::Value::ON;
+    scheduleBuzzerFlash();
+    publishOutputs(false);
+  });
+}
+
+void StacklightChannel::schedulePublish()
+{
+  scheduler_.cancel(publish_timer_);
+  if (utils_.publish_frequency_ <= 0)
+  {
+    return;
+  }
+
+  publish_timer_ = scheduler_.schedule(utils_.publish_frequency_, [this]() {
+    schedulePublish();
+    publishOutputs(true);
+  });
+}
+
+void StacklightChannel::onStatusTimeout()
+{
+  if (current_state_ == packml_msgs::State::UNDEFINED)
+  {
+    return;
+  }
+
+  ROS_WARN("%s status_timeout_ reached on %s, setting current_state to %d", __FUNCTION__, name_.c_str(),
+           packml_msgs::State::UNDEFINED);
+  setState(packml_msgs::State::UNDEFINED);
+}
+
+void StacklightChannel::publishOutputs(bool publish_all)
+{
+  const OutputTable::Outputs& outputs = utils_.getOutputTable().get(current_state_, light_flash_, buzzer_flash_);
+  uint8_t packed = OutputTable::pack(outputs);
+  uint8_t changed = publish_all ? OutputTable::ALL_MASK : packed ^ OutputTable::pack(last_outputs_);
+
+  if (output_callback_ != nullptr && changed != 0)
+  {
+    output_callback_(outputs, changed);
+  }
+
+  if (packed_pub_ && changed != 0)
+  {
+    boost::shared_ptr<StacklightOutputs> msg = boost::make_shared<StacklightOutputs>();
+    msg->header.stamp = scheduler_.now();
+    msg->seq = ++packed_seq_;
+    msg->state = current_state_;
+    msg->outputs = packed;
+    msg->changed = changed;
+    packed_pub_.publish(msg);
+  }
+
+  for (size_t id = 0; id < publishers_.size(); id++)
+  {
+    if (publish_all || outputs[id] != last_outputs_[id])
+    {
+      ROS_DEBUG("do publish state:%d, topic:%s, data:%d", current_state_, OutputTable::getName(id), outputs[id]);
+      boost::shared_ptr<std_msgs::UInt8> msg = boost::make_shared<std_msgs::UInt8>();
+      msg->data = outputs[id];
+      publishers_[id].publish(msg);
+    }
+  }
+
+  last_outputs_ = outputs;
+}
+}  // namespace packml_stacklight
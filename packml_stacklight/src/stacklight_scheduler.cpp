@@ -0,0 +1,114 @@
+/*
+ * Software License Agreement (Apache License)
+ *
+ * Copyright (c) 2019 Joshua Hatzenbuehler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packml_stacklight/stacklight_scheduler.h"
+
+#include <algorithm>
+
+namespace packml_stacklight
+{
+StacklightScheduler::StacklightScheduler(ros::NodeHandle nh, double resolution_secs)
+  : StacklightScheduler(std::make_shared<RosClock>(), resolution_secs)
+{
+  wake_timer_ = nh.createTimer(ros::Duration(1.0), &StacklightScheduler::wakeCb, this, true, false);
+}
+
+StacklightScheduler::StacklightScheduler(Clock::Ptr clock, double resolution_secs)
+  : clock_(clock ? clock : std::make_shared<RosClock>())
+  , wheel_(std::chrono::nanoseconds(static_cast<int64_t>(std::max(resolution_secs, 1e-6) * 1e9)))
+  , last_advance_(clock_->now())
+{
+}
+
+StacklightScheduler::TimerId StacklightScheduler::schedule(double secs, Callback callback)
+{
+  // Bring the wheel up to date first so the delay counts from now rather than from the last wake-up.
+  if (!advancing_)
+  {
+    advanceToNow();
+  }
+
+  TimerId id = wheel_.schedule(std::chrono::nanoseconds(static_cast<int64_t>(std::max(secs, 0.0) * 1e9)), callback);
+  if (!advancing_)
+  {
+    rearm();
+  }
+  return id;
+}
+
+bool StacklightScheduler::cancel(TimerId& id)
+{
+  bool cancelled = id != packml_sm::TimerWheel::INVALID_TIMER && wheel_.cancel(id);
+  id = packml_sm::TimerWheel::INVALID_TIMER;
+  return cancelled;
+}
+
+void StacklightScheduler::poll()
+{
+  advanceToNow();
+  rearm();
+}
+
+bool StacklightScheduler::nextExpiry(ros::Duration& delay_out) const
+{
+  std::chrono::nanoseconds delay;
+  if (!wheel_.nextExpiry(delay))
+  {
+    return false;
+  }
+
+  delay_out.fromNSec(delay.count());
+  return true;
+}
+
+void StacklightScheduler::advanceToNow()
+{
+  ros::Time now = clock_->now();
+  if (now > last_advance_)
+  {
+    advancing_ = true;
+    wheel_.advance(std::chrono::nanoseconds((now - last_advance_).toNSec()));
+    advancing_ = false;
+  }
+  last_advance_ = now;
+}
+
+void StacklightScheduler::rearm()
+{
+  if (!wake_timer_)
+  {
+    return;
+  }
+
+  wake_timer_.stop();
+
+  std::chrono::nanoseconds delay;
+  if (wheel_.nextExpiry(delay))
+  {
+    ros::Duration period;
+    period.fromNSec(std::max<int64_t>(delay.count(), 1000));
+    wake_timer_.setPeriod(period);
+    wake_timer_.start();
+  }
+}
+
+void StacklightScheduler::wakeCb(const ros::TimerEvent& timer_event)
+{
+  poll();
+}
+}  // namespace packml_stacklight
@@ -18,11 +18,71 @@
 
 #include "packml_stacklight/utils.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
 namespace packml_stacklight
 {
-Utils::Utils()
+namespace
 {
-  return;
+// Indexed by packml_msgs::State value.
+const char* STATE_NAMES[OutputTable::STATE_COUNT] = {
+  "undefined", "clearing", "stopped", "starting",  "idle",       "suspended",    "execute",   "stopping",   "aborting",
+  "aborted",   "holding",  "held",    "unholding", "suspending", "unsuspending", "resetting", "completing", "complete",
+};
+
+bool parseMode(const std::string& mode, bool& active, bool& flashing)
+{
+  active = mode == "on" || mode == "flash";
+  flashing = mode == "flash";
+  return active || mode == "off";
+}
+
+bool toActionConfig(XmlRpc::XmlRpcValue& value, Utils::ActionConfig& config, std::string& error)
+{
+  if (value.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+  {
+    error = "actions must map state names to outputs";
+    return false;
+  }
+
+  for (auto& state_entry : value)
+  {
+    if (state_entry.second.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+    {
+      error = state_entry.first + " must map output names to off, on or flash";
+      return false;
+    }
+
+    Utils::OutputConfig& outputs = config[state_entry.first];
+    for (auto& output_entry : state_entry.second)
+    {
+      XmlRpc::XmlRpcValue& mode = output_entry.second;
+      if (mode.getType() == XmlRpc::XmlRpcValue::TypeString)
+      {
+        outputs[output_entry.first] = static_cast<std::string>(mode);
+      }
+      else if (mode.getType() == XmlRpc::XmlRpcValue::TypeBoolean)
+      {
+        // YAML reads unquoted on and off as booleans.
+        outputs[output_entry.first] = static_cast<bool>(mode) ? "on" : "off";
+      }
+      else
+      {
+        error = state_entry.first + "/" + output_entry.first + " must be off, on or flash";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+}  // namespace
+
+Utils::Utils() : clock_(std::make_shared<RosClock>())
+{
+  output_table_.compile(action_vec_);
 }
 
 Utils::~Utils()
@@ -179,35 +239,30 @@ bool Utils::setSuspendStarving(bool starving)
 {
   action_vec_[packml_msgs::State::SUSPENDING].light_vec_[Light::Value::AMBER].flashing_ = starving;
   action_vec_[packml_msgs::State::SUSPENDED].light_vec_[Light::Value::AMBER].flashing_ = starving;
+  output_table_.compile(action_vec_);
   return getSuspendStarving();
 }
 
 Flash::Value Utils::getLightFlash(packml_msgs::State current_state)
 {
-  static ros::Time last_time(0);
-  static int8_t last_state = -1;
-  static Flash::Value last_flash = Flash::Value::ON;
+  getFlash(current_state, light_flash_state_, light_flash_, light_flash_time_, flash_sec_light_on_,
+           flash_sec_light_off_);
 
-  getFlash(current_state, last_state, last_flash, last_time, flash_sec_light_on_, flash_sec_light_off_);
-
-  return last_flash;
+  return light_flash_;
 }
 
 Flash::Value Utils::getBuzzerFlash(packml_msgs::State current_state)
 {
-  static ros::Time last_time(0);
-  static int8_t last_state = -1;
-  static Flash::Value last_flash = Flash::Value::ON;
-
-  getFlash(current_state, last_state, last_flash, last_time, flash_sec_buzzer_on_, flash_sec_buzzer_off_);
+  getFlash(current_state, buzzer_flash_state_, buzzer_flash_, buzzer_flash_time_, flash_sec_buzzer_on_,
+           flash_sec_buzzer_off_);
 
-  return last_flash;
+  return buzzer_flash_;
 }
 
 void Utils::getFlash(packml_msgs::State current_state, int8_t& last_state, Flash::Value& last_flash,
                      ros::Time& last_time, double on_secs, double off_secs)
 {
-  ros::Time new_time = ros::Time::now();
+  ros::Time new_time = clock_->now();
   ros::Duration dur = new_time - last_time;
 
   if (last_state != current_state.val)
@@ -235,21 +290,19 @@ void Utils::getFlash(packml_msgs::State current_state, int8_t& last_state, Flash
 
 bool Utils::getShouldPublish(packml_msgs::State current_state)
 {
-  static ros::Time last_time(0);
-  static int8_t last_state = -1;
-  ros::Time new_time = ros::Time::now();
-  ros::Duration dur = new_time - last_time;
+  ros::Time new_time = clock_->now();
+  ros::Duration dur = new_time - publish_time_;
 
-  if (last_state != current_state.val)
+  if (publish_state_ != current_state.val)
   {
-    last_time = new_time;
-    last_state = current_state.val;
+    publish_time_ = new_time;
+    publish_state_ = current_state.val;
     return true;
   }
 
   if (dur.toSec() >= publish_frequency_)
   {
-    last_time = new_time;
+    publish_time_ = new_time;
     return true;
   }
 
@@ -258,6 +311,11 @@ bool Utils::getShouldPublish(packml_msgs::State current_state)
 
 Action Utils::getActionFromState(packml_msgs::State current_state)
 {
+  if (current_state.val < 0 || static_cast<size_t>(current_state.val) >= action_vec_.size())
+  {
+    return action_vec_[packml_msgs::State::UNDEFINED];
+  }
+
   return action_vec_[current_state.val];
 }
 
@@ -275,69 +333,224 @@ std::map<std::string, uint8_t> Utils::getPubMap(Action action)
   Flash::Value light_flash = getLightFlash(current);
   Flash::Value buzzer_flash = getBuzzerFlash(current);
 
-  std::vector<Light>::iterator light_it;
-  for (light_it = action.light_vec_.begin(); light_it != action.light_vec_.end(); ++light_it)
+  OutputTable::Outputs outputs = OutputTable::evaluate(action, light_flash, buzzer_flash);
+  for (size_t id = 0; id < outputs.size(); id++)
+  {
+    out_map.insert(std::pair<std::string, uint8_t>(OutputTable::getName(id), outputs[id]));
+  }
+
+  return out_map;
+}
+
+const OutputTable& Utils::getOutputTable() const
+{
+  return output_table_;
+}
+
+void Utils::setDoubleParam(ros::NodeHandle& pn, std::string param_name, double& default_val)
+{
+  double val = 0.0;
+  std::string msg = "";
+  pn.param(param_name, val, default_val);
+  if (val != default_val)
+  {
+    default_val = val;
+    msg = "changed";
+  }
+  else
+  {
+    msg = "default";
+  }
+
+  ROS_INFO("%s %s %s => %.02f", __FUNCTION__, msg.c_str(), param_name.c_str(), default_val);
+}
+
+void Utils::setBoolParam(ros::NodeHandle& pn, std::string param_name, bool& default_val)
+{
+  bool val = false;
+  std::string msg = "";
+  pn.param(param_name, val, default_val);
+  if (val != default_val)
+  {
+    default_val = val;
+    msg = "changed";
+  }
+  else
   {
-    if (light_it->current_ == Light::Value::UNDEFINED)
+    msg = "default";
+  }
+
+  ROS_INFO("%s %s %s => %s", __FUNCTION__, msg.c_str(), param_name.c_str(), default_val ? "true" : "false");
+}
+
+void Utils::loadParams(ros::NodeHandle pn)
+{
+  setDoubleParam(pn, "light_on_secs", flash_sec_light_on_);
+  setDoubleParam(pn, "light_off_secs", flash_sec_light_off_);
+  setDoubleParam(pn, "buzzer_on_secs", flash_sec_buzzer_on_);
+  setDoubleParam(pn, "buzzer_off_secs", flash_sec_buzzer_off_);
+  setDoubleParam(pn, "publish_frequency", publish_frequency_);
+  setDoubleParam(pn, "status_timeout", status_timeout_);
+
+  bool suspend_default = getSuspendStarving();
+  setBoolParam(pn, "treat_suspend_starving", suspend_default);
+  setSuspendStarving(suspend_default);
+
+  // Applied after treat_suspend_starving, so a configured suspending or suspended row wins.
+  XmlRpc::XmlRpcValue actions;
+  if (pn.getParam("actions", actions))
+  {
+    ActionConfig config;
+    std::string error;
+    if (!toActionConfig(actions, config, error) || !loadActions(config, error))
     {
-      continue;
+      ROS_ERROR("%s invalid actions, keeping the built-in table: %s", __FUNCTION__, error.c_str());
     }
-
-    uint8_t light_val = 0;
-    if (light_it->active_)
+    else
     {
-      light_val = 1;
+      ROS_INFO("%s loaded actions for %zu states", __FUNCTION__, config.size());
     }
+  }
 
-    if (light_it->flashing_ && light_flash == Flash::Value::OFF)
+  std::string output_mode;
+  pn.param<std::string>("output_mode", output_mode, "topics");
+  if (output_mode == "packed")
+  {
+    output_mode_ = OutputMode::PACKED;
+  }
+  else if (output_mode == "both")
+  {
+    output_mode_ = OutputMode::BOTH;
+  }
+  else
+  {
+    if (output_mode != "topics")
     {
-      light_val = 0;
+      ROS_WARN("%s unknown output_mode %s, using topics", __FUNCTION__, output_mode.c_str());
     }
-
-    out_map.insert(std::pair<std::string, uint8_t>(light_it->map_.find(light_it->current_)->second, light_val));
+    output_mode_ = OutputMode::TOPICS;
   }
+  ROS_INFO("%s output_mode => %s", __FUNCTION__, output_mode.c_str());
+}
+
+const Clock::Ptr& Utils::getClock() const
+{
+  return clock_;
+}
 
-  std::vector<Button>::iterator button_it;
-  for (button_it = action.button_vec_.begin(); button_it != action.button_vec_.end(); ++button_it)
+void Utils::setClock(Clock::Ptr clock)
+{
+  clock_ = clock ? clock : std::make_shared<RosClock>();
+}
+
+bool Utils::loadActions(const ActionConfig& config, std::string& error)
+{
+  // Validate everything on a copy, so a bad entry leaves the current table untouched.
+  std::vector<Action> actions(action_vec_);
+  std::vector<bool> seen(actions.size(), false);
+  for (const auto& state_entry : config)
   {
-    if (button_it->current_ == Button::Value::UNDEFINED)
+    int8_t state = getStateFromName(state_entry.first);
+    if (state < 0)
     {
-      continue;
+      error = "unknown state " + state_entry.first;
+      return false;
     }
-
-    uint8_t button_val = 0;
-    if (button_it->light_.active_)
+    if (seen[state])
     {
-      button_val = 1;
+      error = "state " + state_entry.first + " is configured twice";
+      return false;
     }
+    seen[state] = true;
 
-    if (button_it->light_.flashing_ && light_flash == Flash::Value::OFF)
+    // A configured state starts dark, only the listed outputs are driven.
+    Action& action = actions[state];
+    for (Light& light : action.light_vec_)
     {
-      button_val = 0;
+      light.active_ = false;
+      light.flashing_ = false;
     }
+    for (Button& button : action.button_vec_)
+    {
+      button.light_.active_ = false;
+      button.light_.flashing_ = false;
+    }
+    action.buzzer_.active_ = false;
+    action.buzzer_.flashing_ = false;
 
-    out_map.insert(std::pair<std::string, uint8_t>(button_it->map_.find(button_it->current_)->second, button_val));
-    // todo output color mapp as well
+    for (const auto& output_entry : state_entry.second)
+    {
+      size_t id = 0;
+      while (id < OutputTable::COUNT && output_entry.first != OutputTable::getName(id))
+      {
+        id++;
+      }
+      if (id == OutputTable::COUNT)
+      {
+        error = "unknown output " + state_entry.first + "/" + output_entry.first;
+        return false;
+      }
+
+      bool active = false;
+      bool flashing = false;
+      if (!parseMode(output_entry.second, active, flashing))
+      {
+        error = state_entry.first + "/" + output_entry.first + " is " + output_entry.second +
+                ", expected off, on or flash";
+        return false;
+      }
+
+      if (id <= OutputTable::BLUE)
+      {
+        Light& light = action.light_vec_[Light::Value::RED + id - OutputTable::RED];
+        light.active_ = active;
+        light.flashing_ = flashing;
+      }
+      else if (id <= OutputTable::RESET)
+      {
+        Button& button = action.button_vec_[Button::Value::START + id - OutputTable::START];
+        button.light_.active_ = active;
+        button.light_.flashing_ = flashing;
+      }
+      else
+      {
+        action.buzzer_.active_ = active;
+        action.buzzer_.flashing_ = flashing;
+      }
+    }
   }
 
-  uint8_t buz_val = 0;
-  if (action.buzzer_.active_)
+  action_vec_.swap(actions);
+  output_table_.compile(action_vec_);
+  return true;
+}
+
+int8_t Utils::getStateFromName(const std::string& name)
+{
+  std::string lower(name);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  for (int8_t state = 0; state < OutputTable::STATE_COUNT; state++)
   {
-    buz_val = 1;
+    if (lower == STATE_NAMES[state])
+    {
+      return state;
+    }
   }
 
-  if (action.buzzer_.flashing_ && buzzer_flash == Flash::Value::OFF)
+  // Plain state values are accepted too, as long as they fit the table.
+  char* end = nullptr;
+  long value = std::strtol(lower.c_str(), &end, 10);
+  if (!lower.empty() && *end == '\0' && value >= 0 && value < OutputTable::STATE_COUNT)
   {
-    buz_val = 0;
+    return static_cast<int8_t>(value);
   }
-  out_map.insert(std::pair<std::string, uint8_t>(action.buzzer_.map_, buz_val));
 
-  return out_map;
+  return -1;
 }
 
 void Utils::maybeResetState(packml_msgs::State& current_state, ros::Time& last_time)
 {
-  ros::Time new_time = ros::Time::now();
+  ros::Time new_time = clock_->now();
   ros::Duration dur = new_time - last_time;
 
   if (status_timeout_ <= 0)
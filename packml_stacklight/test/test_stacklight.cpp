@@ -18,6 +18,10 @@
 
 #include <gtest/gtest.h>
 #include <ros/ros.h>
+#include "packml_stacklight/clock.h"
+#include "packml_stacklight/packed_outputs.h"
+#include "packml_stacklight/stacklight_channel.h"
+#include "packml_stacklight/stacklight_scheduler.h"
 #include "packml_stacklight/utils.h"
 
 namespace utils_test
@@ -25,8 +29,10 @@ namespace utils_test
 class StacklightTest : public testing::Test, packml_stacklight::Utils
 {
 protected:
-  StacklightTest()
+  StacklightTest() : sim_clock_(std::make_shared<packml_stacklight::SimulatedClock>())
   {
+    setClock(sim_clock_);
+
     int8_t max_state_value = packml_msgs::State::COMPLETE + 1;
 
     SCOPED_TRACE("StatusActionEmptyTest");
@@ -54,6 +60,13 @@ protected:
   FRIEND_TEST(StacklightTest, TestPubMapFromAction);
   FRIEND_TEST(StacklightTest, TestPubMapFromState);
   FRIEND_TEST(StacklightTest, TestPublishTopics);
+  FRIEND_TEST(StacklightTest, OutputTableLookup);
+  FRIEND_TEST(StacklightTest, IndependentInstances);
+  FRIEND_TEST(StacklightTest, ConfiguredActions);
+  FRIEND_TEST(StacklightTest, ConfiguredActionsInvalid);
+  FRIEND_TEST(StacklightTest, OutOfRangeState);
+
+  std::shared_ptr<packml_stacklight::SimulatedClock> sim_clock_;
 };
 
 TEST_F(StacklightTest, LightActionDefault)
@@ -495,23 +508,23 @@ TEST_F(StacklightTest, LightFlash)
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(on_secs).sleep();
+  sim_clock_->advance(ros::Duration(on_secs));
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
-  ros::Duration(off_secs).sleep();
+  sim_clock_->advance(ros::Duration(off_secs));
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(on_secs * 2).sleep();
+  sim_clock_->advance(ros::Duration(on_secs * 2));
   flash = getLightFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
@@ -535,23 +548,23 @@ TEST_F(StacklightTest, BuzzerFlash)
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(on_secs).sleep();
+  sim_clock_->advance(ros::Duration(on_secs));
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
-  ros::Duration(off_secs).sleep();
+  sim_clock_->advance(ros::Duration(off_secs));
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::ON, flash);
 
-  ros::Duration(on_secs * 2).sleep();
+  sim_clock_->advance(ros::Duration(on_secs * 2));
   flash = getBuzzerFlash(temp);
   EXPECT_EQ(packml_stacklight::Flash::Value::OFF, flash);
 
@@ -573,23 +586,23 @@ TEST_F(StacklightTest, PublishAllNoState)
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(secs).sleep();
+  sim_clock_->advance(ros::Duration(secs));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 }
@@ -607,32 +620,32 @@ TEST_F(StacklightTest, PublishAll)
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(secs).sleep();
+  sim_clock_->advance(ros::Duration(secs));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 
-  ros::Duration(secs).sleep();
+  sim_clock_->advance(ros::Duration(secs));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   temp.val = packml_msgs::State::STOPPED;
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(true, pub_all);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   pub_all = getShouldPublish(temp);
   EXPECT_EQ(false, pub_all);
 }
@@ -651,15 +664,15 @@ TEST_F(StacklightTest, StatusTimeoutReset)
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
   EXPECT_NE(ros::Time(0), temp_time);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   maybeResetState(temp, temp_time);
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   maybeResetState(temp, temp_time);
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
 
-  ros::Duration(secs).sleep();
+  sim_clock_->advance(ros::Duration(secs));
   maybeResetState(temp, temp_time);
   EXPECT_EQ(packml_msgs::State::UNDEFINED, temp.val);
 }
@@ -678,11 +691,11 @@ TEST_F(StacklightTest, StatusTimeoutNoReset)
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
   EXPECT_NE(ros::Time(0), temp_time);
 
-  ros::Duration(0.1).sleep();
+  sim_clock_->advance(ros::Duration(0.1));
   maybeResetState(temp, temp_time);
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
 
-  ros::Duration(.5).sleep();
+  sim_clock_->advance(ros::Duration(.5));
   maybeResetState(temp, temp_time);
   EXPECT_EQ(packml_msgs::State::STOPPING, temp.val);
 }
@@ -760,6 +773,349 @@ TEST_F(StacklightTest, TestPublishTopics)
   EXPECT_EQ(0, temp_map.size());
 }
 
+TEST_F(StacklightTest, OutputTableLookup)
+{
+  const packml_stacklight::OutputTable& table = getOutputTable();
+  packml_stacklight::OutputTable::Outputs outputs;
+
+  outputs = table.get(packml_msgs::State::EXECUTE, packml_stacklight::Flash::Value::ON,
+                      packml_stacklight::Flash::Value::ON);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::GREEN]);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::BLUE]);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::START]);
+  EXPECT_EQ(0, outputs[packml_stacklight::OutputTable::RED]);
+  EXPECT_EQ(0, outputs[packml_stacklight::OutputTable::BUZZER]);
+
+  outputs = table.get(packml_msgs::State::EXECUTE, packml_stacklight::Flash::Value::OFF,
+                      packml_stacklight::Flash::Value::ON);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::GREEN]);
+  EXPECT_EQ(0, outputs[packml_stacklight::OutputTable::BLUE]);
+
+  EXPECT_TRUE(table.lightFlashes(packml_msgs::State::EXECUTE));
+  EXPECT_FALSE(table.buzzerFlashes(packml_msgs::State::EXECUTE));
+  EXPECT_TRUE(table.buzzerFlashes(packml_msgs::State::STARTING));
+  EXPECT_FALSE(table.lightFlashes(packml_msgs::State::HELD));
+  EXPECT_FALSE(table.lightFlashes(packml_msgs::State::UNDEFINED));
+
+  // Every state matches the string map the outputs used to be built from.
+  for (int8_t state = packml_msgs::State::UNDEFINED; state <= packml_msgs::State::COMPLETE; state++)
+  {
+    packml_msgs::State temp;
+    temp.val = state;
+    std::map<std::string, uint8_t> temp_map = getPubMap(temp);
+    outputs = table.get(state, packml_stacklight::Flash::Value::ON, packml_stacklight::Flash::Value::ON);
+    for (size_t id = 0; id < outputs.size(); id++)
+    {
+      EXPECT_EQ(temp_map[packml_stacklight::OutputTable::getName(id)], outputs[id]);
+    }
+  }
+
+  // Out of range states fall back to UNDEFINED.
+  outputs = table.get(-1, packml_stacklight::Flash::Value::ON, packml_stacklight::Flash::Value::ON);
+  for (size_t id = 0; id < outputs.size(); id++)
+  {
+    EXPECT_EQ(0, outputs[id]);
+  }
+  EXPECT_EQ(nullptr, packml_stacklight::OutputTable::getName(packml_stacklight::OutputTable::COUNT));
+
+  // Changing the suspend behavior recompiles the table.
+  setSuspendStarving(false);
+  EXPECT_EQ(1, getOutputTable().get(packml_msgs::State::SUSPENDED, packml_stacklight::Flash::Value::OFF,
+                                    packml_stacklight::Flash::Value::ON)[packml_stacklight::OutputTable::AMBER]);
+}
+
+TEST_F(StacklightTest, IndependentInstances)
+{
+  packml_msgs::State temp;
+  temp.val = packml_msgs::State::STOPPING;
+  publish_frequency_ = 10.0;
+
+  EXPECT_EQ(true, getShouldPublish(temp));
+  EXPECT_EQ(false, getShouldPublish(temp));
+
+  // A second stacklight in the same process starts from its own timing.
+  packml_stacklight::Utils other;
+  other.publish_frequency_ = 10.0;
+  EXPECT_EQ(true, other.getShouldPublish(temp));
+  EXPECT_EQ(false, other.getShouldPublish(temp));
+}
+
+TEST_F(StacklightTest, ConfiguredActions)
+{
+  const packml_stacklight::OutputTable& table = getOutputTable();
+  packml_stacklight::OutputTable::Outputs execute =
+      table.get(packml_msgs::State::EXECUTE, packml_stacklight::Flash::Value::OFF, packml_stacklight::Flash::Value::OFF);
+
+  packml_stacklight::Utils::ActionConfig config;
+  config["Stopped"] = { { "amber", "on" }, { "reset", "flash" }, { "buzzer", "flash" } };
+  config["11"] = { { "red", "off" } };
+  std::string error;
+  ASSERT_TRUE(loadActions(config, error)) << error;
+
+  packml_stacklight::OutputTable::Outputs outputs =
+      table.get(packml_msgs::State::STOPPED, packml_stacklight::Flash::Value::ON, packml_stacklight::Flash::Value::ON);
+  packml_stacklight::OutputTable::Outputs expected = { { 0, 1, 0, 0, 0, 1, 1 } };
+  EXPECT_EQ(expected, outputs);
+  outputs =
+      table.get(packml_msgs::State::STOPPED, packml_stacklight::Flash::Value::OFF, packml_stacklight::Flash::Value::OFF);
+  expected = { { 0, 1, 0, 0, 0, 0, 0 } };
+  EXPECT_EQ(expected, outputs);
+  EXPECT_TRUE(table.lightFlashes(packml_msgs::State::STOPPED));
+  EXPECT_TRUE(table.buzzerFlashes(packml_msgs::State::STOPPED));
+
+  // HELD is dark, states that are not configured keep the built-in behavior.
+  expected.fill(0);
+  EXPECT_EQ(expected, table.get(packml_msgs::State::HELD, packml_stacklight::Flash::Value::ON,
+                                packml_stacklight::Flash::Value::ON));
+  EXPECT_EQ(execute, table.get(packml_msgs::State::EXECUTE, packml_stacklight::Flash::Value::OFF,
+                               packml_stacklight::Flash::Value::OFF));
+}
+
+TEST_F(StacklightTest, ConfiguredActionsInvalid)
+{
+  const packml_stacklight::OutputTable& table = getOutputTable();
+  packml_stacklight::OutputTable::Outputs stopped =
+      table.get(packml_msgs::State::STOPPED, packml_stacklight::Flash::Value::ON, packml_stacklight::Flash::Value::ON);
+
+  std::vector<packml_stacklight::Utils::ActionConfig> configs(5);
+  configs[0]["stopped"] = { { "amber", "on" } };
+  configs[0]["parked"] = { { "red", "on" } };
+  configs[1]["stopped"] = { { "purple", "on" } };
+  configs[2]["stopped"] = { { "red", "blink" } };
+  configs[3]["stopped"] = { { "red", "on" } };
+  configs[3]["2"] = { { "red", "off" } };
+  configs[4]["18"] = { { "red", "on" } };
+
+  for (size_t i = 0; i < configs.size(); i++)
+  {
+    std::string error;
+    EXPECT_FALSE(loadActions(configs[i], error)) << "config " << i;
+    EXPECT_FALSE(error.empty());
+
+    // A rejected configuration leaves the whole table untouched.
+    EXPECT_EQ(stopped, table.get(packml_msgs::State::STOPPED, packml_stacklight::Flash::Value::ON,
+                                 packml_stacklight::Flash::Value::ON));
+  }
+}
+
+TEST_F(StacklightTest, StateFromName)
+{
+  EXPECT_EQ(packml_msgs::State::UNDEFINED, packml_stacklight::Utils::getStateFromName("undefined"));
+  EXPECT_EQ(packml_msgs::State::STOPPED, packml_stacklight::Utils::getStateFromName("STOPPED"));
+  EXPECT_EQ(packml_msgs::State::HELD, packml_stacklight::Utils::getStateFromName("held"));
+  EXPECT_EQ(packml_msgs::State::UNSUSPENDING, packml_stacklight::Utils::getStateFromName("Unsuspending"));
+  EXPECT_EQ(packml_msgs::State::COMPLETE, packml_stacklight::Utils::getStateFromName("complete"));
+  EXPECT_EQ(packml_msgs::State::COMPLETE, packml_stacklight::Utils::getStateFromName("17"));
+  EXPECT_EQ(-1, packml_stacklight::Utils::getStateFromName("18"));
+  EXPECT_EQ(-1, packml_stacklight::Utils::getStateFromName("-1"));
+  EXPECT_EQ(-1, packml_stacklight::Utils::getStateFromName("2x"));
+  EXPECT_EQ(-1, packml_stacklight::Utils::getStateFromName(""));
+}
+
+TEST_F(StacklightTest, OutOfRangeState)
+{
+  packml_msgs::State temp;
+  temp.val = 100;
+  EXPECT_EQ(packml_msgs::State::UNDEFINED, getActionFromState(temp).state_);
+  temp.val = -5;
+  EXPECT_EQ(packml_msgs::State::UNDEFINED, getActionFromState(temp).state_);
+}
+
+TEST(PackedOutputsTest, PackUnpack)
+{
+  packml_stacklight::OutputTable::Outputs outputs;
+  outputs.fill(0);
+  outputs[packml_stacklight::OutputTable::GREEN] = 1;
+  outputs[packml_stacklight::OutputTable::BUZZER] = 1;
+
+  uint8_t packed = packml_stacklight::OutputTable::pack(outputs);
+  EXPECT_EQ((1 << packml_stacklight::OutputTable::GREEN) | (1 << packml_stacklight::OutputTable::BUZZER), packed);
+  EXPECT_EQ(outputs, packml_stacklight::OutputTable::unpack(packed));
+  EXPECT_EQ(0x7f, packml_stacklight::OutputTable::ALL_MASK);
+}
+
+TEST(PackedOutputsTest, Decoder)
+{
+  packml_stacklight::PackedOutputsDecoder decoder;
+  packml_stacklight::OutputTable::Outputs outputs;
+  uint8_t changed = 0;
+
+  EXPECT_TRUE(decoder.decode(1, 0x05, outputs, changed));
+  EXPECT_EQ(packml_stacklight::OutputTable::ALL_MASK, changed);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::RED]);
+  EXPECT_EQ(1, outputs[packml_stacklight::OutputTable::GREEN]);
+
+  EXPECT_TRUE(decoder.decode(2, 0x04, outputs, changed));
+  EXPECT_EQ(0x01, changed);
+  EXPECT_EQ(0, outputs[packml_stacklight::OutputTable::RED]);
+
+  // Reordered and duplicated messages are dropped.
+  EXPECT_FALSE(decoder.decode(2, 0x01, outputs, changed));
+  EXPECT_EQ(1, decoder.getStaleCount());
+  EXPECT_EQ(0, outputs[packml_stacklight::OutputTable::RED]);
+
+  // A lost message still yields the changes against what was last applied.
+  EXPECT_TRUE(decoder.decode(5, 0x44, outputs, changed));
+  EXPECT_EQ(0x40, changed);
+  EXPECT_EQ(1, decoder.getGapCount());
+
+  // A restarted publisher starts at 1 again.
+  EXPECT_TRUE(decoder.decode(1, 0x00, outputs, changed));
+  EXPECT_EQ(0x44, changed);
+}
+
+class StacklightSimTest : public testing::Test
+{
+protected:
+  struct Publish
+  {
+    ros::Duration at;  // since the start of the test
+    packml_stacklight::OutputTable::Outputs outputs;
+    uint8_t changed;
+  };
+
+  StacklightSimTest()
+    : clock_(std::make_shared<packml_stacklight::SimulatedClock>())
+    , scheduler_(clock_)
+    , start_(clock_->now())
+  {
+    utils_.setClock(clock_);
+    utils_.publish_frequency_ = 0.0;
+    utils_.status_timeout_ = 0.0;
+  }
+
+  void createChannel()
+  {
+    channel_.reset(new packml_stacklight::StacklightChannel(
+        "sim", utils_, scheduler_,
+        [this](const packml_stacklight::OutputTable::Outputs& outputs, uint8_t changed) {
+          publishes_.push_back(Publish{ clock_->now() - start_, outputs, changed });
+        }));
+    channel_->start();
+  }
+
+  // Jumps from one timer expiry to the next, so an hour of flashing costs a few thousand wake-ups.
+  void runFor(double secs)
+  {
+    ros::Time end = clock_->now() + ros::Duration(secs);
+    ros::Duration delay;
+    while (scheduler_.nextExpiry(delay) && clock_->now() + delay <= end)
+    {
+      clock_->advance(delay);
+      scheduler_.poll();
+    }
+    clock_->set(end);
+    scheduler_.poll();
+  }
+
+  size_t topicCount() const
+  {
+    size_t count = 0;
+    for (const auto& publish : publishes_)
+    {
+      for (size_t id = 0; id < packml_stacklight::OutputTable::COUNT; id++)
+      {
+        count += (publish.changed >> id) & 1u;
+      }
+    }
+    return count;
+  }
+
+  std::shared_ptr<packml_stacklight::SimulatedClock> clock_;
+  packml_stacklight::Utils utils_;
+  packml_stacklight::StacklightScheduler scheduler_;
+  ros::Time start_;
+  std::unique_ptr<packml_stacklight::StacklightChannel> channel_;
+  std::vector<Publish> publishes_;
+};
+
+TEST_F(StacklightSimTest, FlashEdgeTiming)
+{
+  utils_.flash_sec_light_on_ = 0.5;
+  utils_.flash_sec_light_off_ = 1.5;
+  createChannel();
+  channel_->handleStatus(packml_msgs::State::STOPPED);
+  publishes_.clear();
+
+  runFor(3600.0);
+
+  // Blue flashes 0.5 s on and 1.5 s off for an hour, nothing else changes.
+  ASSERT_EQ(3600u, publishes_.size());
+  for (size_t i = 0; i < publishes_.size(); i++)
+  {
+    int64_t expected_ms = (i / 2) * 2000 + (i % 2 == 0 ? 500 : 2000);
+    EXPECT_EQ(expected_ms * 1000000, publishes_[i].at.toNSec()) << "edge " << i;
+    EXPECT_EQ(1u << packml_stacklight::OutputTable::BLUE, publishes_[i].changed);
+    EXPECT_EQ(i % 2 == 0 ? 0 : 1, publishes_[i].outputs[packml_stacklight::OutputTable::BLUE]);
+  }
+  EXPECT_EQ(3600u, topicCount());
+}
+
+TEST_F(StacklightSimTest, StateChangeRestartsFlash)
+{
+  utils_.flash_sec_light_on_ = 0.5;
+  utils_.flash_sec_light_off_ = 0.5;
+  createChannel();
+  channel_->handleStatus(packml_msgs::State::STOPPED);
+  runFor(0.7);
+  EXPECT_EQ(0, channel_->getOutputs()[packml_stacklight::OutputTable::BLUE]);
+
+  publishes_.clear();
+  channel_->handleStatus(packml_msgs::State::ABORTING);
+  runFor(0.6);
+
+  // The state change publishes everything and the new flash phase starts on.
+  ASSERT_EQ(2u, publishes_.size());
+  EXPECT_EQ(packml_stacklight::OutputTable::ALL_MASK, publishes_[0].changed);
+  EXPECT_EQ(ros::Duration(0.7).toNSec(), publishes_[0].at.toNSec());
+  EXPECT_EQ(1, publishes_[0].outputs[packml_stacklight::OutputTable::RED]);
+  EXPECT_EQ(ros::Duration(1.2).toNSec(), publishes_[1].at.toNSec());
+  EXPECT_EQ(0, publishes_[1].outputs[packml_stacklight::OutputTable::RED]);
+}
+
+TEST_F(StacklightSimTest, PublishCounts)
+{
+  utils_.publish_frequency_ = 0.5;
+  createChannel();
+  channel_->handleStatus(packml_msgs::State::HELD);
+  publishes_.clear();
+
+  runFor(4 * 3600.0);
+
+  // HELD does not flash, so only the periodic re-publish of all outputs remains.
+  ASSERT_EQ(4u * 3600u * 2u, publishes_.size());
+  for (size_t i = 0; i < publishes_.size(); i++)
+  {
+    EXPECT_EQ(static_cast<int64_t>(i + 1) * 500000000, publishes_[i].at.toNSec());
+    EXPECT_EQ(packml_stacklight::OutputTable::ALL_MASK, publishes_[i].changed);
+  }
+  EXPECT_EQ(publishes_.size() * packml_stacklight::OutputTable::COUNT, topicCount());
+}
+
+TEST_F(StacklightSimTest, StatusTimeout)
+{
+  utils_.status_timeout_ = 30.0;
+  createChannel();
+  for (int i = 0; i < 100; i++)
+  {
+    channel_->handleStatus(packml_msgs::State::HELD);
+    runFor(1.0);
+  }
+  EXPECT_EQ(packml_msgs::State::HELD, channel_->getState());
+
+  // The last status arrived at 99 s and the clock is at 100 s, so the stacklight goes dark at exactly 129 s.
+  publishes_.clear();
+  runFor(28.99);
+  EXPECT_EQ(packml_msgs::State::HELD, channel_->getState());
+  EXPECT_TRUE(publishes_.empty());
+
+  runFor(3600.0);
+  EXPECT_EQ(packml_msgs::State::UNDEFINED, channel_->getState());
+  ASSERT_EQ(1u, publishes_.size());
+  EXPECT_EQ(ros::Duration(129.0).toNSec(), publishes_[0].at.toNSec());
+  EXPECT_EQ(0u, scheduler_.size());
+}
+
 }  // namespace utils_test
 
 int main(int argc, char** argv)
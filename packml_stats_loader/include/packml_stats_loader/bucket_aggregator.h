@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#ifndef SRC_BUCKET_AGGREGATOR_H
+#define SRC_BUCKET_AGGREGATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace packml_stats_loader
+{
+
+  /**
+   * @brief Folds a stream of samples into fixed size time buckets.
+   *
+   * Only the buckets are kept, so the memory used depends on the number of buckets, not on the number of samples.
+   * Samples may arrive in any order, first and last are decided by stamp.
+   *
+   * delta sums the change from each sample to the next, so it includes the change since the previous bucket and the
+   * deltas of all buckets add up to the change over the whole range. Samples before start_ns only serve as the
+   * starting point; without one, the first sample of the range contributes nothing. Only samples in stamp order
+   * count towards delta. A counter field that goes down was reset, its change is counted from zero.
+   */
+  class BucketAggregator
+  {
+  public:
+    struct Bucket
+    {
+      uint64_t start_ns = 0;
+      uint32_t samples = 0;
+      uint64_t first_ns = 0;
+      uint64_t last_ns = 0;
+      std::vector<double> min;
+      std::vector<double> max;
+      std::vector<double> first;
+      std::vector<double> last;
+      std::vector<double> delta;
+    };
+
+    /**
+     * @brief Constructor
+     * @param start_ns Start of the first bucket
+     * @param end_ns Samples after this are ignored
+     * @param bucket_ns Bucket size, zero for a single bucket covering the whole range
+     * @param field_count Number of values per sample
+     * @param counters Per field, true if a decrease means the counter was reset. Missing fields are not counters
+     */
+    BucketAggregator(uint64_t start_ns, uint64_t end_ns, uint64_t bucket_ns, size_t field_count,
+                     const std::vector<bool>& counters = std::vector<bool>());
+
+    /**
+     * @brief Number of buckets a range splits into, used to reject queries before scanning
+     */
+    static uint64_t getBucketCount(uint64_t start_ns, uint64_t end_ns, uint64_t bucket_ns);
+
+    /**
+     * @brief Adds a sample, values must hold field_count values
+     */
+    void add(uint64_t stamp_ns, const std::vector<double>& values);
+
+    /**
+     * @brief Buckets holding at least one sample, keyed and ordered by bucket number
+     */
+    const std::map<uint64_t, Bucket>& getBuckets() const
+    {
+      return buckets_;
+    }
+
+  private:
+    uint64_t start_ns_;
+    uint64_t end_ns_;
+    uint64_t bucket_ns_;
+    size_t field_count_;
+    std::vector<bool> counters_;
+    std::map<uint64_t, Bucket> buckets_;
+    bool has_previous_ = false;
+    uint64_t previous_ns_ = 0;
+    std::vector<double> previous_;
+  };
+
+}
+
+#endif //SRC_BUCKET_AGGREGATOR_H
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#ifndef SRC_COLUMNAR_H
+#define SRC_COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace packml_stats_loader
+{
+
+  enum class ColumnType : uint32_t
+  {
+    INT64 = 1,
+    FLOAT64 = 2,
+    INT32 = 3,
+    UINT8 = 4,
+  };
+
+  /**
+   * @brief Writes a column oriented file, one contiguous array per column.
+   *
+   * Columns belong to named tables, all columns of a table hold the same number of rows. Values are buffered per
+   * column and spilled to temporary files, so the memory used does not grow with the number of rows. finish()
+   * writes the header and the column directory followed by every column, each starting on a 64 byte boundary,
+   * and moves the file into place.
+   */
+  class ColumnarWriter
+  {
+  public:
+    ColumnarWriter() = default;
+    ~ColumnarWriter();
+
+    ColumnarWriter(const ColumnarWriter&) = delete;
+    ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+    /**
+     * @brief Adds a column. All columns must be added before the first value.
+     * @return Handle for append(), or -1 if the name is too long or already used
+     */
+    int addColumn(const std::string& table, const std::string& name, ColumnType type);
+
+    /**
+     * @brief Appends a value to a column, converted to the column type
+     */
+    void append(int column, double value);
+    void appendInt(int column, int64_t value);
+
+    /**
+     * @brief Writes the file.
+     * @param path Destination, written to path.tmp first and renamed when complete
+     * @param error Set if the columns of a table differ in length or writing failed
+     */
+    bool finish(const std::string& path, std::string& error);
+
+  private:
+    struct Column
+    {
+      std::string table;
+      std::string name;
+      ColumnType type;
+      uint64_t rows = 0;
+      std::vector<char> buffer;
+      FILE* spill = nullptr;
+    };
+
+    std::vector<Column> columns_;
+    bool spill_failed_ = false;
+
+    void push(Column& column, const void* value, size_t size);
+  };
+
+  /**
+   * @brief Memory maps a file written by ColumnarWriter.
+   *
+   * The column arrays point straight into the mapping, so scanning a metric touches only that metric's pages and
+   * the loops over them vectorize like loops over any aligned array.
+   */
+  class ColumnarReader
+  {
+  public:
+    struct Column
+    {
+      std::string table;
+      std::string name;
+      ColumnType type;
+      uint64_t rows;
+      const void* data;
+    };
+
+    ColumnarReader() = default;
+    ~ColumnarReader();
+
+    ColumnarReader(const ColumnarReader&) = delete;
+    ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+    /**
+     * @brief Maps and validates a file.
+     * @param error Set if the file is not a columnar file or is cut short
+     */
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    const std::vector<Column>& getColumns() const
+    {
+      return columns_;
+    }
+
+    /**
+     * @brief Finds a column, nullptr if the table has no such column
+     */
+    const Column* find(const std::string& table, const std::string& name) const;
+
+    /**
+     * @brief Typed access to a column, nullptr if it does not exist or has another type
+     */
+    const int64_t* getInt64(const std::string& table, const std::string& name, uint64_t& rows) const;
+    const double* getFloat64(const std::string& table, const std::string& name, uint64_t& rows) const;
+    const int32_t* getInt32(const std::string& table, const std::string& name, uint64_t& rows) const;
+    const uint8_t* getUInt8(const std::string& table, const std::string& name, uint64_t& rows) const;
+
+  private:
+    void* mapping_ = nullptr;
+    size_t size_ = 0;
+    std::vector<Column> columns_;
+
+    const void* get(const std::string& table, const std::string& name, ColumnType type, uint64_t& rows) const;
+  };
+
+}
+
+#endif //SRC_COLUMNAR_H
@@ -7,11 +7,16 @@
 #define SRC_PACKML_STATS_LOADER_H
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <rosbag/bag.h>
 #include <rosbag/view.h>
 #include <packml_msgs/GetStats.h>
 #include <packml_msgs/LoadStats.h>
 #include <packml_msgs/Stats.h>
+#include <packml_stats_loader/QueryStatsHistory.h>
+#include <packml_stats_loader/stats_history.h>
+
+#include <memory>
 
 namespace packml_stats_loader
 {
@@ -27,9 +32,27 @@ namespace packml_stats_loader
     packml_msgs::Stats loadStats();
     void writeStats(const packml_msgs::GetStats::Response& get_stats_response);
 
+    /**
+     * @brief Appends the stats to the history archive, called once per history period
+     */
+    void appendHistory(const packml_msgs::Stats& stats);
+
+    /**
+     * @brief Aggregates the archived stats of a time range into buckets, streaming over the history
+     */
+    bool queryHistory(QueryStatsHistory::Request& req, QueryStatsHistory::Response& res);
+
   private:
     ros::NodeHandle pnh_;
     std::string packml_stats_location_;
+    std::unique_ptr<StatsHistory> history_;
+    ros::Duration history_period_;
+    int max_query_buckets_ = 10000;
+    ros::CallbackQueue query_queue_;
+    ros::ServiceServer query_server_;
+    std::unique_ptr<ros::AsyncSpinner> query_spinner_;  // queries are answered while the save loop sleeps
+
+    static ros::Time nextDeadline(const ros::Time& deadline, const ros::Duration& period, const ros::Time& now);
   };
 
 }
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#ifndef SRC_STATS_EXPORT_H
+#define SRC_STATS_EXPORT_H
+
+#include <packml_msgs/Stats.h>
+#include <packml_stats_loader/columnar.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace packml_stats_loader
+{
+
+  /**
+   * @brief Converts stats snapshots and state changes into a columnar file for offline analysis.
+   *
+   * The file holds three tables:
+   *  - stats: stamp (INT64 ns) and one column per scalar field of packml_msgs::Stats, durations in seconds and
+   *    ratios as FLOAT64, counts as INT64. One row per snapshot.
+   *  - items: the itemized error and quality stats, stored sparsely. A row (stats row, kind, id, count, duration)
+   *    is written when an item appears or changes and holds until the next row for the same kind and id. An item
+   *    that disappears (stats reset) gets a row with count and duration 0.
+   *  - transitions: stamp (INT64 ns) and state (INT32), one row per change of state.
+   */
+  class StatsExporter
+  {
+  public:
+    static const uint8_t ERROR_ITEM = 0;
+    static const uint8_t QUALITY_ITEM = 1;
+
+    static const char* const STATS_TABLE;
+    static const char* const ITEMS_TABLE;
+    static const char* const TRANSITIONS_TABLE;
+
+    StatsExporter();
+
+    /**
+     * @brief Adds a snapshot as the next row of the stats table
+     */
+    void addStats(uint64_t stamp_ns, const packml_msgs::Stats& stats);
+
+    /**
+     * @brief Adds a state, only recorded when it differs from the previous one
+     */
+    void addState(uint64_t stamp_ns, int32_t state);
+
+    /**
+     * @brief Writes the file
+     */
+    bool finish(const std::string& path, std::string& error);
+
+    uint64_t getStatsRows() const
+    {
+      return stats_rows_;
+    }
+
+    uint64_t getTransitionRows() const
+    {
+      return transition_rows_;
+    }
+
+  private:
+    typedef std::pair<uint8_t, int32_t> ItemKey;
+    typedef std::pair<int64_t, double> ItemValue;
+
+    ColumnarWriter writer_;
+    int stamp_column_;
+    std::vector<int> field_columns_;
+    int item_row_column_;
+    int item_kind_column_;
+    int item_id_column_;
+    int item_count_column_;
+    int item_duration_column_;
+    int transition_stamp_column_;
+    int transition_state_column_;
+
+    std::map<ItemKey, ItemValue> items_;
+    uint64_t stats_rows_ = 0;
+    uint64_t transition_rows_ = 0;
+    bool has_state_ = false;
+    int32_t last_state_ = 0;
+
+    void addItem(uint8_t kind, int32_t id, const ItemValue& value);
+  };
+
+}
+
+#endif //SRC_STATS_EXPORT_H
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#ifndef SRC_STATS_FIELDS_H
+#define SRC_STATS_FIELDS_H
+
+#include <packml_msgs/Stats.h>
+
+#include <string>
+#include <vector>
+
+namespace packml_stats_loader
+{
+
+  enum class StatsFieldKind
+  {
+    DURATION,  // seconds
+    COUNT,
+    RATIO,
+  };
+
+  /**
+   * @brief A scalar field of packml_msgs::Stats, by name.
+   */
+  struct StatsField
+  {
+    const char* name;
+    StatsFieldKind kind;
+    double (*get)(const packml_msgs::Stats& stats);
+  };
+
+  /**
+   * @brief The scalar fields of packml_msgs::Stats, durations then counts then ratios.
+   */
+  const std::vector<StatsField>& getStatsFields();
+
+  /**
+   * @brief Finds a field by name, nullptr if there is none
+   */
+  const StatsField* findStatsField(const std::string& name);
+
+}
+
+#endif //SRC_STATS_FIELDS_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#ifndef SRC_STATS_HISTORY_H
+#define SRC_STATS_HISTORY_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace packml_stats_loader
+{
+
+  /**
+   * @brief A single archived snapshot, serialized by the caller.
+   */
+  struct HistoryRecord
+  {
+    uint64_t stamp_ns;
+    std::string data;
+  };
+
+  struct HistoryOptions
+  {
+    std::string directory;                                   /** where the segment files live */
+    std::string record_type;                                 /** stored in every segment, checked when reading */
+    uint64_t segment_ns = 24ull * 3600 * 1000000000;         /** time covered by one segment file */
+    size_t block_records = 60;                               /** snapshots compressed together */
+    uint64_t flush_ns = 5ull * 60 * 1000000000;              /** a block older than this is written when appending */
+    uint64_t retention_ns = 90ull * 24 * 3600 * 1000000000;  /** segments older than this are removed */
+    uint64_t max_bytes = 256ull * 1024 * 1024;               /** segments are removed oldest first above this */
+    int compression_level = 6;                               /** zlib level */
+  };
+
+  /**
+   * @brief Rolling archive of stats snapshots.
+   *
+   * Snapshots are collected into blocks of block_records, each block is zlib compressed and appended to the segment
+   * file of the time partition it belongs to (stats_<partition start secs>.seg). A sidecar stats_<...>.idx holds one
+   * fixed size entry per block (first and last stamp, file offset), so a time range query only decompresses the
+   * blocks it overlaps. Every block carries a CRC; a block that was cut short by a crash is dropped when the segment
+   * is reopened. Snapshots that have not filled a block yet are kept in memory and written by flush(), on
+   * destruction, or by the first append() more than flush_ns after the oldest of them, which bounds what a crash
+   * can lose.
+   */
+  class StatsHistory
+  {
+  public:
+    /**
+     * @brief Visitor for scan(). Returning false stops the scan.
+     */
+    typedef std::function<bool(uint64_t stamp_ns, const std::string& data)> Visitor;
+
+    /**
+     * @brief Constructor. Creates the directory if needed, call enforceRetention() to clean up old segments.
+     * @param options Archive location and policy
+     */
+    explicit StatsHistory(const HistoryOptions& options);
+    ~StatsHistory();
+
+    StatsHistory(const StatsHistory&) = delete;
+    StatsHistory& operator=(const StatsHistory&) = delete;
+
+    /**
+     * @brief Appends a snapshot. Moving into a new time partition writes the pending block and applies retention.
+     * @return false if writing a block failed
+     */
+    bool append(uint64_t stamp_ns, const std::string& data);
+
+    /**
+     * @brief Writes the pending snapshots as a (possibly short) block.
+     */
+    bool flush();
+
+    /**
+     * @brief Visits every snapshot with from_ns <= stamp <= to_ns, oldest segment first, one block in memory at a
+     * time. Pending snapshots are visited last. The archive is only locked while the segments and pending snapshots
+     * are listed, so appending is not held up by a long scan; snapshots appended after that are not visited.
+     * @return false if a segment or block could not be read, the remaining data is still visited
+     */
+    bool scan(uint64_t from_ns, uint64_t to_ns, const Visitor& visitor) const;
+
+    /**
+     * @brief Collects the snapshots of a time range.
+     */
+    bool read(uint64_t from_ns, uint64_t to_ns, std::vector<HistoryRecord>& records) const;
+
+    /**
+     * @brief Removes segments older than the retention time and, oldest first, segments above max_bytes. The
+     * segment being written is never removed.
+     */
+    void enforceRetention(uint64_t now_ns);
+
+    /**
+     * @brief Paths of the segment files, oldest first.
+     */
+    std::vector<std::string> getSegments() const;
+
+    /**
+     * @brief Bytes used by segment and index files.
+     */
+    uint64_t getDiskUsage() const;
+
+  private:
+    struct Segment
+    {
+      uint64_t start_ns;
+      std::string path;
+      uint64_t size = 0;  /** bytes a scan may read, taken under the lock */
+    };
+
+    HistoryOptions options_;
+    std::vector<HistoryRecord> pending_;
+    uint64_t pending_partition_ns_ = 0;
+    int segment_fd_ = -1;
+    int index_fd_ = -1;
+    uint64_t segment_start_ns_ = 0;
+    uint64_t segment_size_ = 0;
+    mutable std::mutex mutex_;
+
+    std::vector<Segment> listSegments() const;
+    std::string segmentPath(uint64_t start_ns) const;
+    bool openSegment(uint64_t start_ns);
+    void closeSegment();
+    bool writeBlock();
+    void enforceRetentionLocked(uint64_t now_ns);
+    bool scanSegment(const Segment& segment, uint64_t from_ns, uint64_t to_ns, const Visitor& visitor,
+                     bool& stop) const;
+  };
+
+}
+
+#endif //SRC_STATS_HISTORY_H
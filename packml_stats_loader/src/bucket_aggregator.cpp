@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/bucket_aggregator.h"
+
+#include <algorithm>
+
+namespace packml_stats_loader
+{
+  BucketAggregator::BucketAggregator(uint64_t start_ns, uint64_t end_ns, uint64_t bucket_ns, size_t field_count,
+                                     const std::vector<bool>& counters)
+    : start_ns_(start_ns), end_ns_(end_ns), field_count_(field_count), counters_(counters)
+  {
+    counters_.resize(field_count_, false);
+    // A zero size is one bucket covering [start, end], so it has to be one longer than the span to hold end.
+    uint64_t span = end_ns_ - std::min(start_ns_, end_ns_);
+    bucket_ns_ = bucket_ns > 0 ? bucket_ns : std::max<uint64_t>(span + 1, span);
+  }
+
+  uint64_t BucketAggregator::getBucketCount(uint64_t start_ns, uint64_t end_ns, uint64_t bucket_ns)
+  {
+    if (end_ns < start_ns)
+    {
+      return 0;
+    }
+    return bucket_ns > 0 ? (end_ns - start_ns) / bucket_ns + 1 : 1;
+  }
+
+  void BucketAggregator::add(uint64_t stamp_ns, const std::vector<double>& values)
+  {
+    if (stamp_ns > end_ns_ || values.size() < field_count_)
+    {
+      return;
+    }
+
+    bool in_order = !has_previous_ || stamp_ns >= previous_ns_;
+    if (stamp_ns < start_ns_)
+    {
+      if (in_order)
+      {
+        has_previous_ = true;
+        previous_ns_ = stamp_ns;
+        previous_.assign(values.begin(), values.begin() + field_count_);
+      }
+      return;
+    }
+
+    uint64_t index = (stamp_ns - start_ns_) / bucket_ns_;
+    Bucket& bucket = buckets_[index];
+    bucket.delta.resize(field_count_, 0.0);
+    if (in_order)
+    {
+      for (size_t field = 0; has_previous_ && field < field_count_; field++)
+      {
+        double change = values[field] - previous_[field];
+        bucket.delta[field] += change < 0.0 && counters_[field] ? values[field] : change;
+      }
+      has_previous_ = true;
+      previous_ns_ = stamp_ns;
+      previous_.assign(values.begin(), values.begin() + field_count_);
+    }
+
+    if (bucket.samples == 0)
+    {
+      bucket.start_ns = start_ns_ + index * bucket_ns_;
+      bucket.first_ns = stamp_ns;
+      bucket.last_ns = stamp_ns;
+      bucket.min.assign(values.begin(), values.begin() + field_count_);
+      bucket.max = bucket.min;
+      bucket.first = bucket.min;
+      bucket.last = bucket.min;
+      bucket.samples = 1;
+      return;
+    }
+
+    bucket.samples++;
+    for (size_t field = 0; field < field_count_; field++)
+    {
+      bucket.min[field] = std::min(bucket.min[field], values[field]);
+      bucket.max[field] = std::max(bucket.max[field], values[field]);
+    }
+    if (stamp_ns < bucket.first_ns)
+    {
+      bucket.first_ns = stamp_ns;
+      bucket.first.assign(values.begin(), values.begin() + field_count_);
+    }
+    if (stamp_ns >= bucket.last_ns)
+    {
+      bucket.last_ns = stamp_ns;
+      bucket.last.assign(values.begin(), values.begin() + field_count_);
+    }
+  }
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/columnar.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace packml_stats_loader
+{
+  namespace
+  {
+    const char FILE_MAGIC[4] = { 'P', 'K', 'C', 'L' };
+    const uint32_t FORMAT_VERSION = 1;
+    const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    const uint64_t COLUMN_ALIGNMENT = 64;
+    const size_t SPILL_BYTES = 1024 * 1024;
+
+    struct FileHeader
+    {
+      char magic[4];
+      uint32_t version;
+      uint32_t byte_order;  // read back as another value on a machine of the other endianness
+      uint32_t column_count;  // followed by the column directory
+      uint64_t file_size;
+      uint64_t reserved[5];
+    };
+
+    struct ColumnEntry
+    {
+      char table[24];
+      char name[40];
+      uint32_t type;
+      uint32_t reserved;
+      uint64_t offset;  // of the first value, a multiple of COLUMN_ALIGNMENT
+      uint64_t rows;
+    };
+
+    static_assert(sizeof(FileHeader) == 64, "file header layout");
+    static_assert(sizeof(ColumnEntry) == 88, "column entry layout");
+
+    size_t typeSize(uint32_t type)
+    {
+      switch (static_cast<ColumnType>(type))
+      {
+        case ColumnType::INT64:
+        case ColumnType::FLOAT64:
+          return 8;
+        case ColumnType::INT32:
+          return 4;
+        case ColumnType::UINT8:
+          return 1;
+      }
+      return 0;
+    }
+
+    uint64_t alignUp(uint64_t offset)
+    {
+      return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+    }
+
+    bool writePadding(FILE* file, uint64_t& position, uint64_t offset)
+    {
+      static const char ZEROS[COLUMN_ALIGNMENT] = {};
+      while (position < offset)
+      {
+        size_t size = std::min<uint64_t>(offset - position, sizeof(ZEROS));
+        if (std::fwrite(ZEROS, 1, size, file) != size)
+        {
+          return false;
+        }
+        position += size;
+      }
+      return true;
+    }
+  }
+
+  ColumnarWriter::~ColumnarWriter()
+  {
+    for (auto& column : columns_)
+    {
+      if (column.spill != nullptr)
+      {
+        std::fclose(column.spill);
+      }
+    }
+  }
+
+  int ColumnarWriter::addColumn(const std::string& table, const std::string& name, ColumnType type)
+  {
+    if (table.empty() || name.empty() || table.size() >= sizeof(ColumnEntry::table) ||
+        name.size() >= sizeof(ColumnEntry::name) || typeSize(static_cast<uint32_t>(type)) == 0)
+    {
+      return -1;
+    }
+    for (const auto& column : columns_)
+    {
+      if (column.rows > 0 || (column.table == table && column.name == name))
+      {
+        return -1;
+      }
+    }
+
+    Column column;
+    column.table = table;
+    column.name = name;
+    column.type = type;
+    columns_.push_back(std::move(column));
+    return static_cast<int>(columns_.size()) - 1;
+  }
+
+  void ColumnarWriter::append(int column, double value)
+  {
+    Column& target = columns_.at(column);
+    switch (target.type)
+    {
+      case ColumnType::FLOAT64:
+        push(target, &value, sizeof(value));
+        break;
+      default:
+        appendInt(column, static_cast<int64_t>(value));
+        break;
+    }
+  }
+
+  void ColumnarWriter::appendInt(int column, int64_t value)
+  {
+    Column& target = columns_.at(column);
+    switch (target.type)
+    {
+      case ColumnType::INT64:
+        push(target, &value, sizeof(value));
+        break;
+      case ColumnType::FLOAT64:
+      {
+        double converted = static_cast<double>(value);
+        push(target, &converted, sizeof(converted));
+        break;
+      }
+      case ColumnType::INT32:
+      {
+        int32_t converted = static_cast<int32_t>(value);
+        push(target, &converted, sizeof(converted));
+        break;
+      }
+      case ColumnType::UINT8:
+      {
+        uint8_t converted = static_cast<uint8_t>(value);
+        push(target, &converted, sizeof(converted));
+        break;
+      }
+    }
+  }
+
+  void ColumnarWriter::push(Column& column, const void* value, size_t size)
+  {
+    const char* bytes = static_cast<const char*>(value);
+    column.buffer.insert(column.buffer.end(), bytes, bytes + size);
+    column.rows++;
+    if (column.buffer.size() < SPILL_BYTES)
+    {
+      return;
+    }
+
+    if (column.spill == nullptr)
+    {
+      column.spill = std::tmpfile();
+    }
+    if (column.spill == nullptr ||
+        std::fwrite(column.buffer.data(), 1, column.buffer.size(), column.spill) != column.buffer.size())
+    {
+      spill_failed_ = true;
+    }
+    column.buffer.clear();
+  }
+
+  bool ColumnarWriter::finish(const std::string& path, std::string& error)
+  {
+    if (spill_failed_)
+    {
+      error = "Failed to buffer column data in a temporary file";
+      return false;
+    }
+    for (const auto& column : columns_)
+    {
+      for (const auto& other : columns_)
+      {
+        if (other.table == column.table && other.rows != column.rows)
+        {
+          error = "Columns of table " + column.table + " differ in length";
+          return false;
+        }
+      }
+    }
+
+    std::vector<ColumnEntry> directory(columns_.size());
+    uint64_t offset = sizeof(FileHeader) + directory.size() * sizeof(ColumnEntry);
+    for (size_t i = 0; i < columns_.size(); ++i)
+    {
+      ColumnEntry& entry = directory[i];
+      std::memset(&entry, 0, sizeof(entry));
+      std::strncpy(entry.table, columns_[i].table.c_str(), sizeof(entry.table) - 1);
+      std::strncpy(entry.name, columns_[i].name.c_str(), sizeof(entry.name) - 1);
+      entry.type = static_cast<uint32_t>(columns_[i].type);
+      entry.offset = alignUp(offset);
+      entry.rows = columns_[i].rows;
+      offset = entry.offset + entry.rows * typeSize(entry.type);
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.column_count = static_cast<uint32_t>(directory.size());
+    header.file_size = offset;
+
+    std::string tmp_path = path + ".tmp";
+    FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+      error = "Failed to open " + tmp_path + ": " + std::strerror(errno);
+      return false;
+    }
+
+    uint64_t position = 0;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (directory.empty() ||
+               std::fwrite(directory.data(), sizeof(ColumnEntry), directory.size(), file) == directory.size());
+    position = sizeof(header) + directory.size() * sizeof(ColumnEntry);
+
+    std::vector<char> chunk(SPILL_BYTES);
+    for (size_t i = 0; ok && i < columns_.size(); ++i)
+    {
+      Column& column = columns_[i];
+      ok = writePadding(file, position, directory[i].offset);
+      if (ok && column.spill != nullptr)
+      {
+        std::rewind(column.spill);
+        size_t got;
+        while (ok && (got = std::fread(chunk.data(), 1, chunk.size(), column.spill)) > 0)
+        {
+          ok = std::fwrite(chunk.data(), 1, got, file) == got;
+          position += got;
+        }
+      }
+      if (ok && !column.buffer.empty())
+      {
+        ok = std::fwrite(column.buffer.data(), 1, column.buffer.size(), file) == column.buffer.size();
+        position += column.buffer.size();
+      }
+      ok = ok && position == directory[i].offset + directory[i].rows * typeSize(directory[i].type);
+    }
+
+    ok = std::fflush(file) == 0 && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+      error = "Failed to write " + path + ": " + std::strerror(errno);
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  ColumnarReader::~ColumnarReader()
+  {
+    close();
+  }
+
+  bool ColumnarReader::open(const std::string& path, std::string& error)
+  {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      error = "Failed to open " + path + ": " + std::strerror(errno);
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < sizeof(FileHeader))
+    {
+      ::close(fd);
+      error = path + " is too short to be a columnar stats file";
+      return false;
+    }
+
+    size_ = static_cast<size_t>(info.st_size);
+    mapping_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping_ == MAP_FAILED)
+    {
+      mapping_ = nullptr;
+      error = "Failed to map " + path + ": " + std::strerror(errno);
+      return false;
+    }
+
+    const char* base = static_cast<const char*>(mapping_);
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+    if (std::memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header->version != FORMAT_VERSION)
+    {
+      close();
+      error = path + " is not a columnar stats file";
+      return false;
+    }
+    if (header->byte_order != BYTE_ORDER_MARK)
+    {
+      close();
+      error = path + " was written on a machine of different byte order";
+      return false;
+    }
+    if (header->file_size != size_ ||
+        header->column_count > (size_ - sizeof(FileHeader)) / sizeof(ColumnEntry))
+    {
+      close();
+      error = path + " is truncated";
+      return false;
+    }
+
+    const ColumnEntry* directory = reinterpret_cast<const ColumnEntry*>(base + sizeof(FileHeader));
+    for (uint32_t i = 0; i < header->column_count; ++i)
+    {
+      const ColumnEntry& entry = directory[i];
+      size_t type_size = typeSize(entry.type);
+      if (type_size == 0 || entry.offset % COLUMN_ALIGNMENT != 0 || entry.offset > size_ ||
+          entry.rows > (size_ - entry.offset) / type_size)
+      {
+        close();
+        error = path + " has an invalid column directory";
+        return false;
+      }
+
+      Column column;
+      column.table.assign(entry.table, strnlen(entry.table, sizeof(entry.table)));
+      column.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+      column.type = static_cast<ColumnType>(entry.type);
+      column.rows = entry.rows;
+      column.data = base + entry.offset;
+      columns_.push_back(column);
+    }
+    return true;
+  }
+
+  void ColumnarReader::close()
+  {
+    columns_.clear();
+    if (mapping_ != nullptr)
+    {
+      munmap(mapping_, size_);
+      mapping_ = nullptr;
+    }
+    size_ = 0;
+  }
+
+  const ColumnarReader::Column* ColumnarReader::find(const std::string& table, const std::string& name) const
+  {
+    for (const auto& column : columns_)
+    {
+      if (column.table == table && column.name == name)
+      {
+        return &column;
+      }
+    }
+    return nullptr;
+  }
+
+  const void* ColumnarReader::get(const std::string& table, const std::string& name, ColumnType type,
+                                  uint64_t& rows) const
+  {
+    const Column* column = find(table, name);
+    if (column == nullptr || column->type != type)
+    {
+      rows = 0;
+      return nullptr;
+    }
+    rows = column->rows;
+    return column->data;
+  }
+
+  const int64_t* ColumnarReader::getInt64(const std::string& table, const std::string& name, uint64_t& rows) const
+  {
+    return static_cast<const int64_t*>(get(table, name, ColumnType::INT64, rows));
+  }
+
+  const double* ColumnarReader::getFloat64(const std::string& table, const std::string& name, uint64_t& rows) const
+  {
+    return static_cast<const double*>(get(table, name, ColumnType::FLOAT64, rows));
+  }
+
+  const int32_t* ColumnarReader::getInt32(const std::string& table, const std::string& name, uint64_t& rows) const
+  {
+    return static_cast<const int32_t*>(get(table, name, ColumnType::INT32, rows));
+  }
+
+  const uint8_t* ColumnarReader::getUInt8(const std::string& table, const std::string& name, uint64_t& rows) const
+  {
+    return static_cast<const uint8_t*>(get(table, name, ColumnType::UINT8, rows));
+  }
+
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/stats_export.h"
+#include "packml_stats_loader/stats_history.h"
+
+#include <packml_msgs/Stats.h>
+#include <packml_msgs/Status.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <ros/ros.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+  void usage()
+  {
+    std::cerr << "Usage: packml_stats_export [--history DIR] [--from SECS] [--to SECS] OUTPUT [BAG...]" << std::endl
+              << "  Writes the stats snapshots archived in DIR and the packml_msgs/Stats and packml_msgs/Status"
+              << std::endl
+              << "  messages recorded in the bags to a columnar file. Give the inputs oldest first." << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::Time::init();
+
+  std::string history_location;
+  std::string output;
+  std::vector<std::string> bags;
+  uint64_t from_ns = 0;
+  uint64_t to_ns = std::numeric_limits<uint64_t>::max();
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if ((arg == "--history" || arg == "--from" || arg == "--to") && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      if (arg == "--history")
+      {
+        history_location = value;
+      }
+      else
+      {
+        uint64_t ns = static_cast<uint64_t>(std::max(std::atof(value.c_str()), 0.0) * 1e9);
+        (arg == "--from" ? from_ns : to_ns) = ns;
+      }
+    }
+    else if (arg.empty() || arg[0] == '-')
+    {
+      usage();
+      return 1;
+    }
+    else if (output.empty())
+    {
+      output = arg;
+    }
+    else
+    {
+      bags.push_back(arg);
+    }
+  }
+  if (output.empty() || (history_location.empty() && bags.empty()))
+  {
+    usage();
+    return 1;
+  }
+
+  packml_stats_loader::StatsExporter exporter;
+
+  if (!history_location.empty())
+  {
+    packml_stats_loader::HistoryOptions options;
+    options.directory = history_location;
+    options.record_type = std::string(ros::message_traits::datatype<packml_msgs::Stats>()) + "/" +
+                          ros::message_traits::md5sum<packml_msgs::Stats>();
+    packml_stats_loader::StatsHistory history(options);
+
+    packml_msgs::Stats stats;
+    size_t unreadable = 0;
+    bool complete = history.scan(from_ns, to_ns, [&](uint64_t stamp_ns, const std::string& data) {
+      try
+      {
+        ros::serialization::IStream stream(reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())), data.size());
+        ros::serialization::deserialize(stream, stats);
+      }
+      catch (const ros::Exception&)
+      {
+        unreadable++;
+        return true;
+      }
+      exporter.addStats(stamp_ns, stats);
+      return true;
+    });
+    if (!complete || unreadable > 0)
+    {
+      std::cerr << "Parts of the history in " << history_location << " could not be read, " << unreadable
+                << " snapshots skipped" << std::endl;
+    }
+  }
+
+  for (const auto& path : bags)
+  {
+    rosbag::Bag bag;
+    try
+    {
+      bag.open(path, rosbag::bagmode::Read);
+      for (const auto& message_instance : rosbag::View(bag))
+      {
+        uint64_t stamp_ns = message_instance.getTime().toNSec();
+        if (stamp_ns < from_ns || stamp_ns > to_ns)
+        {
+          continue;
+        }
+
+        packml_msgs::Stats::ConstPtr stats = message_instance.instantiate<packml_msgs::Stats>();
+        if (stats != nullptr)
+        {
+          exporter.addStats(stamp_ns, *stats);
+          continue;
+        }
+        packml_msgs::Status::ConstPtr status = message_instance.instantiate<packml_msgs::Status>();
+        if (status != nullptr)
+        {
+          // Non standard states are published as sub_state
+          int32_t state = status->sub_state != packml_msgs::State::UNDEFINED ? status->sub_state : status->state.val;
+          exporter.addState(stamp_ns, state);
+        }
+      }
+      bag.close();
+    }
+    catch (const rosbag::BagException& ex)
+    {
+      std::cerr << "Failed to read bag " << path << ": " << ex.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::string error;
+  if (!exporter.finish(output, error))
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote " << exporter.getStatsRows() << " snapshots and " << exporter.getTransitionRows()
+            << " state transitions to " << output << std::endl;
+  return 0;
+}
@@ -5,6 +5,11 @@
 
 #include "packml_stats_loader/packml_stats_loader.h"
 
+#include "packml_stats_loader/bucket_aggregator.h"
+#include "packml_stats_loader/stats_fields.h"
+
+#include <algorithm>
+
 namespace packml_stats_loader
 {
   PackmlStatsLoader::PackmlStatsLoader(const ros::NodeHandle &pnh): pnh_(pnh)
@@ -27,6 +32,52 @@ namespace packml_stats_loader
       ROS_WARN_STREAM("Missing param: save_stats_rate. Defaulting to 1.0Hz.");
     }
 
+    // History mode, the bag above keeps holding only the latest snapshot so loading it stays cheap
+    std::string history_location;
+    pnh_.param<std::string>("history_location", history_location, "");
+    if (!history_location.empty())
+    {
+      double history_period = 60.0;
+      double segment_hours = 24.0;
+      double retention_days = 90.0;
+      double max_mb = 256.0;
+      int block_records = 60;
+      double flush_minutes = 5.0;
+      pnh_.param("history_period", history_period, history_period);
+      if (history_period <= 0)
+      {
+        ROS_WARN_STREAM("Invalid history_period " << history_period << ". Defaulting to 60s.");
+        history_period = 60.0;
+      }
+      pnh_.param("history_segment_hours", segment_hours, segment_hours);
+      pnh_.param("history_retention_days", retention_days, retention_days);
+      pnh_.param("history_max_mb", max_mb, max_mb);
+      pnh_.param("history_block_records", block_records, block_records);
+      pnh_.param("history_flush_minutes", flush_minutes, flush_minutes);
+
+      HistoryOptions options;
+      options.directory = history_location;
+      options.record_type = std::string(ros::message_traits::datatype<packml_msgs::Stats>()) + "/" +
+                            ros::message_traits::md5sum<packml_msgs::Stats>();
+      options.segment_ns = static_cast<uint64_t>(std::max(segment_hours, 1.0 / 3600) * 3600e9);
+      options.retention_ns = static_cast<uint64_t>(std::max(retention_days, 0.0) * 24 * 3600e9);
+      options.max_bytes = static_cast<uint64_t>(std::max(max_mb, 0.0) * 1024 * 1024);
+      options.block_records = static_cast<size_t>(std::max(block_records, 1));
+      options.flush_ns = static_cast<uint64_t>(std::max(flush_minutes, 0.0) * 60e9);
+
+      history_.reset(new StatsHistory(options));
+      history_->enforceRetention(ros::Time::now().toNSec());
+      history_period_ = ros::Duration(history_period);
+      ROS_INFO_STREAM("Archiving stats every " << history_period << "s to " << history_location);
+
+      pnh_.param("history_max_query_buckets", max_query_buckets_, 10000);
+      ros::NodeHandle query_nh(pnh_);
+      query_nh.setCallbackQueue(&query_queue_);
+      query_server_ = query_nh.advertiseService("query_stats_history", &PackmlStatsLoader::queryHistory, this);
+      query_spinner_.reset(new ros::AsyncSpinner(1, &query_queue_));
+      query_spinner_->start();
+    }
+
     // Load stats
     if (load_packml_stats)
     {
@@ -46,23 +97,43 @@ namespace packml_stats_loader
       }
     }
 
-    // Save stats
-    if (save_stats_rate > 0)
+    // Save stats and archive history, each on its own period from a loop running at the faster of the two
+    ros::Duration save_period(save_stats_rate > 0 ? 1.0 / save_stats_rate : 0.0);
+    ros::Duration loop_period = save_period;
+    if (history_ && (loop_period.isZero() || history_period_ < loop_period))
+    {
+      loop_period = history_period_;
+    }
+    if (loop_period > ros::Duration(0))
     {
       ros::ServiceClient get_stats_client = pnh_.serviceClient<packml_msgs::GetStats>("get_stats");
       ros::service::waitForService(get_stats_client.getService());
-      ros::Rate rate(save_stats_rate);
+      ros::Rate rate(loop_period);
       packml_msgs::GetStats get_stats_srv;
+      ros::Time next_save = ros::Time::now();
+      ros::Time next_history = next_save;
 
       while (ros::ok())
       {
-        if (!get_stats_client.call(get_stats_srv))
+        ros::Time now = ros::Time::now();
+        bool save = !save_period.isZero() && now >= next_save;
+        bool archive = history_ && now >= next_history;
+        if ((save || archive) && !get_stats_client.call(get_stats_srv))
         {
           ROS_ERROR_STREAM("Failed to call service " << get_stats_client.getService());
         }
         else
         {
-          writeStats(get_stats_srv.response);
+          if (save)
+          {
+            writeStats(get_stats_srv.response);
+            next_save = nextDeadline(next_save, save_period, now);
+          }
+          if (archive)
+          {
+            appendHistory(get_stats_srv.response.stats);
+            next_history = nextDeadline(next_history, history_period_, now);
+          }
         }
 
         ros::spinOnce();
@@ -115,4 +186,126 @@ namespace packml_stats_loader
     bag.close();
   }
 
-}
\ No newline at end of file
+  void PackmlStatsLoader::appendHistory(const packml_msgs::Stats& stats)
+  {
+    if (!history_)
+    {
+      return;
+    }
+
+    std::string data(ros::serialization::serializationLength(stats), '\0');
+    ros::serialization::OStream stream(reinterpret_cast<uint8_t*>(&data[0]), data.size());
+    ros::serialization::serialize(stream, stats);
+    history_->append(ros::Time::now().toNSec(), data);
+  }
+
+  ros::Time PackmlStatsLoader::nextDeadline(const ros::Time& deadline, const ros::Duration& period,
+                                            const ros::Time& now)
+  {
+    // Deadlines keep a period from drifting with loop jitter, after a stall the missed ones are skipped.
+    ros::Time next = deadline + period;
+    return next > now ? next : now + period;
+  }
+
+  bool PackmlStatsLoader::queryHistory(QueryStatsHistory::Request& req, QueryStatsHistory::Response& res)
+  {
+    std::vector<const StatsField*> fields;
+    if (req.fields.empty())
+    {
+      for (const auto& field : getStatsFields())
+      {
+        fields.push_back(&field);
+      }
+    }
+    for (const auto& name : req.fields)
+    {
+      const StatsField* field = findStatsField(name);
+      if (field == nullptr)
+      {
+        res.success = false;
+        res.message = "Unknown stats field " + name;
+        return true;
+      }
+      fields.push_back(field);
+    }
+
+    if (req.end < req.start || req.bucket_size < ros::Duration(0))
+    {
+      res.success = false;
+      res.message = "Invalid range or bucket size";
+      return true;
+    }
+
+    uint64_t start_ns = req.start.toNSec();
+    uint64_t end_ns = req.end.toNSec();
+    uint64_t bucket_ns = req.bucket_size.toNSec();
+    uint64_t bucket_count = BucketAggregator::getBucketCount(start_ns, end_ns, bucket_ns);
+    if (bucket_count > static_cast<uint64_t>(std::max(max_query_buckets_, 1)))
+    {
+      res.success = false;
+      res.message = "Query spans " + std::to_string(bucket_count) + " buckets, the limit is " +
+                    std::to_string(max_query_buckets_) + ". Use a larger bucket_size.";
+      return true;
+    }
+
+    // One snapshot is deserialized at a time, only the buckets are kept. Durations and counts drop back on a stats
+    // reset, ratios may go down at any time.
+    std::vector<bool> counters;
+    for (const auto* field : fields)
+    {
+      counters.push_back(field->kind != StatsFieldKind::RATIO);
+    }
+    BucketAggregator aggregator(start_ns, end_ns, bucket_ns, fields.size(), counters);
+    packml_msgs::Stats stats;
+    std::vector<double> values(fields.size());
+    size_t unreadable = 0;
+
+    // The snapshot archived just before start is where the first bucket's delta starts from
+    uint64_t lookback_ns = std::min<uint64_t>(std::max<int64_t>(2 * history_period_.toNSec(), 0), start_ns);
+    bool complete = history_->scan(start_ns - lookback_ns, end_ns, [&](uint64_t stamp_ns, const std::string& data) {
+      try
+      {
+        ros::serialization::IStream stream(reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())), data.size());
+        ros::serialization::deserialize(stream, stats);
+      }
+      catch (const ros::Exception&)
+      {
+        unreadable++;
+        return true;
+      }
+
+      for (size_t i = 0; i < fields.size(); i++)
+      {
+        values[i] = fields[i]->get(stats);
+      }
+      aggregator.add(stamp_ns, values);
+      return true;
+    });
+
+    for (const auto* field : fields)
+    {
+      res.fields.push_back(field->name);
+    }
+    res.buckets.reserve(aggregator.getBuckets().size());
+    for (const auto& entry : aggregator.getBuckets())
+    {
+      const BucketAggregator::Bucket& bucket = entry.second;
+      StatsBucket out;
+      out.start.fromNSec(bucket.start_ns);
+      out.samples = bucket.samples;
+      out.min = bucket.min;
+      out.max = bucket.max;
+      out.last = bucket.last;
+      out.delta = bucket.delta;
+      res.buckets.push_back(out);
+    }
+
+    res.success = true;
+    if (!complete || unreadable > 0)
+    {
+      res.message = "Parts of the history could not be read";
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/stats_export.h"
+
+#include "packml_stats_loader/stats_fields.h"
+
+namespace packml_stats_loader
+{
+  const uint8_t StatsExporter::ERROR_ITEM;
+  const uint8_t StatsExporter::QUALITY_ITEM;
+
+  const char* const StatsExporter::STATS_TABLE = "stats";
+  const char* const StatsExporter::ITEMS_TABLE = "items";
+  const char* const StatsExporter::TRANSITIONS_TABLE = "transitions";
+
+  StatsExporter::StatsExporter()
+  {
+    stamp_column_ = writer_.addColumn(STATS_TABLE, "stamp", ColumnType::INT64);
+    for (const auto& field : getStatsFields())
+    {
+      ColumnType type = field.kind == StatsFieldKind::COUNT ? ColumnType::INT64 : ColumnType::FLOAT64;
+      field_columns_.push_back(writer_.addColumn(STATS_TABLE, field.name, type));
+    }
+
+    item_row_column_ = writer_.addColumn(ITEMS_TABLE, "row", ColumnType::INT64);
+    item_kind_column_ = writer_.addColumn(ITEMS_TABLE, "kind", ColumnType::UINT8);
+    item_id_column_ = writer_.addColumn(ITEMS_TABLE, "id", ColumnType::INT32);
+    item_count_column_ = writer_.addColumn(ITEMS_TABLE, "count", ColumnType::INT64);
+    item_duration_column_ = writer_.addColumn(ITEMS_TABLE, "duration", ColumnType::FLOAT64);
+
+    transition_stamp_column_ = writer_.addColumn(TRANSITIONS_TABLE, "stamp", ColumnType::INT64);
+    transition_state_column_ = writer_.addColumn(TRANSITIONS_TABLE, "state", ColumnType::INT32);
+  }
+
+  void StatsExporter::addStats(uint64_t stamp_ns, const packml_msgs::Stats& stats)
+  {
+    writer_.appendInt(stamp_column_, static_cast<int64_t>(stamp_ns));
+    const auto& fields = getStatsFields();
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+      writer_.append(field_columns_[i], fields[i].get(stats));
+    }
+
+    // Items missing from this snapshot were reset
+    std::map<ItemKey, ItemValue> current;
+    for (const auto& item : stats.error_items)
+    {
+      current[ItemKey(ERROR_ITEM, item.id)] = ItemValue(item.count, item.duration.data.toSec());
+    }
+    for (const auto& item : stats.quality_items)
+    {
+      current[ItemKey(QUALITY_ITEM, item.id)] = ItemValue(item.count, item.duration.data.toSec());
+    }
+    for (const auto& entry : items_)
+    {
+      if (current.find(entry.first) == current.end())
+      {
+        addItem(entry.first.first, entry.first.second, ItemValue(0, 0.0));
+      }
+    }
+    for (const auto& entry : current)
+    {
+      auto previous = items_.find(entry.first);
+      if (previous == items_.end() || previous->second != entry.second)
+      {
+        addItem(entry.first.first, entry.first.second, entry.second);
+      }
+    }
+    items_.swap(current);
+
+    stats_rows_++;
+  }
+
+  void StatsExporter::addItem(uint8_t kind, int32_t id, const ItemValue& value)
+  {
+    writer_.appendInt(item_row_column_, static_cast<int64_t>(stats_rows_));
+    writer_.appendInt(item_kind_column_, kind);
+    writer_.appendInt(item_id_column_, id);
+    writer_.appendInt(item_count_column_, value.first);
+    writer_.append(item_duration_column_, value.second);
+  }
+
+  void StatsExporter::addState(uint64_t stamp_ns, int32_t state)
+  {
+    if (has_state_ && state == last_state_)
+    {
+      return;
+    }
+    has_state_ = true;
+    last_state_ = state;
+
+    writer_.appendInt(transition_stamp_column_, static_cast<int64_t>(stamp_ns));
+    writer_.appendInt(transition_state_column_, state);
+    transition_rows_++;
+  }
+
+  bool StatsExporter::finish(const std::string& path, std::string& error)
+  {
+    return writer_.finish(path, error);
+  }
+
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/stats_fields.h"
+
+namespace packml_stats_loader
+{
+
+  const std::vector<StatsField>& getStatsFields()
+  {
+    static const std::vector<StatsField> fields = {
+      { "duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.duration.data.toSec(); } },
+      { "idle_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.idle_duration.data.toSec(); } },
+      { "exe_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.exe_duration.data.toSec(); } },
+      { "held_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.held_duration.data.toSec(); } },
+      { "susp_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.susp_duration.data.toSec(); } },
+      { "cmplt_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.cmplt_duration.data.toSec(); } },
+      { "stop_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.stop_duration.data.toSec(); } },
+      { "abort_duration", StatsFieldKind::DURATION,
+        [](const packml_msgs::Stats& s) { return s.abort_duration.data.toSec(); } },
+      { "cycle_count", StatsFieldKind::COUNT,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.cycle_count); } },
+      { "success_count", StatsFieldKind::COUNT,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.success_count); } },
+      { "fail_count", StatsFieldKind::COUNT,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.fail_count); } },
+      { "throughput", StatsFieldKind::RATIO,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.throughput); } },
+      { "availability", StatsFieldKind::RATIO,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.availability); } },
+      { "performance", StatsFieldKind::RATIO,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.performance); } },
+      { "quality", StatsFieldKind::RATIO,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.quality); } },
+      { "overall_equipment_effectiveness", StatsFieldKind::RATIO,
+        [](const packml_msgs::Stats& s) { return static_cast<double>(s.overall_equipment_effectiveness); } },
+    };
+    return fields;
+  }
+
+  const StatsField* findStatsField(const std::string& name)
+  {
+    for (const auto& field : getStatsFields())
+    {
+      if (name == field.name)
+      {
+        return &field;
+      }
+    }
+    return nullptr;
+  }
+
+}
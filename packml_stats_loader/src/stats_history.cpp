@@ -0,0 +1,681 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include "packml_stats_loader/stats_history.h"
+
+#include <ros/console.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace packml_stats_loader
+{
+  namespace
+  {
+    const char SEGMENT_MAGIC[4] = { 'P', 'K', 'S', 'G' };
+    const char BLOCK_MAGIC[4] = { 'P', 'K', 'S', 'B' };
+    const uint32_t FORMAT_VERSION = 1;
+    const uint64_t NSEC_PER_SEC = 1000000000ull;
+    const uint32_t MAX_BLOCK_BYTES = 64u * 1024 * 1024;
+
+    struct SegmentHeader
+    {
+      char magic[4];
+      uint32_t version;
+      uint32_t type_length;  // followed by the record type
+      uint32_t reserved;
+    };
+
+    struct BlockHeader
+    {
+      char magic[4];
+      uint32_t compressed_size;  // followed by the compressed records
+      uint32_t raw_size;
+      uint32_t record_count;
+      uint64_t first_ns;
+      uint64_t last_ns;
+      uint32_t crc;  // of the compressed records
+      uint32_t reserved;
+    };
+
+    struct IndexEntry
+    {
+      uint64_t first_ns;
+      uint64_t last_ns;
+      uint64_t offset;  // of the block header in the segment
+      uint32_t record_count;
+      uint32_t block_size;  // header and compressed records
+    };
+
+    static_assert(sizeof(SegmentHeader) == 16, "segment header layout");
+    static_assert(sizeof(BlockHeader) == 40, "block header layout");
+    static_assert(sizeof(IndexEntry) == 32, "index entry layout");
+
+    bool writeAt(int fd, const void* data, size_t size, uint64_t offset)
+    {
+      const char* ptr = static_cast<const char*>(data);
+      while (size > 0)
+      {
+        ssize_t written = pwrite(fd, ptr, size, offset);
+        if (written < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (written <= 0)
+        {
+          return false;
+        }
+        ptr += written;
+        size -= written;
+        offset += written;
+      }
+      return true;
+    }
+
+    bool readAt(int fd, void* data, size_t size, uint64_t offset)
+    {
+      char* ptr = static_cast<char*>(data);
+      while (size > 0)
+      {
+        ssize_t got = pread(fd, ptr, size, offset);
+        if (got < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (got <= 0)
+        {
+          return false;
+        }
+        ptr += got;
+        size -= got;
+        offset += got;
+      }
+      return true;
+    }
+
+    uint64_t fileSize(const std::string& path)
+    {
+      struct stat info;
+      return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    }
+
+    uint64_t fileSize(int fd)
+    {
+      struct stat info;
+      return fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    }
+
+    std::string indexPath(const std::string& segment_path)
+    {
+      return segment_path.substr(0, segment_path.size() - 4) + ".idx";
+    }
+
+    /**
+     * @brief Reads and checks the segment header.
+     * @return false if the file is not a segment, data_offset is where the first block starts
+     */
+    bool readSegmentHeader(int fd, std::string& type, uint64_t& data_offset)
+    {
+      SegmentHeader header;
+      if (!readAt(fd, &header, sizeof(header), 0) || std::memcmp(header.magic, SEGMENT_MAGIC, 4) != 0 ||
+          header.version != FORMAT_VERSION || header.type_length > 4096)
+      {
+        return false;
+      }
+
+      type.resize(header.type_length);
+      if (header.type_length > 0 && !readAt(fd, &type[0], header.type_length, sizeof(header)))
+      {
+        return false;
+      }
+      data_offset = sizeof(header) + header.type_length;
+      return true;
+    }
+
+    /**
+     * @brief Reads, checks and decompresses the block at offset.
+     */
+    bool readBlock(int fd, uint64_t offset, BlockHeader& header, std::string& raw)
+    {
+      if (!readAt(fd, &header, sizeof(header), offset) || std::memcmp(header.magic, BLOCK_MAGIC, 4) != 0 ||
+          header.compressed_size > MAX_BLOCK_BYTES || header.raw_size > MAX_BLOCK_BYTES)
+      {
+        return false;
+      }
+
+      std::string compressed(header.compressed_size, '\0');
+      if (!readAt(fd, &compressed[0], compressed.size(), offset + sizeof(header)) ||
+          crc32(0L, reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()) != header.crc)
+      {
+        return false;
+      }
+
+      raw.resize(header.raw_size);
+      uLongf raw_size = raw.size();
+      if (uncompress(reinterpret_cast<Bytef*>(&raw[0]), &raw_size, reinterpret_cast<const Bytef*>(compressed.data()),
+                     compressed.size()) != Z_OK ||
+          raw_size != header.raw_size)
+      {
+        return false;
+      }
+      return true;
+    }
+
+    /**
+     * @brief Walks the blocks of a segment, stopping at the first one that is incomplete or corrupt.
+     * @return The index of the intact blocks, end is set to the offset just after the last intact block.
+     */
+    std::vector<IndexEntry> scanBlocks(int fd, uint64_t data_offset, uint64_t size, uint64_t& end)
+    {
+      std::vector<IndexEntry> entries;
+      end = data_offset;
+      while (end + sizeof(BlockHeader) <= size)
+      {
+        BlockHeader header;
+        std::string raw;
+        if (!readBlock(fd, end, header, raw))
+        {
+          break;
+        }
+
+        IndexEntry entry;
+        entry.first_ns = header.first_ns;
+        entry.last_ns = header.last_ns;
+        entry.offset = end;
+        entry.record_count = header.record_count;
+        entry.block_size = sizeof(header) + header.compressed_size;
+        entries.push_back(entry);
+        end += entry.block_size;
+      }
+      return entries;
+    }
+  }
+
+  StatsHistory::StatsHistory(const HistoryOptions& options) : options_(options)
+  {
+    // Segment names carry whole seconds.
+    options_.segment_ns = std::max<uint64_t>((options_.segment_ns + NSEC_PER_SEC - 1) / NSEC_PER_SEC, 1) * NSEC_PER_SEC;
+    options_.block_records = std::max<size_t>(options_.block_records, 1);
+
+    if (mkdir(options_.directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+      ROS_ERROR_STREAM("Failed to create stats history directory " << options_.directory << ": "
+                                                                   << std::strerror(errno));
+    }
+  }
+
+  StatsHistory::~StatsHistory()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeBlock();
+    closeSegment();
+  }
+
+  bool StatsHistory::append(uint64_t stamp_ns, const std::string& data)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t partition_ns = stamp_ns - stamp_ns % options_.segment_ns;
+
+    bool ok = true;
+    bool new_partition = partition_ns != pending_partition_ns_;
+    if (new_partition)
+    {
+      ok = writeBlock();
+    }
+
+    HistoryRecord record;
+    record.stamp_ns = stamp_ns;
+    record.data = data;
+    pending_.push_back(record);
+    pending_partition_ns_ = partition_ns;
+
+    if (new_partition)
+    {
+      enforceRetentionLocked(stamp_ns);
+    }
+
+    uint64_t pending_age_ns = stamp_ns > pending_.front().stamp_ns ? stamp_ns - pending_.front().stamp_ns : 0;
+    if (pending_.size() >= options_.block_records || pending_age_ns >= options_.flush_ns)
+    {
+      ok = writeBlock() && ok;
+    }
+    return ok;
+  }
+
+  bool StatsHistory::flush()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writeBlock();
+  }
+
+  bool StatsHistory::writeBlock()
+  {
+    if (pending_.empty())
+    {
+      return true;
+    }
+
+    if (segment_fd_ < 0 || segment_start_ns_ != pending_partition_ns_)
+    {
+      closeSegment();
+      if (!openSegment(pending_partition_ns_))
+      {
+        ROS_ERROR_STREAM("Dropping " << pending_.size() << " stats snapshots");
+        pending_.clear();
+        return false;
+      }
+    }
+
+    std::string raw;
+    for (const auto& record : pending_)
+    {
+      uint32_t length = record.data.size();
+      raw.append(reinterpret_cast<const char*>(&record.stamp_ns), sizeof(record.stamp_ns));
+      raw.append(reinterpret_cast<const char*>(&length), sizeof(length));
+      raw.append(record.data);
+    }
+
+    BlockHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BLOCK_MAGIC, 4);
+
+    // Header and records go out in a single write.
+    std::string block(sizeof(header) + compressBound(raw.size()), '\0');
+    uLongf compressed_size = block.size() - sizeof(header);
+    if (compress2(reinterpret_cast<Bytef*>(&block[sizeof(header)]), &compressed_size,
+                  reinterpret_cast<const Bytef*>(raw.data()), raw.size(), options_.compression_level) != Z_OK)
+    {
+      ROS_ERROR_STREAM("Failed to compress " << pending_.size() << " stats snapshots");
+      pending_.clear();
+      return false;
+    }
+
+    header.compressed_size = compressed_size;
+    header.raw_size = raw.size();
+    header.record_count = pending_.size();
+    header.first_ns = pending_.front().stamp_ns;
+    header.last_ns = pending_.front().stamp_ns;
+    for (const auto& record : pending_)
+    {
+      header.first_ns = std::min(header.first_ns, record.stamp_ns);
+      header.last_ns = std::max(header.last_ns, record.stamp_ns);
+    }
+    header.crc = crc32(0L, reinterpret_cast<const Bytef*>(&block[sizeof(header)]), compressed_size);
+    std::memcpy(&block[0], &header, sizeof(header));
+    block.resize(sizeof(header) + compressed_size);
+
+    IndexEntry entry;
+    entry.first_ns = header.first_ns;
+    entry.last_ns = header.last_ns;
+    entry.offset = segment_size_;
+    entry.record_count = header.record_count;
+    entry.block_size = block.size();
+
+    // The block is durable before the index points at it, a crash in between is repaired by openSegment().
+    bool ok = writeAt(segment_fd_, block.data(), block.size(), segment_size_) && fdatasync(segment_fd_) == 0;
+    ok = ok && writeAt(index_fd_, &entry, sizeof(entry), fileSize(index_fd_)) &&
+         fdatasync(index_fd_) == 0;
+    if (!ok)
+    {
+      ROS_ERROR_STREAM("Failed to write stats history block to " << segmentPath(segment_start_ns_) << ": "
+                                                                 << std::strerror(errno));
+      closeSegment();
+      pending_.clear();
+      return false;
+    }
+
+    segment_size_ += block.size();
+    pending_.clear();
+    return true;
+  }
+
+  std::string StatsHistory::segmentPath(uint64_t start_ns) const
+  {
+    char name[64];
+    std::snprintf(name, sizeof(name), "stats_%012llu.seg", static_cast<unsigned long long>(start_ns / NSEC_PER_SEC));
+    return options_.directory + "/" + name;
+  }
+
+  bool StatsHistory::openSegment(uint64_t start_ns)
+  {
+    std::string path = segmentPath(start_ns);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+      ROS_ERROR_STREAM("Failed to open stats history segment " << path << ": " << std::strerror(errno));
+      return false;
+    }
+
+    uint64_t size = fileSize(path);
+    std::string type;
+    uint64_t data_offset = 0;
+    if (size > 0 && (!readSegmentHeader(fd, type, data_offset) || type != options_.record_type))
+    {
+      // Written by another version or for another message type, keep it aside rather than mixing records.
+      ROS_WARN_STREAM("Moving unreadable stats history segment " << path << " aside");
+      close(fd);
+      std::rename(path.c_str(), (path + ".bad").c_str());
+      std::remove(indexPath(path).c_str());
+      fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      size = 0;
+      if (fd < 0)
+      {
+        ROS_ERROR_STREAM("Failed to open stats history segment " << path << ": " << std::strerror(errno));
+        return false;
+      }
+    }
+
+    std::vector<IndexEntry> entries;
+    uint64_t end = 0;
+    if (size == 0)
+    {
+      SegmentHeader header;
+      std::memset(&header, 0, sizeof(header));
+      std::memcpy(header.magic, SEGMENT_MAGIC, 4);
+      header.version = FORMAT_VERSION;
+      header.type_length = options_.record_type.size();
+      std::string bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+      bytes += options_.record_type;
+      if (!writeAt(fd, bytes.data(), bytes.size(), 0))
+      {
+        ROS_ERROR_STREAM("Failed to write stats history segment " << path << ": " << std::strerror(errno));
+        close(fd);
+        return false;
+      }
+      end = bytes.size();
+    }
+    else
+    {
+      // Reopened after a restart: drop a block that was cut short and rebuild the index from the intact blocks.
+      entries = scanBlocks(fd, data_offset, size, end);
+      if (end < size)
+      {
+        ROS_WARN_STREAM("Dropping " << size - end << " bytes of incomplete stats history from " << path);
+        if (ftruncate(fd, end) != 0)
+        {
+          ROS_ERROR_STREAM("Failed to truncate " << path << ": " << std::strerror(errno));
+          close(fd);
+          return false;
+        }
+      }
+    }
+
+    int index_fd = open(indexPath(path).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (index_fd < 0 || (!entries.empty() && !writeAt(index_fd, entries.data(), entries.size() * sizeof(IndexEntry), 0)))
+    {
+      ROS_ERROR_STREAM("Failed to write stats history index for " << path << ": " << std::strerror(errno));
+      if (index_fd >= 0)
+      {
+        close(index_fd);
+      }
+      close(fd);
+      return false;
+    }
+
+    segment_fd_ = fd;
+    index_fd_ = index_fd;
+    segment_start_ns_ = start_ns;
+    segment_size_ = end;
+    return true;
+  }
+
+  void StatsHistory::closeSegment()
+  {
+    if (segment_fd_ >= 0)
+    {
+      close(segment_fd_);
+      segment_fd_ = -1;
+    }
+    if (index_fd_ >= 0)
+    {
+      close(index_fd_);
+      index_fd_ = -1;
+    }
+  }
+
+  std::vector<StatsHistory::Segment> StatsHistory::listSegments() const
+  {
+    std::vector<Segment> segments;
+    DIR* dir = opendir(options_.directory.c_str());
+    if (dir == nullptr)
+    {
+      return segments;
+    }
+
+    while (struct dirent* entry = readdir(dir))
+    {
+      std::string name = entry->d_name;
+      unsigned long long secs = 0;
+      int consumed = 0;
+      if (std::sscanf(name.c_str(), "stats_%12llu.seg%n", &secs, &consumed) == 1 &&
+          consumed == static_cast<int>(name.size()))
+      {
+        Segment segment;
+        segment.start_ns = secs * NSEC_PER_SEC;
+        segment.path = options_.directory + "/" + name;
+        segments.push_back(segment);
+      }
+    }
+    closedir(dir);
+
+    std::sort(segments.begin(), segments.end(),
+              [](const Segment& lhs, const Segment& rhs) { return lhs.start_ns < rhs.start_ns; });
+    return segments;
+  }
+
+  std::vector<std::string> StatsHistory::getSegments() const
+  {
+    std::vector<std::string> paths;
+    for (const auto& segment : listSegments())
+    {
+      paths.push_back(segment.path);
+    }
+    return paths;
+  }
+
+  uint64_t StatsHistory::getDiskUsage() const
+  {
+    uint64_t bytes = 0;
+    for (const auto& segment : listSegments())
+    {
+      bytes += fileSize(segment.path) + fileSize(indexPath(segment.path));
+    }
+    return bytes;
+  }
+
+  void StatsHistory::enforceRetention(uint64_t now_ns)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enforceRetentionLocked(now_ns);
+  }
+
+  void StatsHistory::enforceRetentionLocked(uint64_t now_ns)
+  {
+    uint64_t cutoff_ns = now_ns > options_.retention_ns ? now_ns - options_.retention_ns : 0;
+    std::vector<Segment> segments = listSegments();
+
+    uint64_t total = 0;
+    for (const auto& segment : segments)
+    {
+      total += fileSize(segment.path) + fileSize(indexPath(segment.path));
+    }
+
+    for (const auto& segment : segments)
+    {
+      bool current = (segment_fd_ >= 0 && segment.start_ns == segment_start_ns_) ||
+                     (!pending_.empty() && segment.start_ns == pending_partition_ns_);
+      bool expired = segment.start_ns + options_.segment_ns <= cutoff_ns;
+      if (current || (!expired && total <= options_.max_bytes))
+      {
+        continue;
+      }
+
+      uint64_t bytes = fileSize(segment.path) + fileSize(indexPath(segment.path));
+      ROS_INFO_STREAM("Removing stats history segment " << segment.path << (expired ? " (expired)" : " (disk limit)"));
+      std::remove(segment.path.c_str());
+      std::remove(indexPath(segment.path).c_str());
+      total -= std::min(total, bytes);
+    }
+  }
+
+  bool StatsHistory::scan(uint64_t from_ns, uint64_t to_ns, const Visitor& visitor) const
+  {
+    // Only the listing is taken under the lock. Blocks are written whole under it, so the sizes seen here mark
+    // what this scan reads; anything appended while it runs is left out rather than visited twice.
+    std::vector<Segment> segments;
+    std::vector<HistoryRecord> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& segment : listSegments())
+      {
+        // Records always go to the partition of their own stamp, so later segments cannot hold anything older.
+        if (segment.start_ns > to_ns)
+        {
+          break;
+        }
+        segment.size = fileSize(segment.path);
+        segments.push_back(segment);
+      }
+      for (const auto& record : pending_)
+      {
+        if (record.stamp_ns >= from_ns && record.stamp_ns <= to_ns)
+        {
+          pending.push_back(record);
+        }
+      }
+    }
+
+    bool ok = true;
+    bool stop = false;
+    for (size_t i = 0; i < segments.size() && !stop; i++)
+    {
+      ok = scanSegment(segments[i], from_ns, to_ns, visitor, stop) && ok;
+    }
+
+    for (size_t i = 0; i < pending.size() && !stop; i++)
+    {
+      stop = !visitor(pending[i].stamp_ns, pending[i].data);
+    }
+    return ok;
+  }
+
+  bool StatsHistory::scanSegment(const Segment& segment, uint64_t from_ns, uint64_t to_ns, const Visitor& visitor,
+                                 bool& stop) const
+  {
+    const std::string& path = segment.path;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      // Removed by retention since the listing.
+      return errno == ENOENT;
+    }
+
+    std::string type;
+    uint64_t data_offset = 0;
+    if (!readSegmentHeader(fd, type, data_offset) || type != options_.record_type)
+    {
+      ROS_WARN_STREAM("Skipping unreadable stats history segment " << path);
+      close(fd);
+      return false;
+    }
+
+    uint64_t size = std::min(segment.size, fileSize(path));
+    std::vector<IndexEntry> entries;
+    uint64_t index_size = fileSize(indexPath(path));
+    int index_fd = open(indexPath(path).c_str(), O_RDONLY);
+    if (index_fd >= 0 && index_size % sizeof(IndexEntry) == 0)
+    {
+      entries.resize(index_size / sizeof(IndexEntry));
+      if (!entries.empty() && !readAt(index_fd, entries.data(), index_size, 0))
+      {
+        entries.clear();
+      }
+    }
+    if (index_fd >= 0)
+    {
+      close(index_fd);
+    }
+
+    // Blocks written after the listing are not part of this scan.
+    while (!entries.empty() && entries.back().offset + entries.back().block_size > size)
+    {
+      entries.pop_back();
+    }
+
+    // Fall back to walking the blocks if the index is missing or does not match the segment.
+    uint64_t indexed_end = entries.empty() ? data_offset : entries.back().offset + entries.back().block_size;
+    if (indexed_end != size)
+    {
+      uint64_t end = 0;
+      entries = scanBlocks(fd, data_offset, size, end);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < entries.size() && !stop; i++)
+    {
+      if (entries[i].last_ns < from_ns || entries[i].first_ns > to_ns)
+      {
+        continue;
+      }
+
+      BlockHeader header;
+      std::string raw;
+      if (!readBlock(fd, entries[i].offset, header, raw))
+      {
+        ROS_WARN_STREAM("Skipping corrupt stats history block at " << entries[i].offset << " in " << path);
+        ok = false;
+        continue;
+      }
+
+      size_t pos = 0;
+      for (uint32_t record = 0; record < header.record_count && !stop; record++)
+      {
+        uint64_t stamp_ns = 0;
+        uint32_t length = 0;
+        if (pos + sizeof(stamp_ns) + sizeof(length) > raw.size())
+        {
+          ok = false;
+          break;
+        }
+        std::memcpy(&stamp_ns, &raw[pos], sizeof(stamp_ns));
+        std::memcpy(&length, &raw[pos + sizeof(stamp_ns)], sizeof(length));
+        pos += sizeof(stamp_ns) + sizeof(length);
+        if (pos + length > raw.size())
+        {
+          ok = false;
+          break;
+        }
+
+        if (stamp_ns >= from_ns && stamp_ns <= to_ns)
+        {
+          stop = !visitor(stamp_ns, raw.substr(pos, length));
+        }
+        pos += length;
+      }
+    }
+
+    close(fd);
+    return ok;
+  }
+
+  bool StatsHistory::read(uint64_t from_ns, uint64_t to_ns, std::vector<HistoryRecord>& records) const
+  {
+    return scan(from_ns, to_ns, [&records](uint64_t stamp_ns, const std::string& data) {
+      HistoryRecord record;
+      record.stamp_ns = stamp_ns;
+      record.data = data;
+      records.push_back(record);
+      return true;
+    });
+  }
+}
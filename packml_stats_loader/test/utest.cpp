@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2019, PlusOne Robotics
+ * All rights reserved.
+*/
+
+#include <gtest/gtest.h>
+#include <packml_stats_loader/bucket_aggregator.h>
+#include <packml_stats_loader/columnar.h>
+#include <packml_stats_loader/stats_export.h>
+#include <packml_stats_loader/stats_history.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+  const uint64_t MINUTE_NS = 60ull * 1000000000;
+  const uint64_t HOUR_NS = 60 * MINUTE_NS;
+  const uint64_t DAY_NS = 24 * HOUR_NS;
+  const uint64_t T0_NS = 1546300800ull * 1000000000;  // 2019-01-01 00:00:00
+
+  class StatsHistoryTest : public testing::Test
+  {
+  protected:
+    StatsHistoryTest()
+    {
+      char dir[] = "/tmp/packml_stats_history_XXXXXX";
+      directory_ = mkdtemp(dir);
+      options_.directory = directory_;
+      options_.record_type = "packml_msgs/Stats";
+    }
+
+    ~StatsHistoryTest()
+    {
+      std::string command = "rm -rf " + directory_;
+      EXPECT_EQ(0, std::system(command.c_str()));
+    }
+
+    // Looks like a stats snapshot: mostly repeated field layout with a few changing counters.
+    static std::string snapshot(uint64_t i)
+    {
+      std::string data;
+      for (int item = 0; item < 16; item++)
+      {
+        data += "item_" + std::to_string(item) + ":count=" + std::to_string(i * (item + 1)) + ";duration=" +
+                std::to_string(i * 60.0) + ";";
+      }
+      return data;
+    }
+
+    std::string directory_;
+    packml_stats_loader::HistoryOptions options_;
+  };
+}
+
+TEST_F(StatsHistoryTest, AppendAndRead)
+{
+  options_.segment_ns = HOUR_NS;
+  options_.block_records = 10;
+  {
+    packml_stats_loader::StatsHistory history(options_);
+    for (uint64_t i = 0; i < 95; i++)
+    {
+      ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, snapshot(i)));
+    }
+
+    // Pending snapshots are visible before they are written.
+    std::vector<packml_stats_loader::HistoryRecord> records;
+    EXPECT_TRUE(history.read(0, UINT64_MAX, records));
+    EXPECT_EQ(95u, records.size());
+    EXPECT_EQ(2u, history.getSegments().size());
+  }
+
+  // Reopened, the destructor has written the last partial block.
+  packml_stats_loader::StatsHistory history(options_);
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(history.read(0, UINT64_MAX, records));
+  ASSERT_EQ(95u, records.size());
+  for (uint64_t i = 0; i < records.size(); i++)
+  {
+    EXPECT_EQ(T0_NS + i * MINUTE_NS, records[i].stamp_ns);
+    EXPECT_EQ(snapshot(i), records[i].data);
+  }
+
+  records.clear();
+  EXPECT_TRUE(history.read(T0_NS + 55 * MINUTE_NS, T0_NS + 64 * MINUTE_NS, records));
+  ASSERT_EQ(10u, records.size());
+  EXPECT_EQ(T0_NS + 55 * MINUTE_NS, records.front().stamp_ns);
+  EXPECT_EQ(T0_NS + 64 * MINUTE_NS, records.back().stamp_ns);
+
+  // The scan stops when the visitor asks it to.
+  size_t visited = 0;
+  history.scan(0, UINT64_MAX, [&visited](uint64_t, const std::string&) { return ++visited < 3; });
+  EXPECT_EQ(3u, visited);
+}
+
+TEST_F(StatsHistoryTest, AgedBlockFlush)
+{
+  options_.segment_ns = DAY_NS;
+  options_.block_records = 60;
+  options_.flush_ns = 5 * MINUTE_NS;
+  packml_stats_loader::StatsHistory history(options_);
+  for (uint64_t i = 0; i < 7; i++)
+  {
+    ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, snapshot(i)));
+  }
+
+  // Only what reached the disk is seen from outside: the block written once it was five minutes old.
+  packml_stats_loader::StatsHistory reader(options_);
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(reader.read(0, UINT64_MAX, records));
+  ASSERT_EQ(6u, records.size());
+  EXPECT_EQ(T0_NS + 5 * MINUTE_NS, records.back().stamp_ns);
+}
+
+TEST_F(StatsHistoryTest, RetentionBoundsDisk)
+{
+  options_.segment_ns = DAY_NS;
+  options_.retention_ns = 7 * DAY_NS;
+  packml_stats_loader::StatsHistory history(options_);
+
+  // A month of per-minute snapshots.
+  for (uint64_t i = 0; i < 30 * 24 * 60; i++)
+  {
+    ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, snapshot(i)));
+  }
+  ASSERT_TRUE(history.flush());
+
+  std::vector<std::string> segments = history.getSegments();
+  EXPECT_LE(segments.size(), 8u);
+  EXPECT_GE(segments.size(), 7u);
+
+  // Blocks of similar snapshots compress well below their raw size.
+  uint64_t raw_bytes = segments.size() * 24 * 60 * snapshot(30 * 24 * 60).size();
+  EXPECT_LT(history.getDiskUsage(), raw_bytes / 4);
+
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(history.read(0, T0_NS + 20 * DAY_NS, records));
+  EXPECT_TRUE(records.empty());
+  EXPECT_TRUE(history.read(T0_NS + 29 * DAY_NS, UINT64_MAX, records));
+  EXPECT_EQ(24u * 60u, records.size());
+}
+
+TEST_F(StatsHistoryTest, MaxBytes)
+{
+  options_.segment_ns = HOUR_NS;
+  packml_stats_loader::StatsHistory history(options_);
+  for (uint64_t i = 0; i < 3 * 60; i++)
+  {
+    ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, snapshot(i)));
+  }
+  ASSERT_TRUE(history.flush());
+  ASSERT_EQ(3u, history.getSegments().size());
+
+  // Oldest first, but the segment being written stays.
+  options_.max_bytes = 1;
+  packml_stats_loader::StatsHistory limited(options_);
+  limited.append(T0_NS + 3 * 60 * MINUTE_NS, snapshot(0));
+  limited.flush();
+  limited.enforceRetention(T0_NS + 3 * 60 * MINUTE_NS);
+  ASSERT_EQ(1u, limited.getSegments().size());
+
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(limited.read(0, UINT64_MAX, records));
+  EXPECT_EQ(1u, records.size());
+}
+
+TEST_F(StatsHistoryTest, Recovery)
+{
+  options_.segment_ns = DAY_NS;
+  options_.block_records = 5;
+  std::string segment;
+  {
+    packml_stats_loader::StatsHistory history(options_);
+    for (uint64_t i = 0; i < 20; i++)
+    {
+      ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, snapshot(i)));
+    }
+    segment = history.getSegments().front();
+  }
+
+  // A block cut short by a crash, and an index that never got written.
+  {
+    std::ofstream out(segment, std::ios::binary | std::ios::app);
+    out << "PKSB partial block";
+  }
+  std::string index = segment.substr(0, segment.size() - 4) + ".idx";
+  ASSERT_EQ(0, std::remove(index.c_str()));
+
+  packml_stats_loader::StatsHistory history(options_);
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(history.read(0, UINT64_MAX, records));
+  EXPECT_EQ(20u, records.size());
+
+  // Appending to the same partition repairs the segment first.
+  ASSERT_TRUE(history.append(T0_NS + 20 * MINUTE_NS, snapshot(20)));
+  ASSERT_TRUE(history.flush());
+  records.clear();
+  EXPECT_TRUE(history.read(0, UINT64_MAX, records));
+  ASSERT_EQ(21u, records.size());
+  EXPECT_EQ(snapshot(20), records.back().data);
+
+  // Another record type is never mixed into the segment.
+  options_.record_type = "packml_msgs/OtherStats";
+  packml_stats_loader::StatsHistory other(options_);
+  records.clear();
+  other.read(0, UINT64_MAX, records);
+  EXPECT_TRUE(records.empty());
+}
+
+TEST(BucketAggregator, Buckets)
+{
+  EXPECT_EQ(1u, packml_stats_loader::BucketAggregator::getBucketCount(0, 100, 0));
+  EXPECT_EQ(11u, packml_stats_loader::BucketAggregator::getBucketCount(0, 100, 10));
+  EXPECT_EQ(0u, packml_stats_loader::BucketAggregator::getBucketCount(100, 0, 10));
+
+  packml_stats_loader::BucketAggregator aggregator(100, 199, 50, 2);
+  aggregator.add(120, { 5.0, -1.0 });
+  aggregator.add(110, { 7.0, 1.0 });  // out of order, becomes the first sample
+  aggregator.add(130, { 6.0, 0.0 });
+  aggregator.add(160, { 1.0, 1.0 });
+  aggregator.add(99, { 100.0, 100.0 });   // before the range
+  aggregator.add(200, { 100.0, 100.0 });  // after the range
+
+  const auto& buckets = aggregator.getBuckets();
+  ASSERT_EQ(2u, buckets.size());
+  const auto& first = buckets.at(0);
+  EXPECT_EQ(100u, first.start_ns);
+  EXPECT_EQ(3u, first.samples);
+  EXPECT_EQ(std::vector<double>({ 5.0, -1.0 }), first.min);
+  EXPECT_EQ(std::vector<double>({ 7.0, 1.0 }), first.max);
+  EXPECT_EQ(std::vector<double>({ 7.0, 1.0 }), first.first);
+  EXPECT_EQ(std::vector<double>({ 6.0, 0.0 }), first.last);
+  EXPECT_EQ(150u, buckets.at(1).start_ns);
+  EXPECT_EQ(1u, buckets.at(1).samples);
+
+  // A zero size is a single bucket, including a sample stamped exactly at the end.
+  packml_stats_loader::BucketAggregator whole(100, 200, 0, 1);
+  whole.add(150, { 1.0 });
+  whole.add(200, { 2.0 });
+  EXPECT_EQ(packml_stats_loader::BucketAggregator::getBucketCount(100, 200, 0), whole.getBuckets().size());
+  ASSERT_EQ(1u, whole.getBuckets().count(0));
+  EXPECT_EQ(2u, whole.getBuckets().at(0).samples);
+}
+
+TEST(BucketAggregator, Deltas)
+{
+  // A counter with a sample before the range and a bucket holding a single sample, next to a field that is not one.
+  packml_stats_loader::BucketAggregator aggregator(100, 399, 100, 2, { true, false });
+  std::vector<std::pair<uint64_t, double>> samples = { { 90, 5.0 },  { 110, 7.0 }, { 150, 8.0 },
+                                                       { 230, 12.0 }, { 340, 20.0 }, { 390, 21.0 } };
+  for (const auto& sample : samples)
+  {
+    aggregator.add(sample.first, { sample.second, -sample.second });
+  }
+
+  const auto& buckets = aggregator.getBuckets();
+  ASSERT_EQ(3u, buckets.size());
+  EXPECT_DOUBLE_EQ(3.0, buckets.at(0).delta[0]);  // from the sample before the range
+  EXPECT_DOUBLE_EQ(4.0, buckets.at(1).delta[0]);  // a single sample still counts the change since bucket 0
+  EXPECT_DOUBLE_EQ(9.0, buckets.at(2).delta[0]);
+  double sum = 0.0;
+  for (const auto& entry : buckets)
+  {
+    sum += entry.second.delta[0];
+  }
+  EXPECT_DOUBLE_EQ(21.0 - 5.0, sum);
+  EXPECT_DOUBLE_EQ(-4.0, buckets.at(1).delta[1]);  // not a counter, going down is a plain change
+
+  // A counter that drops was reset, the change is counted from zero.
+  aggregator.add(395, { 2.0, 0.0 });
+  EXPECT_DOUBLE_EQ(11.0, buckets.at(2).delta[0]);
+}
+
+TEST_F(StatsHistoryTest, StreamingQuery)
+{
+  options_.segment_ns = DAY_NS;
+  packml_stats_loader::StatsHistory history(options_);
+
+  // A cycle counter that counts one per minute for 30 days, with a gap on day 10.
+  for (uint64_t i = 0; i < 30 * 24 * 60; i++)
+  {
+    if (i / (24 * 60) != 10)
+    {
+      ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, std::to_string(i)));
+    }
+  }
+
+  packml_stats_loader::BucketAggregator aggregator(T0_NS, T0_NS + 30 * DAY_NS, DAY_NS, 1);
+  EXPECT_TRUE(history.scan(T0_NS, T0_NS + 30 * DAY_NS, [&](uint64_t stamp_ns, const std::string& data) {
+    aggregator.add(stamp_ns, { std::stod(data) });
+    return true;
+  }));
+
+  const auto& buckets = aggregator.getBuckets();
+  ASSERT_EQ(29u, buckets.size());
+  EXPECT_EQ(0u, buckets.count(10));
+  for (const auto& entry : buckets)
+  {
+    double first_cycle = entry.first * 24 * 60;
+    EXPECT_EQ(T0_NS + entry.first * DAY_NS, entry.second.start_ns);
+    EXPECT_EQ(24u * 60u, entry.second.samples);
+    EXPECT_EQ(first_cycle, entry.second.min[0]);
+    EXPECT_EQ(first_cycle + 24 * 60 - 1, entry.second.max[0]);
+    EXPECT_EQ(24 * 60 - 1, entry.second.last[0] - entry.second.first[0]);
+  }
+}
+
+TEST_F(StatsHistoryTest, AppendDuringScan)
+{
+  options_.block_records = 10;
+  packml_stats_loader::StatsHistory history(options_);
+  for (uint64_t i = 0; i < 25; i++)
+  {
+    ASSERT_TRUE(history.append(T0_NS + i * MINUTE_NS, std::to_string(i)));
+  }
+
+  // The archive is not locked while visiting, and what is appended meanwhile is not visited, even once the
+  // pending snapshots it joins are written out.
+  std::vector<uint64_t> visited;
+  uint64_t next = 25;
+  EXPECT_TRUE(history.scan(T0_NS, T0_NS + DAY_NS, [&](uint64_t stamp_ns, const std::string& data) {
+    visited.push_back(std::stoull(data));
+    EXPECT_TRUE(history.append(T0_NS + next * MINUTE_NS, std::to_string(next)));
+    next++;
+    return true;
+  }));
+
+  ASSERT_EQ(25u, visited.size());
+  for (uint64_t i = 0; i < visited.size(); i++)
+  {
+    EXPECT_EQ(i, visited[i]);
+  }
+
+  std::vector<packml_stats_loader::HistoryRecord> records;
+  EXPECT_TRUE(history.read(T0_NS, T0_NS + DAY_NS, records));
+  EXPECT_EQ(50u, records.size());
+}
+
+TEST_F(StatsHistoryTest, Columnar)
+{
+  using packml_stats_loader::ColumnType;
+  const uint64_t ROWS = 1000000;
+  std::string path = directory_ + "/stats.pkcl";
+  std::string error;
+
+  {
+    packml_stats_loader::ColumnarWriter writer;
+    int stamp = writer.addColumn("stats", "stamp", ColumnType::INT64);
+    int oee = writer.addColumn("stats", "oee", ColumnType::FLOAT64);
+    int kind = writer.addColumn("items", "kind", ColumnType::UINT8);
+    ASSERT_EQ(-1, writer.addColumn("stats", "oee", ColumnType::FLOAT64));
+    ASSERT_EQ(-1, writer.addColumn("stats", std::string(40, 'x'), ColumnType::FLOAT64));
+    for (uint64_t i = 0; i < ROWS; i++)
+    {
+      writer.appendInt(stamp, T0_NS + i * MINUTE_NS);
+      writer.append(oee, (i % 100) / 100.0);
+    }
+    writer.appendInt(kind, 1);
+    writer.appendInt(kind, 0);
+    EXPECT_EQ(-1, writer.addColumn("stats", "late", ColumnType::INT32));
+    ASSERT_TRUE(writer.finish(path, error)) << error;
+  }
+
+  packml_stats_loader::ColumnarReader reader;
+  ASSERT_TRUE(reader.open(path, error)) << error;
+  EXPECT_EQ(3u, reader.getColumns().size());
+
+  uint64_t rows = 0;
+  const int64_t* stamps = reader.getInt64("stats", "stamp", rows);
+  ASSERT_NE(nullptr, stamps);
+  ASSERT_EQ(ROWS, rows);
+  EXPECT_EQ(static_cast<int64_t>(T0_NS + (ROWS - 1) * MINUTE_NS), stamps[ROWS - 1]);
+
+  const double* oee = reader.getFloat64("stats", "oee", rows);
+  ASSERT_NE(nullptr, oee);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(oee) % 64);
+  double sum = 0.0;
+  for (uint64_t i = 0; i < rows; i++)
+  {
+    sum += oee[i];
+  }
+  EXPECT_NEAR(ROWS * 0.495, sum, 1e-3);
+
+  const uint8_t* kinds = reader.getUInt8("items", "kind", rows);
+  ASSERT_NE(nullptr, kinds);
+  ASSERT_EQ(2u, rows);
+  EXPECT_EQ(1, kinds[0]);
+  EXPECT_EQ(0, kinds[1]);
+
+  EXPECT_EQ(nullptr, reader.getInt64("stats", "oee", rows));
+  EXPECT_EQ(nullptr, reader.getFloat64("items", "oee", rows));
+  EXPECT_EQ(0u, rows);
+}
+
+TEST_F(StatsHistoryTest, ColumnarInvalid)
+{
+  using packml_stats_loader::ColumnType;
+  std::string path = directory_ + "/stats.pkcl";
+  std::string error;
+
+  packml_stats_loader::ColumnarWriter uneven;
+  int a = uneven.addColumn("stats", "a", ColumnType::INT64);
+  uneven.addColumn("stats", "b", ColumnType::INT64);
+  uneven.appendInt(a, 1);
+  EXPECT_FALSE(uneven.finish(path, error));
+  EXPECT_NE(0, access(path.c_str(), F_OK));
+
+  packml_stats_loader::ColumnarWriter writer;
+  int column = writer.addColumn("stats", "a", ColumnType::INT32);
+  for (int i = 0; i < 1000; i++)
+  {
+    writer.appendInt(column, i);
+  }
+  ASSERT_TRUE(writer.finish(path, error)) << error;
+
+  packml_stats_loader::ColumnarReader reader;
+  EXPECT_FALSE(reader.open(directory_ + "/missing.pkcl", error));
+  ASSERT_EQ(0, truncate(path.c_str(), 1000));
+  EXPECT_FALSE(reader.open(path, error));
+  EXPECT_TRUE(reader.getColumns().empty());
+
+  std::ofstream(path) << "not a columnar file, but long enough to hold the header of one. not a columnar file.";
+  EXPECT_FALSE(reader.open(path, error));
+}
+
+TEST_F(StatsHistoryTest, StatsExport)
+{
+  using packml_stats_loader::StatsExporter;
+  std::string path = directory_ + "/stats.pkcl";
+
+  packml_msgs::Stats stats;
+  packml_msgs::ItemizedStats item;
+  StatsExporter exporter;
+  exporter.addState(T0_NS, 2);
+  stats.cycle_count = 10;
+  stats.overall_equipment_effectiveness = 0.5;
+  stats.exe_duration.data.fromSec(30.0);
+  item.id = 7;
+  item.count = 1;
+  item.duration.data.fromSec(2.0);
+  stats.error_items.push_back(item);
+  exporter.addStats(T0_NS, stats);
+  exporter.addState(T0_NS + 1, 6);
+  exporter.addState(T0_NS + 2, 6);  // repeated status, not a transition
+
+  stats.cycle_count = 11;
+  stats.quality_items.push_back(item);
+  exporter.addStats(T0_NS + MINUTE_NS, stats);  // error item unchanged, quality item appears
+
+  stats.error_items.clear();
+  exporter.addStats(T0_NS + 2 * MINUTE_NS, stats);  // error item reset
+  std::string error;
+  ASSERT_TRUE(exporter.finish(path, error)) << error;
+
+  packml_stats_loader::ColumnarReader reader;
+  ASSERT_TRUE(reader.open(path, error)) << error;
+  uint64_t rows = 0;
+  const int64_t* cycles = reader.getInt64(StatsExporter::STATS_TABLE, "cycle_count", rows);
+  ASSERT_NE(nullptr, cycles);
+  ASSERT_EQ(3u, rows);
+  EXPECT_EQ(11, cycles[2]);
+  const double* exe = reader.getFloat64(StatsExporter::STATS_TABLE, "exe_duration", rows);
+  ASSERT_NE(nullptr, exe);
+  EXPECT_DOUBLE_EQ(30.0, exe[0]);
+  const double* oee = reader.getFloat64(StatsExporter::STATS_TABLE, "overall_equipment_effectiveness", rows);
+  ASSERT_NE(nullptr, oee);
+  EXPECT_DOUBLE_EQ(0.5, oee[1]);
+
+  const int64_t* item_rows = reader.getInt64(StatsExporter::ITEMS_TABLE, "row", rows);
+  const uint8_t* kinds = reader.getUInt8(StatsExporter::ITEMS_TABLE, "kind", rows);
+  const int64_t* counts = reader.getInt64(StatsExporter::ITEMS_TABLE, "count", rows);
+  ASSERT_NE(nullptr, item_rows);
+  ASSERT_NE(nullptr, kinds);
+  ASSERT_NE(nullptr, counts);
+  ASSERT_EQ(3u, rows);
+  EXPECT_EQ(std::vector<int64_t>({ 0, 1, 2 }), std::vector<int64_t>(item_rows, item_rows + rows));
+  EXPECT_EQ(std::vector<uint8_t>({ StatsExporter::ERROR_ITEM, StatsExporter::QUALITY_ITEM, StatsExporter::ERROR_ITEM }),
+            std::vector<uint8_t>(kinds, kinds + rows));
+  EXPECT_EQ(std::vector<int64_t>({ 1, 1, 0 }), std::vector<int64_t>(counts, counts + rows));
+
+  const int32_t* states = reader.getInt32(StatsExporter::TRANSITIONS_TABLE, "state", rows);
+  ASSERT_NE(nullptr, states);
+  EXPECT_EQ(std::vector<int32_t>({ 2, 6 }), std::vector<int32_t>(states, states + rows));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}